@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Layout of the columnar export written by "dexdump -l columnar".
+ *
+ * The file is a header, a run of tables, a table directory and a fixed
+ * trailer.  Values are in the writer's host byte order; the header's
+ * endianTag holds kDexEndianConstant so a reader can tell.  Each table is
+ * an array of fixed-size rows starting on an 8-byte boundary, so a
+ * reader can map the file, find the trailer at
+ * (fileSize - sizeof(DexColTrailer)), follow it to the directory and
+ * index rows in place.
+ *
+ * Variable-length data (string contents, method descriptors) lives in
+ * the pool table, whose rows are single bytes; rows that refer to it
+ * hold a pool offset of a '\0'-terminated MUTF-8 string.
+ *
+ * Rows that refer to strings, types, protos, fields and methods use the
+ * indices of the original DEX file.  kDexNoIndex (0xffffffff) means
+ * "none".  New tables and trailing row fields may be added in later
+ * versions; readers must use the directory's rowSize as the stride.
+ */
+
+#ifndef DEXDUMP_DEXCOLUMNAR_H_
+#define DEXDUMP_DEXCOLUMNAR_H_
+
+#include "libdex/DexFile.h"
+
+#define kDexColMagic        "dexcol\n"      /* 8 bytes with the '\0' */
+#define kDexColVersion      1
+
+enum DexColTableId {
+    kDexColTablePool = 1,       /* u1 */
+    kDexColTableStrings,        /* DexColString, by string_id index */
+    kDexColTableTypes,          /* DexColType, by type_id index */
+    kDexColTableProtos,         /* DexColProto, by proto_id index */
+    kDexColTableClasses,        /* DexColClass, by class_def index */
+    kDexColTableFields,         /* DexColField, grouped by class */
+    kDexColTableMethods,        /* DexColMethod, grouped by class */
+    kDexColTableRefs,           /* DexColRef, grouped by method */
+};
+
+/* DexColRef.kind */
+enum DexColRefKind {
+    kDexColRefString = 1,
+    kDexColRefType,
+    kDexColRefField,
+    kDexColRefMethod,
+    kDexColRefProto,
+    kDexColRefCallSite,
+    kDexColRefMethodHandle,
+};
+
+struct DexColHeader {
+    u1  magic[8];
+    u4  version;
+    u4  dexChecksum;                /* copied from the DEX header */
+    u1  dexSignature[kSHA1DigestLen];
+    u4  endianTag;                  /* kDexEndianConstant */
+};
+
+struct DexColTableEntry {
+    u4  tableId;
+    u4  rowSize;
+    u8  offset;                     /* file offset of row 0 */
+    u8  rowCount;
+};
+
+struct DexColTrailer {
+    u8  directoryOffset;            /* file offset of the first entry */
+    u4  tableCount;
+    u4  reserved;
+    u1  magic[8];
+};
+
+struct DexColString {
+    u4  poolOff;
+    u4  utf16Size;                  /* length in UTF-16 code units */
+};
+
+struct DexColType {
+    u4  descriptorIdx;              /* string index */
+};
+
+struct DexColProto {
+    u4  descriptorPoolOff;          /* full descriptor, e.g. "(IJ)V" */
+    u4  shortyIdx;                  /* string index */
+    u4  returnTypeIdx;
+    u4  parameterCount;
+};
+
+struct DexColClass {
+    u4  classIdx;                   /* type index */
+    u4  accessFlags;
+    u4  superclassIdx;              /* type index */
+    u4  sourceFileIdx;              /* string index */
+    u4  interfaceCount;
+    u4  firstField;                 /* row in the fields table */
+    u4  fieldCount;                 /* static fields first */
+    u4  firstMethod;                /* row in the methods table */
+    u4  methodCount;                /* direct methods first */
+};
+
+struct DexColField {
+    u4  fieldIdx;
+    u4  classDefIdx;
+    u4  accessFlags;
+};
+
+struct DexColMethod {
+    u4  methodIdx;
+    u4  classDefIdx;
+    u4  accessFlags;
+    u4  codeOff;                    /* 0 if abstract or native */
+    u4  insnsSize;                  /* in 16-bit code units */
+    u2  registersSize;
+    u2  insSize;
+    u4  firstRef;                   /* row in the refs table */
+    u4  refCount;
+};
+
+struct DexColRef {
+    u4  methodRow;                  /* row in the methods table */
+    u4  dexPc;                      /* in 16-bit code units */
+    u4  targetIdx;                  /* index of "kind" */
+    u2  opcode;
+    u1  kind;                       /* DexColRefKind */
+    u1  reserved;
+};
+
+#endif  // DEXDUMP_DEXCOLUMNAR_H_
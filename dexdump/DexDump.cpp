@@ -33,14 +33,25 @@
 #include "libdex/DexFile.h"
 
 #include "libdex/CmdUtils.h"
+#include "libdex/DexAnnotation.h"
+#include "libdex/DexArena.h"
 #include "libdex/DexCatch.h"
 #include "libdex/DexClass.h"
+#include "libdex/DexCodeHash.h"
 #include "libdex/DexDebugInfo.h"
+#include "libdex/DexDiff.h"
 #include "libdex/DexOpcodes.h"
+#include "libdex/DexOptData.h"
+#include "libdex/DexPageTrace.h"
+#include "libdex/DexParallel.h"
 #include "libdex/DexProto.h"
+#include "libdex/DexStaticValues.h"
+#include "libdex/DexUtf.h"
 #include "libdex/InstrUtils.h"
 #include "libdex/SysUtil.h"
 
+#include "DexColumnar.h"
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <fcntl.h>
@@ -56,11 +67,14 @@ static const char* gProgName = "dexdump";
 enum OutputFormat {
     OUTPUT_PLAIN = 0,               /* default */
     OUTPUT_XML,                     /* fancy */
+    OUTPUT_JSONL,                   /* one JSON object per line */
+    OUTPUT_COLUMNAR,                /* binary tables, see DexColumnar.h */
 };
 
 /* command-line options */
 struct Options {
     bool checksumOnly;
+    bool verifySignature;
     bool disassemble;
     bool showFileHeaders;
     bool showSectionHeaders;
@@ -70,10 +84,23 @@ struct Options {
     const char* tempFileName;
     bool exportsOnly;
     bool verbose;
+    bool sizeReport;
+    const char* pageTraceClassList;
+    const char* diffOldFile;
+    bool dupCodeReport;
+    DexCodeHashMode dupCodeMode;
+    bool staticValues;
 };
 
 struct Options gOptions;
 
+/*
+ * Scratch strings (dotted names, flag strings, operand text).  Released
+ * per class, per method and per instruction, so they're never free()d
+ * individually.
+ */
+static DexArena gArena;
+
 /* basic info about a field or method */
 struct FieldMethodInfo {
     const char* classDescriptor;
@@ -84,7 +111,7 @@ struct FieldMethodInfo {
 
 /* basic info about a prototype */
 struct ProtoInfo {
-    char* parameterTypes;  // dynamically allocated with malloc
+    char* parameterTypes;  // allocated from gArena
     const char* returnType;
 };
 
@@ -130,8 +157,10 @@ static const char* primitiveTypeLabel(char typeChar)
  * example, "Ljava/lang/String;" becomes "java.lang.String", and
  * "[I" becomes "int[]".  Also converts '$' to '.', which means this
  * form can't be converted back to a descriptor.
+ *
+ * The result is allocated from "pArena".
  */
-static char* descriptorToDot(const char* str)
+static char* descriptorToDotInArena(DexArena* pArena, const char* str)
 {
     int targetLen = strlen(str);
     int offset = 0;
@@ -160,7 +189,7 @@ static char* descriptorToDot(const char* str)
         }
     }
 
-    newStr = (char*)malloc(targetLen + arrayDepth * 2 +1);
+    newStr = (char*) dexArenaAlloc(pArena, targetLen + arrayDepth * 2 +1);
 
     /* copy class name over */
     int i;
@@ -181,32 +210,82 @@ static char* descriptorToDot(const char* str)
 }
 
 /*
- * Converts the class name portion of a type descriptor to human-readable
- * "dotted" form.
- *
- * Returns a newly-allocated string.
+ * Like descriptorToDotInArena(), allocating from gArena.
+ */
+static char* descriptorToDot(const char* str)
+{
+    return descriptorToDotInArena(&gArena, str);
+}
+
+/*
+ * Dotted names, indexed by type_id and filled in on first use.  Types
+ * recur constantly in the XML and disassembly output, so each is only
+ * converted once per file.  The names live until the file is done.
+ */
+struct DotNameCache {
+    const DexFile* pDexFile;
+    const char** names;
+    DexArena arena;
+};
+static DotNameCache gDotNames;
+
+/*
+ * Prepare the cache for a new file.  If the table can't be allocated,
+ * lookups fall back to converting every time.
+ */
+static void dotNameCacheInit(const DexFile* pDexFile)
+{
+    gDotNames.pDexFile = pDexFile;
+    gDotNames.names = (const char**)
+        calloc(pDexFile->pHeader->typeIdsSize, sizeof(const char*));
+    dexArenaInit(&gDotNames.arena, 0);
+}
+
+static void dotNameCacheFree()
+{
+    free(gDotNames.names);
+    dexArenaFree(&gDotNames.arena);
+    memset(&gDotNames, 0, sizeof(gDotNames));
+}
+
+/*
+ * Get the dotted form of the type with the specified type_id, as
+ * descriptorToDot() would produce it.
+ */
+static const char* dotNameByTypeIdx(const DexFile* pDexFile, u4 typeIdx)
+{
+    const char* descriptor = dexStringByTypeIdx(pDexFile, typeIdx);
+
+    if (gDotNames.pDexFile != pDexFile || gDotNames.names == NULL)
+        return descriptorToDot(descriptor);
+
+    const char* name = gDotNames.names[typeIdx];
+    if (name == NULL) {
+        name = descriptorToDotInArena(&gDotNames.arena, descriptor);
+        gDotNames.names[typeIdx] = name;
+    }
+    return name;
+}
+
+/*
+ * Get the class name portion of a class type in human-readable "dotted"
+ * form, e.g. "Ljava/util/Map$Entry;" becomes "Map.Entry".  This is a
+ * suffix of the full dotted name, so no copy is needed.
  */
-static char* descriptorClassToDot(const char* str)
+static const char* dotClassNameByTypeIdx(const DexFile* pDexFile,
+    u4 typeIdx)
 {
+    const char* descriptor = dexStringByTypeIdx(pDexFile, typeIdx);
     const char* lastSlash;
-    char* newStr;
-    char* cp;
 
-    /* reduce to just the class name, trimming trailing ';' */
-    lastSlash = strrchr(str, '/');
+    /* skip the package, and the 'L' that the dotted form drops */
+    lastSlash = strrchr(descriptor, '/');
     if (lastSlash == NULL)
-        lastSlash = str + 1;        /* start past 'L' */
+        lastSlash = descriptor + 1;
     else
-        lastSlash++;                /* start past '/' */
-
-    newStr = strdup(lastSlash);
-    newStr[strlen(lastSlash)-1] = '\0';
-    for (cp = newStr; *cp != '\0'; cp++) {
-        if (*cp == '$')
-            *cp = '.';
-    }
+        lastSlash++;
 
-    return newStr;
+    return dotNameByTypeIdx(pDexFile, typeIdx) + (lastSlash - descriptor - 1);
 }
 
 /*
@@ -254,94 +333,169 @@ enum AccessFor {
     kAccessForMAX
 };
 
+#define NUM_FLAGS   18
+static constexpr const char* kAccessStrings[kAccessForMAX][NUM_FLAGS] = {
+    {
+        /* class, inner class */
+        "PUBLIC",           /* 0x0001 */
+        "PRIVATE",          /* 0x0002 */
+        "PROTECTED",        /* 0x0004 */
+        "STATIC",           /* 0x0008 */
+        "FINAL",            /* 0x0010 */
+        "?",                /* 0x0020 */
+        "?",                /* 0x0040 */
+        "?",                /* 0x0080 */
+        "?",                /* 0x0100 */
+        "INTERFACE",        /* 0x0200 */
+        "ABSTRACT",         /* 0x0400 */
+        "?",                /* 0x0800 */
+        "SYNTHETIC",        /* 0x1000 */
+        "ANNOTATION",       /* 0x2000 */
+        "ENUM",             /* 0x4000 */
+        "?",                /* 0x8000 */
+        "VERIFIED",         /* 0x10000 */
+        "OPTIMIZED",        /* 0x20000 */
+    },
+    {
+        /* method */
+        "PUBLIC",           /* 0x0001 */
+        "PRIVATE",          /* 0x0002 */
+        "PROTECTED",        /* 0x0004 */
+        "STATIC",           /* 0x0008 */
+        "FINAL",            /* 0x0010 */
+        "SYNCHRONIZED",     /* 0x0020 */
+        "BRIDGE",           /* 0x0040 */
+        "VARARGS",          /* 0x0080 */
+        "NATIVE",           /* 0x0100 */
+        "?",                /* 0x0200 */
+        "ABSTRACT",         /* 0x0400 */
+        "STRICT",           /* 0x0800 */
+        "SYNTHETIC",        /* 0x1000 */
+        "?",                /* 0x2000 */
+        "?",                /* 0x4000 */
+        "MIRANDA",          /* 0x8000 */
+        "CONSTRUCTOR",      /* 0x10000 */
+        "DECLARED_SYNCHRONIZED", /* 0x20000 */
+    },
+    {
+        /* field */
+        "PUBLIC",           /* 0x0001 */
+        "PRIVATE",          /* 0x0002 */
+        "PROTECTED",        /* 0x0004 */
+        "STATIC",           /* 0x0008 */
+        "FINAL",            /* 0x0010 */
+        "?",                /* 0x0020 */
+        "VOLATILE",         /* 0x0040 */
+        "TRANSIENT",        /* 0x0080 */
+        "?",                /* 0x0100 */
+        "?",                /* 0x0200 */
+        "?",                /* 0x0400 */
+        "?",                /* 0x0800 */
+        "SYNTHETIC",        /* 0x1000 */
+        "?",                /* 0x2000 */
+        "ENUM",             /* 0x4000 */
+        "?",                /* 0x8000 */
+        "?",                /* 0x10000 */
+        "?",                /* 0x20000 */
+    },
+};
+
+/*
+ * Precomputed strings for every combination of the low five access
+ * flags (visibility, static and final), which is all most classes,
+ * fields and methods have.  Any higher flags are appended at run time.
+ */
+#define kAccessTableBits    5
+#define kAccessTableSize    (1 << kAccessTableBits)
+
+static constexpr int constStrlen(const char* str)
+{
+    int len = 0;
+    while (str[len] != '\0')
+        len++;
+    return len;
+}
+
+/*
+ * Length of the longest precomputed string, including the terminator.
+ */
+static constexpr int accessTableWidth()
+{
+    int longest = 0;
+    for (int forWhat = 0; forWhat < kAccessForMAX; forWhat++) {
+        int len = 0;
+        for (int i = 0; i < kAccessTableBits; i++)
+            len += constStrlen(kAccessStrings[forWhat][i]) + 1;
+        if (len > longest)
+            longest = len;
+    }
+    return longest;
+}
+
+struct AccessFlagTable {
+    char str[kAccessForMAX][kAccessTableSize][accessTableWidth()];
+};
+
+static constexpr AccessFlagTable buildAccessFlagTable()
+{
+    AccessFlagTable table = {};
+
+    for (int forWhat = 0; forWhat < kAccessForMAX; forWhat++) {
+        for (int flags = 0; flags < kAccessTableSize; flags++) {
+            char* str = table.str[forWhat][flags];
+            int len = 0;
+
+            for (int i = 0; i < kAccessTableBits; i++) {
+                if ((flags & (1 << i)) == 0)
+                    continue;
+                const char* accessStr = kAccessStrings[forWhat][i];
+                if (len != 0)
+                    str[len++] = ' ';
+                while (*accessStr != '\0')
+                    str[len++] = *accessStr++;
+            }
+            str[len] = '\0';
+        }
+    }
+    return table;
+}
+
+static constexpr AccessFlagTable kAccessFlagTable = buildAccessFlagTable();
+
 /*
- * Create a new string with human-readable access flags.
+ * Get a string with human-readable access flags.  Common combinations
+ * come straight from kAccessFlagTable; anything else is allocated from
+ * gArena.
  *
  * In the base language the access_flags fields are type u2; in Dalvik
  * they're u4.
  */
-static char* createAccessFlagStr(u4 flags, AccessFor forWhat)
+static const char* createAccessFlagStr(u4 flags, AccessFor forWhat)
 {
-#define NUM_FLAGS   18
-    static const char* kAccessStrings[kAccessForMAX][NUM_FLAGS] = {
-        {
-            /* class, inner class */
-            "PUBLIC",           /* 0x0001 */
-            "PRIVATE",          /* 0x0002 */
-            "PROTECTED",        /* 0x0004 */
-            "STATIC",           /* 0x0008 */
-            "FINAL",            /* 0x0010 */
-            "?",                /* 0x0020 */
-            "?",                /* 0x0040 */
-            "?",                /* 0x0080 */
-            "?",                /* 0x0100 */
-            "INTERFACE",        /* 0x0200 */
-            "ABSTRACT",         /* 0x0400 */
-            "?",                /* 0x0800 */
-            "SYNTHETIC",        /* 0x1000 */
-            "ANNOTATION",       /* 0x2000 */
-            "ENUM",             /* 0x4000 */
-            "?",                /* 0x8000 */
-            "VERIFIED",         /* 0x10000 */
-            "OPTIMIZED",        /* 0x20000 */
-        },
-        {
-            /* method */
-            "PUBLIC",           /* 0x0001 */
-            "PRIVATE",          /* 0x0002 */
-            "PROTECTED",        /* 0x0004 */
-            "STATIC",           /* 0x0008 */
-            "FINAL",            /* 0x0010 */
-            "SYNCHRONIZED",     /* 0x0020 */
-            "BRIDGE",           /* 0x0040 */
-            "VARARGS",          /* 0x0080 */
-            "NATIVE",           /* 0x0100 */
-            "?",                /* 0x0200 */
-            "ABSTRACT",         /* 0x0400 */
-            "STRICT",           /* 0x0800 */
-            "SYNTHETIC",        /* 0x1000 */
-            "?",                /* 0x2000 */
-            "?",                /* 0x4000 */
-            "MIRANDA",          /* 0x8000 */
-            "CONSTRUCTOR",      /* 0x10000 */
-            "DECLARED_SYNCHRONIZED", /* 0x20000 */
-        },
-        {
-            /* field */
-            "PUBLIC",           /* 0x0001 */
-            "PRIVATE",          /* 0x0002 */
-            "PROTECTED",        /* 0x0004 */
-            "STATIC",           /* 0x0008 */
-            "FINAL",            /* 0x0010 */
-            "?",                /* 0x0020 */
-            "VOLATILE",         /* 0x0040 */
-            "TRANSIENT",        /* 0x0080 */
-            "?",                /* 0x0100 */
-            "?",                /* 0x0200 */
-            "?",                /* 0x0400 */
-            "?",                /* 0x0800 */
-            "SYNTHETIC",        /* 0x1000 */
-            "?",                /* 0x2000 */
-            "ENUM",             /* 0x4000 */
-            "?",                /* 0x8000 */
-            "?",                /* 0x10000 */
-            "?",                /* 0x20000 */
-        },
-    };
-    const int kLongest = 21;        /* strlen of longest string above */
+    const char* lowStr =
+        kAccessFlagTable.str[forWhat][flags & (kAccessTableSize - 1)];
+    const int kLongest = 21;        /* strlen of longest flag string */
     int i, count;
     char* str;
     char* cp;
 
+    flags >>= kAccessTableBits;
+    if (flags == 0)
+        return lowStr;
+
     /*
      * Allocate enough storage to hold the expected number of strings,
      * plus a space between each.  We over-allocate, using the longest
-     * string above as the base metric.
+     * string as the base metric.
      */
+    int lowLen = strlen(lowStr);
     count = countOnes(flags);
-    cp = str = (char*) malloc(count * (kLongest+1) +1);
+    cp = str = (char*) dexArenaAlloc(&gArena,
+        lowLen + count * (kLongest+1) +1);
+    memcpy(cp, lowStr, lowLen);
+    cp += lowLen;
 
-    for (i = 0; i < NUM_FLAGS; i++) {
+    for (i = kAccessTableBits; i < NUM_FLAGS; i++) {
         if (flags & 0x01) {
             const char* accessStr = kAccessStrings[forWhat][i];
             int len = strlen(accessStr);
@@ -421,6 +575,20 @@ void dumpFileHeader(const DexFile* pDexFile)
         printf("opt_length          : %d\n", pOptHeader->optLength);
         printf("flags               : %08x\n", pOptHeader->flags);
         printf("checksum            : %08x\n", pOptHeader->checksum);
+
+        DexOptChunkIterator iterator;
+        const u1* chunkData;
+        u4 chunkType, chunkSize;
+
+        dexOptChunkIteratorInit(&iterator, pDexFile);
+        while (dexOptChunkIteratorNext(&iterator, &chunkType, &chunkData,
+                &chunkSize)) {
+            const char* chunkName = dexGetOptChunkName(chunkType);
+            printf("opt_chunk           : '%c%c%c%c' (%s), %u bytes\n",
+                (char) (chunkType >> 24), (char) (chunkType >> 16),
+                (char) (chunkType >> 8), (char) chunkType,
+                (chunkName != NULL) ? chunkName : "unknown", chunkSize);
+        }
         printf("\n");
     }
 
@@ -521,7 +689,7 @@ void dumpClassDef(DexFile* pDexFile, int idx)
 
     pClassDef = dexGetClassDef(pDexFile, idx);
     pEncodedData = dexGetClassData(pDexFile, pClassDef);
-    pClassData = dexReadAndVerifyClassData(&pEncodedData, NULL);
+    pClassData = dexReadAndVerifyClassDataInArena(&pEncodedData, NULL, &gArena);
 
     if (pClassData == NULL) {
         fprintf(stderr, "Trouble reading class data\n");
@@ -547,8 +715,6 @@ void dumpClassDef(DexFile* pDexFile, int idx)
     printf("virtual_methods_size: %d\n",
             pClassData->header.virtualMethodsSize);
     printf("\n");
-
-    free(pClassData);
 }
 
 /*
@@ -557,15 +723,13 @@ void dumpClassDef(DexFile* pDexFile, int idx)
 void dumpInterface(const DexFile* pDexFile, const DexTypeItem* pTypeItem,
     int i)
 {
-    const char* interfaceName =
-        dexStringByTypeIdx(pDexFile, pTypeItem->typeIdx);
-
     if (gOptions.outputFormat == OUTPUT_PLAIN) {
+        const char* interfaceName =
+            dexStringByTypeIdx(pDexFile, pTypeItem->typeIdx);
         printf("    #%d              : '%s'\n", i, interfaceName);
     } else {
-        char* dotted = descriptorToDot(interfaceName);
+        const char* dotted = dotNameByTypeIdx(pDexFile, pTypeItem->typeIdx);
         printf("<implements name=\"%s\">\n</implements>\n", dotted);
-        free(dotted);
     }
 }
 
@@ -583,27 +747,26 @@ void dumpCatches(DexFile* pDexFile, const DexCode* pCode)
 
     printf("      catches       : %d\n", triesSize);
 
-    const DexTry* pTries = dexGetTries(pCode);
-    u4 i;
+    DexCatchTable* pTable = dexCatchTableCreate(pCode);
+    if (pTable == NULL) {
+        fprintf(stderr, "Trouble decoding catch handlers\n");
+        return;
+    }
 
-    for (i = 0; i < triesSize; i++) {
-        const DexTry* pTry = &pTries[i];
-        u4 start = pTry->startAddr;
-        u4 end = start + pTry->insnCount;
-        DexCatchIterator iterator;
+    u4 i;
 
-        printf("        0x%04x - 0x%04x\n", start, end);
+    for (i = 0; i < pTable->rangeCount; i++) {
+        const DexCatchRange* pRange = &pTable->pRanges[i];
+        const DexCatchHandlerList* pList = &pTable->pLists[pRange->listIdx];
 
-        dexCatchIteratorInit(&iterator, pCode, pTry->handlerOff);
+        printf("        0x%04x - 0x%04x\n", pRange->startAddr,
+                pRange->endAddr);
 
-        for (;;) {
-            DexCatchHandler* handler = dexCatchIteratorNext(&iterator);
+        for (u4 j = 0; j < pList->count; j++) {
+            const DexCatchHandler* handler =
+                &pTable->pHandlers[pList->first + j];
             const char* descriptor;
 
-            if (handler == NULL) {
-                break;
-            }
-
             descriptor = (handler->typeIdx == kDexNoIndex) ? "<any>" :
                 dexStringByTypeIdx(pDexFile, handler->typeIdx);
 
@@ -611,6 +774,8 @@ void dumpCatches(DexFile* pDexFile, const DexCode* pCode)
                     handler->address);
         }
     }
+
+    dexCatchTableFree(pTable);
 }
 
 static int dumpPositionsCb(void * /* cnxt */, u4 address, u4 lineNum)
@@ -673,7 +838,8 @@ bool getMethodInfo(DexFile* pDexFile, u4 methodIdx, FieldMethodInfo* pMethInfo)
 
     pMethodId = dexGetMethodId(pDexFile, methodIdx);
     pMethInfo->name = dexStringById(pDexFile, pMethodId->nameIdx);
-    pMethInfo->signature = dexCopyDescriptorFromMethodId(pDexFile, pMethodId);
+    pMethInfo->signature =
+            dexProtoTableGet(pDexFile->pProtoTable, pMethodId->protoIdx);
 
     pMethInfo->classDescriptor =
             dexStringByTypeIdx(pDexFile, pMethodId->classIdx);
@@ -716,42 +882,30 @@ bool getProtoInfo(DexFile* pDexFile, u4 protoIdx, ProtoInfo* pProtoInfo)
     pProtoInfo->returnType = dexStringByTypeIdx(pDexFile, protoId->returnTypeIdx);
 
     // Build string for parameter types.
-    size_t bufSize = 1;
-    char* buf = (char*)malloc(bufSize);
-    if (buf == NULL) {
-        return false;
-    }
-
-    buf[0] = '\0';
-    size_t bufUsed = 1;
-
     const DexTypeList* paramTypes = dexGetProtoParameters(pDexFile, protoId);
-    if (paramTypes == NULL) {
-        // No parameters.
-        pProtoInfo->parameterTypes = buf;
-        return true;
-    }
+    u4 paramCount = (paramTypes == NULL) ? 0 : paramTypes->size;
+    size_t bufSize = 1;
 
-    for (u4 i = 0; i < paramTypes->size; ++i) {
+    for (u4 i = 0; i < paramCount; ++i) {
         if (paramTypes->list[i].typeIdx >= pDexFile->pHeader->typeIdsSize) {
-            free(buf);
             return false;
         }
+        bufSize += strlen(dexStringByTypeIdx(pDexFile, paramTypes->list[i].typeIdx));
+    }
+
+    char* buf = (char*) dexArenaAlloc(&gArena, bufSize);
+    if (buf == NULL) {
+        return false;
+    }
+
+    char* cp = buf;
+    for (u4 i = 0; i < paramCount; ++i) {
         const char* param = dexStringByTypeIdx(pDexFile, paramTypes->list[i].typeIdx);
         size_t paramLen = strlen(param);
-        size_t newUsed = bufUsed + paramLen;
-        if (newUsed > bufSize) {
-            char* newBuf = (char*)realloc(buf, newUsed);
-            if (newBuf == NULL) {
-                free(buf);
-                return false;
-            }
-            buf = newBuf;
-            bufSize = newUsed;
-        }
-        memcpy(buf + bufUsed - 1, param, paramLen + 1);
-        bufUsed = newUsed;
+        memcpy(cp, param, paramLen);
+        cp += paramLen;
     }
+    *cp = '\0';
 
     pProtoInfo->parameterTypes = buf;
     return true;
@@ -767,16 +921,15 @@ const char* getClassDescriptor(DexFile* pDexFile, u4 classIdx)
 
 /*
  * Helper for dumpInstruction(), which builds the string
- * representation for the index in the given instruction. This will
- * first try to use the given buffer, but if the result won't fit,
- * then this will allocate a new buffer to hold the result. A pointer
- * to the buffer which holds the full result is always returned, and
- * this can be compared with the one passed in, to see if the result
- * needs to be free()d.
+ * representation for the index in the given instruction. This first
+ * tries a buffer of "bufSize" bytes, and if the result won't fit it
+ * retries with one of exactly the right size.  The result is allocated
+ * from gArena.
  */
 static char* indexString(DexFile* pDexFile, const DecodedInstruction* pDecInsn, size_t bufSize)
 {
-    char* buf = (char*)malloc(bufSize);
+    DexArenaMark mark = dexArenaMark(&gArena);
+    char* buf = (char*) dexArenaAlloc(&gArena, bufSize);
     if (buf == NULL) {
       return NULL;
     }
@@ -867,7 +1020,6 @@ static char* indexString(DexFile* pDexFile, const DecodedInstruction* pDecInsn,
                 outSize = snprintf(buf, bufSize, "%s.%s:%s // method@%0*x",
                         methInfo.classDescriptor, methInfo.name,
                         methInfo.signature, width, index);
-                free((void *) methInfo.signature);
             } else {
                 outSize = snprintf(buf, bufSize, "<method?> // method@%0*x",
                         width, index);
@@ -913,7 +1065,6 @@ static char* indexString(DexFile* pDexFile, const DecodedInstruction* pDecInsn,
                 outSize = snprintf(buf, bufSize, "<method?>, <proto?> // method@%0*x, proto@%0*x",
                                    width, index, width, secondaryIndex);
             }
-            free(protoInfo.parameterTypes);
         }
         break;
     case kIndexCallSiteRef:
@@ -934,7 +1085,6 @@ static char* indexString(DexFile* pDexFile, const DecodedInstruction* pDecInsn,
                 outSize = snprintf(buf, bufSize, "<proto?> // proto@%0*x",
                                    width, secondaryIndex);
             }
-            free(protoInfo.parameterTypes);
         }
         break;
     default:
@@ -948,7 +1098,7 @@ static char* indexString(DexFile* pDexFile, const DecodedInstruction* pDecInsn,
          * snprintf() doesn't count the '\0' as part of its returned
          * size, so we add explicit space for it here.
          */
-        free(buf);
+        dexArenaRelease(&gArena, mark);
         return indexString(pDexFile, pDecInsn, outSize + 1);
     } else {
         return buf;
@@ -962,6 +1112,7 @@ void dumpInstruction(DexFile* pDexFile, const DexCode* pCode, int insnIdx,
     int insnWidth, const DecodedInstruction* pDecInsn)
 {
     const u2* insns = pCode->insns;
+    DexArenaMark mark = dexArenaMark(&gArena);
     int i;
 
     // Address of instruction (expressed as byte offset).
@@ -999,8 +1150,8 @@ void dumpInstruction(DexFile* pDexFile, const DexCode* pCode, int insnIdx,
         printf("|%04x: %s", insnIdx, dexGetOpcodeName(pDecInsn->opcode));
     }
 
-    // Provide an initial buffer that usually suffices, although indexString()
-    // may reallocate the buffer if more space is needed.
+    // Start with a buffer size that usually suffices, although indexString()
+    // will retry with a bigger one if more space is needed.
     char* indexBuf = NULL;
     if (pDecInsn->indexType != kIndexNone) {
         indexBuf = indexString(pDexFile, pDecInsn, 200);
@@ -1180,7 +1331,7 @@ void dumpInstruction(DexFile* pDexFile, const DexCode* pCode, int insnIdx,
 
     putchar('\n');
 
-    free(indexBuf);
+    dexArenaRelease(&gArena, mark);
 }
 
 /*
@@ -1193,7 +1344,7 @@ void dumpBytecodes(DexFile* pDexFile, const DexMethod* pDexMethod)
     int insnIdx;
     FieldMethodInfo methInfo;
     int startAddr;
-    char* className = NULL;
+    const char* className;
 
     assert(pCode->insnsSize > 0);
     insns = pCode->insns;
@@ -1204,12 +1355,12 @@ void dumpBytecodes(DexFile* pDexFile, const DexMethod* pDexMethod)
 
     getMethodInfo(pDexFile, pDexMethod->methodIdx, &methInfo);
     startAddr = ((u1*)pCode - pDexFile->baseAddr);
-    className = descriptorToDot(methInfo.classDescriptor);
+    className = dotNameByTypeIdx(pDexFile,
+        dexGetMethodId(pDexFile, pDexMethod->methodIdx)->classIdx);
 
     printf("%06x:                                        |[%06x] %s.%s:%s\n",
         startAddr, startAddr,
         className, methInfo.name, methInfo.signature);
-    free((void *) methInfo.signature);
 
     insnIdx = 0;
     while (insnIdx < (int) pCode->insnsSize) {
@@ -1252,8 +1403,6 @@ void dumpBytecodes(DexFile* pDexFile, const DexMethod* pDexMethod)
         insns += insnWidth;
         insnIdx += insnWidth;
     }
-
-    free(className);
 }
 
 /*
@@ -1285,8 +1434,9 @@ void dumpMethod(DexFile* pDexFile, const DexMethod* pDexMethod, int i)
     const DexMethodId* pMethodId;
     const char* backDescriptor;
     const char* name;
-    char* typeDescriptor = NULL;
-    char* accessStr = NULL;
+    const char* typeDescriptor = NULL;
+    const char* accessStr = NULL;
+    DexArenaMark mark = dexArenaMark(&gArena);
 
     if (gOptions.exportsOnly &&
         (pDexMethod->accessFlags & (ACC_PUBLIC | ACC_PROTECTED)) == 0)
@@ -1296,7 +1446,8 @@ void dumpMethod(DexFile* pDexFile, const DexMethod* pDexMethod, int i)
 
     pMethodId = dexGetMethodId(pDexFile, pDexMethod->methodIdx);
     name = dexStringById(pDexFile, pMethodId->nameIdx);
-    typeDescriptor = dexCopyDescriptorFromMethodId(pDexFile, pMethodId);
+    typeDescriptor =
+        dexProtoTableGet(pDexFile->pProtoTable, pMethodId->protoIdx);
 
     backDescriptor = dexStringByTypeIdx(pDexFile, pMethodId->classIdx);
 
@@ -1323,15 +1474,10 @@ void dumpMethod(DexFile* pDexFile, const DexMethod* pDexMethod, int i)
         bool constructor = (name[0] == '<');
 
         if (constructor) {
-            char* tmp;
-
-            tmp = descriptorClassToDot(backDescriptor);
-            printf("<constructor name=\"%s\"\n", tmp);
-            free(tmp);
-
-            tmp = descriptorToDot(backDescriptor);
-            printf(" type=\"%s\"\n", tmp);
-            free(tmp);
+            printf("<constructor name=\"%s\"\n",
+                dotClassNameByTypeIdx(pDexFile, pMethodId->classIdx));
+            printf(" type=\"%s\"\n",
+                dotNameByTypeIdx(pDexFile, pMethodId->classIdx));
         } else {
             printf("<method name=\"%s\"\n", name);
 
@@ -1342,9 +1488,8 @@ void dumpMethod(DexFile* pDexFile, const DexMethod* pDexMethod, int i)
                 goto bail;
             }
 
-            char* tmp = descriptorToDot(returnType+1);
-            printf(" return=\"%s\"\n", tmp);
-            free(tmp);
+            printf(" return=\"%s\"\n", dotNameByTypeIdx(pDexFile,
+                dexGetProtoId(pDexFile, pMethodId->protoIdx)->returnTypeIdx));
 
             printf(" abstract=%s\n",
                 quotedBool((pDexMethod->accessFlags & ACC_ABSTRACT) != 0));
@@ -1375,38 +1520,14 @@ void dumpMethod(DexFile* pDexFile, const DexMethod* pDexMethod, int i)
             goto bail;
         }
 
-        char tmpBuf[strlen(typeDescriptor)+1];      /* more than big enough */
-        int argNum = 0;
-
-        const char* base = typeDescriptor+1;
-
-        while (*base != ')') {
-            char* cp = tmpBuf;
-
-            while (*base == '[')
-                *cp++ = *base++;
-
-            if (*base == 'L') {
-                /* copy through ';' */
-                do {
-                    *cp = *base++;
-                } while (*cp++ != ';');
-            } else {
-                /* primitive char, copy it */
-                if (strchr("ZBCSIFJD", *base) == NULL) {
-                    fprintf(stderr, "ERROR: bad method signature '%s'\n", base);
-                    goto bail;
-                }
-                *cp++ = *base++;
-            }
-
-            /* null terminate and display */
-            *cp++ = '\0';
+        const DexTypeList* pParams = dexGetProtoParameters(pDexFile,
+            dexGetProtoId(pDexFile, pMethodId->protoIdx));
+        u4 paramCount = (pParams != NULL) ? pParams->size : 0;
 
-            char* tmp = descriptorToDot(tmpBuf);
+        for (u4 argNum = 0; argNum < paramCount; argNum++) {
+            const DexTypeItem* pItem = dexGetTypeItem(pParams, argNum);
             printf("<parameter name=\"arg%d\" type=\"%s\">\n</parameter>\n",
-                argNum++, tmp);
-            free(tmp);
+                argNum, dotNameByTypeIdx(pDexFile, pItem->typeIdx));
         }
 
         if (constructor)
@@ -1416,8 +1537,7 @@ void dumpMethod(DexFile* pDexFile, const DexMethod* pDexMethod, int i)
     }
 
 bail:
-    free(typeDescriptor);
-    free(accessStr);
+    dexArenaRelease(&gArena, mark);
 }
 
 /*
@@ -1429,7 +1549,7 @@ void dumpSField(const DexFile* pDexFile, const DexField* pSField, int i)
     const char* backDescriptor;
     const char* name;
     const char* typeDescriptor;
-    char* accessStr;
+    const char* accessStr;
 
     if (gOptions.exportsOnly &&
         (pSField->accessFlags & (ACC_PUBLIC | ACC_PROTECTED)) == 0)
@@ -1451,13 +1571,10 @@ void dumpSField(const DexFile* pDexFile, const DexField* pSField, int i)
         printf("      access        : 0x%04x (%s)\n",
             pSField->accessFlags, accessStr);
     } else if (gOptions.outputFormat == OUTPUT_XML) {
-        char* tmp;
-
         printf("<field name=\"%s\"\n", name);
 
-        tmp = descriptorToDot(typeDescriptor);
-        printf(" type=\"%s\"\n", tmp);
-        free(tmp);
+        printf(" type=\"%s\"\n",
+            dotNameByTypeIdx(pDexFile, pFieldId->typeIdx));
 
         printf(" transient=%s\n",
             quotedBool((pSField->accessFlags & ACC_TRANSIENT) != 0));
@@ -1473,8 +1590,172 @@ void dumpSField(const DexFile* pDexFile, const DexField* pSField, int i)
             quotedVisibility(pSField->accessFlags));
         printf(">\n</field>\n");
     }
+}
+
+/*
+ * Get the name dexdump uses for an encoded_value type.
+ */
+static const char* encodedValueTypeName(u1 type)
+{
+    switch (type) {
+    case kDexAnnotationByte:            return "byte";
+    case kDexAnnotationShort:           return "short";
+    case kDexAnnotationChar:            return "char";
+    case kDexAnnotationInt:             return "int";
+    case kDexAnnotationLong:            return "long";
+    case kDexAnnotationFloat:           return "float";
+    case kDexAnnotationDouble:          return "double";
+    case kDexAnnotationMethodType:      return "MethodType";
+    case kDexAnnotationMethodHandle:    return "MethodHandle";
+    case kDexAnnotationString:          return "String";
+    case kDexAnnotationType:            return "Class";
+    case kDexAnnotationField:           return "Field";
+    case kDexAnnotationMethod:          return "Method";
+    case kDexAnnotationEnum:            return "Enum";
+    case kDexAnnotationArray:           return "Array";
+    case kDexAnnotationAnnotation:      return "Annotation";
+    case kDexAnnotationNull:            return "null";
+    case kDexAnnotationBoolean:         return "boolean";
+    default:                            return NULL;
+    }
+}
+
+/*
+ * Print a decoded encoded_value, without its type.  Returns false for a
+ * type dexdump doesn't know, in which case nothing is printed.
+ */
+static bool printEncodedValue(DexFile* pDexFile, const DexEncodedValue* pValue)
+{
+    switch (pValue->type) {
+    case kDexAnnotationByte:
+    case kDexAnnotationShort:
+    case kDexAnnotationInt:
+        printf("%d", pValue->value.i);
+        break;
+    case kDexAnnotationChar:
+        printf("%u", (u2) pValue->value.i);
+        break;
+    case kDexAnnotationLong:
+        printf("%" PRId64, (int64_t) pValue->value.j);
+        break;
+    case kDexAnnotationFloat:
+        printf("%g", pValue->value.f);
+        break;
+    case kDexAnnotationDouble:
+        printf("%g", pValue->value.d);
+        break;
+    case kDexAnnotationMethodType: {
+        ProtoInfo protoInfo;
+        memset(&protoInfo, 0, sizeof(protoInfo));
+        getProtoInfo(pDexFile, pValue->value.idx, &protoInfo);
+        printf("(%s)%s", protoInfo.parameterTypes, protoInfo.returnType);
+        break;
+    }
+    case kDexAnnotationMethodHandle:
+        printf("%u", pValue->value.idx);
+        break;
+    case kDexAnnotationString:
+        printf("%s", dexStringById(pDexFile, pValue->value.idx));
+        break;
+    case kDexAnnotationType:
+        printf("%s", dexStringByTypeIdx(pDexFile, pValue->value.idx));
+        break;
+    case kDexAnnotationField:
+    case kDexAnnotationEnum: {
+        const DexFieldId* pFieldId = dexGetFieldId(pDexFile, pValue->value.idx);
+        printf("%s.%s", dexStringByTypeIdx(pDexFile, pFieldId->classIdx),
+            dexStringById(pDexFile, pFieldId->nameIdx));
+        break;
+    }
+    case kDexAnnotationMethod: {
+        const DexMethodId* pMethodId =
+            dexGetMethodId(pDexFile, pValue->value.idx);
+        printf("%s.%s", dexStringByTypeIdx(pDexFile, pMethodId->classIdx),
+            dexStringById(pDexFile, pMethodId->nameIdx));
+        break;
+    }
+    case kDexAnnotationArray: {
+        DexEncodedArrayIterator arrayIterator;
+        dexEncodedArrayIteratorInit(&arrayIterator, pValue->value.data);
+        printf("%u values", arrayIterator.size);
+        break;
+    }
+    case kDexAnnotationAnnotation: {
+        DexAnnotationIterator annotationIterator;
+        dexAnnotationIteratorInit(&annotationIterator, pValue->value.data);
+        printf("%s", dexStringByTypeIdx(pDexFile, annotationIterator.typeIdx));
+        break;
+    }
+    case kDexAnnotationNull:
+        printf("null");
+        break;
+    case kDexAnnotationBoolean:
+        printf("%s", pValue->value.z ? "true" : "false");
+        break;
+    default:
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Print the initial value of a static field, for --static-values.  This
+ * is the next entry in the class's static_values, or the default for the
+ * field's type once those run out.
+ */
+static void dumpStaticValue(DexFile* pDexFile, const DexField* pSField,
+    DexEncodedArrayIterator* pIterator)
+{
+    DexEncodedValue value;
+
+    if (!dexEncodedArrayIteratorNext(pIterator, &value)) {
+        const DexFieldId* pFieldId = dexGetFieldId(pDexFile, pSField->fieldIdx);
+        switch (dexStringByTypeIdx(pDexFile, pFieldId->typeIdx)[0]) {
+        case 'Z':
+            value.type = kDexAnnotationBoolean;
+            value.value.z = false;
+            break;
+        case 'L':
+        case '[':
+            value.type = kDexAnnotationNull;
+            break;
+        default:
+            value.type = kDexAnnotationInt;
+            value.value.i = 0;
+            break;
+        }
+    }
+
+    printf("      value         : ");
+    if (printEncodedValue(pDexFile, &value))
+        printf(" (%s)\n", encodedValueTypeName(value.type));
+    else
+        printf("(type 0x%02x)\n", value.type);
+}
+
+/*
+ * Print how many static values of each kind the file's static_values
+ * hold, for --static-values.  Uses the bulk extractor, so the totals are
+ * an independent check on the per-field values printed above.
+ */
+static void dumpStaticValueSummary(const DexFile* pDexFile)
+{
+    static const char* const kKindNames[kDexStaticKindCount] = {
+        "int", "long", "float", "double", "String", "Class"
+    };
+    DexStaticValues* pValues = dexExtractStaticValues(pDexFile);
+
+    if (pValues == NULL) {
+        fprintf(stderr, "Unable to extract static values\n");
+        return;
+    }
+
+    printf("Static values     -\n");
+    for (int kind = 0; kind < kDexStaticKindCount; kind++)
+        printf("  %-8s: %u\n", kKindNames[kind], pValues->count[kind]);
+    printf("\n");
 
-    free(accessStr);
+    dexStaticValuesFree(pValues);
 }
 
 /*
@@ -1502,7 +1783,8 @@ void dumpClass(DexFile* pDexFile, int idx, char** pLastPackage)
     const char* fileName;
     const char* classDescriptor;
     const char* superclassDescriptor;
-    char* accessStr = NULL;
+    const char* accessStr = NULL;
+    DexArenaMark mark = dexArenaMark(&gArena);
     int i;
 
     pClassDef = dexGetClassDef(pDexFile, idx);
@@ -1514,7 +1796,7 @@ void dumpClass(DexFile* pDexFile, int idx, char** pLastPackage)
     }
 
     pEncodedData = dexGetClassData(pDexFile, pClassDef);
-    pClassData = dexReadAndVerifyClassData(&pEncodedData, NULL);
+    pClassData = dexReadAndVerifyClassDataInArena(&pEncodedData, NULL, &gArena);
 
     if (pClassData == NULL) {
         printf("Trouble reading class data (#%d)\n", idx);
@@ -1540,7 +1822,7 @@ void dumpClass(DexFile* pDexFile, int idx, char** pLastPackage)
         char* lastSlash;
         char* cp;
 
-        mangle = strdup(classDescriptor + 1);
+        mangle = dexArenaStrdup(&gArena, classDescriptor + 1);
         mangle[strlen(mangle)-1] = '\0';
 
         /* reduce to just the package name */
@@ -1562,9 +1844,7 @@ void dumpClass(DexFile* pDexFile, int idx, char** pLastPackage)
                 printf("</package>\n");
             printf("<package name=\"%s\"\n>\n", mangle);
             free(*pLastPackage);
-            *pLastPackage = mangle;
-        } else {
-            free(mangle);
+            *pLastPackage = strdup(mangle);
         }
     }
 
@@ -1588,16 +1868,12 @@ void dumpClass(DexFile* pDexFile, int idx, char** pLastPackage)
 
         printf("  Interfaces        -\n");
     } else {
-        char* tmp;
-
-        tmp = descriptorClassToDot(classDescriptor);
-        printf("<class name=\"%s\"\n", tmp);
-        free(tmp);
+        printf("<class name=\"%s\"\n",
+            dotClassNameByTypeIdx(pDexFile, pClassDef->classIdx));
 
         if (superclassDescriptor != NULL) {
-            tmp = descriptorToDot(superclassDescriptor);
-            printf(" extends=\"%s\"\n", tmp);
-            free(tmp);
+            printf(" extends=\"%s\"\n",
+                dotNameByTypeIdx(pDexFile, pClassDef->superclassIdx));
         }
         printf(" abstract=%s\n",
             quotedBool((pClassDef->accessFlags & ACC_ABSTRACT) != 0));
@@ -1618,8 +1894,23 @@ void dumpClass(DexFile* pDexFile, int idx, char** pLastPackage)
 
     if (gOptions.outputFormat == OUTPUT_PLAIN)
         printf("  Static fields     -\n");
-    for (i = 0; i < (int) pClassData->header.staticFieldsSize; i++) {
-        dumpSField(pDexFile, &pClassData->staticFields[i], i);
+    {
+        const DexEncodedArray* pStaticValues =
+            dexGetStaticValuesList(pDexFile, pClassDef);
+        DexEncodedArrayIterator staticValues;
+
+        /* an absent list means every field starts out with its default */
+        staticValues.countRemaining = 0;
+        if (pStaticValues != NULL)
+            dexEncodedArrayIteratorInit(&staticValues, pStaticValues->array);
+
+        for (i = 0; i < (int) pClassData->header.staticFieldsSize; i++) {
+            dumpSField(pDexFile, &pClassData->staticFields[i], i);
+            if (gOptions.staticValues && gOptions.outputFormat == OUTPUT_PLAIN) {
+                dumpStaticValue(pDexFile, &pClassData->staticFields[i],
+                    &staticValues);
+            }
+        }
     }
 
     if (gOptions.outputFormat == OUTPUT_PLAIN)
@@ -1658,8 +1949,7 @@ void dumpClass(DexFile* pDexFile, int idx, char** pLastPackage)
     }
 
 bail:
-    free(pClassData);
-    free(accessStr);
+    dexArenaRelease(&gArena, mark);
 }
 
 
@@ -1961,41 +2251,6 @@ static void dumpMethodHandles(DexFile* pDexFile)
     }
 }
 
-/* Helper for dumpCallSites(), which reads a 1- to 8- byte signed
- * little endian value. */
-static u8 readSignedLittleEndian(const u1** pData, u4 size) {
-    const u1* data = *pData;
-    u8 result = 0;
-    u4 i;
-
-    for (i = 0; i < size; i++) {
-        result = (result >> 8) | (((int64_t)*data++) << 56);
-    }
-
-    result >>= (8 - size) * 8;
-    *pData = data;
-    return result;
-}
-
-/* Helper for dumpCallSites(), which reads a 1- to 8- byte unsigned
- * little endian value. */
-static u8 readUnsignedLittleEndian(const u1** pData, u4 size, bool fillOnRight = false) {
-    const u1* data = *pData;
-    u8 result = 0;
-    u4 i;
-
-    for (i = 0; i < size; i++) {
-        result = (result >> 8) | (((u8)*data++) << 56);
-    }
-
-    if (!fillOnRight) {
-        result >>= (8u - size) * 8;
-    }
-
-    *pData = data;
-    return result;
-}
-
 static void dumpCallSites(DexFile* pDexFile)
 {
     const DexMapItem* item = findMapItem(pDexFile, kDexTypeCallSiteIdItem);
@@ -2009,88 +2264,21 @@ static void dumpCallSites(DexFile* pDexFile)
         u4 count = readUnsignedLeb128(&data);
         for (u4 i = 0; i < count; ++i) {
             printf(doXml ? "<link_argument index=\"%u\" " : "  link_argument[%u] : ", i);
-            u1 headerByte = *data++;
-            u4 valueType = headerByte & kDexAnnotationValueTypeMask;
-            u4 valueArg = headerByte >> kDexAnnotationValueArgShift;
-            switch (valueType) {
-                case kDexAnnotationByte: {
-                    printf(doXml ? "type=\"byte\" value=\"%d\"/>" : "%d (byte)", (int)*data++);
-                    break;
-                }
-                case kDexAnnotationShort: {
-                    printf(doXml ? "type=\"short\" value=\"%d\"/>" : "%d (short)",
-                           (int) readSignedLittleEndian(&data, valueArg + 1));
-                    break;
-                }
-                case kDexAnnotationChar: {
-                    printf(doXml ? "type=\"short\" value=\"%u\"/>" : "%u (char)",
-                           (u2) readUnsignedLittleEndian(&data, valueArg + 1));
-                    break;
-                }
-                case kDexAnnotationInt: {
-                    printf(doXml ? "type=\"int\" value=\"%d\"/>" : "%d (int)",
-                           (int) readSignedLittleEndian(&data, valueArg + 1));
-                    break;
-                }
-                case kDexAnnotationLong: {
-                    printf(doXml ? "type=\"long\" value=\"%" PRId64 "\"/>" : "%" PRId64 " (long)",
-                           (int64_t) readSignedLittleEndian(&data, valueArg + 1));
-                    break;
-                }
-                case kDexAnnotationFloat: {
-                    u4 rawValue = (u4) (readUnsignedLittleEndian(&data, valueArg + 1, true) >> 32);
-                    printf(doXml ? "type=\"float\" value=\"%g\"/>" : "%g (float)",
-                           *((float*) &rawValue));
-                    break;
-                }
-                case kDexAnnotationDouble: {
-                    u8 rawValue = readUnsignedLittleEndian(&data, valueArg + 1, true);
-                    printf(doXml ? "type=\"double\" value=\"%g\"/>" : "%g (double)",
-                           *((double*) &rawValue));
-                    break;
-                }
-                case kDexAnnotationMethodType: {
-                    u4 idx = (u4) readUnsignedLittleEndian(&data, valueArg + 1);
-                    ProtoInfo protoInfo;
-                    memset(&protoInfo, 0, sizeof(protoInfo));
-                    getProtoInfo(pDexFile, idx, &protoInfo);
-                    printf(doXml ? "type=\"MethodType\" value=\"(%s)%s\"/>" : "(%s)%s (MethodType)",
-                           protoInfo.parameterTypes, protoInfo.returnType);
-                    free(protoInfo.parameterTypes);
-                    break;
-                }
-                case kDexAnnotationMethodHandle: {
-                    u4 idx = (u4) readUnsignedLittleEndian(&data, valueArg + 1);
-                    printf(doXml ? "type=\"MethodHandle\" value=\"%u\"/>" : "%u (MethodHandle)",
-                           idx);
-                    break;
-                }
-                case kDexAnnotationString: {
-                    u4 idx = (u4) readUnsignedLittleEndian(&data, valueArg + 1);
-                    printf(doXml ? "type=\"String\" value=\"%s\"/>" : "%s (String)",
-                           dexStringById(pDexFile, idx));
-                    break;
-                }
-                case kDexAnnotationType: {
-                    u4 idx = (u4) readUnsignedLittleEndian(&data, valueArg + 1);
-                    printf(doXml ? "type=\"Class\" value=\"%s\"/>" : "%s (Class)",
-                           dexStringByTypeIdx(pDexFile, idx));
-                    break;
-                }
-                case kDexAnnotationNull: {
-                    printf(doXml ? "type=\"null\" value=\"null\"/>" : "null (null)");
-                    break;
-                }
-                case kDexAnnotationBoolean: {
-                    printf(doXml ? "type=\"boolean\" value=\"%s\"/>" : "%s (boolean)",
-                           (valueArg & 1) == 0 ? "false" : "true");
-                    break;
-                }
-                default:
-                    // Other types are not anticipated being reached here.
-                    printf("Unexpected type found, bailing on call site info.\n");
-                    i = count;
-                    break;
+            DexEncodedValue value;
+            dexReadEncodedValue(&data, &value);
+            const char* typeName = encodedValueTypeName(value.type);
+            if (typeName == NULL) {
+                // Other types are not anticipated being reached here.
+                printf("Unexpected type found, bailing on call site info.\n");
+                break;
+            }
+            if (doXml) {
+                printf("type=\"%s\" value=\"", typeName);
+                printEncodedValue(pDexFile, &value);
+                printf("\"/>");
+            } else {
+                printEncodedValue(pDexFile, &value);
+                printf(" (%s)", typeName);
             }
             printf("\n");
         }
@@ -2102,82 +2290,1612 @@ static void dumpCallSites(DexFile* pDexFile)
 }
 
 /*
- * Dump the requested sections of the file.
+ * Byte attribution buckets for the size report.  "Other" covers the
+ * class_data, interface lists and static values owned by a class.
  */
-void processDexFile(const char* fileName, DexFile* pDexFile)
-{
-    char* package = NULL;
-    int i;
+enum SizeCategory {
+    kSizeCode = 0,
+    kSizeDebug,
+    kSizeStrings,
+    kSizeAnnotations,
+    kSizeOther,
+    kSizeCategoryCount
+};
 
-    if (gOptions.verbose) {
-        printf("Opened '%s', DEX version '%.3s'\n", fileName,
-            pDexFile->pHeader->magic +4);
-    }
+static const char* const gSizeCategoryNames[kSizeCategoryCount] = {
+    "code", "debug", "strings", "annotations", "other"
+};
 
-    if (gOptions.dumpRegisterMaps) {
-        dumpRegisterMaps(pDexFile);
+/*
+ * Maps the file offset of a data item to the class_def that owns it.
+ */
+struct SizeOwner {
+    u4 offset;
+    u4 classDefIdx;
+};
+
+struct SizeReport {
+    SizeOwner* owners;
+    u4 ownerCount;
+    u4 ownerCapacity;
+
+    u4 (*classBytes)[kSizeCategoryCount];   /* per class_def */
+    u4 unattributed[kSizeCategoryCount];
+
+    u4* codeSizes;              /* one per code_item, in file order */
+    u4 codeCount;
+    u4 codePadding;             /* alignment padding between code_items */
+    u4 triesPadding;            /* padding between insns and tries */
+};
+
+/*
+ * Record that "classDefIdx" owns the data item at "offset".
+ */
+static void addSizeOwner(SizeReport* pReport, u4 offset, u4 classDefIdx)
+{
+    if (offset == 0)
         return;
-    }
 
-    if (gOptions.showFileHeaders) {
-        dumpFileHeader(pDexFile);
-        dumpOptDirectory(pDexFile);
+    if (pReport->ownerCount == pReport->ownerCapacity) {
+        u4 newCapacity = (pReport->ownerCapacity == 0) ?
+            1024 : pReport->ownerCapacity * 2;
+        SizeOwner* newOwners = (SizeOwner*) realloc(pReport->owners,
+            newCapacity * sizeof(SizeOwner));
+        if (newOwners == NULL) {
+            fprintf(stderr, "ERROR: out of memory\n");
+            exit(1);
+        }
+        pReport->owners = newOwners;
+        pReport->ownerCapacity = newCapacity;
     }
 
-    if (gOptions.outputFormat == OUTPUT_XML)
-        printf("<api>\n");
+    pReport->owners[pReport->ownerCount].offset = offset;
+    pReport->owners[pReport->ownerCount].classDefIdx = classDefIdx;
+    pReport->ownerCount++;
+}
 
-    for (i = 0; i < (int) pDexFile->pHeader->classDefsSize; i++) {
-        if (gOptions.showSectionHeaders)
-            dumpClassDef(pDexFile, i);
+static int compareSizeOwners(const void* a, const void* b)
+{
+    const SizeOwner* pA = (const SizeOwner*) a;
+    const SizeOwner* pB = (const SizeOwner*) b;
 
-        dumpClass(pDexFile, i, &package);
-    }
+    if (pA->offset != pB->offset)
+        return (pA->offset < pB->offset) ? -1 : 1;
+    return (pA->classDefIdx < pB->classDefIdx) ? -1 :
+        (pA->classDefIdx > pB->classDefIdx);
+}
 
-    dumpMethodHandles(pDexFile);
-    dumpCallSites(pDexFile);
+/*
+ * Find the owner of the item at "offset".  Shared items go to the
+ * lowest-numbered class that references them.
+ */
+static u4 findSizeOwner(const SizeReport* pReport, u4 offset)
+{
+    u4 lo = 0;
+    u4 hi = pReport->ownerCount;
 
-    /* free the last one allocated */
-    if (package != NULL) {
-        printf("</package>\n");
-        free(package);
+    while (lo < hi) {
+        u4 mid = (lo + hi) / 2;
+        if (pReport->owners[mid].offset < offset)
+            lo = mid + 1;
+        else
+            hi = mid;
     }
 
-    if (gOptions.outputFormat == OUTPUT_XML)
-        printf("</api>\n");
+    if (lo < pReport->ownerCount && pReport->owners[lo].offset == offset)
+        return pReport->owners[lo].classDefIdx;
+    return kDexNoIndex;
 }
 
-
 /*
- * Process one file.
+ * Claim an annotation_set_item and the annotation_items it points to.
  */
-int process(const char* fileName)
+static void addAnnotationSetOwner(const DexFile* pDexFile,
+    SizeReport* pReport, u4 setOff, u4 classDefIdx)
 {
-    DexFile* pDexFile = NULL;
-    MemMapping map;
-    bool mapped = false;
-    int result = -1;
+    if (setOff == 0)
+        return;
+
+    const DexAnnotationSetItem* pSet = (const DexAnnotationSetItem*)
+        (pDexFile->baseAddr + setOff);
+    addSizeOwner(pReport, setOff, classDefIdx);
+    for (u4 i = 0; i < pSet->size; i++)
+        addSizeOwner(pReport, pSet->entries[i], classDefIdx);
+}
+
+/*
+ * Claim everything hanging off a class's annotations_directory_item.
+ */
+static void addAnnotationsOwner(const DexFile* pDexFile,
+    SizeReport* pReport, const DexClassDef* pClassDef, u4 classDefIdx)
+{
+    const DexAnnotationsDirectoryItem* pDir =
+        dexGetAnnotationsDirectoryItem(pDexFile, pClassDef);
+    if (pDir == NULL)
+        return;
+
+    addSizeOwner(pReport, pClassDef->annotationsOff, classDefIdx);
+    addAnnotationSetOwner(pDexFile, pReport, pDir->classAnnotationsOff,
+        classDefIdx);
+
+    const DexFieldAnnotationsItem* pFields =
+        dexGetFieldAnnotations(pDexFile, pDir);
+    for (int i = 0; i < dexGetFieldAnnotationsSize(pDexFile, pDir); i++) {
+        addAnnotationSetOwner(pDexFile, pReport,
+            pFields[i].annotationsOff, classDefIdx);
+    }
+
+    const DexMethodAnnotationsItem* pMethods =
+        dexGetMethodAnnotations(pDexFile, pDir);
+    for (int i = 0; i < dexGetMethodAnnotationsSize(pDexFile, pDir); i++) {
+        addAnnotationSetOwner(pDexFile, pReport,
+            pMethods[i].annotationsOff, classDefIdx);
+    }
+
+    const DexParameterAnnotationsItem* pParams =
+        dexGetParameterAnnotations(pDexFile, pDir);
+    for (int i = 0; i < dexGetParameterAnnotationsSize(pDexFile, pDir); i++) {
+        u4 refListOff = pParams[i].annotationsOff;
+        if (refListOff == 0)
+            continue;
+
+        const DexAnnotationSetRefList* pRefList =
+            (const DexAnnotationSetRefList*) (pDexFile->baseAddr + refListOff);
+        addSizeOwner(pReport, refListOff, classDefIdx);
+        for (u4 j = 0; j < pRefList->size; j++) {
+            addAnnotationSetOwner(pDexFile, pReport,
+                pRefList->list[j].annotationsOff, classDefIdx);
+        }
+    }
+}
+
+/*
+ * Claim the strings a method's code loads with const-string.
+ */
+static void claimCodeStrings(const DexCode* pCode, u4* stringOwners,
+    u4 classDefIdx)
+{
+    const u2* insns = pCode->insns;
+    u4 insnIdx = 0;
+
+    while (insnIdx < pCode->insnsSize) {
+        Opcode opcode = dexOpcodeFromCodeUnit(insns[insnIdx]);
+        size_t width = dexGetWidthFromInstruction(&insns[insnIdx]);
+
+        if (width == 0)
+            break;
+
+        if (opcode == OP_CONST_STRING || opcode == OP_CONST_STRING_JUMBO) {
+            DecodedInstruction decInsn;
+            dexDecodeInstruction(&insns[insnIdx], &decInsn);
+            if (stringOwners[decInsn.vB] == kDexNoIndex)
+                stringOwners[decInsn.vB] = classDefIdx;
+        }
+        insnIdx += width;
+    }
+}
+
+/*
+ * Walk the class definitions and record which class owns which data
+ * items.  Strings are claimed by the first class that names them as its
+ * descriptor, source file, member name, or const-string operand.
+ */
+static void collectSizeOwners(const DexFile* pDexFile, SizeReport* pReport)
+{
+    const DexHeader* pHeader = pDexFile->pHeader;
+    u4* stringOwners = (u4*) malloc(pHeader->stringIdsSize * sizeof(u4));
+
+    if (stringOwners == NULL && pHeader->stringIdsSize != 0) {
+        fprintf(stderr, "ERROR: out of memory\n");
+        exit(1);
+    }
+    memset(stringOwners, 0xff, pHeader->stringIdsSize * sizeof(u4));
+
+    for (u4 i = 0; i < pHeader->classDefsSize; i++) {
+        const DexClassDef* pClassDef = dexGetClassDef(pDexFile, i);
+        const DexTypeId* pTypeId = dexGetTypeId(pDexFile, pClassDef->classIdx);
+
+        if (stringOwners[pTypeId->descriptorIdx] == kDexNoIndex)
+            stringOwners[pTypeId->descriptorIdx] = i;
+        if (pClassDef->sourceFileIdx != kDexNoIndex &&
+                stringOwners[pClassDef->sourceFileIdx] == kDexNoIndex)
+            stringOwners[pClassDef->sourceFileIdx] = i;
+
+        addSizeOwner(pReport, pClassDef->interfacesOff, i);
+        addSizeOwner(pReport, pClassDef->staticValuesOff, i);
+        addAnnotationsOwner(pDexFile, pReport, pClassDef, i);
+
+        const u1* pEncodedData = dexGetClassData(pDexFile, pClassDef);
+        if (pEncodedData == NULL)
+            continue;
+        addSizeOwner(pReport, pClassDef->classDataOff, i);
+
+        DexClassData* pClassData = dexReadAndVerifyClassData(&pEncodedData, NULL);
+        if (pClassData == NULL)
+            continue;
+
+        u4 fieldCount = pClassData->header.staticFieldsSize +
+            pClassData->header.instanceFieldsSize;
+        for (u4 j = 0; j < fieldCount; j++) {
+            const DexField* pField = (j < pClassData->header.staticFieldsSize) ?
+                &pClassData->staticFields[j] :
+                &pClassData->instanceFields[j - pClassData->header.staticFieldsSize];
+            u4 nameIdx = dexGetFieldId(pDexFile, pField->fieldIdx)->nameIdx;
+            if (stringOwners[nameIdx] == kDexNoIndex)
+                stringOwners[nameIdx] = i;
+        }
+
+        u4 methodCount = pClassData->header.directMethodsSize +
+            pClassData->header.virtualMethodsSize;
+        for (u4 j = 0; j < methodCount; j++) {
+            const DexMethod* pMethod = (j < pClassData->header.directMethodsSize) ?
+                &pClassData->directMethods[j] :
+                &pClassData->virtualMethods[j - pClassData->header.directMethodsSize];
+            u4 nameIdx = dexGetMethodId(pDexFile, pMethod->methodIdx)->nameIdx;
+            if (stringOwners[nameIdx] == kDexNoIndex)
+                stringOwners[nameIdx] = i;
+
+            const DexCode* pCode = dexGetCode(pDexFile, pMethod);
+            if (pCode == NULL)
+                continue;
+            addSizeOwner(pReport, pMethod->codeOff, i);
+            addSizeOwner(pReport, pCode->debugInfoOff, i);
+            claimCodeStrings(pCode, stringOwners, i);
+        }
+
+        free(pClassData);
+    }
+
+    for (u4 i = 0; i < pHeader->stringIdsSize; i++) {
+        if (stringOwners[i] != kDexNoIndex) {
+            addSizeOwner(pReport, dexGetStringId(pDexFile, i)->stringDataOff,
+                stringOwners[i]);
+        }
+    }
+    free(stringOwners);
+
+    qsort(pReport->owners, pReport->ownerCount, sizeof(SizeOwner),
+        compareSizeOwners);
+}
+
+/*
+ * Return the alignment required by items of the given map type.
+ */
+static u4 mapItemAlignment(u2 type)
+{
+    switch (type) {
+    case kDexTypeClassDataItem:
+    case kDexTypeStringDataItem:
+    case kDexTypeDebugInfoItem:
+    case kDexTypeAnnotationItem:
+    case kDexTypeEncodedArrayItem:
+        return 1;
+    default:
+        return 4;
+    }
+}
+
+/*
+ * Return the size of the item of the given map type at "ptr".
+ */
+static u4 mapItemSize(const DexFile* pDexFile, u2 type, const u1* ptr)
+{
+    const u1* data = ptr;
+
+    switch (type) {
+    case kDexTypeHeaderItem:            return pDexFile->pHeader->headerSize;
+    case kDexTypeStringIdItem:          return sizeof(DexStringId);
+    case kDexTypeTypeIdItem:            return sizeof(DexTypeId);
+    case kDexTypeProtoIdItem:           return sizeof(DexProtoId);
+    case kDexTypeFieldIdItem:           return sizeof(DexFieldId);
+    case kDexTypeMethodIdItem:          return sizeof(DexMethodId);
+    case kDexTypeClassDefItem:          return sizeof(DexClassDef);
+    case kDexTypeCallSiteIdItem:        return sizeof(DexCallSiteId);
+    case kDexTypeMethodHandleItem:      return sizeof(DexMethodHandleItem);
+    case kDexTypeMapList:
+        return sizeof(u4) + ((const DexMapList*) ptr)->size * sizeof(DexMapItem);
+    case kDexTypeTypeList:
+        return sizeof(u4) + ((const DexTypeList*) ptr)->size * sizeof(DexTypeItem);
+    case kDexTypeAnnotationSetRefList:
+        return sizeof(u4) + ((const DexAnnotationSetRefList*) ptr)->size *
+            sizeof(DexAnnotationSetRefItem);
+    case kDexTypeAnnotationSetItem:
+        return sizeof(u4) + ((const DexAnnotationSetItem*) ptr)->size * sizeof(u4);
+    case kDexTypeAnnotationsDirectoryItem: {
+        const DexAnnotationsDirectoryItem* pDir =
+            (const DexAnnotationsDirectoryItem*) ptr;
+        return sizeof(DexAnnotationsDirectoryItem) +
+            pDir->fieldsSize * sizeof(DexFieldAnnotationsItem) +
+            pDir->methodsSize * sizeof(DexMethodAnnotationsItem) +
+            pDir->parametersSize * sizeof(DexParameterAnnotationsItem);
+    }
+    case kDexTypeClassDataItem: {
+        DexClassDataHeader header;
+        dexReadClassDataHeader(&data, &header);
+        u4 count = 2 * (header.staticFieldsSize + header.instanceFieldsSize) +
+            3 * (header.directMethodsSize + header.virtualMethodsSize);
+        while (count-- != 0)
+            skipLeb128(&data);
+        return data - ptr;
+    }
+    case kDexTypeCodeItem:
+        return dexGetCodeItemSize((const DexCode*) ptr);
+    case kDexTypeStringDataItem:
+        skipLeb128(&data);
+        return (data - ptr) + strlen((const char*) data) + 1;
+    case kDexTypeDebugInfoItem:
+        return dexGetDebugInfoSize(ptr);
+    case kDexTypeAnnotationItem:
+        data++;                             // visibility
+        dexSkipEncodedAnnotation(&data);
+        return data - ptr;
+    case kDexTypeEncodedArrayItem:
+        dexSkipEncodedArray(&data);
+        return data - ptr;
+    default:
+        return 0;
+    }
+}
+
+/*
+ * Return the attribution bucket for a map type, or -1 if items of that
+ * type aren't owned by any one class.
+ */
+static int mapItemCategory(u2 type)
+{
+    switch (type) {
+    case kDexTypeCodeItem:                  return kSizeCode;
+    case kDexTypeDebugInfoItem:             return kSizeDebug;
+    case kDexTypeStringDataItem:            return kSizeStrings;
+    case kDexTypeAnnotationSetRefList:
+    case kDexTypeAnnotationSetItem:
+    case kDexTypeAnnotationItem:
+    case kDexTypeAnnotationsDirectoryItem:  return kSizeAnnotations;
+    case kDexTypeClassDataItem:
+    case kDexTypeTypeList:
+    case kDexTypeEncodedArrayItem:          return kSizeOther;
+    default:                                return -1;
+    }
+}
+
+static const char* mapItemTypeName(u2 type)
+{
+    switch (type) {
+    case kDexTypeHeaderItem:                return "header_item";
+    case kDexTypeStringIdItem:              return "string_id_item";
+    case kDexTypeTypeIdItem:                return "type_id_item";
+    case kDexTypeProtoIdItem:               return "proto_id_item";
+    case kDexTypeFieldIdItem:               return "field_id_item";
+    case kDexTypeMethodIdItem:              return "method_id_item";
+    case kDexTypeClassDefItem:              return "class_def_item";
+    case kDexTypeCallSiteIdItem:            return "call_site_id_item";
+    case kDexTypeMethodHandleItem:          return "method_handle_item";
+    case kDexTypeMapList:                   return "map_list";
+    case kDexTypeTypeList:                  return "type_list";
+    case kDexTypeAnnotationSetRefList:      return "annotation_set_ref_list";
+    case kDexTypeAnnotationSetItem:         return "annotation_set_item";
+    case kDexTypeClassDataItem:             return "class_data_item";
+    case kDexTypeCodeItem:                  return "code_item";
+    case kDexTypeStringDataItem:            return "string_data_item";
+    case kDexTypeDebugInfoItem:             return "debug_info_item";
+    case kDexTypeAnnotationItem:            return "annotation_item";
+    case kDexTypeEncodedArrayItem:          return "encoded_array_item";
+    case kDexTypeAnnotationsDirectoryItem:  return "annotations_directory_item";
+    default:                                return "unknown";
+    }
+}
+
+static int compareU4(const void* a, const void* b)
+{
+    u4 valA = *(const u4*) a;
+    u4 valB = *(const u4*) b;
+    return (valA < valB) ? -1 : (valA > valB);
+}
+
+/*
+ * Sort key for grouping classes by package.
+ */
+struct SizePackageKey {
+    const char* descriptor;
+    int packageLen;             /* up to and including the last '/' */
+    u4 classDefIdx;
+};
+
+static int comparePackageKeys(const void* a, const void* b)
+{
+    const SizePackageKey* pA = (const SizePackageKey*) a;
+    const SizePackageKey* pB = (const SizePackageKey*) b;
+    int len = (pA->packageLen < pB->packageLen) ? pA->packageLen : pB->packageLen;
+    int result = strncmp(pA->descriptor, pB->descriptor, len);
+
+    if (result != 0)
+        return result;
+    if (pA->packageLen != pB->packageLen)
+        return pA->packageLen - pB->packageLen;
+    return (pA->classDefIdx < pB->classDefIdx) ? -1 : 1;
+}
+
+static void printSizeRow(const u4* bytes, const char* name, int nameLen)
+{
+    u4 total = 0;
+
+    for (int i = 0; i < kSizeCategoryCount; i++) {
+        printf("%10u ", bytes[i]);
+        total += bytes[i];
+    }
+    printf("%10u  %.*s\n", total, nameLen, name);
+}
+
+/*
+ * Print the per-package totals.  Classes in the default package are
+ * reported under "<default>".
+ */
+static void dumpPackageSizes(const DexFile* pDexFile, const SizeReport* pReport)
+{
+    u4 classCount = pDexFile->pHeader->classDefsSize;
+    SizePackageKey* keys =
+        (SizePackageKey*) malloc(classCount * sizeof(SizePackageKey));
+
+    if (keys == NULL && classCount != 0) {
+        fprintf(stderr, "ERROR: out of memory\n");
+        exit(1);
+    }
+
+    for (u4 i = 0; i < classCount; i++) {
+        const DexClassDef* pClassDef = dexGetClassDef(pDexFile, i);
+        const char* descriptor = dexStringByTypeIdx(pDexFile, pClassDef->classIdx);
+        const char* lastSlash = strrchr(descriptor, '/');
+
+        keys[i].descriptor = descriptor;
+        keys[i].packageLen = (lastSlash != NULL) ? lastSlash - descriptor + 1 : 0;
+        keys[i].classDefIdx = i;
+    }
+    qsort(keys, classCount, sizeof(SizePackageKey), comparePackageKeys);
+
+    u4 start = 0;
+    while (start < classCount) {
+        u4 bytes[kSizeCategoryCount] = { 0 };
+        u4 end = start;
+
+        while (end < classCount &&
+                keys[end].packageLen == keys[start].packageLen &&
+                strncmp(keys[end].descriptor, keys[start].descriptor,
+                    keys[start].packageLen) == 0) {
+            for (int i = 0; i < kSizeCategoryCount; i++)
+                bytes[i] += pReport->classBytes[keys[end].classDefIdx][i];
+            end++;
+        }
+
+        if (keys[start].packageLen == 0) {
+            printSizeRow(bytes, "<default>", 9);
+        } else {
+            /* skip the leading 'L' and trailing '/' */
+            printSizeRow(bytes, keys[start].descriptor + 1,
+                keys[start].packageLen - 2);
+        }
+        start = end;
+    }
+
+    free(keys);
+}
+
+/*
+ * Print the code_item size distribution.
+ */
+static void dumpCodeSizeDistribution(SizeReport* pReport)
+{
+    u4 count = pReport->codeCount;
+    u8 total = 0;
+
+    if (count == 0)
+        return;
+
+    qsort(pReport->codeSizes, count, sizeof(u4), compareU4);
+    for (u4 i = 0; i < count; i++)
+        total += pReport->codeSizes[i];
+
+    printf("code_item sizes:\n");
+    printf("  count %u, total %" PRIu64 ", mean %" PRIu64
+        ", min %u, median %u, p90 %u, max %u\n",
+        count, total, total / count, pReport->codeSizes[0],
+        pReport->codeSizes[count / 2], pReport->codeSizes[(count * 9) / 10],
+        pReport->codeSizes[count - 1]);
+
+    u4 i = 0;
+    for (u4 limit = 16; i < count; limit *= 2) {
+        u4 bucketCount = 0;
+        while (i < count && pReport->codeSizes[i] <= limit) {
+            bucketCount++;
+            i++;
+        }
+        if (bucketCount != 0)
+            printf("  <= %7u bytes : %u\n", limit, bucketCount);
+    }
+
+    printf("  alignment waste: %u bytes between items, %u bytes before tries\n",
+        pReport->codePadding, pReport->triesPadding);
+    printf("\n");
+}
+
+/*
+ * Produce the size report: one linear pass over every section listed in
+ * the map, attributing each data item to the class that owns it.
+ */
+void dumpSizeReport(const DexFile* pDexFile)
+{
+    const DexHeader* pHeader = pDexFile->pHeader;
+    const DexMapList* pMap =
+        (const DexMapList*) (pDexFile->baseAddr + pHeader->mapOff);
+    SizeReport report;
+
+    memset(&report, 0, sizeof(report));
+    report.classBytes = (u4 (*)[kSizeCategoryCount])
+        calloc(pHeader->classDefsSize + 1, sizeof(*report.classBytes));
+    if (report.classBytes == NULL) {
+        fprintf(stderr, "ERROR: out of memory\n");
+        return;
+    }
+
+    collectSizeOwners(pDexFile, &report);
+
+    printf("Sections:\n");
+    printf("  %-27s %8s %10s %8s\n", "type", "items", "bytes", "padding");
+
+    for (u4 i = 0; i < pMap->size; i++) {
+        const DexMapItem* pItem = &pMap->list[i];
+        u4 alignMask = mapItemAlignment(pItem->type) - 1;
+        int category = mapItemCategory(pItem->type);
+        u4 offset = pItem->offset;
+        u4 padding = 0;
+
+        if (pItem->type == kDexTypeCodeItem) {
+            report.codeSizes = (u4*) malloc(pItem->size * sizeof(u4));
+            if (report.codeSizes == NULL && pItem->size != 0) {
+                fprintf(stderr, "ERROR: out of memory\n");
+                exit(1);
+            }
+        }
+
+        for (u4 j = 0; j < pItem->size; j++) {
+            u4 aligned = (offset + alignMask) & ~alignMask;
+            const u1* ptr = pDexFile->baseAddr + aligned;
+            u4 size = mapItemSize(pDexFile, pItem->type, ptr);
+
+            padding += aligned - offset;
+            if (pItem->type == kDexTypeCodeItem) {
+                const DexCode* pCode = (const DexCode*) ptr;
+                report.codeSizes[report.codeCount++] = size;
+                report.codePadding += aligned - offset;
+                if (pCode->triesSize != 0 && (pCode->insnsSize & 1) != 0)
+                    report.triesPadding += 2;
+            }
+
+            if (category >= 0) {
+                u4 owner = findSizeOwner(&report, aligned);
+                if (owner != kDexNoIndex)
+                    report.classBytes[owner][category] += size;
+                else
+                    report.unattributed[category] += size;
+            }
+            offset = aligned + size;
+        }
+
+        printf("  %-27s %8u %10u %8u\n", mapItemTypeName(pItem->type),
+            pItem->size, offset - pItem->offset, padding);
+    }
+    printf("\n");
+
+    dumpCodeSizeDistribution(&report);
+
+    printf("Classes:\n");
+    for (int i = 0; i < kSizeCategoryCount; i++)
+        printf("%10s ", gSizeCategoryNames[i]);
+    printf("%10s  %s\n", "total", "class");
+    for (u4 i = 0; i < pHeader->classDefsSize; i++) {
+        const char* descriptor = dexStringByTypeIdx(pDexFile,
+            dexGetClassDef(pDexFile, i)->classIdx);
+        printSizeRow(report.classBytes[i], descriptor, strlen(descriptor));
+    }
+    printSizeRow(report.unattributed, "<unattributed>", 14);
+    printf("\n");
+
+    printf("Packages:\n");
+    for (int i = 0; i < kSizeCategoryCount; i++)
+        printf("%10s ", gSizeCategoryNames[i]);
+    printf("%10s  %s\n", "total", "package");
+    dumpPackageSizes(pDexFile, &report);
+    printf("\n");
+
+    free(report.codeSizes);
+    free(report.classBytes);
+    free(report.owners);
+}
+
+/*
+ * A run of code_items with the same hash in a DexCodeHashTable.
+ */
+struct DupCodeGroup {
+    u4  start;          /* first entry in the table */
+    u4  end;
+    u4  copies;         /* distinct code_items */
+    u4  savings;        /* bytes freed by keeping only the largest */
+};
+
+static int compareDupCodeGroups(const void* a, const void* b)
+{
+    const DupCodeGroup* pGroupA = (const DupCodeGroup*) a;
+    const DupCodeGroup* pGroupB = (const DupCodeGroup*) b;
+
+    if (pGroupA->savings != pGroupB->savings)
+        return (pGroupA->savings < pGroupB->savings) ? 1 : -1;
+    return (pGroupA->start > pGroupB->start) - (pGroupA->start < pGroupB->start);
+}
+
+/*
+ * Report groups of methods whose code hashes the same, largest savings
+ * first.  Methods already sharing one code_item count as one copy.
+ */
+void dumpDuplicateCode(const DexFile* pDexFile, DexCodeHashMode mode)
+{
+    DexCodeHashTable* pTable =
+        dexCodeHashTableCreate(pDexFile, mode, dexGetDefaultThreadCount());
+    DupCodeGroup* groups = NULL;
+    u4 groupCount = 0;
+    u4 dupCount = 0;
+    u8 totalSavings = 0;
+
+    if (pTable == NULL) {
+        fprintf(stderr, "ERROR: unable to hash code\n");
+        return;
+    }
+
+    groups = (DupCodeGroup*) malloc((pTable->count / 2 + 1) *
+        sizeof(DupCodeGroup));
+    if (groups == NULL) {
+        fprintf(stderr, "ERROR: out of memory\n");
+        goto bail;
+    }
+
+    for (u4 start = 0, end; start < pTable->count; start = end) {
+        const DexCodeHashEntry* entries = pTable->entries;
+        u4 copies = 1;
+        u4 totalSize = entries[start].codeSize;
+        u4 largest = entries[start].codeSize;
+
+        for (end = start + 1;
+                end < pTable->count && entries[end].hash == entries[start].hash;
+                end++) {
+            if (entries[end].codeOff == entries[end - 1].codeOff)
+                continue;
+            copies++;
+            totalSize += entries[end].codeSize;
+            if (entries[end].codeSize > largest)
+                largest = entries[end].codeSize;
+        }
+
+        if (copies > 1) {
+            DupCodeGroup* pGroup = &groups[groupCount++];
+            pGroup->start = start;
+            pGroup->end = end;
+            pGroup->copies = copies;
+            pGroup->savings = totalSize - largest;
+            dupCount += copies - 1;
+            totalSavings += pGroup->savings;
+        }
+    }
+    qsort(groups, groupCount, sizeof(DupCodeGroup), compareDupCodeGroups);
+
+    printf("Duplicate code (%s):\n",
+        (mode == kDexCodeHashExact) ? "exact" : "indices normalized");
+    printf("  %u methods with code, %u groups, %u duplicate code_items, "
+        "%" PRIu64 " bytes\n",
+        pTable->count, groupCount, dupCount, totalSavings);
+
+    for (u4 i = 0; i < groupCount; i++) {
+        const DupCodeGroup* pGroup = &groups[i];
+
+        printf("\n  %u copies, %u bytes (hash %016" PRIx64 "):\n",
+            pGroup->copies, pGroup->savings,
+            pTable->entries[pGroup->start].hash);
+        for (u4 j = pGroup->start; j < pGroup->end; j++) {
+            const DexCodeHashEntry* pEntry = &pTable->entries[j];
+            const DexMethodId* pMethodId =
+                dexGetMethodId(pDexFile, pEntry->methodIdx);
+
+            printf("    0x%06x %5u  %s.%s%s\n", pEntry->codeOff,
+                pEntry->codeSize,
+                dexStringByTypeIdx(pDexFile, pMethodId->classIdx),
+                dexStringById(pDexFile, pMethodId->nameIdx),
+                dexProtoTableGet(pDexFile->pProtoTable, pMethodId->protoIdx));
+        }
+    }
+    printf("\n");
+
+bail:
+    free(groups);
+    dexCodeHashTableFree(pTable);
+}
+
+/*
+ * Touch the parts of the file the VM reads when it loads a class and
+ * links its members: the class_def, descriptors, interfaces, static
+ * values, class_data, member ids and names, protos and whole code_items.
+ */
+static void replayClassLoad(const DexFile* pDexFile, const DexClassDef* pClassDef)
+{
+    dexGetClassDescriptor(pDexFile, pClassDef);
+    dexGetSuperClassDescriptor(pDexFile, pClassDef);
+    dexGetSourceFile(pDexFile, pClassDef);
+    dexGetStaticValuesList(pDexFile, pClassDef);
+
+    const DexTypeList* pInterfaces = dexGetInterfacesList(pDexFile, pClassDef);
+    if (pInterfaces != NULL) {
+        dexPageTraceRecord(pDexFile->pPageTrace, pInterfaces,
+            sizeof(u4) + pInterfaces->size * sizeof(DexTypeItem));
+        for (u4 i = 0; i < pInterfaces->size; i++)
+            dexStringByTypeIdx(pDexFile, dexTypeListGetIdx(pInterfaces, i));
+    }
+
+    const u1* pEncodedData = dexGetClassData(pDexFile, pClassDef);
+    if (pEncodedData == NULL)
+        return;
+
+    const u1* pStart = pEncodedData;
+    DexClassData* pClassData = dexReadAndVerifyClassData(&pEncodedData, NULL);
+    if (pClassData == NULL)
+        return;
+    dexPageTraceRecord(pDexFile->pPageTrace, pStart, pEncodedData - pStart);
+
+    u4 fieldCount = pClassData->header.staticFieldsSize +
+        pClassData->header.instanceFieldsSize;
+    for (u4 i = 0; i < fieldCount; i++) {
+        const DexField* pField = (i < pClassData->header.staticFieldsSize) ?
+            &pClassData->staticFields[i] :
+            &pClassData->instanceFields[i - pClassData->header.staticFieldsSize];
+        const DexFieldId* pFieldId = dexGetFieldId(pDexFile, pField->fieldIdx);
+
+        dexStringById(pDexFile, pFieldId->nameIdx);
+        dexStringByTypeIdx(pDexFile, pFieldId->typeIdx);
+    }
+
+    u4 methodCount = pClassData->header.directMethodsSize +
+        pClassData->header.virtualMethodsSize;
+    for (u4 i = 0; i < methodCount; i++) {
+        const DexMethod* pMethod = (i < pClassData->header.directMethodsSize) ?
+            &pClassData->directMethods[i] :
+            &pClassData->virtualMethods[i - pClassData->header.directMethodsSize];
+        const DexMethodId* pMethodId = dexGetMethodId(pDexFile, pMethod->methodIdx);
+        const DexProtoId* pProtoId = dexGetProtoId(pDexFile, pMethodId->protoIdx);
+
+        dexStringById(pDexFile, pMethodId->nameIdx);
+        dexStringById(pDexFile, pProtoId->shortyIdx);
+        const DexTypeList* pParams = dexGetProtoParameters(pDexFile, pProtoId);
+        if (pParams != NULL) {
+            dexPageTraceRecord(pDexFile->pPageTrace, pParams,
+                sizeof(u4) + pParams->size * sizeof(DexTypeItem));
+        }
+
+        const DexCode* pCode = dexGetCode(pDexFile, pMethod);
+        if (pCode != NULL)
+            dexPageTraceRecord(pDexFile->pPageTrace, pCode, dexGetDexCodeSize(pCode));
+    }
+
+    free(pClassData);
+}
+
+/*
+ * Replay a list of class loads, one descriptor per line, and report the
+ * pages of the file that get touched.  Blank lines and lines starting
+ * with '#' are ignored; dotted names ("java.lang.String") are accepted.
+ */
+void dumpPageTraceReplay(DexFile* pDexFile, const char* classListFileName)
+{
+    DexClassLookup* pLookup = NULL;
+    DexPageTrace* pTrace = NULL;
+    FILE* fp;
+    char line[1024];
+    char descriptor[1024 + 3];
+
+    fp = fopen(classListFileName, "r");
+    if (fp == NULL) {
+        fprintf(stderr, "ERROR: unable to open '%s': %s\n",
+            classListFileName, strerror(errno));
+        return;
+    }
+
+#if !defined(DEX_PAGE_TRACE)
+    fprintf(stderr,
+        "WARNING: built without DEX_PAGE_TRACE; only class_data and code\n"
+        "         ranges will be recorded\n");
+#endif
+
+    /*
+     * dexFindClass() needs a class lookup table.  Build one before the
+     * trace starts if the file didn't come with one; the VM gets it
+     * from the optimized file.
+     */
+    if (pDexFile->pClassLookup == NULL) {
+        pLookup = dexCreateClassLookup(pDexFile);
+        if (pLookup == NULL)
+            goto bail;
+        pDexFile->pClassLookup = pLookup;
+    }
+
+    pTrace = dexPageTraceCreate(pDexFile);
+    if (pTrace == NULL) {
+        fprintf(stderr, "ERROR: unable to create page trace\n");
+        goto bail;
+    }
+    pDexFile->pPageTrace = pTrace;
+
+    printf("Class replay:\n");
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        char* start = line;
+        char* end;
+
+        while (*start == ' ' || *start == '\t')
+            start++;
+        end = start + strlen(start);
+        while (end > start && (end[-1] == '\n' || end[-1] == '\r' ||
+                end[-1] == ' ' || end[-1] == '\t'))
+            *--end = '\0';
+        if (*start == '\0' || *start == '#')
+            continue;
+
+        if (start[0] == 'L' || start[0] == '[') {
+            strcpy(descriptor, start);
+        } else {
+            /* dotted class name */
+            char* cp = descriptor;
+            *cp++ = 'L';
+            for (const char* from = start; *from != '\0'; from++)
+                *cp++ = (*from == '.') ? '/' : *from;
+            *cp++ = ';';
+            *cp = '\0';
+        }
+
+        u4 pagesBefore = pTrace->touchCount;
+        const DexClassDef* pClassDef = dexFindClass(pDexFile, descriptor);
+        if (pClassDef == NULL) {
+            printf("  %s : not found\n", descriptor);
+            continue;
+        }
+        replayClassLoad(pDexFile, pClassDef);
+        printf("  %s : +%u pages\n", descriptor, pTrace->touchCount - pagesBefore);
+    }
+    printf("\n");
+
+    dexPageTraceDump(pTrace, stdout, false);
+
+bail:
+    pDexFile->pPageTrace = NULL;
+    dexPageTraceFree(pTrace);
+    if (pLookup != NULL) {
+        pDexFile->pClassLookup = NULL;
+        free(pLookup);
+    }
+    fclose(fp);
+}
+
+/*
+ * ===========================================================================
+ *      Structured export (-l jsonl, -l columnar)
+ * ===========================================================================
+ */
+
+/*
+ * The instruction index types that name something in the file, mapped
+ * to the export's reference kinds.  Returns 0 for everything else.
+ */
+static u1 refKindFromIndexType(InstructionIndexType indexType)
+{
+    switch (indexType) {
+    case kIndexStringRef:           return kDexColRefString;
+    case kIndexTypeRef:             return kDexColRefType;
+    case kIndexFieldRef:            return kDexColRefField;
+    case kIndexMethodRef:
+    case kIndexMethodAndProtoRef:   return kDexColRefMethod;
+    case kIndexCallSiteRef:         return kDexColRefCallSite;
+    case kIndexMethodHandleRef:     return kDexColRefMethodHandle;
+    case kIndexProtoRef:            return kDexColRefProto;
+    default:                        return 0;
+    }
+}
+
+/*
+ * One reference made by an instruction.
+ */
+struct CodeRef {
+    u4      dexPc;
+    u4      targetIdx;
+    u2      opcode;
+    u1      kind;
+};
+
+typedef void (*CodeRefFunc)(void* arg, const CodeRef* pRef);
+
+/*
+ * Call "func" for each reference made by the instructions in "pCode".
+ * invoke-polymorphic(/range) reports its method and its proto as two
+ * references; invoke-custom(/range) reports its call site.
+ */
+static void forEachCodeRef(const DexCode* pCode, CodeRefFunc func, void* arg)
+{
+    const u2* insns = pCode->insns;
+    u4 insnIdx = 0;
+
+    while (insnIdx < pCode->insnsSize) {
+        Opcode opcode = dexOpcodeFromCodeUnit(insns[insnIdx]);
+        size_t width = dexGetWidthFromInstruction(&insns[insnIdx]);
+        u1 kind;
+
+        if (width == 0)
+            break;
+
+        /* payloads decode as nop, which has no index */
+        kind = refKindFromIndexType(dexGetIndexTypeFromOpcode(opcode));
+        if (kind != 0) {
+            DecodedInstruction decInsn;
+            CodeRef ref;
+
+            dexDecodeInstruction(&insns[insnIdx], &decInsn);
+            ref.dexPc = insnIdx;
+            ref.opcode = opcode;
+            ref.kind = kind;
+            switch (dexGetFormatFromOpcode(opcode)) {
+            case kFmt22c:
+            case kFmt22cs:
+                ref.targetIdx = decInsn.vC;
+                break;
+            default:
+                ref.targetIdx = decInsn.vB;
+                break;
+            }
+            (*func)(arg, &ref);
+
+            if (decInsn.indexType == kIndexMethodAndProtoRef) {
+                ref.targetIdx = decInsn.arg[4];
+                ref.kind = kDexColRefProto;
+                (*func)(arg, &ref);
+            }
+        }
+        insnIdx += width;
+    }
+}
+
+/*
+ * Write a MUTF-8 string as a JSON string literal.  Printable ASCII is
+ * written as-is; everything else is escaped as UTF-16 code units, which
+ * is also how JSON represents supplementary characters.
+ */
+static void printJsonString(const char* str)
+{
+    putchar('"');
+    while (*str != '\0') {
+        unsigned char ch = *str;
+
+        if (ch >= 0x20 && ch < 0x7f) {
+            if (ch == '"' || ch == '\\')
+                putchar('\\');
+            putchar(ch);
+            str++;
+        } else {
+            printf("\\u%04x", dexGetUtf16FromUtf8(&str));
+        }
+    }
+    putchar('"');
+}
+
+static void printJsonTypeOrNull(const DexFile* pDexFile, u4 typeIdx)
+{
+    if (typeIdx == kDexNoIndex)
+        printf("null");
+    else
+        printJsonString(dexStringByTypeIdx(pDexFile, typeIdx));
+}
+
+static const char* gRefKindNames[] = {
+    NULL, "string", "type", "field", "method", "proto", "call_site",
+    "method_handle",
+};
+
+/*
+ * Write a "ref" record.  Names are resolved for the kinds that have one.
+ */
+static void printJsonRef(void* arg, const CodeRef* pRef)
+{
+    const DexFile* pDexFile = (const DexFile*) arg;
+    const DexFieldId* pFieldId;
+    const DexMethodId* pMethodId;
+
+    printf("{\"type\":\"ref\",\"pc\":%u,\"opcode\":\"%s\",\"kind\":\"%s\","
+        "\"idx\":%u", pRef->dexPc, dexGetOpcodeName((Opcode) pRef->opcode),
+        gRefKindNames[pRef->kind], pRef->targetIdx);
+
+    switch (pRef->kind) {
+    case kDexColRefString:
+        if (pRef->targetIdx < pDexFile->pHeader->stringIdsSize) {
+            printf(",\"value\":");
+            printJsonString(dexStringById(pDexFile, pRef->targetIdx));
+        }
+        break;
+    case kDexColRefType:
+        if (pRef->targetIdx < pDexFile->pHeader->typeIdsSize) {
+            printf(",\"descriptor\":");
+            printJsonString(dexStringByTypeIdx(pDexFile, pRef->targetIdx));
+        }
+        break;
+    case kDexColRefField:
+        if (pRef->targetIdx < pDexFile->pHeader->fieldIdsSize) {
+            pFieldId = dexGetFieldId(pDexFile, pRef->targetIdx);
+            printf(",\"class\":");
+            printJsonString(dexStringByTypeIdx(pDexFile, pFieldId->classIdx));
+            printf(",\"name\":");
+            printJsonString(dexStringById(pDexFile, pFieldId->nameIdx));
+            printf(",\"fieldType\":");
+            printJsonString(dexStringByTypeIdx(pDexFile, pFieldId->typeIdx));
+        }
+        break;
+    case kDexColRefMethod:
+        if (pRef->targetIdx < pDexFile->pHeader->methodIdsSize) {
+            pMethodId = dexGetMethodId(pDexFile, pRef->targetIdx);
+            printf(",\"class\":");
+            printJsonString(dexStringByTypeIdx(pDexFile, pMethodId->classIdx));
+            printf(",\"name\":");
+            printJsonString(dexStringById(pDexFile, pMethodId->nameIdx));
+            printf(",\"descriptor\":");
+            printJsonString(dexProtoTableGet(pDexFile->pProtoTable,
+                pMethodId->protoIdx));
+        }
+        break;
+    case kDexColRefProto:
+        if (pRef->targetIdx < pDexFile->pHeader->protoIdsSize) {
+            printf(",\"descriptor\":");
+            printJsonString(dexProtoTableGet(pDexFile->pProtoTable,
+                pRef->targetIdx));
+        }
+        break;
+    default:
+        break;
+    }
+    printf("}\n");
+}
 
-    if (gOptions.verbose)
-        printf("Processing '%s'...\n", fileName);
+static void printJsonField(const DexFile* pDexFile, const DexField* pField,
+    u4 classDefIdx, bool isStatic)
+{
+    const DexFieldId* pFieldId = dexGetFieldId(pDexFile, pField->fieldIdx);
+
+    printf("{\"type\":\"field\",\"classDef\":%u,\"idx\":%u,\"name\":",
+        classDefIdx, pField->fieldIdx);
+    printJsonString(dexStringById(pDexFile, pFieldId->nameIdx));
+    printf(",\"fieldType\":");
+    printJsonString(dexStringByTypeIdx(pDexFile, pFieldId->typeIdx));
+    printf(",\"access\":%u,\"static\":%s}\n", pField->accessFlags,
+        isStatic ? "true" : "false");
+}
 
-    if (dexOpenAndMap(fileName, gOptions.tempFileName, &map, false) != 0) {
-        return result;
+static void printJsonMethod(const DexFile* pDexFile, const DexMethod* pMethod,
+    u4 classDefIdx, bool isDirect)
+{
+    const DexMethodId* pMethodId = dexGetMethodId(pDexFile, pMethod->methodIdx);
+    const DexCode* pCode = dexGetCode(pDexFile, pMethod);
+
+    printf("{\"type\":\"method\",\"classDef\":%u,\"idx\":%u,\"name\":",
+        classDefIdx, pMethod->methodIdx);
+    printJsonString(dexStringById(pDexFile, pMethodId->nameIdx));
+    printf(",\"descriptor\":");
+    printJsonString(dexProtoTableGet(pDexFile->pProtoTable,
+        pMethodId->protoIdx));
+    printf(",\"access\":%u,\"direct\":%s", pMethod->accessFlags,
+        isDirect ? "true" : "false");
+    if (pCode != NULL) {
+        printf(",\"codeOff\":%u,\"insnsSize\":%u,\"registers\":%u,"
+            "\"ins\":%u,\"outs\":%u", pMethod->codeOff, pCode->insnsSize,
+            pCode->registersSize, pCode->insSize, pCode->outsSize);
     }
-    mapped = true;
+    printf("}\n");
+
+    /* the refs of a method follow it directly */
+    if (pCode != NULL)
+        forEachCodeRef(pCode, printJsonRef, (void*) pDexFile);
+}
+
+/*
+ * Export the file as JSON Lines: one self-contained object per line,
+ * each with a "type" member.  A "file" record comes first, then the
+ * strings, then each class followed by its fields and methods, each
+ * method followed by the references its code makes.
+ */
+static bool dumpJsonl(const char* fileName, DexFile* pDexFile)
+{
+    const DexHeader* pHeader = pDexFile->pHeader;
+
+    printf("{\"type\":\"file\",\"name\":");
+    printJsonString(fileName);
+    printf(",\"version\":\"%.3s\",\"checksum\":%u,\"signature\":\"",
+        pHeader->magic + 4, pHeader->checksum);
+    for (int i = 0; i < kSHA1DigestLen; i++)
+        printf("%02x", pHeader->signature[i]);
+    printf("\",\"strings\":%u,\"types\":%u,\"protos\":%u,\"fields\":%u,"
+        "\"methods\":%u,\"classDefs\":%u}\n",
+        pHeader->stringIdsSize, pHeader->typeIdsSize, pHeader->protoIdsSize,
+        pHeader->fieldIdsSize, pHeader->methodIdsSize, pHeader->classDefsSize);
+
+    for (u4 i = 0; i < pHeader->stringIdsSize; i++) {
+        printf("{\"type\":\"string\",\"idx\":%u,\"value\":", i);
+        printJsonString(dexStringById(pDexFile, i));
+        printf("}\n");
+    }
+
+    for (u4 i = 0; i < pHeader->classDefsSize; i++) {
+        DexArenaMark mark = dexArenaMark(&gArena);
+        const DexClassDef* pClassDef = dexGetClassDef(pDexFile, i);
+        const DexTypeList* pInterfaces = dexGetInterfacesList(pDexFile, pClassDef);
+        const u1* pEncodedData = dexGetClassData(pDexFile, pClassDef);
+        DexClassData* pClassData = NULL;
+
+        if (pEncodedData != NULL) {
+            pClassData = dexReadAndVerifyClassDataInArena(&pEncodedData, NULL,
+                &gArena);
+            if (pClassData == NULL) {
+                fprintf(stderr, "Trouble reading class data (#%u)\n", i);
+                return false;
+            }
+        }
+
+        printf("{\"type\":\"class\",\"idx\":%u,\"descriptor\":", i);
+        printJsonString(dexStringByTypeIdx(pDexFile, pClassDef->classIdx));
+        printf(",\"access\":%u,\"superclass\":", pClassDef->accessFlags);
+        printJsonTypeOrNull(pDexFile, pClassDef->superclassIdx);
+        printf(",\"sourceFile\":");
+        if (pClassDef->sourceFileIdx == kDexNoIndex)
+            printf("null");
+        else
+            printJsonString(dexStringById(pDexFile, pClassDef->sourceFileIdx));
+        printf(",\"interfaces\":[");
+        if (pInterfaces != NULL) {
+            for (u4 j = 0; j < pInterfaces->size; j++) {
+                if (j != 0)
+                    putchar(',');
+                printJsonString(dexStringByTypeIdx(pDexFile,
+                    dexTypeListGetIdx(pInterfaces, j)));
+            }
+        }
+        printf("]}\n");
+
+        if (pClassData != NULL) {
+            const DexClassDataHeader* pDataHeader = &pClassData->header;
+            for (u4 j = 0; j < pDataHeader->staticFieldsSize; j++)
+                printJsonField(pDexFile, &pClassData->staticFields[j], i, true);
+            for (u4 j = 0; j < pDataHeader->instanceFieldsSize; j++)
+                printJsonField(pDexFile, &pClassData->instanceFields[j], i, false);
+            for (u4 j = 0; j < pDataHeader->directMethodsSize; j++)
+                printJsonMethod(pDexFile, &pClassData->directMethods[j], i, true);
+            for (u4 j = 0; j < pDataHeader->virtualMethodsSize; j++)
+                printJsonMethod(pDexFile, &pClassData->virtualMethods[j], i, false);
+        }
+        dexArenaRelease(&gArena, mark);
+    }
+
+    return ferror(stdout) == 0;
+}
+
+/*
+ * Growable array of fixed-size rows.
+ */
+struct ColRows {
+    u1*     data;
+    u4      count;
+    u4      capacity;
+    u4      rowSize;
+};
+
+static void* addColRow(ColRows* pRows)
+{
+    if (pRows->count == pRows->capacity) {
+        u4 newCapacity = (pRows->capacity == 0) ? 256 : pRows->capacity * 2;
+        u1* newData = (u1*) realloc(pRows->data,
+            (size_t) newCapacity * pRows->rowSize);
+        if (newData == NULL) {
+            fprintf(stderr, "ERROR: out of memory\n");
+            exit(1);
+        }
+        pRows->data = newData;
+        pRows->capacity = newCapacity;
+    }
+    return pRows->data + (size_t) pRows->count++ * pRows->rowSize;
+}
+
+/*
+ * Output state for the columnar export.  "pos" tracks the file offset
+ * so stdout needn't be seekable.
+ */
+struct ColWriter {
+    FILE*               fp;
+    u8                  pos;
+    DexColTableEntry    tables[kDexColTableRefs];
+    u4                  tableCount;
+    ColRows             fields;
+    ColRows             methods;
+    ColRows             refs;
+};
+
+static void colWrite(ColWriter* pWriter, const void* data, size_t len)
+{
+    fwrite(data, 1, len, pWriter->fp);
+    pWriter->pos += len;
+}
+
+static void colAlign(ColWriter* pWriter)
+{
+    static const u1 kZeroes[8] = { 0 };
+    size_t pad = (size_t) (-pWriter->pos & 7);
+
+    colWrite(pWriter, kZeroes, pad);
+}
+
+/*
+ * Start a table at the current (aligned) position.  The row count is
+ * filled in by endColTable().
+ */
+static void beginColTable(ColWriter* pWriter, u4 tableId, u4 rowSize)
+{
+    DexColTableEntry* pEntry = &pWriter->tables[pWriter->tableCount++];
+
+    colAlign(pWriter);
+    pEntry->tableId = tableId;
+    pEntry->rowSize = rowSize;
+    pEntry->offset = pWriter->pos;
+    pEntry->rowCount = 0;
+}
+
+static void endColTable(ColWriter* pWriter)
+{
+    DexColTableEntry* pEntry = &pWriter->tables[pWriter->tableCount - 1];
+
+    pEntry->rowCount = (pWriter->pos - pEntry->offset) / pEntry->rowSize;
+}
+
+static void writeColRows(ColWriter* pWriter, u4 tableId, const ColRows* pRows)
+{
+    beginColTable(pWriter, tableId, pRows->rowSize);
+    colWrite(pWriter, pRows->data, (size_t) pRows->count * pRows->rowSize);
+    endColTable(pWriter);
+}
+
+static void addColField(ColWriter* pWriter, const DexField* pField,
+    u4 classDefIdx)
+{
+    DexColField* pRow = (DexColField*) addColRow(&pWriter->fields);
+
+    pRow->fieldIdx = pField->fieldIdx;
+    pRow->classDefIdx = classDefIdx;
+    pRow->accessFlags = pField->accessFlags;
+}
+
+static void addColRef(void* arg, const CodeRef* pRef)
+{
+    ColWriter* pWriter = (ColWriter*) arg;
+    DexColRef* pRow = (DexColRef*) addColRow(&pWriter->refs);
+
+    pRow->methodRow = pWriter->methods.count - 1;
+    pRow->dexPc = pRef->dexPc;
+    pRow->targetIdx = pRef->targetIdx;
+    pRow->opcode = pRef->opcode;
+    pRow->kind = pRef->kind;
+    pRow->reserved = 0;
+}
+
+static void addColMethod(ColWriter* pWriter, const DexFile* pDexFile,
+    const DexMethod* pMethod, u4 classDefIdx)
+{
+    DexColMethod* pRow = (DexColMethod*) addColRow(&pWriter->methods);
+    const DexCode* pCode = dexGetCode(pDexFile, pMethod);
+
+    memset(pRow, 0, sizeof(*pRow));
+    pRow->methodIdx = pMethod->methodIdx;
+    pRow->classDefIdx = classDefIdx;
+    pRow->accessFlags = pMethod->accessFlags;
+    pRow->codeOff = pMethod->codeOff;
+    pRow->firstRef = pWriter->refs.count;
+    if (pCode != NULL) {
+        pRow->insnsSize = pCode->insnsSize;
+        pRow->registersSize = pCode->registersSize;
+        pRow->insSize = pCode->insSize;
+        forEachCodeRef(pCode, addColRef, pWriter);
+    }
+    pRow->refCount = pWriter->refs.count - pRow->firstRef;
+}
+
+/*
+ * Export the file in the columnar format described in DexColumnar.h.
+ *
+ * The id tables and classes are streamed out as they're visited; the
+ * fields, methods and refs are collected during the same walk over the
+ * class data and written after it.
+ */
+static bool dumpColumnar(DexFile* pDexFile)
+{
+    const DexHeader* pHeader = pDexFile->pHeader;
+    ColWriter writer;
+    DexColHeader colHeader;
+    DexColTrailer trailer;
+    DexColString* stringRows = NULL;
+    DexColProto* protoRows = NULL;
+    bool result = false;
+
+    memset(&writer, 0, sizeof(writer));
+    writer.fp = stdout;
+    writer.fields.rowSize = sizeof(DexColField);
+    writer.methods.rowSize = sizeof(DexColMethod);
+    writer.refs.rowSize = sizeof(DexColRef);
+
+    stringRows = (DexColString*) malloc(
+        pHeader->stringIdsSize * sizeof(DexColString) + 1);
+    protoRows = (DexColProto*) malloc(
+        pHeader->protoIdsSize * sizeof(DexColProto) + 1);
+    if (stringRows == NULL || protoRows == NULL) {
+        fprintf(stderr, "ERROR: out of memory\n");
+        goto bail;
+    }
+
+    memset(&colHeader, 0, sizeof(colHeader));
+    memcpy(colHeader.magic, kDexColMagic, sizeof(colHeader.magic));
+    colHeader.version = kDexColVersion;
+    colHeader.dexChecksum = pHeader->checksum;
+    memcpy(colHeader.dexSignature, pHeader->signature, kSHA1DigestLen);
+    colHeader.endianTag = kDexEndianConstant;
+    colWrite(&writer, &colHeader, sizeof(colHeader));
+
+    /* string contents, then proto descriptors */
+    beginColTable(&writer, kDexColTablePool, 1);
+    for (u4 i = 0; i < pHeader->stringIdsSize; i++) {
+        u4 utf16Size;
+        const char* str = dexStringAndSizeById(pDexFile, i, &utf16Size);
+
+        stringRows[i].poolOff = (u4) (writer.pos - writer.tables[0].offset);
+        stringRows[i].utf16Size = utf16Size;
+        colWrite(&writer, str, strlen(str) + 1);
+    }
+    for (u4 i = 0; i < pHeader->protoIdsSize; i++) {
+        const DexProtoId* pProtoId = dexGetProtoId(pDexFile, i);
+        const char* descriptor = dexProtoTableGet(pDexFile->pProtoTable, i);
+        DexProto proto;
+
+        proto.dexFile = pDexFile;
+        proto.protoIdx = i;
+        protoRows[i].descriptorPoolOff =
+            (u4) (writer.pos - writer.tables[0].offset);
+        protoRows[i].shortyIdx = pProtoId->shortyIdx;
+        protoRows[i].returnTypeIdx = pProtoId->returnTypeIdx;
+        protoRows[i].parameterCount = dexProtoGetParameterCount(&proto);
+        colWrite(&writer, descriptor, strlen(descriptor) + 1);
+    }
+    endColTable(&writer);
+
+    beginColTable(&writer, kDexColTableStrings, sizeof(DexColString));
+    colWrite(&writer, stringRows, pHeader->stringIdsSize * sizeof(DexColString));
+    endColTable(&writer);
+
+    beginColTable(&writer, kDexColTableTypes, sizeof(DexColType));
+    for (u4 i = 0; i < pHeader->typeIdsSize; i++) {
+        DexColType row;
+        row.descriptorIdx = dexGetTypeId(pDexFile, i)->descriptorIdx;
+        colWrite(&writer, &row, sizeof(row));
+    }
+    endColTable(&writer);
+
+    beginColTable(&writer, kDexColTableProtos, sizeof(DexColProto));
+    colWrite(&writer, protoRows, pHeader->protoIdsSize * sizeof(DexColProto));
+    endColTable(&writer);
+
+    beginColTable(&writer, kDexColTableClasses, sizeof(DexColClass));
+    for (u4 i = 0; i < pHeader->classDefsSize; i++) {
+        DexArenaMark mark = dexArenaMark(&gArena);
+        const DexClassDef* pClassDef = dexGetClassDef(pDexFile, i);
+        const DexTypeList* pInterfaces = dexGetInterfacesList(pDexFile, pClassDef);
+        const u1* pEncodedData = dexGetClassData(pDexFile, pClassDef);
+        DexClassData* pClassData = NULL;
+        DexColClass row;
+
+        if (pEncodedData != NULL) {
+            pClassData = dexReadAndVerifyClassDataInArena(&pEncodedData, NULL,
+                &gArena);
+            if (pClassData == NULL) {
+                fprintf(stderr, "Trouble reading class data (#%u)\n", i);
+                goto bail;
+            }
+        }
+
+        row.classIdx = pClassDef->classIdx;
+        row.accessFlags = pClassDef->accessFlags;
+        row.superclassIdx = pClassDef->superclassIdx;
+        row.sourceFileIdx = pClassDef->sourceFileIdx;
+        row.interfaceCount = (pInterfaces != NULL) ? pInterfaces->size : 0;
+        row.firstField = writer.fields.count;
+        row.firstMethod = writer.methods.count;
+
+        if (pClassData != NULL) {
+            const DexClassDataHeader* pDataHeader = &pClassData->header;
+            for (u4 j = 0; j < pDataHeader->staticFieldsSize; j++)
+                addColField(&writer, &pClassData->staticFields[j], i);
+            for (u4 j = 0; j < pDataHeader->instanceFieldsSize; j++)
+                addColField(&writer, &pClassData->instanceFields[j], i);
+            for (u4 j = 0; j < pDataHeader->directMethodsSize; j++)
+                addColMethod(&writer, pDexFile, &pClassData->directMethods[j], i);
+            for (u4 j = 0; j < pDataHeader->virtualMethodsSize; j++)
+                addColMethod(&writer, pDexFile, &pClassData->virtualMethods[j], i);
+        }
+
+        row.fieldCount = writer.fields.count - row.firstField;
+        row.methodCount = writer.methods.count - row.firstMethod;
+        colWrite(&writer, &row, sizeof(row));
+        dexArenaRelease(&gArena, mark);
+    }
+    endColTable(&writer);
+
+    writeColRows(&writer, kDexColTableFields, &writer.fields);
+    writeColRows(&writer, kDexColTableMethods, &writer.methods);
+    writeColRows(&writer, kDexColTableRefs, &writer.refs);
+
+    colAlign(&writer);
+    memset(&trailer, 0, sizeof(trailer));
+    trailer.directoryOffset = writer.pos;
+    trailer.tableCount = writer.tableCount;
+    memcpy(trailer.magic, kDexColMagic, sizeof(trailer.magic));
+    colWrite(&writer, writer.tables, writer.tableCount * sizeof(DexColTableEntry));
+    colWrite(&writer, &trailer, sizeof(trailer));
+
+    if (fflush(stdout) != 0 || ferror(stdout)) {
+        fprintf(stderr, "ERROR: write failed: %s\n", strerror(errno));
+        goto bail;
+    }
+    result = true;
+
+bail:
+    free(stringRows);
+    free(protoRows);
+    free(writer.fields.data);
+    free(writer.methods.data);
+    free(writer.refs.data);
+    return result;
+}
+
+/*
+ * Dump the requested sections of the file.
+ */
+void processDexFile(const char* fileName, DexFile* pDexFile)
+{
+    char* package = NULL;
+    int i;
+
+    if (gOptions.verbose) {
+        printf("Opened '%s', DEX version '%.3s'\n", fileName,
+            pDexFile->pHeader->magic +4);
+    }
+
+    if (gOptions.dumpRegisterMaps) {
+        dumpRegisterMaps(pDexFile);
+        return;
+    }
+
+    if (gOptions.sizeReport) {
+        dumpSizeReport(pDexFile);
+        return;
+    }
+
+    if (gOptions.dupCodeReport) {
+        dumpDuplicateCode(pDexFile, gOptions.dupCodeMode);
+        return;
+    }
+
+    if (gOptions.pageTraceClassList != NULL) {
+        dumpPageTraceReplay(pDexFile, gOptions.pageTraceClassList);
+        return;
+    }
+
+    if (gOptions.showFileHeaders) {
+        dumpFileHeader(pDexFile);
+        dumpOptDirectory(pDexFile);
+    }
+
+    dotNameCacheInit(pDexFile);
+
+    if (gOptions.outputFormat == OUTPUT_XML)
+        printf("<api>\n");
+
+    for (i = 0; i < (int) pDexFile->pHeader->classDefsSize; i++) {
+        DexArenaMark mark = dexArenaMark(&gArena);
+
+        if (gOptions.showSectionHeaders)
+            dumpClassDef(pDexFile, i);
+
+        dumpClass(pDexFile, i, &package);
+        dexArenaRelease(&gArena, mark);
+    }
+
+    dumpMethodHandles(pDexFile);
+    dumpCallSites(pDexFile);
+
+    if (gOptions.staticValues && gOptions.outputFormat == OUTPUT_PLAIN)
+        dumpStaticValueSummary(pDexFile);
+
+    /* free the last one allocated */
+    if (package != NULL) {
+        printf("</package>\n");
+        free(package);
+    }
+
+    if (gOptions.outputFormat == OUTPUT_XML)
+        printf("</api>\n");
+
+    dotNameCacheFree();
+}
+
+
+/*
+ * Map and parse one file.  On failure, returns NULL with nothing left
+ * mapped.
+ */
+static DexFile* openDexFile(const char* fileName, MemMapping* pMap)
+{
+    DexFile* pDexFile;
+
+    /* -c reads the whole file once and exits; stream it in up front */
+    int mapFlags = gOptions.checksumOnly ? kDexMapVerifyOnce : kDexMapDefault;
+    if (dexOpenAndMapWithOptions(fileName, gOptions.tempFileName, mapFlags,
+            pMap, false) != 0)
+        return NULL;
 
     int flags = kDexParseVerifyChecksum;
     if (gOptions.ignoreBadChecksum)
         flags |= kDexParseContinueOnError;
+    if (gOptions.verifySignature)
+        flags |= kDexParseVerifySignature;
 
-    pDexFile = dexFileParse((u1*)map.addr, map.length, flags);
+    pDexFile = dexFileParse((u1*)pMap->addr, pMap->length, flags);
     if (pDexFile == NULL) {
         fprintf(stderr, "ERROR: DEX parse failed\n");
+        sysReleaseShmem(pMap);
+    }
+    return pDexFile;
+}
+
+/*
+ * Process one file.
+ */
+int process(const char* fileName)
+{
+    DexFile* pDexFile = NULL;
+    MemMapping map;
+    bool mapped = false;
+    int result = -1;
+
+    if (gOptions.verbose)
+        printf("Processing '%s'...\n", fileName);
+
+    pDexFile = openDexFile(fileName, &map);
+    if (pDexFile == NULL)
+        return result;
+    mapped = true;
+
+    /* every method descriptor gets printed, so build them all up front */
+    if (!gOptions.checksumOnly &&
+        !dexFileAttachProtoTable(pDexFile, dexGetDefaultThreadCount())) {
+        fprintf(stderr, "ERROR: unable to build proto table\n");
         goto bail;
     }
 
     if (gOptions.checksumOnly) {
-        printf("Checksum verified\n");
+        printf(gOptions.verifySignature ?
+            "Checksum and signature verified\n" : "Checksum verified\n");
+    } else if (gOptions.outputFormat == OUTPUT_JSONL) {
+        if (!dumpJsonl(fileName, pDexFile))
+            goto bail;
+    } else if (gOptions.outputFormat == OUTPUT_COLUMNAR) {
+        if (!dumpColumnar(pDexFile))
+            goto bail;
     } else {
         processDexFile(fileName, pDexFile);
     }
@@ -2192,6 +3910,120 @@ bail:
     return result;
 }
 
+/*
+ * Print the item a diff entry refers to, from whichever file has it.
+ */
+static void printDiffItem(const DexDiff* pDiff, const DexDiffEntry* pEntry)
+{
+    bool inOld = (pEntry->oldIdx != kDexNoIndex);
+    const DexFile* pDexFile = inOld ? pDiff->pOldDexFile : pDiff->pNewDexFile;
+    u4 idx = inOld ? pEntry->oldIdx : pEntry->newIdx;
+
+    switch (pEntry->itemType) {
+    case kDexDiffClass:
+        printf("class %s", dexStringByTypeIdx(pDexFile,
+            dexGetClassDef(pDexFile, idx)->classIdx));
+        break;
+    case kDexDiffField: {
+        const DexFieldId* pFieldId = dexGetFieldId(pDexFile, idx);
+        printf("field %s:%s", dexStringById(pDexFile, pFieldId->nameIdx),
+            dexStringByTypeIdx(pDexFile, pFieldId->typeIdx));
+        break;
+    }
+    case kDexDiffMethod: {
+        const DexMethodId* pMethodId = dexGetMethodId(pDexFile, idx);
+        printf("method %s%s", dexStringById(pDexFile, pMethodId->nameIdx),
+            dexProtoTableGet(pDexFile->pProtoTable, pMethodId->protoIdx));
+        break;
+    }
+    }
+}
+
+/*
+ * Compare two files and list the classes, fields and methods that were
+ * added (+), removed (-) or modified (*).
+ */
+int diffFiles(const char* oldFileName, const char* newFileName)
+{
+    static const struct {
+        u4 flag;
+        const char* name;
+    } kChangeNames[] = {
+        { kDexDiffAccessFlags,  "access" },
+        { kDexDiffSuperclass,   "superclass" },
+        { kDexDiffInterfaces,   "interfaces" },
+        { kDexDiffMembers,      "members" },
+        { kDexDiffCode,         "code" },
+    };
+    static const char kKindMarks[] = { '+', '-', '*' };
+    int numThreads = dexGetDefaultThreadCount();
+    MemMapping oldMap, newMap;
+    DexFile* pOldDexFile = NULL;
+    DexFile* pNewDexFile = NULL;
+    DexDiff* pDiff = NULL;
+    u4 classCounts[3] = { 0, 0, 0 };
+    int result = -1;
+
+    pOldDexFile = openDexFile(oldFileName, &oldMap);
+    if (pOldDexFile == NULL)
+        return result;
+    pNewDexFile = openDexFile(newFileName, &newMap);
+    if (pNewDexFile == NULL)
+        goto bail;
+
+    /* methods are matched and printed by descriptor */
+    if (!dexFileAttachProtoTable(pOldDexFile, numThreads) ||
+        !dexFileAttachProtoTable(pNewDexFile, numThreads))
+    {
+        fprintf(stderr, "ERROR: unable to build proto table\n");
+        goto bail;
+    }
+
+    pDiff = dexDiffCreate(pOldDexFile, pNewDexFile, numThreads);
+    if (pDiff == NULL) {
+        fprintf(stderr, "ERROR: unable to compare '%s' with '%s'\n",
+            oldFileName, newFileName);
+        goto bail;
+    }
+
+    printf("Diff '%s' -> '%s'\n", oldFileName, newFileName);
+    for (u4 i = 0; i < pDiff->count; i++) {
+        const DexDiffEntry* pEntry = &pDiff->entries[i];
+        const char* separator = " (";
+
+        if (pEntry->itemType == kDexDiffClass) {
+            classCounts[pEntry->kind]++;
+            printf("%c ", kKindMarks[pEntry->kind]);
+        } else {
+            printf("    %c ", kKindMarks[pEntry->kind]);
+        }
+        printDiffItem(pDiff, pEntry);
+
+        for (size_t j = 0; j < sizeof(kChangeNames) / sizeof(kChangeNames[0]); j++) {
+            if ((pEntry->changes & kChangeNames[j].flag) != 0) {
+                printf("%s%s", separator, kChangeNames[j].name);
+                separator = ", ";
+            }
+        }
+        printf("%s\n", (pEntry->changes != 0) ? ")" : "");
+    }
+    printf("Classes: %u added, %u removed, %u modified\n",
+        classCounts[kDexDiffAdded], classCounts[kDexDiffRemoved],
+        classCounts[kDexDiffModified]);
+
+    result = 0;
+
+bail:
+    dexDiffFree(pDiff);
+    if (pNewDexFile != NULL) {
+        dexFileFree(pNewDexFile);
+        sysReleaseShmem(&newMap);
+    }
+    dexFileFree(pOldDexFile);
+    sysReleaseShmem(&oldMap);
+    return result;
+}
+
 
 /*
  * Show usage.
@@ -2200,7 +4032,11 @@ void usage(void)
 {
     fprintf(stderr, "Copyright (C) 2007 The Android Open Source Project\n\n");
     fprintf(stderr,
-        "%s: [-c] [-d] [-f] [-h] [-i] [-l layout] [-m] [-t tempfile] dexfile...\n",
+        "%s: [-c] [-d] [-f] [-h] [-i] [-l layout] [-m] [-t tempfile]\n"
+        "        [--size-report] [--page-trace=classlist] [--diff=olddexfile]\n"
+        "        [--dup-code[=exact|normalized]] [--verify-signature]\n"
+        "        [--static-values]\n"
+        "        dexfile...\n",
         gProgName);
     fprintf(stderr, "\n");
     fprintf(stderr, " -c : verify checksum and exit\n");
@@ -2208,15 +4044,49 @@ void usage(void)
     fprintf(stderr, " -f : display summary information from file header\n");
     fprintf(stderr, " -h : display file header details\n");
     fprintf(stderr, " -i : ignore checksum failures\n");
-    fprintf(stderr, " -l : output layout, either 'plain' or 'xml'\n");
+    fprintf(stderr, " -l : output layout: 'plain', 'xml', 'jsonl' (JSON Lines) or\n"
+        "      'columnar' (binary tables on stdout, one dexfile only)\n");
     fprintf(stderr, " -m : dump register maps (and nothing else)\n");
     fprintf(stderr, " -t : temp file name (defaults to /sdcard/dex-temp-*)\n");
+    fprintf(stderr, " --size-report : report section sizes, code_item size\n"
+        "     distribution and per-class/per-package byte attribution\n");
+    fprintf(stderr, " --page-trace=FILE : replay loading the classes listed in FILE\n"
+        "     (one descriptor per line) and report the pages touched\n");
+    fprintf(stderr, " --diff=OLDFILE : list the classes, fields and methods added,\n"
+        "     removed or modified between OLDFILE and dexfile\n");
+    fprintf(stderr, " --dup-code[=MODE] : list groups of methods with duplicate code\n"
+        "     and the bytes they waste; MODE 'normalized' ignores the strings,\n"
+        "     types, fields and methods the code refers to (default 'exact')\n");
+    fprintf(stderr, " --verify-signature : also verify the SHA-1 signature (with -i,\n"
+        "     report a mismatch and carry on)\n");
+    fprintf(stderr, " --static-values : show the initial value of each static field\n"
+        "     (plain output only)\n");
 }
 
+/*
+ * Values returned by getopt_long() for options that have no short form.
+ */
+enum {
+    kOptSizeReport = 0x100,
+    kOptPageTrace,
+    kOptDiff,
+    kOptDupCode,
+    kOptVerifySignature,
+    kOptStaticValues,
+};
+
+static const struct option gLongOptions[] = {
+    { "size-report",    no_argument,        NULL,   kOptSizeReport },
+    { "page-trace",     required_argument,  NULL,   kOptPageTrace },
+    { "diff",           required_argument,  NULL,   kOptDiff },
+    { "dup-code",       optional_argument,  NULL,   kOptDupCode },
+    { "verify-signature", no_argument,      NULL,   kOptVerifySignature },
+    { "static-values",  no_argument,        NULL,   kOptStaticValues },
+    { NULL,             0,                  NULL,   0 },
+};
+
 /*
  * Parse args.
- *
- * I'm not using getopt_long() because we may not have it in libc.
  */
 int main(int argc, char* const argv[])
 {
@@ -2225,9 +4095,10 @@ int main(int argc, char* const argv[])
 
     memset(&gOptions, 0, sizeof(gOptions));
     gOptions.verbose = true;
+    dexArenaInit(&gArena, 0);
 
     while (1) {
-        ic = getopt(argc, argv, "cdfhil:mt:");
+        ic = getopt_long(argc, argv, "cdfhil:mt:", gLongOptions, NULL);
         if (ic < 0)
             break;
 
@@ -2254,6 +4125,12 @@ int main(int argc, char* const argv[])
                 gOptions.outputFormat = OUTPUT_XML;
                 gOptions.verbose = false;
                 gOptions.exportsOnly = true;
+            } else if (strcmp(optarg, "jsonl") == 0) {
+                gOptions.outputFormat = OUTPUT_JSONL;
+                gOptions.verbose = false;
+            } else if (strcmp(optarg, "columnar") == 0) {
+                gOptions.outputFormat = OUTPUT_COLUMNAR;
+                gOptions.verbose = false;
             } else {
                 wantUsage = true;
             }
@@ -2264,6 +4141,30 @@ int main(int argc, char* const argv[])
         case 't':       // temp file, used when opening compressed Jar
             gOptions.tempFileName = optarg;
             break;
+        case kOptSizeReport:    // section and per-class size report
+            gOptions.sizeReport = true;
+            break;
+        case kOptPageTrace:     // replay class loads, report pages touched
+            gOptions.pageTraceClassList = optarg;
+            break;
+        case kOptDiff:          // compare against an older file
+            gOptions.diffOldFile = optarg;
+            break;
+        case kOptDupCode:       // report duplicate code
+            gOptions.dupCodeReport = true;
+            if (optarg == NULL || strcmp(optarg, "exact") == 0)
+                gOptions.dupCodeMode = kDexCodeHashExact;
+            else if (strcmp(optarg, "normalized") == 0)
+                gOptions.dupCodeMode = kDexCodeHashNormalized;
+            else
+                wantUsage = true;
+            break;
+        case kOptVerifySignature:   // check the SHA-1 signature too
+            gOptions.verifySignature = true;
+            break;
+        case kOptStaticValues:  // show static field initial values
+            gOptions.staticValues = true;
+            break;
         default:
             wantUsage = true;
             break;
@@ -2275,6 +4176,22 @@ int main(int argc, char* const argv[])
         wantUsage = true;
     }
 
+    if (gOptions.outputFormat == OUTPUT_COLUMNAR) {
+        if (argc - optind > 1) {
+            fprintf(stderr, "Can't write more than one dexfile with -l columnar\n");
+            wantUsage = true;
+        } else if (isatty(STDOUT_FILENO)) {
+            fprintf(stderr, "%s: not writing binary output to a terminal\n",
+                gProgName);
+            return 2;
+        }
+    }
+
+    if (gOptions.diffOldFile != NULL && argc - optind > 1) {
+        fprintf(stderr, "Can't compare more than one dexfile with --diff\n");
+        wantUsage = true;
+    }
+
     if (gOptions.checksumOnly && gOptions.ignoreBadChecksum) {
         fprintf(stderr, "Can't specify both -c and -i\n");
         wantUsage = true;
@@ -2286,9 +4203,14 @@ int main(int argc, char* const argv[])
     }
 
     int result = 0;
-    while (optind < argc) {
-        result |= process(argv[optind++]);
+    if (gOptions.diffOldFile != NULL) {
+        result = diffFiles(gOptions.diffOldFile, argv[optind]);
+    } else {
+        while (optind < argc) {
+            result |= process(argv[optind++]);
+        }
     }
 
+    dexArenaFree(&gArena);
     return (result != 0);
 }
@@ -25,10 +25,15 @@
 #include <strings.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #ifndef O_BINARY
 #define O_BINARY 0
 #endif
+#ifndef O_NOFOLLOW
+#define O_NOFOLLOW 0
+#endif
 
 /*
  * Extract "classes.dex" from archive file.
@@ -109,11 +114,264 @@ bail:
  */
 UnzipToFileResult dexOpenAndMap(const char* fileName, const char* tempFileName,
     MemMapping* pMap, bool quiet)
+{
+    return dexOpenAndMapWithOptions(fileName, tempFileName, kDexMapDefault,
+        pMap, quiet);
+}
+
+/*
+ * Find the header and id tables of a mapped DEX or optimized DEX file.
+ * They run from the start of the header to the start of the data
+ * section.  Returns false if the map doesn't hold a plausible header.
+ */
+static bool findIdTables(const MemMapping* pMap, u1** pStart, size_t* pLength)
+{
+    u1* addr = (u1*) pMap->addr;
+    size_t length = pMap->length;
+
+    if (length >= sizeof(DexOptHeader) &&
+        memcmp(addr, DEX_OPT_MAGIC, 4) == 0)
+    {
+        const DexOptHeader* pOptHeader = (const DexOptHeader*) addr;
+        if (pOptHeader->dexOffset > length ||
+            pOptHeader->dexLength > length - pOptHeader->dexOffset)
+            return false;
+        addr += pOptHeader->dexOffset;
+        length = pOptHeader->dexLength;
+    }
+
+    if (length < sizeof(DexHeader))
+        return false;
+    const DexHeader* pHeader = (const DexHeader*) addr;
+    if (!dexHasValidMagic(pHeader) || pHeader->dataOff > length)
+        return false;
+
+    *pStart = addr;
+    *pLength = pHeader->dataOff;
+    return true;
+}
+
+/*
+ * Contents of a "verified" stamp, the file that records that a DEX file
+ * passed structural verification.  It matches the file if the file is
+ * still the same inode, unmodified since the stamp was written, and
+ * carries the same checksum and signature.  The struct is zeroed before
+ * it's filled in, so it's compared as raw bytes.
+ */
+struct VerifiedStamp {
+    char    magic[8];
+    u8      dev;
+    u8      ino;
+    u8      size;
+    s8      mtimeSec;
+    s8      mtimeNsec;
+    u4      checksum;
+    u1      signature[kSHA1DigestLen];
+};
+
+static const char kVerifiedStampMagic[8] =
+    { 'd', 'e', 'x', 'v', 'r', 'f', 'y', '2' };
+
+/*
+ * Build the stamp for the open file "fd", whose header is at "pHeader".
+ */
+static bool makeVerifiedStamp(int fd, const DexHeader* pHeader,
+    VerifiedStamp* pStamp)
+{
+    struct stat st;
+
+    if (fstat(fd, &st) != 0)
+        return false;
+
+    memset(pStamp, 0, sizeof(*pStamp));
+    memcpy(pStamp->magic, kVerifiedStampMagic, sizeof(pStamp->magic));
+    pStamp->dev = st.st_dev;
+    pStamp->ino = st.st_ino;
+    pStamp->size = st.st_size;
+    pStamp->mtimeSec = st.st_mtime;
+#if defined(__APPLE__)
+    pStamp->mtimeNsec = st.st_mtimespec.tv_nsec;
+#elif defined(__linux__)
+    pStamp->mtimeNsec = st.st_mtim.tv_nsec;
+#endif
+    pStamp->checksum = pHeader->checksum;
+    memcpy(pStamp->signature, pHeader->signature, kSHA1DigestLen);
+    return true;
+}
+
+/*
+ * Get the name of the stamp for the file "pStamp" describes.  Stamps
+ * live in "/tmp/dex-verified-<uid>", named after the file's device and
+ * inode, never next to the file: anyone who can write there could plant
+ * one.  /tmp is shared too, so the directory is only used if it's a
+ * real directory owned by this user and closed to everyone else.
+ * Returns false if there's no such directory (or, on Windows, ever).
+ */
+static bool getStampName(const VerifiedStamp* pStamp, char* buf,
+    size_t bufLen)
+{
+#if !defined(__MINGW32__)
+    struct stat st;
+    int len;
+
+    len = snprintf(buf, bufLen, "/tmp/dex-verified-%u",
+        (unsigned int) getuid());
+    if (len < 0 || (size_t) len >= bufLen)
+        return false;
+    if (mkdir(buf, 0700) != 0 && errno != EEXIST)
+        return false;
+    if (lstat(buf, &st) != 0 || !S_ISDIR(st.st_mode) ||
+        st.st_uid != getuid() || (st.st_mode & 077) != 0)
+    {
+        return false;
+    }
+
+    len = snprintf(buf + len, bufLen - len, "/%llx-%llx",
+        (unsigned long long) pStamp->dev, (unsigned long long) pStamp->ino);
+    return len >= 0 && (size_t) len < bufLen;
+#else
+    return false;
+#endif
+}
+
+/*
+ * Check whether the DEX file "fd", mapped at "pHeader" for "length"
+ * bytes, has a trustworthy stamp.  The stamp must be a regular file
+ * owned by this user that nobody else can write, and must match the
+ * file.  Since a rewrite in place can keep the inode, size and mtime,
+ * the adler32 checksum is recomputed too and must match the one in the
+ * header (and so the one in the stamp).
+ */
+static bool checkVerifiedStamp(int fd, const DexHeader* pHeader,
+    size_t length)
+{
+    VerifiedStamp expected, actual;
+    char stampName[96];
+    struct stat st;
+    bool result = false;
+    int stampFd = -1;
+
+    if (!makeVerifiedStamp(fd, pHeader, &expected) ||
+        !getStampName(&expected, stampName, sizeof(stampName)))
+        goto bail;
+
+    stampFd = open(stampName, O_RDONLY | O_BINARY | O_NOFOLLOW);
+    if (stampFd < 0)
+        goto bail;
+    if (fstat(stampFd, &st) != 0 || !S_ISREG(st.st_mode) ||
+        st.st_uid != getuid() || (st.st_mode & 022) != 0)
+    {
+        ALOGW("Ignoring verified stamp '%s' with bad owner or mode",
+            stampName);
+        goto bail;
+    }
+    if (read(stampFd, &actual, sizeof(actual)) != (ssize_t) sizeof(actual))
+        goto bail;
+    if (memcmp(&expected, &actual, sizeof(actual)) != 0)
+        goto bail;
+
+    result = pHeader->fileSize == length &&
+        dexComputeChecksum(pHeader) == pHeader->checksum;
+
+bail:
+    if (stampFd >= 0)
+        close(stampFd);
+    return result;
+}
+
+/*
+ * Write the stamp for a file that just passed verification.  It goes to
+ * a temp file that's renamed into place, so concurrent openers never see
+ * a partial stamp.  Failure only means the next opener verifies again.
+ */
+static void writeVerifiedStamp(int fd, const DexHeader* pHeader)
+{
+    VerifiedStamp stamp;
+    char stampName[96];
+    char tempName[sizeof(stampName) + 16];
+    int tempFd = -1;
+
+    if (!makeVerifiedStamp(fd, pHeader, &stamp) ||
+        !getStampName(&stamp, stampName, sizeof(stampName)))
+        return;
+
+    sprintf(tempName, "%s.%d", stampName, (int) getpid());
+    tempFd = open(tempName,
+        O_WRONLY | O_CREAT | O_TRUNC | O_BINARY | O_NOFOLLOW, 0600);
+    if (tempFd < 0)
+        return;
+    if (sysWriteFully(tempFd, &stamp, sizeof(stamp), "verified stamp") != 0 ||
+        close(tempFd) != 0)
+    {
+        unlink(tempName);
+        return;
+    }
+    if (rename(tempName, stampName) != 0)
+        unlink(tempName);
+}
+
+/*
+ * Map "fd" shared and read-only.  Returns false, with nothing mapped,
+ * unless it's an optimized DEX file (which dexOpenAndMap never
+ * verifies) or a DEX file with a matching verified stamp.
+ */
+static bool mapSharedIfVerified(int fd, int mapFlags, MemMapping* pMap)
+{
+    struct stat st;
+    MemMapping map;
+
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(DexHeader))
+        return false;
+    if (sysMapFileSegmentInShmemWithFlags(fd, 0, st.st_size, mapFlags,
+            &map) != 0)
+        return false;
+
+    const DexHeader* pHeader = (const DexHeader*) map.addr;
+    bool usable = memcmp(map.addr, DEX_OPT_MAGIC, 4) == 0 ||
+        (dexHasValidMagic(pHeader) &&
+         checkVerifiedStamp(fd, pHeader, st.st_size));
+    if (!usable) {
+        sysReleaseShmem(&map);
+        return false;
+    }
+
+    sysCopyMap(pMap, &map);
+    return true;
+}
+
+/*
+ * The private mapping in "pMap" just passed verification.  Record that
+ * in a stamp, then swap it for a shared read-only mapping so this
+ * process doesn't hold a copy either.  Keeps the private mapping if the
+ * shared one can't be made.
+ */
+static void switchToShared(int fd, int mapFlags, MemMapping* pMap)
+{
+    const DexHeader* pHeader = (const DexHeader*) pMap->addr;
+    MemMapping map;
+
+    if (!dexHasValidMagic(pHeader))
+        return;         /* optimized DEX; mapSharedIfVerified took those */
+    writeVerifiedStamp(fd, pHeader);
+
+    if (sysMapFileSegmentInShmemWithFlags(fd, 0, pMap->length, mapFlags,
+            &map) != 0)
+        return;
+    sysReleaseShmem(pMap);
+    sysCopyMap(pMap, &map);
+}
+
+/* (documented in header file) */
+UnzipToFileResult dexOpenAndMapWithOptions(const char* fileName,
+    const char* tempFileName, int flags, MemMapping* pMap, bool quiet)
 {
     UnzipToFileResult result = kUTFRGenericFailure;
     int len = strlen(fileName);
     char tempNameBuf[32];
     bool removeTemp = false;
+    bool sharedMode;
+    int mapFlags;
+    int mapResult;
     int fd = -1;
 
     if (len < 5) {
@@ -182,7 +440,31 @@ UnzipToFileResult dexOpenAndMap(const char* fileName, const char* tempFileName,
         goto bail;
     }
 
-    if (sysMapFileInShmemWritableReadOnly(fd, pMap) != 0) {
+    /* verification reads every byte, so stream it in either way */
+    mapFlags = kSysMapDefault;
+    if (flags & kDexMapVerifyOnce)
+        mapFlags = kSysMapSequential | kSysMapPopulate;
+    else if (flags & kDexMapLongLived)
+        mapFlags = kSysMapSequential | kSysMapWillNeed;
+
+    /*
+     * A file that's already been verified, by this process or another,
+     * needs nothing written to it, so it can be mapped shared and
+     * read-only: every process then uses the same page cache pages.
+     */
+    sharedMode = (flags & kDexMapShared) && !(flags & kDexMapHugePages) &&
+        !removeTemp;
+    if (sharedMode && mapSharedIfVerified(fd, mapFlags, pMap))
+        goto mapped;
+
+    if (flags & kDexMapHugePages) {
+        /* a private copy; the file's page cache pages can't be huge */
+        mapResult = sysLoadFileInPrivateMap(fd, kSysMapHugePages, pMap);
+    } else {
+        mapResult = sysMapFileInShmemWritableReadOnlyWithFlags(fd, mapFlags,
+            pMap);
+    }
+    if (mapResult != 0) {
         fprintf(stderr, "ERROR: Unable to map '%s'\n", fileName);
         goto bail;
     }
@@ -207,7 +489,26 @@ UnzipToFileResult dexOpenAndMap(const char* fileName, const char* tempFileName,
      * read-only to begin with. This is innocuous, though it is
      * undesirable from a memory hygiene perspective.
      */
-    sysChangeMapAccess(pMap->addr, pMap->length, false, pMap);
+    sysChangeMapAccess(pMap->baseAddr, pMap->baseLength, false, pMap);
+
+    if (sharedMode)
+        switchToShared(fd, mapFlags, pMap);
+
+mapped:
+    /*
+     * Readahead hints mean nothing for the anonymous copy, and advising
+     * part of it would split huge pages at the edges.
+     */
+    if ((flags & kDexMapLongLived) && !(flags & kDexMapHugePages)) {
+        u1* idStart;
+        size_t idLength;
+
+        sysAdviseMap(pMap->addr, pMap->length, kSysMapRandom, pMap);
+        if (findIdTables(pMap, &idStart, &idLength)) {
+            sysAdviseMap(idStart, idLength, kSysMapRandom | kSysMapWillNeed,
+                pMap);
+        }
+    }
 
     /*
      * Success!  Close the file and return with the start/length in pMap.
@@ -63,6 +63,48 @@ enum UnzipToFileResult {
 UnzipToFileResult dexOpenAndMap(const char* fileName, const char* tempFileName,
     MemMapping* pMap, bool quiet);
 
+/* flags for dexOpenAndMapWithOptions() */
+enum {
+    kDexMapDefault      = 0,
+    kDexMapVerifyOnce   = (1 << 0),     /* read through once, then unmapped */
+    kDexMapLongLived    = (1 << 1),     /* kept mapped for scattered lookups */
+    kDexMapHugePages    = (1 << 2),     /* private copy on huge pages */
+    kDexMapShared       = (1 << 3),     /* share pages once verified */
+};
+
+/*
+ * Like dexOpenAndMap(), with a hint about how the mapping will be used.
+ *
+ * kDexMapVerifyOnce reads the whole file in up front, with sequential
+ * readahead, so verification and checksumming don't stall page by page.
+ * kDexMapLongLived reads sequentially while verifying, then switches the
+ * mapping to random access (no readahead around later faults) and asks
+ * for the header and id tables, which nearly every lookup goes through,
+ * to stay resident.
+ *
+ * kDexMapHugePages reads the file into private memory backed by
+ * transparent huge pages instead of mapping it, trading sharing with the
+ * page cache (and the file's size in RSS) for far fewer TLB misses on
+ * files that stay open for hours.  sysGetHugePageBytes() reports how
+ * much of it the kernel actually gave huge pages.
+ *
+ * kDexMapShared maps a .dex file MAP_SHARED and read-only if it's known
+ * to have passed verification, so processes opening the same file all
+ * use the page cache's pages instead of each holding a private copy.
+ * "Known" means a stamp in this user's private "/tmp/dex-verified-<uid>"
+ * directory matches it (same inode, size, mtime, checksum and
+ * signature) and its adler32 checksum still checks out; stamps that
+ * other users own or can write are ignored.  The stamp is written, best
+ * effort, by whichever of this user's openers verifies the file first,
+ * after which it switches to the shared mapping too.  This relies on
+ * verification not rewriting anything, which holds because byte-swapping
+ * is a no-op in this tree (little-endian hosts only).  Optimized DEX files are never
+ * verified here, so they're always mapped shared.  Ignored for files
+ * extracted from archives and with kDexMapHugePages.
+ */
+UnzipToFileResult dexOpenAndMapWithOptions(const char* fileName,
+    const char* tempFileName, int flags, MemMapping* pMap, bool quiet);
+
 /*
  * Utility function to open a Zip archive, find "classes.dex", and extract
  * it to a file.
@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/*
+ * Lazy, zero-copy reading of encoded values and annotations.
+ */
+
+#include "DexAnnotation.h"
+#include "DexIndex.h"
+
+#include <string.h>
+
+/*
+ * Read a "size"-byte little-endian value.  If "fillOnRight" is set the
+ * bytes end up in the most significant positions, as encoded floats and
+ * doubles expect; otherwise the result is zero-extended.
+ */
+static u8 readUnsignedValue(const u1** pData, u4 size, bool fillOnRight)
+{
+    const u1* data = *pData;
+    u8 result = 0;
+
+    for (u4 i = 0; i < size; i++)
+        result |= ((u8) data[i]) << (i * 8);
+    if (fillOnRight)
+        result <<= (8 - size) * 8;
+
+    *pData = data + size;
+    return result;
+}
+
+/*
+ * Read a "size"-byte little-endian value and sign-extend it.
+ */
+static s8 readSignedValue(const u1** pData, u4 size)
+{
+    u4 shift = (8 - size) * 8;
+    return ((s8) (readUnsignedValue(pData, size, false) << shift)) >> shift;
+}
+
+/* (documented in header file) */
+void dexReadEncodedValue(const u1** pData, DexEncodedValue* pValue)
+{
+    u1 headerByte = *(*pData)++;
+    u4 valueType = headerByte & kDexAnnotationValueTypeMask;
+    u4 size = (headerByte >> kDexAnnotationValueArgShift) + 1;
+
+    pValue->type = valueType;
+    pValue->value.j = 0;
+
+    switch (valueType) {
+    case kDexAnnotationByte:
+    case kDexAnnotationShort:
+    case kDexAnnotationInt:
+        pValue->value.i = (s4) readSignedValue(pData, size);
+        break;
+    case kDexAnnotationChar:
+        pValue->value.i = (s4) readUnsignedValue(pData, size, false);
+        break;
+    case kDexAnnotationLong:
+        pValue->value.j = readSignedValue(pData, size);
+        break;
+    case kDexAnnotationFloat: {
+        u4 bits = (u4) (readUnsignedValue(pData, size, true) >> 32);
+        memcpy(&pValue->value.f, &bits, sizeof(bits));
+        break;
+    }
+    case kDexAnnotationDouble: {
+        u8 bits = readUnsignedValue(pData, size, true);
+        memcpy(&pValue->value.d, &bits, sizeof(bits));
+        break;
+    }
+    case kDexAnnotationMethodType:
+    case kDexAnnotationMethodHandle:
+    case kDexAnnotationString:
+    case kDexAnnotationType:
+    case kDexAnnotationField:
+    case kDexAnnotationMethod:
+    case kDexAnnotationEnum:
+        pValue->value.idx = (u4) readUnsignedValue(pData, size, false);
+        break;
+    case kDexAnnotationArray:
+        pValue->value.data = *pData;
+        dexSkipEncodedArray(pData);
+        break;
+    case kDexAnnotationAnnotation:
+        pValue->value.data = *pData;
+        dexSkipEncodedAnnotation(pData);
+        break;
+    case kDexAnnotationBoolean:
+        pValue->value.z = (size - 1) != 0;
+        break;
+    case kDexAnnotationNull:
+        break;
+    default:
+        /* verified data never gets here */
+        ALOGW("Unexpected encoded_value type %#x", valueType);
+        break;
+    }
+}
+
+/* (documented in header file) */
+void dexSkipEncodedValue(const u1** pData)
+{
+    u1 headerByte = *(*pData)++;
+    u4 valueType = headerByte & kDexAnnotationValueTypeMask;
+    u4 valueArg = headerByte >> kDexAnnotationValueArgShift;
+
+    switch (valueType) {
+    case kDexAnnotationArray:
+        dexSkipEncodedArray(pData);
+        break;
+    case kDexAnnotationAnnotation:
+        dexSkipEncodedAnnotation(pData);
+        break;
+    case kDexAnnotationNull:
+    case kDexAnnotationBoolean:
+        break;
+    default:
+        *pData += valueArg + 1;
+        break;
+    }
+}
+
+/* (documented in header file) */
+void dexSkipEncodedArray(const u1** pData)
+{
+    u4 size = readUnsignedLeb128(pData);
+    while (size-- != 0)
+        dexSkipEncodedValue(pData);
+}
+
+/* (documented in header file) */
+void dexSkipEncodedAnnotation(const u1** pData)
+{
+    skipLeb128(pData);                      // type_idx
+    u4 size = readUnsignedLeb128(pData);
+    while (size-- != 0) {
+        skipLeb128(pData);                  // name_idx
+        dexSkipEncodedValue(pData);
+    }
+}
+
+/* (documented in header file) */
+const DexAnnotationItem* dexFindAnnotationByTypeIdx(const DexFile* pDexFile,
+    const DexAnnotationSetItem* pAnnoSet, u4 typeIdx)
+{
+    if (pAnnoSet == NULL || typeIdx == kDexNoIndex)
+        return NULL;
+
+    /* entries are sorted by type_idx, so we can stop early */
+    for (u4 i = 0; i < pAnnoSet->size; i++) {
+        const DexAnnotationItem* pItem =
+            dexGetAnnotationItem(pDexFile, pAnnoSet, i);
+        if (pItem == NULL)
+            continue;
+
+        u4 idx = dexGetAnnotationItemTypeIdx(pItem);
+        if (idx == typeIdx)
+            return pItem;
+        if (idx > typeIdx)
+            break;
+    }
+
+    return NULL;
+}
+
+/* (documented in header file) */
+const DexAnnotationItem* dexFindAnnotation(const DexFile* pDexFile,
+    const DexAnnotationSetItem* pAnnoSet, const char* descriptor)
+{
+    if (pAnnoSet == NULL || pAnnoSet->size == 0)
+        return NULL;
+
+    return dexFindAnnotationByTypeIdx(pDexFile, pAnnoSet,
+        dexFindTypeIdx(pDexFile, descriptor));
+}
+
+/* (documented in header file) */
+bool dexFindAnnotationElement(const DexFile* pDexFile,
+    const u1* pEncodedAnnotation, const char* name, DexEncodedValue* pValue)
+{
+    u4 nameIdx = dexFindStringIdx(pDexFile, name);
+    if (nameIdx == kDexNoIndex)
+        return false;
+
+    const u1* data = pEncodedAnnotation;
+    skipLeb128(&data);                      // type_idx
+    u4 size = readUnsignedLeb128(&data);
+
+    /* elements are sorted by name_idx, so we can stop early */
+    while (size-- != 0) {
+        u4 idx = readUnsignedLeb128(&data);
+        if (idx == nameIdx) {
+            dexReadEncodedValue(&data, pValue);
+            return true;
+        }
+        if (idx > nameIdx)
+            break;
+        dexSkipEncodedValue(&data);
+    }
+
+    return false;
+}
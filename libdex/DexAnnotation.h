@@ -0,0 +1,186 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/*
+ * Lazy, zero-copy reading of encoded_value, encoded_array and
+ * encoded_annotation data (annotation_items, static values, call sites).
+ *
+ * Nothing here allocates or copies: scalar values are decoded into a
+ * small view, while arrays and nested annotations are handed back as
+ * pointers to their encoded bytes, to be walked only if the caller asks.
+ * The data is assumed to have passed dexSwapAndVerify(), so there is no
+ * bounds checking.
+ */
+#ifndef LIBDEX_DEXANNOTATION_H_
+#define LIBDEX_DEXANNOTATION_H_
+
+#include "DexFile.h"
+#include "Leb128.h"
+
+/*
+ * A decoded encoded_value.  Which member of "value" is meaningful depends
+ * on "type", one of the kDexAnnotation* value types:
+ *
+ *   Byte, Short, Char, Int  i (Char is zero-extended, the rest sign-extended)
+ *   Boolean                 z
+ *   Long                    j
+ *   Float, Double           f, d
+ *   MethodType, MethodHandle, String, Type, Field, Method, Enum
+ *                           idx (an index into the matching id table)
+ *   Array                   data (an encoded_array)
+ *   Annotation              data (an encoded_annotation)
+ *   Null                    nothing
+ */
+struct DexEncodedValue {
+    u1          type;
+    union {
+        s4          i;
+        bool        z;
+        s8          j;
+        float       f;
+        double      d;
+        u4          idx;
+        const u1*   data;
+    } value;
+};
+
+/*
+ * An annotation element: a name (string_id index) and its value.
+ */
+struct DexAnnotationElement {
+    u4              nameIdx;
+    DexEncodedValue value;
+};
+
+/*
+ * Decode the encoded_value at "*pData" into "pValue", and advance "*pData"
+ * past it.  Arrays and annotations are not decoded; their contents are
+ * skipped and "pValue->value.data" points at them.
+ */
+void dexReadEncodedValue(const u1** pData, DexEncodedValue* pValue);
+
+/*
+ * Advance "*pData" past an encoded_value, encoded_array or
+ * encoded_annotation without decoding it.
+ */
+void dexSkipEncodedValue(const u1** pData);
+void dexSkipEncodedArray(const u1** pData);
+void dexSkipEncodedAnnotation(const u1** pData);
+
+/*
+ * Iterator over the values of an encoded_array.  This structure should be
+ * treated as opaque, apart from "size".
+ */
+struct DexEncodedArrayIterator {
+    const u1*   pData;
+    u4          size;           /* total number of values */
+    u4          countRemaining;
+};
+
+/* Initialize a DexEncodedArrayIterator from a pointer to an encoded_array. */
+DEX_INLINE void dexEncodedArrayIteratorInit(DexEncodedArrayIterator* pIterator,
+    const u1* pEncodedArray)
+{
+    pIterator->size = readUnsignedLeb128(&pEncodedArray);
+    pIterator->countRemaining = pIterator->size;
+    pIterator->pData = pEncodedArray;
+}
+
+/* Get the next value, returning false when there are no more. */
+DEX_INLINE bool dexEncodedArrayIteratorNext(DexEncodedArrayIterator* pIterator,
+    DexEncodedValue* pValue)
+{
+    if (pIterator->countRemaining == 0)
+        return false;
+    pIterator->countRemaining--;
+    dexReadEncodedValue(&pIterator->pData, pValue);
+    return true;
+}
+
+/*
+ * Iterator over the elements of an encoded_annotation.  This structure
+ * should be treated as opaque, apart from "typeIdx" and "size".
+ */
+struct DexAnnotationIterator {
+    const u1*   pData;
+    u4          typeIdx;        /* type of the annotation */
+    u4          size;           /* total number of elements */
+    u4          countRemaining;
+};
+
+/*
+ * Initialize a DexAnnotationIterator from a pointer to an
+ * encoded_annotation.
+ */
+DEX_INLINE void dexAnnotationIteratorInit(DexAnnotationIterator* pIterator,
+    const u1* pEncodedAnnotation)
+{
+    pIterator->typeIdx = readUnsignedLeb128(&pEncodedAnnotation);
+    pIterator->size = readUnsignedLeb128(&pEncodedAnnotation);
+    pIterator->countRemaining = pIterator->size;
+    pIterator->pData = pEncodedAnnotation;
+}
+
+/* Get the next element, returning false when there are no more. */
+DEX_INLINE bool dexAnnotationIteratorNext(DexAnnotationIterator* pIterator,
+    DexAnnotationElement* pElement)
+{
+    if (pIterator->countRemaining == 0)
+        return false;
+    pIterator->countRemaining--;
+    pElement->nameIdx = readUnsignedLeb128(&pIterator->pData);
+    dexReadEncodedValue(&pIterator->pData, &pElement->value);
+    return true;
+}
+
+/* Get the type_idx of an annotation_item, without touching its elements. */
+DEX_INLINE u4 dexGetAnnotationItemTypeIdx(const DexAnnotationItem* pItem)
+{
+    const u1* ptr = pItem->annotation;
+    return readUnsignedLeb128(&ptr);
+}
+
+/*
+ * Find the annotation of type "typeIdx" in an annotation set.  Only the
+ * leading type_idx of each entry is read; the elements of entries that
+ * don't match are never decoded.
+ *
+ * Returns NULL if there is no such annotation.
+ */
+const DexAnnotationItem* dexFindAnnotationByTypeIdx(const DexFile* pDexFile,
+    const DexAnnotationSetItem* pAnnoSet, u4 typeIdx);
+
+/*
+ * Find the annotation with type descriptor "descriptor" (for example
+ * "Ldalvik/annotation/Signature;") in an annotation set.  The descriptor
+ * is resolved to a type_idx once, so a type the file doesn't reference
+ * costs no scan at all.
+ *
+ * Returns NULL if there is no such annotation.
+ */
+const DexAnnotationItem* dexFindAnnotation(const DexFile* pDexFile,
+    const DexAnnotationSetItem* pAnnoSet, const char* descriptor);
+
+/*
+ * Find the element called "name" in an encoded_annotation, skipping the
+ * values of the elements before it.  Fills in "pValue" and returns true
+ * if found.
+ */
+bool dexFindAnnotationElement(const DexFile* pDexFile,
+    const u1* pEncodedAnnotation, const char* name, DexEncodedValue* pValue);
+
+#endif  // LIBDEX_DEXANNOTATION_H_
@@ -0,0 +1,237 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/*
+ * Annotation index.
+ */
+
+#include "DexAnnotationIndex.h"
+#include "DexAnnotation.h"
+
+#include <stdlib.h>
+
+static const DexCsrFormat kAnnoFormat = {
+    kDexAnnotationIndexMagic, kDexAnnotationIndexVersion, 1,
+    sizeof(DexAnnotationTarget), kDexChunkAnnotationIndex, "annotation index"
+};
+
+struct AnnoBuild {
+    const DexFile*  pDexFile;
+    u4              typeCount;
+};
+
+static bool addEdge(DexParallelChunk* pChunk, u4 typeIdx, u4 kind,
+    u4 visibility, u4 parameter, u4 idx)
+{
+    DexAnnotationTarget* pTarget =
+        (DexAnnotationTarget*) dexCsrAddEdge(pChunk, 0, typeIdx);
+
+    if (pTarget == NULL)
+        return false;
+    pTarget->kind = kind;
+    pTarget->visibility = visibility;
+    pTarget->parameter = parameter;
+    pTarget->idx = idx;
+    return true;
+}
+
+/*
+ * Record every annotation in one annotation_set_item.  Only the type_idx
+ * of each annotation is read.
+ */
+static bool scanSet(const AnnoBuild* pBuild, DexParallelChunk* pChunk,
+    const DexAnnotationSetItem* pSet, u4 kind, u4 parameter, u4 idx)
+{
+    if (pSet == NULL)
+        return true;
+
+    for (u4 i = 0; i < pSet->size; i++) {
+        const DexAnnotationItem* pItem =
+            dexGetAnnotationItem(pBuild->pDexFile, pSet, i);
+        if (pItem == NULL)
+            continue;
+
+        u4 typeIdx = dexGetAnnotationItemTypeIdx(pItem);
+
+        /* ignore anything the verifier would have rejected */
+        if (typeIdx < pBuild->typeCount &&
+            !addEdge(pChunk, typeIdx, kind, pItem->visibility, parameter, idx))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Record the annotations in one class's annotations_directory_item.
+ */
+static bool scanDirectory(const AnnoBuild* pBuild, DexParallelChunk* pChunk,
+    const DexAnnotationsDirectoryItem* pAnnoDir, u4 classDefIdx)
+{
+    const DexFile* pDexFile = pBuild->pDexFile;
+
+    if (!scanSet(pBuild, pChunk, dexGetClassAnnotationSet(pDexFile, pAnnoDir),
+            kDexAnnotationTargetClass, 0, classDefIdx))
+    {
+        return false;
+    }
+
+    const DexFieldAnnotationsItem* pFields =
+        dexGetFieldAnnotations(pDexFile, pAnnoDir);
+    for (u4 i = 0; i < pAnnoDir->fieldsSize; i++) {
+        if (!scanSet(pBuild, pChunk,
+                dexGetFieldAnnotationSetItem(pDexFile, &pFields[i]),
+                kDexAnnotationTargetField, 0, pFields[i].fieldIdx))
+        {
+            return false;
+        }
+    }
+
+    const DexMethodAnnotationsItem* pMethods =
+        dexGetMethodAnnotations(pDexFile, pAnnoDir);
+    for (u4 i = 0; i < pAnnoDir->methodsSize; i++) {
+        if (!scanSet(pBuild, pChunk,
+                dexGetMethodAnnotationSetItem(pDexFile, &pMethods[i]),
+                kDexAnnotationTargetMethod, 0, pMethods[i].methodIdx))
+        {
+            return false;
+        }
+    }
+
+    const DexParameterAnnotationsItem* pParams =
+        dexGetParameterAnnotations(pDexFile, pAnnoDir);
+    for (u4 i = 0; i < pAnnoDir->parametersSize; i++) {
+        const DexAnnotationSetRefList* pList =
+            dexGetParameterAnnotationSetRefList(pDexFile, &pParams[i]);
+        if (pList == NULL)
+            continue;
+
+        for (u4 j = 0; j < pList->size; j++) {
+            const DexAnnotationSetRefItem* pRef =
+                dexGetParameterAnnotationSetRef(pList, j);
+            if (!scanSet(pBuild, pChunk, dexGetSetRefItemItem(pDexFile, pRef),
+                    kDexAnnotationTargetParameter, j, pParams[i].methodIdx))
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+/*
+ * DexCollectFunc: scan class_defs [start, end) into "pChunk".
+ */
+static void scanClasses(void* arg, DexParallelChunk* pChunk, u4 start,
+    u4 end)
+{
+    const AnnoBuild* pBuild = (const AnnoBuild*) arg;
+
+    for (u4 i = start; i < end && !pChunk->failed; i++) {
+        const DexClassDef* pClassDef = dexGetClassDef(pBuild->pDexFile, i);
+        const DexAnnotationsDirectoryItem* pAnnoDir =
+            dexGetAnnotationsDirectoryItem(pBuild->pDexFile, pClassDef);
+
+        if (pAnnoDir != NULL)
+            pChunk->failed = !scanDirectory(pBuild, pChunk, pAnnoDir, i);
+    }
+}
+
+/* (documented in header file) */
+DexAnnotationIndex* dexAnnotationIndexBuild(const DexFile* pDexFile,
+    int numThreads)
+{
+    const DexHeader* pHeader = pDexFile->pHeader;
+    DexParallelCollector collector;
+    DexParallelChunk** chunks = NULL;
+    DexAnnotationIndex* pIndex = NULL;
+    AnnoBuild build;
+
+    build.pDexFile = pDexFile;
+    build.typeCount = pHeader->typeIdsSize;
+    dexParallelCollectorInit(&collector,
+        sizeof(DexCsrEdge) + sizeof(DexAnnotationTarget));
+
+    dexParallelCollect(&collector, pHeader->classDefsSize, numThreads, 0,
+        scanClasses, &build);
+
+    chunks = dexParallelCollectorSort(&collector);
+    if (chunks == NULL)
+        goto bail;
+
+    pIndex = (DexAnnotationIndex*) malloc(sizeof(DexAnnotationIndex));
+    if (pIndex == NULL)
+        goto bail;
+    if (!dexCsrBuild(&pIndex->csr, &kAnnoFormat, pDexFile, &build.typeCount,
+            chunks, collector.chunkCount)) {
+        free(pIndex);
+        pIndex = NULL;
+    }
+
+bail:
+    free(chunks);
+    dexParallelCollectorFree(&collector);
+    return pIndex;
+}
+
+/* (documented in header file) */
+void dexAnnotationIndexFree(DexAnnotationIndex* pIndex)
+{
+    if (pIndex == NULL)
+        return;
+    dexCsrRelease(&pIndex->csr);
+    free(pIndex);
+}
+
+/* (documented in header file) */
+int dexAnnotationIndexWrite(const DexAnnotationIndex* pIndex, int fd)
+{
+    return dexCsrWrite(&pIndex->csr, fd);
+}
+
+/* (documented in header file) */
+DexAnnotationIndex* dexAnnotationIndexOpen(const char* fileName,
+    const DexFile* pDexFile)
+{
+    DexAnnotationIndex* pIndex =
+        (DexAnnotationIndex*) malloc(sizeof(DexAnnotationIndex));
+
+    if (pIndex != NULL &&
+        !dexCsrOpen(&pIndex->csr, &kAnnoFormat, fileName, pDexFile))
+    {
+        free(pIndex);
+        pIndex = NULL;
+    }
+    return pIndex;
+}
+
+/* (documented in header file) */
+DexAnnotationIndex* dexAnnotationIndexFromOptData(const DexFile* pDexFile)
+{
+    DexAnnotationIndex* pIndex =
+        (DexAnnotationIndex*) malloc(sizeof(DexAnnotationIndex));
+
+    if (pIndex != NULL &&
+        !dexCsrFromOptData(&pIndex->csr, &kAnnoFormat, pDexFile))
+    {
+        free(pIndex);
+        pIndex = NULL;
+    }
+    return pIndex;
+}
@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/*
+ * Annotation index: which classes, fields, methods and parameters carry
+ * an annotation of a given type.
+ *
+ * Like the cross-reference index (DexXref.h) this is stored in
+ * compressed sparse row form, keyed by the annotation's type_id: an
+ * array of (typeCount + 1) offsets and an array of targets, so the
+ * targets annotated with type "i" are targets[offsets[i]] through
+ * targets[offsets[i+1] - 1], in class_def order.  The index is a
+ * serialized DexCsr (see DexCsr.h) with a single table, so it can be
+ * written to disk and mapped back in place.
+ */
+
+#ifndef LIBDEX_DEXANNOTATIONINDEX_H_
+#define LIBDEX_DEXANNOTATIONINDEX_H_
+
+#include "DexFile.h"
+#include "DexCsr.h"
+
+#define kDexAnnotationIndexMagic    "dexanno"       /* 8 bytes with the '\0' */
+#define kDexAnnotationIndexVersion  1
+
+/*
+ * What an annotation is attached to.
+ */
+enum DexAnnotationTargetKind {
+    kDexAnnotationTargetClass = 0,      /* idx is a class_def index */
+    kDexAnnotationTargetField,          /* idx is a field_id */
+    kDexAnnotationTargetMethod,         /* idx is a method_id */
+    kDexAnnotationTargetParameter,      /* idx is a method_id */
+};
+
+/*
+ * One annotated item.  "parameter" is the parameter number for
+ * kDexAnnotationTargetParameter and zero otherwise; "visibility" is the
+ * annotation's kDexVisibility* value.
+ */
+struct DexAnnotationTarget {
+    u1  kind;
+    u1  visibility;
+    u2  parameter;
+    u4  idx;
+};
+
+/*
+ * An index, either built in memory or mapped from a file.  Its one
+ * table holds DexAnnotationTarget records.
+ */
+struct DexAnnotationIndex {
+    DexCsr      csr;
+};
+
+/*
+ * Scan every class_def's annotations directory in "pDexFile" and build
+ * the index.  Classes are split across up to "numThreads" threads; the
+ * result doesn't depend on the thread count.  Returns NULL on failure.
+ */
+DexAnnotationIndex* dexAnnotationIndexBuild(const DexFile* pDexFile,
+    int numThreads);
+
+/*
+ * Free an index from dexAnnotationIndexBuild() or dexAnnotationIndexOpen().
+ */
+void dexAnnotationIndexFree(DexAnnotationIndex* pIndex);
+
+/*
+ * Write the serialized index to "fd".  Returns 0 on success.
+ */
+int dexAnnotationIndexWrite(const DexAnnotationIndex* pIndex, int fd);
+
+/*
+ * Map an index written by dexAnnotationIndexWrite().  The file's layout
+ * is checked before it's used.  If "pDexFile" is non-NULL the index must
+ * have been built from a file with the same checksum and signature.
+ * Returns NULL on failure.
+ */
+DexAnnotationIndex* dexAnnotationIndexOpen(const char* fileName,
+    const DexFile* pDexFile);
+
+/*
+ * Use the index stored in the kDexChunkAnnotationIndex chunk of an
+ * optimized DEX file's opt data (see dexOptAppendChunks()), in place.
+ * The chunk is checked as dexAnnotationIndexOpen() checks a file.
+ * Returns NULL if there is no usable chunk.  Free the result with
+ * dexAnnotationIndexFree(); the data stays with "pDexFile".
+ */
+DexAnnotationIndex* dexAnnotationIndexFromOptData(const DexFile* pDexFile);
+
+/*
+ * Get the items annotated with type "typeIdx".  Sets "*pCount" to the
+ * number of targets.
+ */
+DEX_INLINE const DexAnnotationTarget* dexAnnotationIndexGetTargets(
+    const DexAnnotationIndex* pIndex, u4 typeIdx, u4* pCount)
+{
+    return (const DexAnnotationTarget*) dexCsrGetRecords(&pIndex->csr, 0,
+        typeIdx, pCount);
+}
+
+#endif  // LIBDEX_DEXANNOTATIONINDEX_H_
@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Bump-pointer arena.
+ */
+
+#include "DexArena.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define kDefaultBlockSize   (16 * 1024)
+#define kAlignment          8
+
+static inline u1* blockData(DexArenaBlock* pBlock)
+{
+    return (u1*) (pBlock + 1);
+}
+
+/* (documented in header file) */
+void dexArenaInit(DexArena* pArena, size_t blockSize)
+{
+    memset(pArena, 0, sizeof(*pArena));
+    pArena->blockSize = (blockSize != 0) ? blockSize : kDefaultBlockSize;
+}
+
+/* (documented in header file) */
+void dexArenaFree(DexArena* pArena)
+{
+    DexArenaBlock* pBlock = pArena->pFirst;
+
+    while (pBlock != NULL) {
+        DexArenaBlock* pNext = pBlock->pNext;
+        free(pBlock);
+        pBlock = pNext;
+    }
+
+    pArena->pFirst = pArena->pCurrent = NULL;
+    pArena->totalSize = 0;
+    pArena->blockCount = 0;
+}
+
+/*
+ * Move to the next block in the chain that can hold "size" bytes,
+ * inserting a new block after the current one if the next doesn't fit.
+ * Returns NULL on allocation failure.
+ */
+static DexArenaBlock* advanceBlock(DexArena* pArena, size_t size)
+{
+    DexArenaBlock* pNext = (pArena->pCurrent == NULL) ?
+        pArena->pFirst : pArena->pCurrent->pNext;
+
+    if (pNext == NULL || pNext->size < size) {
+        size_t blockSize = (size > pArena->blockSize) ? size : pArena->blockSize;
+        DexArenaBlock* pBlock =
+            (DexArenaBlock*) malloc(sizeof(DexArenaBlock) + blockSize);
+        if (pBlock == NULL)
+            return NULL;
+
+        pBlock->size = blockSize;
+        pBlock->pNext = pNext;
+        if (pArena->pCurrent == NULL)
+            pArena->pFirst = pBlock;
+        else
+            pArena->pCurrent->pNext = pBlock;
+
+        pArena->totalSize += blockSize;
+        pArena->blockCount++;
+        pNext = pBlock;
+    }
+
+    pNext->used = 0;
+    pArena->pCurrent = pNext;
+    return pNext;
+}
+
+/* (documented in header file) */
+void* dexArenaAlloc(DexArena* pArena, size_t size)
+{
+    DexArenaBlock* pBlock = pArena->pCurrent;
+
+    size = (size + kAlignment - 1) & ~(size_t) (kAlignment - 1);
+
+    if (pBlock == NULL || pBlock->size - pBlock->used < size) {
+        pBlock = advanceBlock(pArena, size);
+        if (pBlock == NULL)
+            return NULL;
+    }
+
+    void* result = blockData(pBlock) + pBlock->used;
+    pBlock->used += size;
+    return result;
+}
+
+/* (documented in header file) */
+char* dexArenaStrdup(DexArena* pArena, const char* str)
+{
+    size_t length = strlen(str) + 1;
+    char* result = (char*) dexArenaAlloc(pArena, length);
+
+    if (result != NULL)
+        memcpy(result, str, length);
+    return result;
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Bump-pointer arena for short-lived allocations.
+ *
+ * Memory is handed out from a chain of blocks and is never freed
+ * individually.  Instead, take a mark before a unit of work (a class, a
+ * method) and release back to it afterwards.  Blocks are kept for reuse,
+ * so once the arena has grown to fit the largest unit of work it stops
+ * calling malloc() altogether.
+ */
+
+#ifndef LIBDEX_DEXARENA_H_
+#define LIBDEX_DEXARENA_H_
+
+#include "DexFile.h"
+
+struct DexArenaBlock {
+    DexArenaBlock*  pNext;
+    size_t          size;       /* usable bytes after the header */
+    size_t          used;
+};
+
+struct DexArena {
+    DexArenaBlock*  pFirst;
+    DexArenaBlock*  pCurrent;
+    size_t          blockSize;  /* default size of new blocks */
+    size_t          totalSize;  /* bytes held in all blocks */
+    u4              blockCount;
+};
+
+/*
+ * A position in an arena, for dexArenaRelease().
+ */
+struct DexArenaMark {
+    DexArenaBlock*  pBlock;
+    size_t          used;
+};
+
+/*
+ * Initialize an empty arena.  No memory is allocated until the first
+ * dexArenaAlloc().  "blockSize" of 0 picks a default.
+ */
+void dexArenaInit(DexArena* pArena, size_t blockSize);
+
+/*
+ * Free every block.  The arena may be reused after dexArenaInit().
+ */
+void dexArenaFree(DexArena* pArena);
+
+/*
+ * Allocate "size" bytes, aligned to 8.  Returns NULL if malloc() fails.
+ */
+void* dexArenaAlloc(DexArena* pArena, size_t size);
+
+/*
+ * Copy a '\0'-terminated string into the arena.
+ */
+char* dexArenaStrdup(DexArena* pArena, const char* str);
+
+/*
+ * Record the current position.
+ */
+DEX_INLINE DexArenaMark dexArenaMark(const DexArena* pArena)
+{
+    DexArenaMark mark;
+
+    mark.pBlock = pArena->pCurrent;
+    mark.used = (pArena->pCurrent != NULL) ? pArena->pCurrent->used : 0;
+    return mark;
+}
+
+/*
+ * Discard everything allocated since "mark" was taken.
+ */
+DEX_INLINE void dexArenaRelease(DexArena* pArena, DexArenaMark mark)
+{
+    pArena->pCurrent = mark.pBlock;
+    if (mark.pBlock != NULL)
+        mark.pBlock->used = mark.used;
+}
+
+/*
+ * Discard everything, keeping the blocks.
+ */
+DEX_INLINE void dexArenaReset(DexArena* pArena)
+{
+    pArena->pCurrent = NULL;
+}
+
+#endif  // LIBDEX_DEXARENA_H_
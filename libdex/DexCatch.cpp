@@ -20,6 +20,8 @@
 
 #include "DexCatch.h"
 
+#include <stdlib.h>
+
 /* Get the first handler offset for the given DexCode.
  * It's not 0 because the handlers list is prefixed with its size
  * (in entries) as a uleb128. */
@@ -88,3 +90,250 @@ u4 dexCatchIteratorGetEndOffset(DexCatchIterator* pIterator,
 
     return (u4) (pIterator->pEncodedData - dexGetCatchHandlerData(pCode));
 }
+
+/* (documented in header file) */
+DexCatchTable* dexCatchTableCreate(const DexCode* pCode) {
+    const DexTry* pTries = dexGetTries(pCode);
+    const u1* baseData = dexGetCatchHandlerData(pCode);
+    const u1* data = baseData;
+    u4 triesSize = pCode->triesSize;
+    u4 listCount = 0;
+    u4 handlerCount = 0;
+    u4 i;
+
+    /*
+     * First pass: count the lists and handlers so everything can live
+     * in a single allocation.
+     */
+    if (triesSize != 0) {
+        listCount = readUnsignedLeb128(&data);
+        for (i = 0; i < listCount; i++) {
+            s4 size = readSignedLeb128(&data);
+            u4 count = (size <= 0) ? -size : size;
+
+            handlerCount += count + ((size <= 0) ? 1 : 0);
+            for (u4 j = 0; j < count; j++) {
+                skipLeb128(&data);      // type_idx
+                skipLeb128(&data);      // addr
+            }
+            if (size <= 0) {
+                skipLeb128(&data);      // catch_all_addr
+            }
+        }
+    }
+
+    size_t allocSize = sizeof(DexCatchTable) +
+        triesSize * sizeof(DexCatchRange) +
+        listCount * sizeof(DexCatchHandlerList) +
+        handlerCount * sizeof(DexCatchHandler);
+    DexCatchTable* pTable = (DexCatchTable*) malloc(allocSize);
+    u4* listOffsets = (u4*) malloc((listCount + 1) * sizeof(u4));
+
+    if (pTable == NULL || listOffsets == NULL) {
+        free(pTable);
+        free(listOffsets);
+        return NULL;
+    }
+
+    DexCatchRange* pRanges = (DexCatchRange*) (pTable + 1);
+    DexCatchHandlerList* pLists = (DexCatchHandlerList*) (pRanges + triesSize);
+    DexCatchHandler* pHandlers = (DexCatchHandler*) (pLists + listCount);
+
+    pTable->pCode = pCode;
+    pTable->codeSize = dexGetCodeItemSize(pCode);
+    pTable->rangeCount = triesSize;
+    pTable->listCount = listCount;
+    pTable->handlerCount = handlerCount;
+    pTable->pRanges = pRanges;
+    pTable->pLists = pLists;
+    pTable->pHandlers = pHandlers;
+
+    /* Second pass: decode every list, remembering where each one began. */
+    data = baseData;
+    if (triesSize != 0) {
+        readUnsignedLeb128(&data);
+    }
+
+    u4 handlerIdx = 0;
+    for (i = 0; i < listCount; i++) {
+        DexCatchIterator iterator;
+        DexCatchHandler* pHandler;
+
+        listOffsets[i] = data - baseData;
+        pLists[i].first = handlerIdx;
+        dexCatchIteratorInitToPointer(&iterator, data);
+        while ((pHandler = dexCatchIteratorNext(&iterator)) != NULL) {
+            pHandlers[handlerIdx++] = *pHandler;
+        }
+        pLists[i].count = handlerIdx - pLists[i].first;
+        data = iterator.pEncodedData;
+    }
+
+    /*
+     * Map each try's handler offset to a list index. Lists appear in
+     * offset order, so a binary search over listOffsets does it.
+     */
+    for (i = 0; i < triesSize; i++) {
+        u4 handlerOff = pTries[i].handlerOff;
+        int lo = 0;
+        int hi = (int) listCount - 1;
+        int found = -1;
+
+        while (lo <= hi) {
+            int mid = (lo + hi) >> 1;
+            if (listOffsets[mid] < handlerOff) {
+                lo = mid + 1;
+            } else if (listOffsets[mid] > handlerOff) {
+                hi = mid - 1;
+            } else {
+                found = mid;
+                break;
+            }
+        }
+
+        if (found < 0) {
+            ALOGE("Bogus handler offset 0x%x in try %u", handlerOff, i);
+            free(listOffsets);
+            free(pTable);
+            return NULL;
+        }
+
+        pRanges[i].startAddr = pTries[i].startAddr;
+        pRanges[i].endAddr = pTries[i].startAddr + pTries[i].insnCount;
+        pRanges[i].listIdx = found;
+    }
+
+    free(listOffsets);
+    return pTable;
+}
+
+/* (documented in header file) */
+void dexCatchTableFree(DexCatchTable* pTable) {
+    free(pTable);
+}
+
+/* (documented in header file) */
+const DexCatchHandler* dexCatchTableFind(const DexCatchTable* pTable,
+        u4 address, u4* pCount) {
+    const DexCatchRange* pRanges = pTable->pRanges;
+    int min = 0;
+    int max = (int) pTable->rangeCount - 1;
+
+    while (max >= min) {
+        int guess = (min + max) >> 1;
+        const DexCatchRange* pRange = &pRanges[guess];
+
+        if (address < pRange->startAddr) {
+            max = guess - 1;
+        } else if (address >= pRange->endAddr) {
+            min = guess + 1;
+        } else {
+            const DexCatchHandlerList* pList = &pTable->pLists[pRange->listIdx];
+            *pCount = pList->count;
+            return &pTable->pHandlers[pList->first];
+        }
+    }
+
+    *pCount = 0;
+    return NULL;
+}
+
+/* (documented in header file) */
+DexCatchTableCache* dexCatchTableCacheAlloc(void) {
+    DexCatchTableCache* pCache =
+        (DexCatchTableCache*) malloc(sizeof(DexCatchTableCache));
+
+    if (pCache == NULL) {
+        return NULL;
+    }
+
+    pCache->capacity = 64;
+    pCache->used = 0;
+    pCache->pEntries =
+        (DexCatchTable**) calloc(pCache->capacity, sizeof(DexCatchTable*));
+    if (pCache->pEntries == NULL) {
+        free(pCache);
+        return NULL;
+    }
+
+    return pCache;
+}
+
+/* (documented in header file) */
+void dexCatchTableCacheFree(DexCatchTableCache* pCache) {
+    if (pCache == NULL) {
+        return;
+    }
+
+    for (u4 i = 0; i < pCache->capacity; i++) {
+        dexCatchTableFree(pCache->pEntries[i]);
+    }
+    free(pCache->pEntries);
+    free(pCache);
+}
+
+/* Hash a DexCode pointer to a starting probe slot. */
+static u4 catchTableSlot(const DexCode* pCode, u4 capacity) {
+    uintptr_t key = (uintptr_t) pCode >> 2;     // code items are 4-aligned
+    return (u4) (key * 0x9e3779b1u) & (capacity - 1);
+}
+
+/* Double the table size and rehash. Returns false on allocation failure. */
+static bool growCatchTableCache(DexCatchTableCache* pCache) {
+    u4 newCapacity = pCache->capacity * 2;
+    DexCatchTable** pNewEntries =
+        (DexCatchTable**) calloc(newCapacity, sizeof(DexCatchTable*));
+
+    if (pNewEntries == NULL) {
+        return false;
+    }
+
+    for (u4 i = 0; i < pCache->capacity; i++) {
+        DexCatchTable* pTable = pCache->pEntries[i];
+
+        if (pTable != NULL) {
+            u4 slot = catchTableSlot(pTable->pCode, newCapacity);
+            while (pNewEntries[slot] != NULL) {
+                slot = (slot + 1) & (newCapacity - 1);
+            }
+            pNewEntries[slot] = pTable;
+        }
+    }
+
+    free(pCache->pEntries);
+    pCache->pEntries = pNewEntries;
+    pCache->capacity = newCapacity;
+    return true;
+}
+
+/* (documented in header file) */
+const DexCatchTable* dexCatchTableCacheGet(DexCatchTableCache* pCache,
+        const DexCode* pCode) {
+    u4 slot = catchTableSlot(pCode, pCache->capacity);
+
+    while (pCache->pEntries[slot] != NULL) {
+        if (pCache->pEntries[slot]->pCode == pCode) {
+            return pCache->pEntries[slot];
+        }
+        slot = (slot + 1) & (pCache->capacity - 1);
+    }
+
+    /* Keep the load factor under 3/4. */
+    if ((pCache->used + 1) * 4 > pCache->capacity * 3) {
+        if (!growCatchTableCache(pCache)) {
+            return NULL;
+        }
+        slot = catchTableSlot(pCode, pCache->capacity);
+        while (pCache->pEntries[slot] != NULL) {
+            slot = (slot + 1) & (pCache->capacity - 1);
+        }
+    }
+
+    DexCatchTable* pTable = dexCatchTableCreate(pCode);
+    if (pTable != NULL) {
+        pCache->pEntries[slot] = pTable;
+        pCache->used++;
+    }
+
+    return pTable;
+}
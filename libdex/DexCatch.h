@@ -159,4 +159,68 @@ DEX_INLINE bool dexFindCatchHandler(DexCatchIterator *pIterator,
     }
 }
 
+/*
+ * Pre-decoded form of a DexCode's tries and handlers, for callers that
+ * look up handlers repeatedly (exception analysis over big methods).
+ * The whole table is one allocation; treat it as read-only.
+ *
+ * Each handler list is a run of "count" entries in pHandlers starting at
+ * "first"; a catch-all entry, if present, comes last and has typeIdx
+ * kDexNoIndex, matching the iterator.
+ */
+struct DexCatchRange {
+    u4          startAddr;  /* first covered code unit */
+    u4          endAddr;    /* one past the last covered code unit */
+    u4          listIdx;    /* index into pLists */
+};
+
+struct DexCatchHandlerList {
+    u4          first;      /* index into pHandlers */
+    u4          count;
+};
+
+struct DexCatchTable {
+    const DexCode*  pCode;
+    u4              codeSize;   /* same as dexGetCodeItemSize(pCode) */
+    u4              rangeCount;
+    u4              listCount;
+    u4              handlerCount;
+    const DexCatchRange*        pRanges;    /* sorted by address */
+    const DexCatchHandlerList*  pLists;
+    const DexCatchHandler*      pHandlers;
+};
+
+/* Decode the tries and handlers of "pCode". Returns NULL on allocation
+ * failure. The result must be released with dexCatchTableFree(). */
+DexCatchTable* dexCatchTableCreate(const DexCode* pCode);
+
+/* Free a table from dexCatchTableCreate(). */
+void dexCatchTableFree(DexCatchTable* pTable);
+
+/* Find the handlers covering "address". Returns a pointer to the first
+ * handler and sets "*pCount", or returns NULL if no try covers it. */
+const DexCatchHandler* dexCatchTableFind(const DexCatchTable* pTable,
+    u4 address, u4* pCount);
+
+/*
+ * Cache of DexCatchTables keyed by DexCode, built on first use. Not
+ * thread-safe; use one cache per thread.
+ */
+struct DexCatchTableCache {
+    u4              capacity;   /* always a power of 2 */
+    u4              used;
+    DexCatchTable** pEntries;
+};
+
+/* Allocate an empty cache. Returns NULL on allocation failure. */
+DexCatchTableCache* dexCatchTableCacheAlloc(void);
+
+/* Free a cache and every table in it. */
+void dexCatchTableCacheFree(DexCatchTableCache* pCache);
+
+/* Return the table for "pCode", decoding it on first use. Returns NULL
+ * on allocation failure. */
+const DexCatchTable* dexCatchTableCacheGet(DexCatchTableCache* pCache,
+    const DexCode* pCode);
+
 #endif  // LIBDEX_DEXCATCH_H_
@@ -90,23 +90,21 @@ bool dexReadAndVerifyClassDataMethod(const u1** pData, const u1* pLimit,
     return true;
 }
 
-/* Read, verify, and return an entire class_data_item. This updates
- * the given data pointer to point past the end of the read data. This
- * function allocates a single chunk of memory for the result, which
- * must subsequently be free()d. This function returns NULL if there
- * was trouble parsing the data. If this function is passed NULL, it
- * returns an initialized empty DexClassData structure.
- *
- * The verification done by this function is of the raw data format
- * only; it does not verify that access flags, indices, or offsets
- * are valid. */
-DexClassData* dexReadAndVerifyClassData(const u1** pData, const u1* pLimit) {
+/* Helper for dexReadAndVerifyClassData() and
+ * dexReadAndVerifyClassDataInArena(). Allocates from pArena if it is
+ * non-NULL, otherwise with malloc(). */
+static DexClassData* readAndVerifyClassData(const u1** pData,
+        const u1* pLimit, DexArena* pArena) {
     DexClassDataHeader header;
     u4 lastIndex;
 
     if (*pData == NULL) {
-        DexClassData* result = (DexClassData*) malloc(sizeof(DexClassData));
-        memset(result, 0, sizeof(*result));
+        DexClassData* result = (pArena != NULL) ?
+            (DexClassData*) dexArenaAlloc(pArena, sizeof(DexClassData)) :
+            (DexClassData*) malloc(sizeof(DexClassData));
+        if (result != NULL) {
+            memset(result, 0, sizeof(*result));
+        }
         return result;
     }
 
@@ -120,7 +118,9 @@ DexClassData* dexReadAndVerifyClassData(const u1** pData, const u1* pLimit) {
         (header.directMethodsSize * sizeof(DexMethod)) +
         (header.virtualMethodsSize * sizeof(DexMethod));
 
-    DexClassData* result = (DexClassData*) malloc(resultSize);
+    DexClassData* result = (pArena != NULL) ?
+        (DexClassData*) dexArenaAlloc(pArena, resultSize) :
+        (DexClassData*) malloc(resultSize);
     u1* ptr = ((u1*) result) + sizeof(DexClassData);
     bool okay = true;
     u4 i;
@@ -183,9 +183,31 @@ DexClassData* dexReadAndVerifyClassData(const u1** pData, const u1* pLimit) {
     }
 
     if (! okay) {
-        free(result);
+        if (pArena == NULL) {
+            free(result);
+        }
         return NULL;
     }
 
     return result;
 }
+
+/* Read, verify, and return an entire class_data_item. This updates
+ * the given data pointer to point past the end of the read data. This
+ * function allocates a single chunk of memory for the result, which
+ * must subsequently be free()d. This function returns NULL if there
+ * was trouble parsing the data. If this function is passed NULL, it
+ * returns an initialized empty DexClassData structure.
+ *
+ * The verification done by this function is of the raw data format
+ * only; it does not verify that access flags, indices, or offsets
+ * are valid. */
+DexClassData* dexReadAndVerifyClassData(const u1** pData, const u1* pLimit) {
+    return readAndVerifyClassData(pData, pLimit, NULL);
+}
+
+/* (documented in header file) */
+DexClassData* dexReadAndVerifyClassDataInArena(const u1** pData,
+        const u1* pLimit, DexArena* pArena) {
+    return readAndVerifyClassData(pData, pLimit, pArena);
+}
@@ -21,9 +21,12 @@
 #ifndef LIBDEX_DEXCLASS_H_
 #define LIBDEX_DEXCLASS_H_
 
+#include "DexArena.h"
 #include "DexFile.h"
 #include "Leb128.h"
 
+#include <stddef.h>
+
 /* expanded form of a class_data_item header */
 struct DexClassDataHeader {
     u4 staticFieldsSize;
@@ -102,6 +105,11 @@ bool dexReadAndVerifyClassDataMethod(const u1** pData, const u1* pLimit,
  * are valid. */
 DexClassData* dexReadAndVerifyClassData(const u1** pData, const u1* pLimit);
 
+/* Same as dexReadAndVerifyClassData(), but the result is allocated from
+ * the given arena and must not be free()d. */
+DexClassData* dexReadAndVerifyClassDataInArena(const u1** pData,
+        const u1* pLimit, DexArena* pArena);
+
 /*
  * Get the DexCode for a DexMethod.  Returns NULL if the class is native
  * or abstract.
@@ -111,6 +119,8 @@ DEX_INLINE const DexCode* dexGetCode(const DexFile* pDexFile,
 {
     if (pDexMethod->codeOff == 0)
         return NULL;
+    DEX_TRACE_ACCESS(pDexFile, pDexFile->baseAddr + pDexMethod->codeOff,
+        offsetof(DexCode, insns));
     return (const DexCode*) (pDexFile->baseAddr + pDexMethod->codeOff);
 }
 
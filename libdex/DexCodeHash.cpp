@@ -0,0 +1,362 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Content hashes of code items.
+ */
+
+#include "DexCodeHash.h"
+#include "DexArena.h"
+#include "DexCatch.h"
+#include "DexClass.h"
+#include "DexHash.h"
+#include "DexParallel.h"
+#include "DexProto.h"
+#include "InstrUtils.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* the widest instruction that has an index operand */
+#define kMaxIndexedWidth    4
+
+static u8 hashName(u8 hash, const char* str)
+{
+    return dexHashBlock(hash, str, strlen(str));
+}
+
+static u8 hashType(u8 hash, const DexFile* pDexFile, u4 typeIdx)
+{
+    if (typeIdx >= pDexFile->pHeader->typeIdsSize)
+        return dexHashU4(hash, typeIdx);
+    return hashName(hash, dexStringByTypeIdx(pDexFile, typeIdx));
+}
+
+static u8 hashProto(u8 hash, const DexFile* pDexFile, u4 protoIdx)
+{
+    if (protoIdx >= pDexFile->pHeader->protoIdsSize)
+        return dexHashU4(hash, protoIdx);
+
+    DexProto proto = { pDexFile, protoIdx };
+    u8 fingerprint = dexProtoGetFingerprint(&proto);
+    return dexHashBytes(hash, &fingerprint, sizeof(fingerprint));
+}
+
+/*
+ * Fold in the item that index "idx" of kind "indexType" refers to.
+ * Indices that can't be resolved (call sites, method handles, the
+ * offsets in optimized instructions, or anything out of range) are
+ * folded in as-is.
+ */
+static u8 hashReference(u8 hash, const DexFile* pDexFile,
+    InstructionIndexType indexType, u4 idx)
+{
+    const DexHeader* pHeader = pDexFile->pHeader;
+
+    switch (indexType) {
+    case kIndexStringRef:
+        if (idx < pHeader->stringIdsSize)
+            return hashName(hash, dexStringById(pDexFile, idx));
+        break;
+    case kIndexTypeRef:
+        return hashType(hash, pDexFile, idx);
+    case kIndexFieldRef:
+        if (idx < pHeader->fieldIdsSize) {
+            const DexFieldId* pFieldId = dexGetFieldId(pDexFile, idx);
+            hash = hashType(hash, pDexFile, pFieldId->classIdx);
+            hash = hashName(hash, dexStringById(pDexFile, pFieldId->nameIdx));
+            return hashType(hash, pDexFile, pFieldId->typeIdx);
+        }
+        break;
+    case kIndexMethodRef:
+    case kIndexMethodAndProtoRef:
+        if (idx < pHeader->methodIdsSize) {
+            const DexMethodId* pMethodId = dexGetMethodId(pDexFile, idx);
+            hash = hashType(hash, pDexFile, pMethodId->classIdx);
+            hash = hashName(hash, dexStringById(pDexFile, pMethodId->nameIdx));
+            return hashProto(hash, pDexFile, pMethodId->protoIdx);
+        }
+        break;
+    case kIndexProtoRef:
+        return hashProto(hash, pDexFile, idx);
+    default:
+        break;
+    }
+    return dexHashU4(hash, idx);
+}
+
+/*
+ * Fold in one instruction that has an index operand.  The code units
+ * go in with the index zeroed, followed, when resolving, by what the
+ * index refers to.
+ */
+static u8 hashIndexedInsn(u8 hash, const DexFile* pDexFile, const u2* insns,
+    size_t width, InstructionIndexType indexType, DexCodeHashMode mode)
+{
+    InstructionFormat format =
+        dexGetFormatFromOpcode(dexOpcodeFromCodeUnit(insns[0]));
+    u2 units[kMaxIndexedWidth];
+
+    memcpy(units, insns, width * sizeof(u2));
+    units[1] = 0;
+    if (format == kFmt31c)
+        units[2] = 0;
+    else if (indexType == kIndexMethodAndProtoRef)
+        units[3] = 0;
+    hash = dexHashBlock(hash, units, width * sizeof(u2));
+
+    if (mode == kDexCodeHashResolved) {
+        DecodedInstruction decInsn;
+
+        dexDecodeInstruction(insns, &decInsn);
+        hash = hashReference(hash, pDexFile, indexType,
+            (format == kFmt22c) ? decInsn.vC : decInsn.vB);
+        if (indexType == kIndexMethodAndProtoRef)
+            hash = hashProto(hash, pDexFile, decInsn.arg[4]);
+    }
+    return hash;
+}
+
+/*
+ * Fold in the instructions, treating index operands according to
+ * "mode".  Runs of instructions without indices are hashed in one go.
+ */
+static u8 hashInsns(u8 hash, const DexFile* pDexFile, const DexCode* pCode,
+    DexCodeHashMode mode)
+{
+    const u2* insns = pCode->insns;
+    u4 insnsSize = pCode->insnsSize;
+    u4 runStart = 0;
+    u4 insnIdx = 0;
+
+    while (insnIdx < insnsSize) {
+        const u2* insn = &insns[insnIdx];
+        size_t width = dexGetWidthFromInstruction(insn);
+
+        /* if it's malformed, take the rest as raw data */
+        if (width == 0 || width > insnsSize - insnIdx)
+            break;
+
+        InstructionIndexType indexType =
+            dexGetIndexTypeFromOpcode(dexOpcodeFromCodeUnit(*insn));
+        switch (indexType) {
+        case kIndexStringRef:
+        case kIndexTypeRef:
+        case kIndexFieldRef:
+        case kIndexMethodRef:
+        case kIndexMethodAndProtoRef:
+        case kIndexProtoRef:
+            if (width > kMaxIndexedWidth)
+                break;
+            if (insnIdx > runStart) {
+                hash = dexHashBlock(hash, &insns[runStart],
+                    (insnIdx - runStart) * sizeof(u2));
+            }
+            hash = hashIndexedInsn(hash, pDexFile, insn, width, indexType,
+                mode);
+            runStart = insnIdx + width;
+            break;
+        default:
+            break;
+        }
+        insnIdx += width;
+    }
+
+    if (insnsSize > runStart) {
+        hash = dexHashBlock(hash, &insns[runStart],
+            (insnsSize - runStart) * sizeof(u2));
+    }
+    return hash;
+}
+
+/* (documented in header file) */
+u8 dexComputeCodeHash(const DexFile* pDexFile, const DexCode* pCode,
+    DexCodeHashMode mode)
+{
+    u4 counts[4] = {
+        pCode->registersSize, pCode->insSize, pCode->outsSize,
+        pCode->insnsSize
+    };
+    u8 hash = dexHashBlock(kDexHashInit, counts, sizeof(counts));
+
+    if (mode == kDexCodeHashExact) {
+        hash = dexHashBlock(hash, pCode->insns,
+            pCode->insnsSize * sizeof(u2));
+    } else {
+        hash = hashInsns(hash, pDexFile, pCode, mode);
+    }
+
+    /* the handler offsets are file layout, so hash the handlers instead */
+    const DexTry* pTries = dexGetTries(pCode);
+    hash = dexHashU4(hash, pCode->triesSize);
+    for (u4 i = 0; i < pCode->triesSize; i++) {
+        DexCatchIterator iterator;
+        DexCatchHandler* pHandler;
+
+        hash = dexHashU4(hash, pTries[i].startAddr);
+        hash = dexHashU4(hash, pTries[i].insnCount);
+
+        dexCatchIteratorInit(&iterator, pCode, pTries[i].handlerOff);
+        while ((pHandler = dexCatchIteratorNext(&iterator)) != NULL) {
+            u4 typeIdx = pHandler->typeIdx;
+
+            /* a catch-all has kDexNoIndex, which is never resolved */
+            if (mode == kDexCodeHashResolved)
+                hash = hashType(hash, pDexFile, typeIdx);
+            else if (mode == kDexCodeHashExact || typeIdx == kDexNoIndex)
+                hash = dexHashU4(hash, typeIdx);
+            else
+                hash = dexHashU4(hash, 0);
+            hash = dexHashU4(hash, pHandler->address);
+        }
+    }
+
+    return hash;
+}
+
+struct CodeHashBuild {
+    const DexFile*      pDexFile;
+    DexCodeHashMode     mode;
+    DexCodeHashEntry*   entries;
+};
+
+/*
+ * DexParallelFunc: fill in the hash and size of entries [start, end).
+ */
+static void hashEntries(void* arg, u4 start, u4 end)
+{
+    CodeHashBuild* pBuild = (CodeHashBuild*) arg;
+
+    for (u4 i = start; i < end; i++) {
+        DexCodeHashEntry* pEntry = &pBuild->entries[i];
+        const DexCode* pCode =
+            (const DexCode*) (pBuild->pDexFile->baseAddr + pEntry->codeOff);
+
+        pEntry->hash = dexComputeCodeHash(pBuild->pDexFile, pCode,
+            pBuild->mode);
+        pEntry->codeSize = dexGetCodeItemSize(pCode);
+    }
+}
+
+static int compareEntries(const void* a, const void* b)
+{
+    const DexCodeHashEntry* pEntryA = (const DexCodeHashEntry*) a;
+    const DexCodeHashEntry* pEntryB = (const DexCodeHashEntry*) b;
+
+    if (pEntryA->hash != pEntryB->hash)
+        return (pEntryA->hash > pEntryB->hash) ? 1 : -1;
+    if (pEntryA->codeOff != pEntryB->codeOff)
+        return (pEntryA->codeOff > pEntryB->codeOff) ? 1 : -1;
+    return (pEntryA->methodIdx > pEntryB->methodIdx) -
+        (pEntryA->methodIdx < pEntryB->methodIdx);
+}
+
+/*
+ * Add an entry for each method in "pMethods" that has code.
+ */
+static bool addMethods(DexCodeHashTable* pTable, u4* pCapacity,
+    const DexMethod* pMethods, u4 count)
+{
+    for (u4 i = 0; i < count; i++) {
+        if (pMethods[i].codeOff == 0)
+            continue;
+
+        if (pTable->count == *pCapacity) {
+            u4 newCapacity = (*pCapacity == 0) ? 1024 : *pCapacity * 2;
+            DexCodeHashEntry* newEntries = (DexCodeHashEntry*)
+                realloc(pTable->entries, newCapacity * sizeof(DexCodeHashEntry));
+            if (newEntries == NULL)
+                return false;
+            pTable->entries = newEntries;
+            *pCapacity = newCapacity;
+        }
+
+        DexCodeHashEntry* pEntry = &pTable->entries[pTable->count++];
+        pEntry->methodIdx = pMethods[i].methodIdx;
+        pEntry->codeOff = pMethods[i].codeOff;
+    }
+    return true;
+}
+
+/* (documented in header file) */
+DexCodeHashTable* dexCodeHashTableCreate(const DexFile* pDexFile,
+    DexCodeHashMode mode, int numThreads)
+{
+    DexCodeHashTable* pTable =
+        (DexCodeHashTable*) calloc(1, sizeof(DexCodeHashTable));
+    CodeHashBuild build;
+    DexArena arena;
+    u4 capacity = 0;
+    bool ok = true;
+
+    if (pTable == NULL)
+        return NULL;
+    pTable->mode = mode;
+
+    /*
+     * Listing the methods is cheap next to hashing them, so do it here
+     * and only spread the hashing over the threads.
+     */
+    dexArenaInit(&arena, 0);
+    for (u4 i = 0; ok && i < pDexFile->pHeader->classDefsSize; i++) {
+        const u1* pEncodedData =
+            dexGetClassData(pDexFile, dexGetClassDef(pDexFile, i));
+        DexArenaMark mark = dexArenaMark(&arena);
+        DexClassData* pClassData;
+
+        if (pEncodedData == NULL)
+            continue;
+
+        pClassData = dexReadAndVerifyClassDataInArena(&pEncodedData, NULL,
+            &arena);
+        if (pClassData == NULL) {
+            ALOGE("Trouble reading class data for class_def %u", i);
+            ok = false;
+        } else {
+            ok = addMethods(pTable, &capacity, pClassData->directMethods,
+                    pClassData->header.directMethodsSize) &&
+                addMethods(pTable, &capacity, pClassData->virtualMethods,
+                    pClassData->header.virtualMethodsSize);
+        }
+        dexArenaRelease(&arena, mark);
+    }
+    dexArenaFree(&arena);
+
+    if (!ok) {
+        dexCodeHashTableFree(pTable);
+        return NULL;
+    }
+
+    build.pDexFile = pDexFile;
+    build.mode = mode;
+    build.entries = pTable->entries;
+    dexParallelFor(pTable->count, numThreads, hashEntries, &build);
+
+    if (pTable->count != 0) {
+        qsort(pTable->entries, pTable->count, sizeof(DexCodeHashEntry),
+            compareEntries);
+    }
+    return pTable;
+}
+
+/* (documented in header file) */
+void dexCodeHashTableFree(DexCodeHashTable* pTable)
+{
+    if (pTable == NULL)
+        return;
+    free(pTable->entries);
+    free(pTable);
+}
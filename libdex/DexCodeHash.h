@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Content hashes of code items, and a per-file table of them for
+ * finding duplicate method bodies.
+ *
+ * Debug info is never included, so methods that differ only in line
+ * numbers or local variable names hash the same.
+ */
+
+#ifndef LIBDEX_DEXCODEHASH_H_
+#define LIBDEX_DEXCODEHASH_H_
+
+#include "DexFile.h"
+
+/*
+ * What to do with the index operands of instructions (string, type,
+ * field, method and proto references) and with catch types.
+ */
+enum DexCodeHashMode {
+    /*
+     * Replace each index with what it refers to (string contents,
+     * descriptors, member names and prototypes), so the same code
+     * gives the same hash in any DEX file.
+     */
+    kDexCodeHashResolved = 0,
+
+    /*
+     * Hash the code units as stored, so within one file only code with
+     * the same instructions, indices and catch table is expected to
+     * collide.  Equal hashes are not compared further.
+     */
+    kDexCodeHashExact,
+
+    /*
+     * Leave indices out, so code that differs only in what it refers
+     * to (e.g. accessors for different fields) hashes the same.
+     */
+    kDexCodeHashNormalized,
+};
+
+/*
+ * Compute the hash of "pCode": the register and argument counts, the
+ * instructions and the try/catch table.
+ */
+u8 dexComputeCodeHash(const DexFile* pDexFile, const DexCode* pCode,
+    DexCodeHashMode mode);
+
+/*
+ * One method with code.
+ */
+struct DexCodeHashEntry {
+    u8  hash;
+    u4  methodIdx;
+    u4  codeOff;
+    u4  codeSize;       /* dexGetCodeItemSize() of the code_item */
+};
+
+/*
+ * The hashes of every method with code in a file, sorted by hash, then
+ * by code_item offset, then by method_id.  Methods with the same hash
+ * are adjacent.
+ */
+struct DexCodeHashTable {
+    DexCodeHashMode     mode;
+    DexCodeHashEntry*   entries;
+    u4                  count;
+};
+
+/*
+ * Hash every code_item in "pDexFile", spreading the work over up to
+ * "numThreads" threads.  Returns NULL on failure.
+ */
+DexCodeHashTable* dexCodeHashTableCreate(const DexFile* pDexFile,
+    DexCodeHashMode mode, int numThreads);
+
+/*
+ * Free a table.  NULL is allowed.
+ */
+void dexCodeHashTableFree(DexCodeHashTable* pTable);
+
+#endif  // LIBDEX_DEXCODEHASH_H_
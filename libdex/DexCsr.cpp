@@ -0,0 +1,291 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Serialized compressed-sparse-row indexes.
+ */
+
+#include "DexCsr.h"
+#include "DexOptData.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Get the size of the header and the count arrays that follow it.
+ */
+static size_t headerSize(const DexCsrFormat* pFormat)
+{
+    return sizeof(DexCsrHeader) + 2 * pFormat->tableCount * sizeof(u4);
+}
+
+/*
+ * Point the array pointers of "pCsr" into "data".  If "check" is set,
+ * make sure the data is a well-formed index first.
+ */
+static bool setCsrData(DexCsr* pCsr, const DexCsrFormat* pFormat,
+    const u1* data, size_t length, bool check)
+{
+    const DexCsrHeader* pHeader = (const DexCsrHeader*) data;
+    const u4* idCount = (const u4*) (data + sizeof(DexCsrHeader));
+    const u4* recordCount = idCount + pFormat->tableCount;
+    u8 offset = headerSize(pFormat);
+
+    if (check) {
+        if (length < offset ||
+            memcmp(pHeader->magic, pFormat->magic, sizeof(pHeader->magic)) != 0)
+        {
+            ALOGE("Bad %s magic", pFormat->description);
+            return false;
+        }
+        if (pHeader->version != pFormat->version) {
+            ALOGE("Unsupported %s version %u", pFormat->description,
+                pHeader->version);
+            return false;
+        }
+    }
+
+    for (u4 table = 0; table < pFormat->tableCount; table++) {
+        u8 offsetsSize = ((u8) idCount[table] + 1) * sizeof(u4);
+        u8 recordsSize = (u8) recordCount[table] * pFormat->recordSize;
+
+        if (check && offset + offsetsSize + recordsSize > length) {
+            ALOGE("Truncated %s", pFormat->description);
+            return false;
+        }
+        pCsr->offsets[table] = (const u4*) (data + offset);
+        pCsr->records[table] = data + offset + offsetsSize;
+        offset += offsetsSize + recordsSize;
+    }
+
+    if (check) {
+        if (offset != length) {
+            ALOGE("Bad %s length %zu, expected %llu", pFormat->description,
+                length, (unsigned long long) offset);
+            return false;
+        }
+
+        /* the lookups trust the offsets, so make sure they're sane */
+        for (u4 table = 0; table < pFormat->tableCount; table++) {
+            const u4* offsets = pCsr->offsets[table];
+            u4 count = idCount[table];
+            bool sane = offsets[0] == 0 &&
+                offsets[count] == recordCount[table];
+
+            for (u4 i = 0; sane && i < count; i++)
+                sane = offsets[i] <= offsets[i + 1];
+            if (!sane) {
+                ALOGE("Bad %s offsets", pFormat->description);
+                return false;
+            }
+        }
+    }
+
+    pCsr->pHeader = pHeader;
+    pCsr->length = length;
+    pCsr->recordSize = pFormat->recordSize;
+    pCsr->idCount = idCount;
+    pCsr->recordCount = recordCount;
+    return true;
+}
+
+/* (documented in header file) */
+void* dexCsrAddEdge(DexParallelChunk* pChunk, u4 table, u4 idx)
+{
+    DexCsrEdge* pEdge = (DexCsrEdge*) dexParallelChunkAppend(pChunk);
+
+    if (pEdge == NULL)
+        return NULL;
+    pEdge->table = table;
+    pEdge->idx = idx;
+    return pEdge + 1;
+}
+
+/* (documented in header file) */
+bool dexCsrBuild(DexCsr* pCsr, const DexCsrFormat* pFormat,
+    const DexFile* pDexFile, const u4* idCount,
+    DexParallelChunk* const* chunks, u4 chunkCount)
+{
+    const DexHeader* pDexHeader = pDexFile->pHeader;
+    u4 tableCount = pFormat->tableCount;
+    size_t recordSize = pFormat->recordSize;
+    u4 recordCount[kDexCsrMaxTables];
+    u4* offsets[kDexCsrMaxTables];
+    u1* records[kDexCsrMaxTables];
+    size_t length = headerSize(pFormat);
+
+    memset(pCsr, 0, sizeof(*pCsr));
+    memset(recordCount, 0, sizeof(recordCount));
+    for (u4 i = 0; i < chunkCount; i++) {
+        for (u4 j = 0; j < chunks[i]->count; j++) {
+            const DexCsrEdge* pEdge =
+                (const DexCsrEdge*) dexParallelChunkRecord(chunks[i], j);
+            recordCount[pEdge->table]++;
+        }
+    }
+    for (u4 table = 0; table < tableCount; table++) {
+        length += ((size_t) idCount[table] + 1) * sizeof(u4) +
+            (size_t) recordCount[table] * recordSize;
+    }
+
+    u1* data = (u1*) calloc(1, length);
+    if (data == NULL)
+        return false;
+
+    DexCsrHeader* pHeader = (DexCsrHeader*) data;
+    memcpy(pHeader->magic, pFormat->magic, sizeof(pHeader->magic));
+    pHeader->version = pFormat->version;
+    pHeader->dexChecksum = pDexHeader->checksum;
+    memcpy(pHeader->dexSignature, pDexHeader->signature, kSHA1DigestLen);
+    u4* counts = (u4*) (pHeader + 1);
+    memcpy(counts, idCount, tableCount * sizeof(u4));
+    memcpy(counts + tableCount, recordCount, tableCount * sizeof(u4));
+
+    pCsr->allocData = data;
+    setCsrData(pCsr, pFormat, data, length, false);
+    for (u4 table = 0; table < tableCount; table++) {
+        offsets[table] = (u4*) pCsr->offsets[table];
+        records[table] = (u1*) pCsr->records[table];
+    }
+
+    /* count, then turn the counts into start offsets */
+    for (u4 i = 0; i < chunkCount; i++) {
+        for (u4 j = 0; j < chunks[i]->count; j++) {
+            const DexCsrEdge* pEdge =
+                (const DexCsrEdge*) dexParallelChunkRecord(chunks[i], j);
+            offsets[pEdge->table][pEdge->idx]++;
+        }
+    }
+    for (u4 table = 0; table < tableCount; table++) {
+        u4 total = 0;
+        for (u4 i = 0; i <= idCount[table]; i++) {
+            u4 count = offsets[table][i];
+            offsets[table][i] = total;
+            total += count;
+        }
+    }
+
+    /*
+     * Scatter in chunk order, which keeps each id's records in the
+     * order they were found.  This advances each offset to the start of
+     * the next id, so shift them back afterwards.
+     */
+    for (u4 i = 0; i < chunkCount; i++) {
+        for (u4 j = 0; j < chunks[i]->count; j++) {
+            const DexCsrEdge* pEdge =
+                (const DexCsrEdge*) dexParallelChunkRecord(chunks[i], j);
+            u4 pos = offsets[pEdge->table][pEdge->idx]++;
+            memcpy(records[pEdge->table] + (size_t) pos * recordSize,
+                pEdge + 1, recordSize);
+        }
+    }
+    for (u4 table = 0; table < tableCount; table++) {
+        memmove(&offsets[table][1], &offsets[table][0],
+            idCount[table] * sizeof(u4));
+        offsets[table][0] = 0;
+    }
+
+    return true;
+}
+
+/* (documented in header file) */
+void dexCsrRelease(DexCsr* pCsr)
+{
+    if (pCsr->mapped)
+        sysReleaseShmem(&pCsr->map);
+    free(pCsr->allocData);
+    pCsr->mapped = false;
+    pCsr->allocData = NULL;
+}
+
+/* (documented in header file) */
+int dexCsrWrite(const DexCsr* pCsr, int fd)
+{
+    return sysWriteFully(fd, pCsr->pHeader, pCsr->length, "dexcsr");
+}
+
+/*
+ * Return true if "pCsr" was built from "pDexFile".
+ */
+static bool builtFrom(const DexCsr* pCsr, const DexFile* pDexFile)
+{
+    return pCsr->pHeader->dexChecksum == pDexFile->pHeader->checksum &&
+        memcmp(pCsr->pHeader->dexSignature, pDexFile->pHeader->signature,
+            kSHA1DigestLen) == 0;
+}
+
+/* (documented in header file) */
+bool dexCsrOpen(DexCsr* pCsr, const DexCsrFormat* pFormat,
+    const char* fileName, const DexFile* pDexFile)
+{
+    bool result = false;
+    struct stat st;
+    int fd;
+
+    memset(pCsr, 0, sizeof(*pCsr));
+    fd = open(fileName, O_RDONLY);
+    if (fd < 0) {
+        ALOGE("Unable to open '%s': %s", fileName, strerror(errno));
+        return false;
+    }
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t) headerSize(pFormat)) {
+        ALOGE("Truncated %s '%s'", pFormat->description, fileName);
+        goto bail;
+    }
+
+    if (sysMapFileSegmentInShmem(fd, 0, st.st_size, &pCsr->map) != 0)
+        goto bail;
+    pCsr->mapped = true;
+
+    if (!setCsrData(pCsr, pFormat, (const u1*) pCsr->map.addr,
+            pCsr->map.length, true))
+        goto bail;
+    if (pDexFile != NULL && !builtFrom(pCsr, pDexFile)) {
+        ALOGE("'%s' was built from a different DEX file", fileName);
+        goto bail;
+    }
+    result = true;
+
+bail:
+    if (!result)
+        dexCsrRelease(pCsr);
+    close(fd);
+    return result;
+}
+
+/* (documented in header file) */
+bool dexCsrFromOptData(DexCsr* pCsr, const DexCsrFormat* pFormat,
+    const DexFile* pDexFile)
+{
+    u4 size;
+    const u1* data = dexGetOptChunk(pDexFile, pFormat->optChunkType, &size);
+
+    memset(pCsr, 0, sizeof(*pCsr));
+    if (data == NULL)
+        return false;
+
+    if (!setCsrData(pCsr, pFormat, data, size, true) ||
+        !builtFrom(pCsr, pDexFile))
+    {
+        ALOGW("Ignoring unusable %s chunk", pFormat->description);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Serialized compressed-sparse-row indexes, the on-disk form of the
+ * cross-reference and annotation indexes (DexXref.h,
+ * DexAnnotationIndex.h).
+ *
+ * An index holds one or more tables.  Each table maps ids in
+ * [0, idCount) to runs of fixed-size records: an array of (idCount + 1)
+ * offsets and an array of records, so the records for id "i" are
+ * records[offsets[i]] through records[offsets[i+1] - 1].
+ *
+ * The index is a single contiguous block: a DexCsrHeader, u4
+ * idCount[tableCount], u4 recordCount[tableCount], then for each table
+ * in turn its offsets and its records.  All values are in host byte
+ * order.  The block can be written to disk as-is and later mapped and
+ * used in place.
+ */
+
+#ifndef LIBDEX_DEXCSR_H_
+#define LIBDEX_DEXCSR_H_
+
+#include "DexFile.h"
+#include "DexParallel.h"
+
+#define kDexCsrMaxTables    4
+
+/*
+ * Start of a serialized index.
+ */
+struct DexCsrHeader {
+    u1  magic[8];
+    u4  version;
+    u4  dexChecksum;                /* of the file that was indexed */
+    u1  dexSignature[kSHA1DigestLen];
+};
+
+/*
+ * What distinguishes one kind of index from another.
+ */
+struct DexCsrFormat {
+    const char* magic;              /* 8 bytes with the '\0' */
+    u4          version;
+    u4          tableCount;
+    size_t      recordSize;         /* a multiple of 4 */
+    u4          optChunkType;       /* kDexChunk* type in opt data */
+    const char* description;        /* for messages */
+};
+
+/*
+ * An index, either built in memory or mapped from a file.
+ */
+struct DexCsr {
+    const DexCsrHeader* pHeader;
+    size_t              length;     /* of the serialized form */
+    size_t              recordSize;
+    const u4*           idCount;    /* in the header */
+    const u4*           recordCount;
+    const u4*           offsets[kDexCsrMaxTables];
+    const u1*           records[kDexCsrMaxTables];
+
+    /* at most one of these owns the data; neither for opt data */
+    u1*                 allocData;
+    MemMapping          map;
+    bool                mapped;
+};
+
+/*
+ * What builders put in a DexParallelCollector: the table and id a
+ * record belongs to, followed by the record itself.  Collectors for
+ * dexCsrBuild() have a record size of sizeof(DexCsrEdge) plus the
+ * format's recordSize.
+ */
+struct DexCsrEdge {
+    u4  table;
+    u4  idx;
+};
+
+/*
+ * Add an edge to "pChunk".  Returns a pointer to the (uninitialized)
+ * record that follows it, or NULL on allocation failure.
+ */
+void* dexCsrAddEdge(DexParallelChunk* pChunk, u4 table, u4 idx);
+
+/*
+ * Lay the edges in "chunks", sorted by dexParallelCollectorSort(), out
+ * as an index of "pFormat" built from "pDexFile".  Each id's records
+ * keep the order of the chunks and of the edges within them.  Returns
+ * false on allocation failure.
+ */
+bool dexCsrBuild(DexCsr* pCsr, const DexCsrFormat* pFormat,
+    const DexFile* pDexFile, const u4* idCount,
+    DexParallelChunk* const* chunks, u4 chunkCount);
+
+/*
+ * Free the data "pCsr" owns.
+ */
+void dexCsrRelease(DexCsr* pCsr);
+
+/*
+ * Write the serialized index to "fd".  Returns 0 on success.
+ */
+int dexCsrWrite(const DexCsr* pCsr, int fd);
+
+/*
+ * Map an index written by dexCsrWrite().  The file's layout is checked
+ * before it's used.  If "pDexFile" is non-NULL the index must have been
+ * built from a file with the same checksum and signature.  Returns false
+ * on failure.
+ */
+bool dexCsrOpen(DexCsr* pCsr, const DexCsrFormat* pFormat,
+    const char* fileName, const DexFile* pDexFile);
+
+/*
+ * Use the index stored in the format's chunk of an optimized DEX file's
+ * opt data (see dexOptAppendChunks()), in place.  The chunk is checked
+ * as dexCsrOpen() checks a file.  Returns false if there is no usable
+ * chunk.
+ */
+bool dexCsrFromOptData(DexCsr* pCsr, const DexCsrFormat* pFormat,
+    const DexFile* pDexFile);
+
+/*
+ * Get the records for "idx" in table "table".  Sets "*pCount" to the
+ * number of records.
+ */
+DEX_INLINE const void* dexCsrGetRecords(const DexCsr* pCsr, u4 table,
+    u4 idx, u4* pCount)
+{
+    const u4* offsets = pCsr->offsets[table];
+    assert(idx < pCsr->idCount[table]);
+    *pCount = offsets[idx + 1] - offsets[idx];
+    return pCsr->records[table] + (size_t) offsets[idx] * pCsr->recordSize;
+}
+
+#endif  // LIBDEX_DEXCSR_H_
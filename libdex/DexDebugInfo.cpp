@@ -279,3 +279,43 @@ void dexDecodeDebugInfo(
         emitLocalCbIfLive(cnxt, reg, pCode->insnsSize, localInReg, localCb);
     }
 }
+
+/* (documented in header file) */
+size_t dexGetDebugInfoSize(const u1* stream)
+{
+    const u1* start = stream;
+    u4 parametersSize;
+
+    skipLeb128(&stream);                    // line_start
+    parametersSize = readUnsignedLeb128(&stream);
+    while (parametersSize-- != 0)
+        skipLeb128(&stream);                // parameter_names
+
+    for (;;) {
+        u1 opcode = *stream++;
+
+        switch (opcode) {
+            case DBG_END_SEQUENCE:
+                return stream - start;
+
+            case DBG_START_LOCAL_EXTENDED:
+                skipLeb128(&stream);        // sig_idx
+                // fall through
+            case DBG_START_LOCAL:
+                skipLeb128(&stream);        // name_idx
+                skipLeb128(&stream);        // type_idx
+                // fall through
+            case DBG_ADVANCE_PC:
+            case DBG_ADVANCE_LINE:
+            case DBG_END_LOCAL:
+            case DBG_RESTART_LOCAL:
+            case DBG_SET_FILE:
+                skipLeb128(&stream);
+                break;
+
+            default:
+                /* DBG_SET_PROLOGUE_END, DBG_SET_EPILOGUE_BEGIN, specials */
+                break;
+        }
+    }
+}
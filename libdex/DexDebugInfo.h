@@ -52,4 +52,10 @@ void dexDecodeDebugInfo(
             DexDebugNewPositionCb posCb, DexDebugNewLocalCb localCb,
             void* cnxt);
 
+/*
+ * Return the size, in bytes, of the debug_info_item starting at
+ * "stream", without interpreting it.  The stream must be well-formed.
+ */
+size_t dexGetDebugInfoSize(const u1* stream);
+
 #endif  // LIBDEX_DEXDEBUGINFO_H_
@@ -0,0 +1,476 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Structural comparison of two DEX files.
+ */
+
+#include "DexDiff.h"
+#include "DexArena.h"
+#include "DexClass.h"
+#include "DexCodeHash.h"
+#include "DexParallel.h"
+#include "DexProto.h"
+#include "DexUtf.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Which class_defs a pass walks: the old file's, looking for removed
+ * and modified classes, or the new file's, looking for added ones.
+ */
+enum DiffPass {
+    kDiffPassOld = 0,
+    kDiffPassNew,
+};
+
+struct DiffBuild {
+    const DexFile*  pOld;
+    const DexFile*  pNew;
+    DiffPass        pass;
+};
+
+static bool addEntry(DexParallelChunk* pChunk, DexDiffKind kind,
+    DexDiffItemType itemType, u4 changes, u4 oldIdx, u4 newIdx)
+{
+    DexDiffEntry* pEntry = (DexDiffEntry*) dexParallelChunkAppend(pChunk);
+
+    if (pEntry == NULL)
+        return false;
+    pEntry->kind = kind;
+    pEntry->itemType = itemType;
+    pEntry->changes = changes;
+    pEntry->oldIdx = oldIdx;
+    pEntry->newIdx = newIdx;
+    return true;
+}
+
+/*
+ * Compare type "oldIdx" in the old file with "newIdx" in the new one.
+ * Either may be kDexNoIndex.
+ */
+static bool sameType(const DiffBuild* pBuild, u4 oldIdx, u4 newIdx)
+{
+    if (oldIdx == kDexNoIndex || newIdx == kDexNoIndex)
+        return oldIdx == newIdx;
+    return strcmp(dexStringByTypeIdx(pBuild->pOld, oldIdx),
+        dexStringByTypeIdx(pBuild->pNew, newIdx)) == 0;
+}
+
+static bool sameTypeList(const DiffBuild* pBuild, const DexTypeList* pOldList,
+    const DexTypeList* pNewList)
+{
+    u4 oldSize = (pOldList != NULL) ? pOldList->size : 0;
+    u4 newSize = (pNewList != NULL) ? pNewList->size : 0;
+
+    if (oldSize != newSize)
+        return false;
+    for (u4 i = 0; i < oldSize; i++) {
+        if (!sameType(pBuild, dexGetTypeItem(pOldList, i)->typeIdx,
+                dexGetTypeItem(pNewList, i)->typeIdx))
+            return false;
+    }
+    return true;
+}
+
+/*
+ * Get the next field of a class in field_id order, merging the static
+ * and instance lists, which are each sorted already.  Returns NULL at
+ * the end.
+ */
+static const DexField* nextField(const DexClassData* pClassData,
+    u4* pStaticPos, u4* pInstancePos)
+{
+    const DexClassDataHeader* pHeader = &pClassData->header;
+    const DexField* pStatic = (*pStaticPos < pHeader->staticFieldsSize) ?
+        &pClassData->staticFields[*pStaticPos] : NULL;
+    const DexField* pInstance =
+        (*pInstancePos < pHeader->instanceFieldsSize) ?
+        &pClassData->instanceFields[*pInstancePos] : NULL;
+
+    if (pStatic != NULL &&
+        (pInstance == NULL || pStatic->fieldIdx < pInstance->fieldIdx))
+    {
+        (*pStaticPos)++;
+        return pStatic;
+    }
+    if (pInstance != NULL)
+        (*pInstancePos)++;
+    return pInstance;
+}
+
+/*
+ * Like nextField(), for direct and virtual methods.
+ */
+static const DexMethod* nextMethod(const DexClassData* pClassData,
+    u4* pDirectPos, u4* pVirtualPos)
+{
+    const DexClassDataHeader* pHeader = &pClassData->header;
+    const DexMethod* pDirect = (*pDirectPos < pHeader->directMethodsSize) ?
+        &pClassData->directMethods[*pDirectPos] : NULL;
+    const DexMethod* pVirtual =
+        (*pVirtualPos < pHeader->virtualMethodsSize) ?
+        &pClassData->virtualMethods[*pVirtualPos] : NULL;
+
+    if (pDirect != NULL &&
+        (pVirtual == NULL || pDirect->methodIdx < pVirtual->methodIdx))
+    {
+        (*pDirectPos)++;
+        return pDirect;
+    }
+    if (pVirtual != NULL)
+        (*pVirtualPos)++;
+    return pVirtual;
+}
+
+/*
+ * Order two fields of the same class the way field_ids are sorted:
+ * by name, then by type.
+ */
+static int compareFields(const DiffBuild* pBuild, const DexField* pOldField,
+    const DexField* pNewField)
+{
+    const DexFieldId* pOldId = dexGetFieldId(pBuild->pOld, pOldField->fieldIdx);
+    const DexFieldId* pNewId = dexGetFieldId(pBuild->pNew, pNewField->fieldIdx);
+    int result;
+
+    result = dexUtf8Cmp(dexStringById(pBuild->pOld, pOldId->nameIdx),
+        dexStringById(pBuild->pNew, pNewId->nameIdx));
+    if (result == 0) {
+        result = dexUtf8Cmp(dexStringByTypeIdx(pBuild->pOld, pOldId->typeIdx),
+            dexStringByTypeIdx(pBuild->pNew, pNewId->typeIdx));
+    }
+    return result;
+}
+
+/*
+ * Order two methods of the same class the way method_ids are sorted:
+ * by name, then by prototype.
+ */
+static int compareMethods(const DiffBuild* pBuild,
+    const DexMethod* pOldMethod, const DexMethod* pNewMethod)
+{
+    const DexMethodId* pOldId =
+        dexGetMethodId(pBuild->pOld, pOldMethod->methodIdx);
+    const DexMethodId* pNewId =
+        dexGetMethodId(pBuild->pNew, pNewMethod->methodIdx);
+    int result;
+
+    result = dexUtf8Cmp(dexStringById(pBuild->pOld, pOldId->nameIdx),
+        dexStringById(pBuild->pNew, pNewId->nameIdx));
+    if (result == 0) {
+        DexProto oldProto = { pBuild->pOld, pOldId->protoIdx };
+        DexProto newProto = { pBuild->pNew, pNewId->protoIdx };
+        result = dexProtoCompare(&oldProto, &newProto);
+    }
+    return result;
+}
+
+static u4 methodChanges(const DiffBuild* pBuild, const DexMethod* pOldMethod,
+    const DexMethod* pNewMethod)
+{
+    u4 changes = 0;
+
+    if (pOldMethod->accessFlags != pNewMethod->accessFlags)
+        changes |= kDexDiffAccessFlags;
+
+    if (pOldMethod->codeOff == 0 || pNewMethod->codeOff == 0) {
+        if (pOldMethod->codeOff != pNewMethod->codeOff)
+            changes |= kDexDiffCode;
+    } else if (dexComputeCodeHash(pBuild->pOld,
+                   dexGetCode(pBuild->pOld, pOldMethod),
+                   kDexCodeHashResolved) !=
+               dexComputeCodeHash(pBuild->pNew,
+                   dexGetCode(pBuild->pNew, pNewMethod),
+                   kDexCodeHashResolved))
+    {
+        changes |= kDexDiffCode;
+    }
+    return changes;
+}
+
+/*
+ * Merge the members of a class present in both files, in id order, and
+ * record the ones added, removed or changed.
+ */
+static bool diffMembers(const DiffBuild* pBuild, DexParallelChunk* pChunk,
+    const DexClassData* pOldData, const DexClassData* pNewData)
+{
+    u4 oldFirst = 0, oldSecond = 0, newFirst = 0, newSecond = 0;
+    const DexField* pOldField = nextField(pOldData, &oldFirst, &oldSecond);
+    const DexField* pNewField = nextField(pNewData, &newFirst, &newSecond);
+    bool ok = true;
+
+    while (ok && (pOldField != NULL || pNewField != NULL)) {
+        int cmp;
+
+        if (pOldField == NULL)
+            cmp = 1;
+        else if (pNewField == NULL)
+            cmp = -1;
+        else
+            cmp = compareFields(pBuild, pOldField, pNewField);
+
+        if (cmp < 0) {
+            ok = addEntry(pChunk, kDexDiffRemoved, kDexDiffField, 0,
+                pOldField->fieldIdx, kDexNoIndex);
+            pOldField = nextField(pOldData, &oldFirst, &oldSecond);
+        } else if (cmp > 0) {
+            ok = addEntry(pChunk, kDexDiffAdded, kDexDiffField, 0,
+                kDexNoIndex, pNewField->fieldIdx);
+            pNewField = nextField(pNewData, &newFirst, &newSecond);
+        } else {
+            if (pOldField->accessFlags != pNewField->accessFlags) {
+                ok = addEntry(pChunk, kDexDiffModified, kDexDiffField,
+                    kDexDiffAccessFlags,
+                    pOldField->fieldIdx, pNewField->fieldIdx);
+            }
+            pOldField = nextField(pOldData, &oldFirst, &oldSecond);
+            pNewField = nextField(pNewData, &newFirst, &newSecond);
+        }
+    }
+
+    oldFirst = oldSecond = newFirst = newSecond = 0;
+    const DexMethod* pOldMethod = nextMethod(pOldData, &oldFirst, &oldSecond);
+    const DexMethod* pNewMethod = nextMethod(pNewData, &newFirst, &newSecond);
+
+    while (ok && (pOldMethod != NULL || pNewMethod != NULL)) {
+        int cmp;
+
+        if (pOldMethod == NULL)
+            cmp = 1;
+        else if (pNewMethod == NULL)
+            cmp = -1;
+        else
+            cmp = compareMethods(pBuild, pOldMethod, pNewMethod);
+
+        if (cmp < 0) {
+            ok = addEntry(pChunk, kDexDiffRemoved, kDexDiffMethod, 0,
+                pOldMethod->methodIdx, kDexNoIndex);
+            pOldMethod = nextMethod(pOldData, &oldFirst, &oldSecond);
+        } else if (cmp > 0) {
+            ok = addEntry(pChunk, kDexDiffAdded, kDexDiffMethod, 0,
+                kDexNoIndex, pNewMethod->methodIdx);
+            pNewMethod = nextMethod(pNewData, &newFirst, &newSecond);
+        } else {
+            u4 changes = methodChanges(pBuild, pOldMethod, pNewMethod);
+            if (changes != 0) {
+                ok = addEntry(pChunk, kDexDiffModified, kDexDiffMethod,
+                    changes, pOldMethod->methodIdx, pNewMethod->methodIdx);
+            }
+            pOldMethod = nextMethod(pOldData, &oldFirst, &oldSecond);
+            pNewMethod = nextMethod(pNewData, &newFirst, &newSecond);
+        }
+    }
+    return ok;
+}
+
+/*
+ * Compare a class present in both files.  Its entry goes ahead of the
+ * entries for its members, and is dropped again if nothing changed.
+ */
+static void diffClass(const DiffBuild* pBuild, DexParallelChunk* pChunk,
+    DexArena* pArena, u4 oldIdx, u4 newIdx)
+{
+    const DexClassDef* pOldDef = dexGetClassDef(pBuild->pOld, oldIdx);
+    const DexClassDef* pNewDef = dexGetClassDef(pBuild->pNew, newIdx);
+    u4 entryPos = pChunk->count;
+    u4 changes = 0;
+
+    if (pOldDef->accessFlags != pNewDef->accessFlags)
+        changes |= kDexDiffAccessFlags;
+    if (!sameType(pBuild, pOldDef->superclassIdx, pNewDef->superclassIdx))
+        changes |= kDexDiffSuperclass;
+    if (!sameTypeList(pBuild, dexGetInterfacesList(pBuild->pOld, pOldDef),
+            dexGetInterfacesList(pBuild->pNew, pNewDef)))
+        changes |= kDexDiffInterfaces;
+
+    if (!addEntry(pChunk, kDexDiffModified, kDexDiffClass, 0, oldIdx, newIdx))
+        return;
+
+    DexArenaMark mark = dexArenaMark(pArena);
+    const u1* pOldEncoded = dexGetClassData(pBuild->pOld, pOldDef);
+    const u1* pNewEncoded = dexGetClassData(pBuild->pNew, pNewDef);
+    DexClassData* pOldData =
+        dexReadAndVerifyClassDataInArena(&pOldEncoded, NULL, pArena);
+    DexClassData* pNewData =
+        dexReadAndVerifyClassDataInArena(&pNewEncoded, NULL, pArena);
+    bool ok;
+
+    if (pOldData == NULL || pNewData == NULL) {
+        ALOGE("Trouble reading class data for %s",
+            dexStringByTypeIdx(pBuild->pOld, pOldDef->classIdx));
+        pChunk->failed = true;
+        ok = false;
+    } else {
+        ok = diffMembers(pBuild, pChunk, pOldData, pNewData);
+    }
+    dexArenaRelease(pArena, mark);
+    if (!ok)
+        return;
+
+    if (pChunk->count > entryPos + 1)
+        changes |= kDexDiffMembers;
+    if (changes == 0) {
+        pChunk->count = entryPos;
+    } else {
+        DexDiffEntry* pEntry =
+            (DexDiffEntry*) dexParallelChunkRecord(pChunk, entryPos);
+        pEntry->changes = changes;
+    }
+}
+
+static u4 classDefIndex(const DexFile* pDexFile, const DexClassDef* pClassDef)
+{
+    return pClassDef - dexGetClassDef(pDexFile, 0);
+}
+
+/*
+ * DexCollectFunc: compare class_defs [start, end) of the file being
+ * walked by the current pass into "pChunk".
+ */
+static void diffClasses(void* arg, DexParallelChunk* pChunk, u4 start,
+    u4 end)
+{
+    const DiffBuild* pBuild = (const DiffBuild*) arg;
+    DexArena arena;
+
+    dexArenaInit(&arena, 0);
+
+    for (u4 i = start; i < end && !pChunk->failed; i++) {
+        if (pBuild->pass == kDiffPassOld) {
+            const DexClassDef* pClassDef = dexGetClassDef(pBuild->pOld, i);
+            const DexClassDef* pNewDef = dexFindClass(pBuild->pNew,
+                dexStringByTypeIdx(pBuild->pOld, pClassDef->classIdx));
+
+            if (pNewDef == NULL) {
+                addEntry(pChunk, kDexDiffRemoved, kDexDiffClass, 0,
+                    i, kDexNoIndex);
+            } else {
+                diffClass(pBuild, pChunk, &arena, i,
+                    classDefIndex(pBuild->pNew, pNewDef));
+            }
+        } else {
+            const DexClassDef* pClassDef = dexGetClassDef(pBuild->pNew, i);
+
+            if (dexFindClass(pBuild->pOld,
+                    dexStringByTypeIdx(pBuild->pNew, pClassDef->classIdx))
+                == NULL)
+            {
+                addEntry(pChunk, kDexDiffAdded, kDexDiffClass, 0,
+                    kDexNoIndex, i);
+            }
+        }
+    }
+    dexArenaFree(&arena);
+}
+
+/*
+ * Make sure "pDexFile" has a class lookup table.  Returns the table if
+ * one had to be built, so the caller can take it away again.
+ */
+static DexClassLookup* ensureClassLookup(DexFile* pDexFile, bool* pFailed)
+{
+    DexClassLookup* pLookup;
+
+    if (pDexFile->pClassLookup != NULL)
+        return NULL;
+
+    pLookup = dexCreateClassLookup(pDexFile);
+    if (pLookup == NULL)
+        *pFailed = true;
+    pDexFile->pClassLookup = pLookup;
+    return pLookup;
+}
+
+/* (documented in header file) */
+DexDiff* dexDiffCreate(DexFile* pOldDexFile, DexFile* pNewDexFile,
+    int numThreads)
+{
+    DexClassLookup* pOldLookup = NULL;
+    DexClassLookup* pNewLookup = NULL;
+    DexParallelCollector collector;
+    DexParallelChunk** chunks = NULL;
+    DexDiff* pDiff = NULL;
+    DiffBuild build;
+    bool failed = false;
+    u4 total = 0;
+
+    build.pOld = pOldDexFile;
+    build.pNew = pNewDexFile;
+    dexParallelCollectorInit(&collector, sizeof(DexDiffEntry));
+
+    pOldLookup = ensureClassLookup(pOldDexFile, &failed);
+    pNewLookup = ensureClassLookup(pNewDexFile, &failed);
+    if (failed)
+        goto bail;
+
+    /* the new-file pass is keyed past every old-file chunk */
+    build.pass = kDiffPassOld;
+    dexParallelCollect(&collector, pOldDexFile->pHeader->classDefsSize,
+        numThreads, 0, diffClasses, &build);
+    build.pass = kDiffPassNew;
+    dexParallelCollect(&collector, pNewDexFile->pHeader->classDefsSize,
+        numThreads, (u8) 1 << 32, diffClasses, &build);
+
+    chunks = dexParallelCollectorSort(&collector);
+    if (chunks == NULL)
+        goto bail;
+    for (u4 i = 0; i < collector.chunkCount; i++)
+        total += chunks[i]->count;
+
+    pDiff = (DexDiff*) calloc(1, sizeof(DexDiff));
+    if (pDiff == NULL)
+        goto bail;
+    pDiff->pOldDexFile = pOldDexFile;
+    pDiff->pNewDexFile = pNewDexFile;
+    pDiff->entries = (DexDiffEntry*) malloc((total + 1) * sizeof(DexDiffEntry));
+    if (pDiff->entries == NULL) {
+        free(pDiff);
+        pDiff = NULL;
+        goto bail;
+    }
+    for (u4 i = 0; i < collector.chunkCount; i++) {
+        if (chunks[i]->count == 0)
+            continue;
+        memcpy(&pDiff->entries[pDiff->count], chunks[i]->records,
+            chunks[i]->count * sizeof(DexDiffEntry));
+        pDiff->count += chunks[i]->count;
+    }
+
+bail:
+    free(chunks);
+    dexParallelCollectorFree(&collector);
+    if (pOldLookup != NULL) {
+        pOldDexFile->pClassLookup = NULL;
+        free(pOldLookup);
+    }
+    if (pNewLookup != NULL) {
+        pNewDexFile->pClassLookup = NULL;
+        free(pNewLookup);
+    }
+    return pDiff;
+}
+
+/* (documented in header file) */
+void dexDiffFree(DexDiff* pDiff)
+{
+    if (pDiff == NULL)
+        return;
+    free(pDiff->entries);
+    free(pDiff);
+}
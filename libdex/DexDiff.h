@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Structural comparison of two DEX files, e.g. two builds of the same
+ * app.  Classes are matched by descriptor and members by name and
+ * signature, so the result doesn't depend on how either file happens to
+ * number its strings, types, fields and methods.  Code is compared by
+ * content hash, with indices resolved (see DexCodeHash.h).
+ *
+ * Class access flags, superclass, interfaces, fields and methods are
+ * compared.  Annotations, static values and debug info are not.
+ */
+
+#ifndef LIBDEX_DEXDIFF_H_
+#define LIBDEX_DEXDIFF_H_
+
+#include "DexFile.h"
+
+enum DexDiffKind {
+    kDexDiffAdded = 0,
+    kDexDiffRemoved,
+    kDexDiffModified,
+};
+
+enum DexDiffItemType {
+    kDexDiffClass = 0,
+    kDexDiffField,
+    kDexDiffMethod,
+};
+
+/*
+ * What changed in a kDexDiffModified entry.
+ */
+enum {
+    kDexDiffAccessFlags     = 0x01,
+    kDexDiffSuperclass      = 0x02,     /* classes only */
+    kDexDiffInterfaces      = 0x04,     /* classes only */
+    kDexDiffMembers         = 0x08,     /* classes only; see the entries
+                                           that follow */
+    kDexDiffCode            = 0x10,     /* methods only */
+};
+
+/*
+ * One difference.  For classes the indices are class_def indices; for
+ * fields and methods they are field_id and method_id indices.  The
+ * index for the side an item is missing from is kDexNoIndex.
+ */
+struct DexDiffEntry {
+    u1  kind;               /* DexDiffKind */
+    u1  itemType;           /* DexDiffItemType */
+    u2  changes;            /* kDexDiff* flags, for kDexDiffModified */
+    u4  oldIdx;
+    u4  newIdx;
+};
+
+/*
+ * The differences between two files.  Removed and modified classes
+ * come first, in the old file's class_def order, each modified class
+ * followed by its changed fields and then its changed methods; added
+ * classes follow in the new file's class_def order.
+ */
+struct DexDiff {
+    const DexFile*  pOldDexFile;
+    const DexFile*  pNewDexFile;
+    DexDiffEntry*   entries;
+    u4              count;
+};
+
+/*
+ * Compare "pOldDexFile" with "pNewDexFile".  Classes are split across up
+ * to "numThreads" threads; the result doesn't depend on the thread
+ * count.  Nothing is copied out of the files beyond the entries found.
+ *
+ * Class lookup tables are needed to match classes; if a file doesn't
+ * have one, one is built for the duration of the call.
+ *
+ * Returns NULL on failure.
+ */
+DexDiff* dexDiffCreate(DexFile* pOldDexFile, DexFile* pNewDexFile,
+    int numThreads);
+
+/*
+ * Free a result from dexDiffCreate().  NULL is allowed.
+ */
+void dexDiffFree(DexDiff* pDiff);
+
+#endif  // LIBDEX_DEXDIFF_H_
@@ -19,6 +19,8 @@
  */
 
 #include "DexFile.h"
+#include "DexIndex.h"
+#include "DexIntegrity.h"
 #include "DexOptData.h"
 #include "DexProto.h"
 #include "DexCatch.h"
@@ -35,13 +37,6 @@
 #include <errno.h>
 
 
-/*
- * Verifying checksums is good, but it slows things down and causes us to
- * touch every page.  In the "optimized" world, it doesn't work at all,
- * because we rewrite the contents.
- */
-static const bool kVerifySignature = false;
-
 /* (documented in header) */
 char dexGetPrimitiveTypeDescriptorChar(PrimitiveType type) {
     const char* string = dexGetPrimitiveTypeDescriptor(type);
@@ -288,6 +283,8 @@ DexFile* dexFileParse(const u1* data, size_t length, int flags)
     DexFile* pDexFile = NULL;
     const DexHeader* pHeader;
     const u1* magic;
+    DexIntegrity integrity;
+    bool haveIntegrity = false;
     int result = -1;
 
     if (length < sizeof(DexHeader)) {
@@ -337,13 +334,24 @@ DexFile* dexFileParse(const u1* data, size_t length, int flags)
         goto bail;
     }
 
+    /*
+     * When both the checksum and the signature are wanted, get them from
+     * a single pass over the file rather than one pass each.
+     */
+    if ((flags & kDexParseVerifyAll) == kDexParseVerifyAll &&
+        pDexFile->pOptHeader == NULL && pHeader->fileSize == length) {
+        dexComputeIntegrity(data, length, 1, &integrity);
+        haveIntegrity = true;
+    }
+
     /*
      * Verify the checksum(s).  This is reasonably quick, but does require
      * touching every byte in the DEX file.  The base checksum changes after
      * byte-swapping and DEX optimization.
      */
     if (flags & kDexParseVerifyChecksum) {
-        u4 adler = dexComputeChecksum(pHeader);
+        u4 adler = haveIntegrity ?
+            integrity.checksum : dexComputeChecksum(pHeader);
         if (adler != pHeader->checksum) {
             ALOGE("ERROR: bad checksum (%08x vs %08x)",
                 adler, pHeader->checksum);
@@ -369,16 +377,20 @@ DexFile* dexFileParse(const u1* data, size_t length, int flags)
 
     /*
      * Verify the SHA-1 digest.  (Normally we don't want to do this --
-     * the digest is used to uniquely identify the original DEX file, and
-     * can't be computed for verification after the DEX is byte-swapped
-     * and optimized.)
+     * it touches every page, the digest is used to uniquely identify the
+     * original DEX file, and it can't be computed for verification after
+     * the DEX is byte-swapped and optimized, so it's skipped there.)
      */
-    if (kVerifySignature) {
+    if ((flags & kDexParseVerifySignature) && pDexFile->pOptHeader == NULL) {
         unsigned char sha1Digest[kSHA1DigestLen];
         const int nonSum = sizeof(pHeader->magic) + sizeof(pHeader->checksum) +
                             kSHA1DigestLen;
 
-        dexComputeSHA1Digest(data + nonSum, length - nonSum, sha1Digest);
+        if (haveIntegrity) {
+            memcpy(sha1Digest, integrity.signature, kSHA1DigestLen);
+        } else {
+            dexComputeSHA1Digest(data + nonSum, length - nonSum, sha1Digest);
+        }
         if (memcmp(sha1Digest, pHeader->signature, kSHA1DigestLen) != 0) {
             char tmpBuf1[kSHA1DigestOutputLen];
             char tmpBuf2[kSHA1DigestOutputLen];
@@ -427,6 +439,8 @@ void dexFileFree(DexFile* pDexFile)
     if (pDexFile == NULL)
         return;
 
+    dexProtoTableFree(pDexFile->pProtoTable);
+    dexStringIndexFree(pDexFile->pStringIndex);
     free(pDexFile);
 }
 
@@ -491,33 +505,38 @@ size_t dexGetDexCodeSize(const DexCode* pCode)
 {
     /*
      * The catch handler data is the last entry.  It has a variable number
-     * of variable-size pieces, so we need to create an iterator.
+     * of variable-size pieces.  We only need to find its end, so skip
+     * over the LEB128 values without decoding them.
      */
-    u4 handlersSize;
-    u4 offset;
-    u4 ui;
+    const u1* handlerData = dexGetCatchHandlerData(pCode);
+    const u1* data = handlerData;
 
     if (pCode->triesSize != 0) {
-        handlersSize = dexGetHandlersSize(pCode);
-        offset = dexGetFirstHandlerOffset(pCode);
-    } else {
-        handlersSize = 0;
-        offset = 0;
-    }
+        u4 handlersSize = readUnsignedLeb128(&data);
 
-    for (ui = 0; ui < handlersSize; ui++) {
-        DexCatchIterator iterator;
-        dexCatchIteratorInit(&iterator, pCode, offset);
-        offset = dexCatchIteratorGetEndOffset(&iterator, pCode);
-    }
+        for (u4 ui = 0; ui < handlersSize; ui++) {
+            s4 size = readSignedLeb128(&data);
+            /* each typed handler is a (type_idx, addr) pair */
+            u4 count = (size <= 0) ? (-size * 2) + 1 : size * 2;
 
-    const u1* handlerData = dexGetCatchHandlerData(pCode);
+            while (count-- != 0)
+                skipLeb128(&data);
+        }
+    }
 
     //ALOGD("+++ pCode=%p handlerData=%p last offset=%d",
-    //    pCode, handlerData, offset);
+    //    pCode, handlerData, data - handlerData);
 
     /* return the size of the catch handler + everything before it */
-    return (handlerData - (u1*) pCode) + offset;
+    return data - (const u1*) pCode;
+}
+
+/* (documented in header file) */
+size_t dexGetCodeItemSize(const DexCode* pCode)
+{
+    if (pCode->triesSize == 0)
+        return offsetof(DexCode, insns) + pCode->insnsSize * sizeof(u2);
+    return dexGetDexCodeSize(pCode);
 }
 
 /*
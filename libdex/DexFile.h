@@ -245,6 +245,9 @@ enum {
 enum {
     kDexChunkClassLookup            = 0x434c4b50,   /* CLKP */
     kDexChunkRegisterMaps           = 0x524d4150,   /* RMAP */
+    kDexChunkStringIndex            = 0x53494458,   /* SIDX */
+    kDexChunkXref                   = 0x58524546,   /* XREF */
+    kDexChunkAnnotationIndex        = 0x414e4e58,   /* ANNX */
 
     kDexChunkEnd                    = 0x41454e44,   /* AEND */
 };
@@ -585,6 +588,10 @@ struct DexOptHeader {
  * Code should regard DexFile as opaque, using the API calls provided here
  * to access specific structures.
  */
+struct DexPageTrace;
+struct DexProtoTable;
+struct DexStringIndex;
+
 struct DexFile {
     /* directly-mapped "opt" header */
     const DexOptHeader* pOptHeader;
@@ -612,6 +619,15 @@ struct DexFile {
     /* track memory overhead for auxillary structures */
     int                 overhead;
 
+    /* page-touch trace, if one is attached (see DexPageTrace.h) */
+    DexPageTrace*       pPageTrace;
+
+    /* precomputed method descriptors, if attached (see DexProto.h) */
+    DexProtoTable*      pProtoTable;
+
+    /* string prefix keys, if attached (see DexIndex.h) */
+    DexStringIndex*     pStringIndex;
+
     /* additional app-specific data structures associated with the DEX */
     //void*               auxData;
 };
@@ -633,6 +649,11 @@ enum {
     kDexParseDefault            = 0,
     kDexParseVerifyChecksum     = 1,
     kDexParseContinueOnError    = (1 << 1),
+    kDexParseVerifySignature    = (1 << 2),     /* ignored for optimized DEX */
+
+    /* both, in one pass over the file where possible */
+    kDexParseVerifyAll          = kDexParseVerifyChecksum |
+                                  kDexParseVerifySignature,
 };
 
 /*
@@ -687,6 +708,27 @@ const DexClassDef* dexFindClass(const DexFile* pFile, const char* descriptor);
  */
 void dexFileSetupBasicPointers(DexFile* pDexFile, const u1* data);
 
+/*
+ * Record an access to "length" bytes at "addr" in a page trace.  Called
+ * through DEX_TRACE_ACCESS(); see DexPageTrace.h.
+ */
+void dexPageTraceRecord(DexPageTrace* pTrace, const void* addr, size_t length);
+
+/*
+ * Accessor hook for page-touch tracing.  Only compiled in when
+ * DEX_PAGE_TRACE is defined, and then only active while a trace is
+ * attached to the DexFile.
+ */
+#if defined(DEX_PAGE_TRACE)
+# define DEX_TRACE_ACCESS(_pDexFile, _addr, _length)                        \
+    do {                                                                    \
+        if ((_pDexFile)->pPageTrace != NULL)                                \
+            dexPageTraceRecord((_pDexFile)->pPageTrace, (_addr), (_length)); \
+    } while (false)
+#else
+# define DEX_TRACE_ACCESS(_pDexFile, _addr, _length) ((void) 0)
+#endif
+
 /* return the DexMapList of the file, if any */
 DEX_INLINE const DexMapList* dexGetMap(const DexFile* pDexFile) {
     u4 mapOff = pDexFile->pHeader->mapOff;
@@ -694,6 +736,7 @@ DEX_INLINE const DexMapList* dexGetMap(const DexFile* pDexFile) {
     if (mapOff == 0) {
         return NULL;
     } else {
+        DEX_TRACE_ACCESS(pDexFile, pDexFile->baseAddr + mapOff, sizeof(u4));
         return (const DexMapList*) (pDexFile->baseAddr + mapOff);
     }
 }
@@ -703,6 +746,8 @@ DEX_INLINE const char* dexGetStringData(const DexFile* pDexFile,
         const DexStringId* pStringId) {
     const u1* ptr = pDexFile->baseAddr + pStringId->stringDataOff;
 
+    DEX_TRACE_ACCESS(pDexFile, ptr, 1);
+
     // Skip the uleb128 length.
     while (*(ptr++) > 0x7f) /* empty */ ;
 
@@ -711,6 +756,7 @@ DEX_INLINE const char* dexGetStringData(const DexFile* pDexFile,
 /* return the StringId with the specified index */
 DEX_INLINE const DexStringId* dexGetStringId(const DexFile* pDexFile, u4 idx) {
     assert(idx < pDexFile->pHeader->stringIdsSize);
+    DEX_TRACE_ACCESS(pDexFile, &pDexFile->pStringIds[idx], sizeof(DexStringId));
     return &pDexFile->pStringIds[idx];
 }
 /* return the UTF-8 encoded string with the specified string_id index */
@@ -727,6 +773,7 @@ const char* dexStringAndSizeById(const DexFile* pDexFile, u4 idx,
 /* return the TypeId with the specified index */
 DEX_INLINE const DexTypeId* dexGetTypeId(const DexFile* pDexFile, u4 idx) {
     assert(idx < pDexFile->pHeader->typeIdsSize);
+    DEX_TRACE_ACCESS(pDexFile, &pDexFile->pTypeIds[idx], sizeof(DexTypeId));
     return &pDexFile->pTypeIds[idx];
 }
 
@@ -742,18 +789,21 @@ DEX_INLINE const char* dexStringByTypeIdx(const DexFile* pDexFile, u4 idx) {
 /* return the MethodId with the specified index */
 DEX_INLINE const DexMethodId* dexGetMethodId(const DexFile* pDexFile, u4 idx) {
     assert(idx < pDexFile->pHeader->methodIdsSize);
+    DEX_TRACE_ACCESS(pDexFile, &pDexFile->pMethodIds[idx], sizeof(DexMethodId));
     return &pDexFile->pMethodIds[idx];
 }
 
 /* return the FieldId with the specified index */
 DEX_INLINE const DexFieldId* dexGetFieldId(const DexFile* pDexFile, u4 idx) {
     assert(idx < pDexFile->pHeader->fieldIdsSize);
+    DEX_TRACE_ACCESS(pDexFile, &pDexFile->pFieldIds[idx], sizeof(DexFieldId));
     return &pDexFile->pFieldIds[idx];
 }
 
 /* return the ProtoId with the specified index */
 DEX_INLINE const DexProtoId* dexGetProtoId(const DexFile* pDexFile, u4 idx) {
     assert(idx < pDexFile->pHeader->protoIdsSize);
+    DEX_TRACE_ACCESS(pDexFile, &pDexFile->pProtoIds[idx], sizeof(DexProtoId));
     return &pDexFile->pProtoIds[idx];
 }
 
@@ -766,6 +816,8 @@ DEX_INLINE const DexTypeList* dexGetProtoParameters(
     if (pProtoId->parametersOff == 0) {
         return NULL;
     }
+    DEX_TRACE_ACCESS(pDexFile, pDexFile->baseAddr + pProtoId->parametersOff,
+        sizeof(u4));
     return (const DexTypeList*)
         (pDexFile->baseAddr + pProtoId->parametersOff);
 }
@@ -773,6 +825,7 @@ DEX_INLINE const DexTypeList* dexGetProtoParameters(
 /* return the ClassDef with the specified index */
 DEX_INLINE const DexClassDef* dexGetClassDef(const DexFile* pDexFile, u4 idx) {
     assert(idx < pDexFile->pHeader->classDefsSize);
+    DEX_TRACE_ACCESS(pDexFile, &pDexFile->pClassDefs[idx], sizeof(DexClassDef));
     return &pDexFile->pClassDefs[idx];
 }
 
@@ -791,6 +844,8 @@ DEX_INLINE const DexTypeList* dexGetInterfacesList(const DexFile* pDexFile,
 {
     if (pClassDef->interfacesOff == 0)
         return NULL;
+    DEX_TRACE_ACCESS(pDexFile, pDexFile->baseAddr + pClassDef->interfacesOff,
+        sizeof(u4));
     return (const DexTypeList*)
         (pDexFile->baseAddr + pClassDef->interfacesOff);
 }
@@ -813,6 +868,8 @@ DEX_INLINE const DexEncodedArray* dexGetStaticValuesList(
 {
     if (pClassDef->staticValuesOff == 0)
         return NULL;
+    DEX_TRACE_ACCESS(pDexFile, pDexFile->baseAddr + pClassDef->staticValuesOff,
+        1);
     return (const DexEncodedArray*)
         (pDexFile->baseAddr + pClassDef->staticValuesOff);
 }
@@ -823,6 +880,8 @@ DEX_INLINE const DexAnnotationsDirectoryItem* dexGetAnnotationsDirectoryItem(
 {
     if (pClassDef->annotationsOff == 0)
         return NULL;
+    DEX_TRACE_ACCESS(pDexFile, pDexFile->baseAddr + pClassDef->annotationsOff,
+        sizeof(DexAnnotationsDirectoryItem));
     return (const DexAnnotationsDirectoryItem*)
         (pDexFile->baseAddr + pClassDef->annotationsOff);
 }
@@ -839,6 +898,14 @@ DEX_INLINE const char* dexGetSourceFile(
 /* get the size, in bytes, of a DexCode */
 size_t dexGetDexCodeSize(const DexCode* pCode);
 
+/*
+ * Get the size, in bytes, of a code_item as laid out in the file.  Unlike
+ * dexGetDexCodeSize(), this doesn't count the two bytes of padding after
+ * an odd number of instructions when there are no tries, since they
+ * aren't part of the item.
+ */
+size_t dexGetCodeItemSize(const DexCode* pCode);
+
 /* Get the list of "tries" for the given DexCode. */
 DEX_INLINE const DexTry* dexGetTries(const DexCode* pCode) {
     const u2* insnsEnd = &pCode->insns[pCode->insnsSize];
@@ -864,6 +931,7 @@ DEX_INLINE const u1* dexGetDebugInfoStream(const DexFile* pDexFile,
     if (pCode->debugInfoOff == 0) {
         return NULL;
     } else {
+        DEX_TRACE_ACCESS(pDexFile, pDexFile->baseAddr + pCode->debugInfoOff, 1);
         return pDexFile->baseAddr + pCode->debugInfoOff;
     }
 }
@@ -890,6 +958,7 @@ DEX_INLINE const u1* dexGetClassData(const DexFile* pDexFile,
 {
     if (pClassDef->classDataOff == 0)
         return NULL;
+    DEX_TRACE_ACCESS(pDexFile, pDexFile->baseAddr + pClassDef->classDataOff, 1);
     return (const u1*) (pDexFile->baseAddr + pClassDef->classDataOff);
 }
 
@@ -900,6 +969,7 @@ DEX_INLINE const DexAnnotationSetItem* dexGetAnnotationSetItem(
     if (offset == 0) {
         return NULL;
     }
+    DEX_TRACE_ACCESS(pDexFile, pDexFile->baseAddr + offset, sizeof(u4));
     return (const DexAnnotationSetItem*) (pDexFile->baseAddr + offset);
 }
 /* get the class' annotation set */
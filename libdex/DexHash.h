@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * 64-bit FNV-1a hashing, used for fingerprints that must agree across
+ * DEX files (so they are computed from string contents, never indices),
+ * and a word-at-a-time hash for bulk data.
+ */
+
+#ifndef LIBDEX_DEXHASH_H_
+#define LIBDEX_DEXHASH_H_
+
+#include "DexFile.h"
+
+#include <string.h>
+
+#define kDexHashInit    0xcbf29ce484222325ULL
+#define kDexHashPrime   0x100000001b3ULL
+
+/*
+ * Fold "length" bytes into "hash".
+ */
+DEX_INLINE u8 dexHashBytes(u8 hash, const void* data, size_t length)
+{
+    const u1* ptr = (const u1*) data;
+
+    while (length-- != 0) {
+        hash ^= *ptr++;
+        hash *= kDexHashPrime;
+    }
+    return hash;
+}
+
+/*
+ * Fold a '\0'-terminated string, not including the '\0', into "hash".
+ */
+DEX_INLINE u8 dexHashString(u8 hash, const char* str)
+{
+    const u1* ptr = (const u1*) str;
+
+    while (*ptr != '\0') {
+        hash ^= *ptr++;
+        hash *= kDexHashPrime;
+    }
+    return hash;
+}
+
+/*
+ * Fold a u4 into "hash", low byte first.
+ */
+DEX_INLINE u8 dexHashU4(u8 hash, u4 value)
+{
+    for (int i = 0; i < 4; i++) {
+        hash ^= value & 0xff;
+        hash *= kDexHashPrime;
+        value >>= 8;
+    }
+    return hash;
+}
+
+/*
+ * Mix the bits of a 64-bit value (the MurmurHash3 finalizer).
+ */
+DEX_INLINE u8 dexHashMix(u8 value)
+{
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdULL;
+    value ^= value >> 33;
+    value *= 0xc4ceb9fe1a85ec53ULL;
+    value ^= value >> 33;
+    return value;
+}
+
+/*
+ * Fold "length" bytes into "hash" eight at a time.  Much faster than
+ * dexHashBytes() on long runs, but gives different values, so the two
+ * can't be mixed for the same purpose.  Words are read in host byte
+ * order.
+ */
+DEX_INLINE u8 dexHashBlock(u8 hash, const void* data, size_t length)
+{
+    const u1* ptr = (const u1*) data;
+    u8 word;
+
+    hash = dexHashMix(hash ^ length);
+    while (length >= sizeof(word)) {
+        memcpy(&word, ptr, sizeof(word));
+        hash = dexHashMix(hash ^ word) + kDexHashPrime;
+        ptr += sizeof(word);
+        length -= sizeof(word);
+    }
+    if (length != 0) {
+        word = 0;
+        memcpy(&word, ptr, length);
+        hash = dexHashMix(hash ^ word) + kDexHashPrime;
+    }
+    return hash;
+}
+
+#endif  // LIBDEX_DEXHASH_H_
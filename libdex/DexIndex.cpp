@@ -0,0 +1,557 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Lookups by content.
+ */
+
+#include "DexIndex.h"
+#include "DexOptData.h"
+#include "DexParallel.h"
+#include "DexProto.h"
+#include "DexUtf.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* the most parameters a method can have */
+#define kMaxProtoParams     255
+
+/*
+ * Compute the prefix key for a string.
+ *
+ * Each of the first 8 bytes is kept if it's ASCII.  At the first
+ * non-ASCII character the key is padded with 0xff, since every such
+ * character sorts after every ASCII one -- except U+0000 (encoded as
+ * 0xc0 0x80), which sorts first and so pads with 0x00, like the end of
+ * the string.  Equal keys say nothing; unequal keys order the strings.
+ */
+static u8 computeKey(const char* str)
+{
+    const u1* cp = (const u1*) str;
+    u8 key = 0;
+    u1 pad = 0;
+    int i;
+
+    for (i = 0; i < 8; i++) {
+        u1 ch = cp[i];
+        if (ch == 0)
+            break;
+        if (ch >= 0x80) {
+            pad = (ch == 0xc0 && cp[i + 1] == 0x80) ? 0x00 : 0xff;
+            break;
+        }
+        key = (key << 8) | ch;
+    }
+    for (; i < 8; i++)
+        key = (key << 8) | pad;
+    return key;
+}
+
+static inline u4 keyClass(u1 byte)
+{
+    return (byte < 0x80) ? byte : 128;
+}
+
+static inline u4 keyBucket(u8 key)
+{
+    return keyClass((u1) (key >> 56)) * 129 + keyClass((u1) (key >> 48));
+}
+
+struct StringIndexBuild {
+    const DexFile*  pDexFile;
+    u8*             keys;
+};
+
+static void stringIndexFill(void* arg, u4 start, u4 end)
+{
+    StringIndexBuild* pBuild = (StringIndexBuild*) arg;
+
+    for (u4 i = start; i < end; i++)
+        pBuild->keys[i] = computeKey(dexStringById(pBuild->pDexFile, i));
+}
+
+/* (documented in header file) */
+DexStringIndex* dexStringIndexCreate(const DexFile* pDexFile, int numThreads)
+{
+    u4 stringCount = pDexFile->pHeader->stringIdsSize;
+    size_t allocSize = sizeof(DexStringIndex) + stringCount * sizeof(u8) +
+        (kDexStringIndexBucketCount + 1) * sizeof(u4);
+    DexStringIndex* pIndex = (DexStringIndex*) malloc(allocSize);
+    StringIndexBuild build;
+
+    if (pIndex == NULL)
+        return NULL;
+
+    /* the keys go first to keep them 8-byte aligned */
+    build.pDexFile = pDexFile;
+    build.keys = (u8*) (pIndex + 1);
+    u4* buckets = (u4*) (build.keys + stringCount);
+
+    dexParallelFor(stringCount, numThreads, stringIndexFill, &build);
+
+    /* strings are sorted, so the buckets are too */
+    u4 row = 0;
+    for (u4 b = 0; b < kDexStringIndexBucketCount; b++) {
+        while (row < stringCount && keyBucket(build.keys[row]) < b)
+            row++;
+        buckets[b] = row;
+    }
+    buckets[kDexStringIndexBucketCount] = stringCount;
+
+    pIndex->stringCount = stringCount;
+    pIndex->allocSize = allocSize;
+    pIndex->keys = build.keys;
+    pIndex->buckets = buckets;
+    return pIndex;
+}
+
+/* (documented in header file) */
+void dexStringIndexFree(DexStringIndex* pIndex)
+{
+    free(pIndex);
+}
+
+/*
+ * Start of a flattened index.  The keys follow, then the buckets.
+ */
+struct FlatStringIndexHeader {
+    u4  stringCount;
+    u4  dexChecksum;
+    u1  dexSignature[kSHA1DigestLen];
+    u4  reserved;                   /* keeps the keys 8-byte aligned */
+};
+
+/* size of a flattened index, less the keys */
+#define kFlatStringIndexFixedSize \
+    (sizeof(FlatStringIndexHeader) + \
+     (kDexStringIndexBucketCount + 1) * sizeof(u4))
+
+/* (documented in header file) */
+u1* dexStringIndexFlatten(const DexFile* pDexFile,
+    const DexStringIndex* pIndex, u4* pSize)
+{
+    size_t keysSize = pIndex->stringCount * sizeof(u8);
+    u4 size = kFlatStringIndexFixedSize + keysSize;
+    u1* data = (u1*) malloc(size);
+
+    if (data == NULL)
+        return NULL;
+
+    FlatStringIndexHeader* pHeader = (FlatStringIndexHeader*) data;
+    pHeader->stringCount = pIndex->stringCount;
+    pHeader->dexChecksum = pDexFile->pHeader->checksum;
+    memcpy(pHeader->dexSignature, pDexFile->pHeader->signature,
+        kSHA1DigestLen);
+    pHeader->reserved = 0;
+    memcpy(pHeader + 1, pIndex->keys, keysSize);
+    memcpy(data + sizeof(FlatStringIndexHeader) + keysSize, pIndex->buckets,
+        (kDexStringIndexBucketCount + 1) * sizeof(u4));
+
+    *pSize = size;
+    return data;
+}
+
+/*
+ * Check that a flattened index was built from "pDexFile".
+ */
+static bool builtFrom(const FlatStringIndexHeader* pHeader,
+    const DexFile* pDexFile)
+{
+    return pHeader->stringCount == pDexFile->pHeader->stringIdsSize &&
+        pHeader->dexChecksum == pDexFile->pHeader->checksum &&
+        memcmp(pHeader->dexSignature, pDexFile->pHeader->signature,
+            kSHA1DigestLen) == 0;
+}
+
+/*
+ * Wrap the file's kDexChunkStringIndex chunk, if it has a usable one.
+ * The keys and buckets stay in the chunk; only the DexStringIndex is
+ * allocated.
+ */
+static DexStringIndex* stringIndexFromOptData(const DexFile* pDexFile)
+{
+    u4 stringCount = pDexFile->pHeader->stringIdsSize;
+    u4 size;
+    const u1* data = dexGetOptChunk(pDexFile, kDexChunkStringIndex, &size);
+
+    if (data == NULL)
+        return NULL;
+
+    const FlatStringIndexHeader* pHeader = (const FlatStringIndexHeader*) data;
+    const u8* keys = (const u8*) (pHeader + 1);
+    const u4* buckets = (const u4*) (keys + stringCount);
+
+    if (size != kFlatStringIndexFixedSize + (size_t) stringCount * sizeof(u8) ||
+        !builtFrom(pHeader, pDexFile))
+    {
+        ALOGW("Ignoring string index chunk that doesn't match the file");
+        return NULL;
+    }
+
+    /* the lookups trust the buckets, so make sure they're sane */
+    for (u4 b = 0; b < kDexStringIndexBucketCount; b++) {
+        if (buckets[b] > buckets[b + 1]) {
+            ALOGW("Ignoring string index chunk with bad buckets");
+            return NULL;
+        }
+    }
+    if (buckets[kDexStringIndexBucketCount] != stringCount) {
+        ALOGW("Ignoring string index chunk with bad buckets");
+        return NULL;
+    }
+
+    DexStringIndex* pIndex = (DexStringIndex*) malloc(sizeof(DexStringIndex));
+    if (pIndex == NULL)
+        return NULL;
+    pIndex->stringCount = stringCount;
+    pIndex->allocSize = sizeof(DexStringIndex);
+    pIndex->keys = keys;
+    pIndex->buckets = buckets;
+    return pIndex;
+}
+
+/* (documented in header file) */
+bool dexFileAttachStringIndex(DexFile* pDexFile, int numThreads)
+{
+    if (pDexFile->pStringIndex != NULL)
+        return true;
+
+    DexStringIndex* pIndex = stringIndexFromOptData(pDexFile);
+    if (pIndex == NULL)
+        pIndex = dexStringIndexCreate(pDexFile, numThreads);
+    if (pIndex == NULL)
+        return false;
+
+    pDexFile->pStringIndex = pIndex;
+    pDexFile->overhead += pIndex->allocSize;
+    return true;
+}
+
+/*
+ * Compare string_id "idx" against "str", which is "strLen" bytes long,
+ * with the same ordering as dexUtf8Cmp().
+ *
+ * Every UTF-16 code unit takes at least one byte, so both strings have
+ * at least min(utf16Size, strLen) bytes before their terminators.  The
+ * equal prefix is skipped 8 bytes at a time within that bound; the rest
+ * is handed to dexUtf8Cmp() from the last character boundary.
+ */
+static int compareString(const DexFile* pDexFile, u4 idx, const char* str,
+    size_t strLen)
+{
+    u4 utf16Size;
+    const char* data = dexStringAndSizeById(pDexFile, idx, &utf16Size);
+    size_t limit = (utf16Size < strLen) ? utf16Size : strLen;
+    size_t i = 0;
+
+    for (; i + 8 <= limit; i += 8) {
+        u8 a, b;
+        memcpy(&a, data + i, sizeof(a));
+        memcpy(&b, str + i, sizeof(b));
+        if (a != b)
+            break;
+    }
+    while (i > 0 && (((u1) data[i]) & 0xc0) == 0x80)
+        i--;
+
+    return dexUtf8Cmp(data + i, str + i);
+}
+
+/*
+ * Binary search string_ids [lo, hi) by content.
+ */
+static u4 searchStrings(const DexFile* pDexFile, const char* str, u4 lo, u4 hi)
+{
+    size_t strLen = strlen(str);
+
+    while (lo < hi) {
+        u4 mid = lo + (hi - lo) / 2;
+        int cmp = compareString(pDexFile, mid, str, strLen);
+
+        if (cmp < 0)
+            lo = mid + 1;
+        else if (cmp > 0)
+            hi = mid;
+        else
+            return mid;
+    }
+    return kDexNoIndex;
+}
+
+/* (documented in header file) */
+u4 dexFindStringIdx(const DexFile* pDexFile, const char* str)
+{
+    const DexStringIndex* pIndex = pDexFile->pStringIndex;
+
+    if (pIndex == NULL)
+        return searchStrings(pDexFile, str, 0, pDexFile->pHeader->stringIdsSize);
+
+    /*
+     * Narrow to the bucket, then to the run of equal keys, without
+     * touching string data.  Only that run needs real comparisons.
+     */
+    u8 key = computeKey(str);
+    u4 bucket = keyBucket(key);
+    u4 lo = pIndex->buckets[bucket];
+    u4 hi = pIndex->buckets[bucket + 1];
+
+    u4 first = lo;
+    u4 end = hi;
+    while (first < end) {
+        u4 mid = first + (end - first) / 2;
+        if (pIndex->keys[mid] < key)
+            first = mid + 1;
+        else
+            end = mid;
+    }
+    u4 probe = first;
+    end = hi;
+    while (probe < end) {
+        u4 mid = probe + (end - probe) / 2;
+        if (pIndex->keys[mid] == key)
+            probe = mid + 1;
+        else
+            end = mid;
+    }
+
+    return searchStrings(pDexFile, str, first, end);
+}
+
+/*
+ * Binary search type_ids for the one naming string "stringIdx".
+ */
+static u4 findTypeIdxByString(const DexFile* pDexFile, u4 stringIdx)
+{
+    u4 lo = 0;
+    u4 hi = pDexFile->pHeader->typeIdsSize;
+
+    if (stringIdx == kDexNoIndex)
+        return kDexNoIndex;
+
+    while (lo < hi) {
+        u4 mid = lo + (hi - lo) / 2;
+        u4 descriptorIdx = dexGetTypeId(pDexFile, mid)->descriptorIdx;
+
+        if (descriptorIdx < stringIdx)
+            lo = mid + 1;
+        else if (descriptorIdx > stringIdx)
+            hi = mid;
+        else
+            return mid;
+    }
+    return kDexNoIndex;
+}
+
+/* (documented in header file) */
+u4 dexFindTypeIdx(const DexFile* pDexFile, const char* descriptor)
+{
+    return findTypeIdxByString(pDexFile, dexFindStringIdx(pDexFile, descriptor));
+}
+
+/*
+ * Return the length of the type descriptor at the start of "str", or 0
+ * if there isn't a well-formed one.
+ */
+static size_t typeDescriptorLength(const char* str)
+{
+    const char* cp = str;
+
+    while (*cp == '[')
+        cp++;
+    if (*cp == 'L') {
+        const char* end = strchr(cp, ';');
+        return (end == NULL) ? 0 : end + 1 - str;
+    }
+    return (*cp == '\0' || *cp == '(' || *cp == ')') ? 0 : cp + 1 - str;
+}
+
+/*
+ * Compare proto_id "protoIdx" with the given return and parameter types,
+ * in proto_ids order.
+ */
+static int compareProto(const DexFile* pDexFile, u4 protoIdx, u4 returnTypeIdx,
+    const u4* params, u4 paramCount)
+{
+    const DexProtoId* pProtoId = dexGetProtoId(pDexFile, protoIdx);
+    const DexTypeList* pList = dexGetProtoParameters(pDexFile, pProtoId);
+    u4 count = (pList == NULL) ? 0 : pList->size;
+
+    if (pProtoId->returnTypeIdx != returnTypeIdx)
+        return (pProtoId->returnTypeIdx < returnTypeIdx) ? -1 : 1;
+
+    for (u4 i = 0; i < count && i < paramCount; i++) {
+        u4 typeIdx = dexTypeListGetIdx(pList, i);
+        if (typeIdx != params[i])
+            return (typeIdx < params[i]) ? -1 : 1;
+    }
+    return (count > paramCount) - (count < paramCount);
+}
+
+/* (documented in header file) */
+u4 dexFindProtoIdx(const DexFile* pDexFile, const char* descriptor)
+{
+    u4 params[kMaxProtoParams];
+    u4 paramCount = 0;
+    u4 returnTypeIdx;
+    u4 result = kDexNoIndex;
+    const char* cp;
+    char* scratch;
+
+    if (pDexFile->pProtoTable != NULL)
+        return dexProtoTableFindDescriptor(pDexFile->pProtoTable, descriptor);
+
+    if (*descriptor != '(')
+        return kDexNoIndex;
+
+    /* each type is copied out so it can be looked up on its own */
+    scratch = (char*) malloc(strlen(descriptor) + 1);
+    if (scratch == NULL)
+        return kDexNoIndex;
+
+    cp = descriptor + 1;
+    while (*cp != ')') {
+        size_t len = typeDescriptorLength(cp);
+        if (len == 0 || paramCount == kMaxProtoParams)
+            goto bail;
+        memcpy(scratch, cp, len);
+        scratch[len] = '\0';
+        params[paramCount] = dexFindTypeIdx(pDexFile, scratch);
+        if (params[paramCount] == kDexNoIndex)
+            goto bail;
+        paramCount++;
+        cp += len;
+    }
+    cp++;
+    if (typeDescriptorLength(cp) != strlen(cp))
+        goto bail;
+    returnTypeIdx = dexFindTypeIdx(pDexFile, cp);
+    if (returnTypeIdx == kDexNoIndex)
+        goto bail;
+
+    {
+        u4 lo = 0;
+        u4 hi = pDexFile->pHeader->protoIdsSize;
+        while (lo < hi) {
+            u4 mid = lo + (hi - lo) / 2;
+            int cmp = compareProto(pDexFile, mid, returnTypeIdx, params,
+                paramCount);
+            if (cmp < 0) {
+                lo = mid + 1;
+            } else if (cmp > 0) {
+                hi = mid;
+            } else {
+                result = mid;
+                break;
+            }
+        }
+    }
+
+bail:
+    free(scratch);
+    return result;
+}
+
+/* (documented in header file) */
+u4 dexFindFieldIdx(const DexFile* pDexFile, const char* classDescriptor,
+    const char* name, const char* typeDescriptor)
+{
+    u4 classIdx = dexFindTypeIdx(pDexFile, classDescriptor);
+    u4 nameIdx = dexFindStringIdx(pDexFile, name);
+    u4 typeIdx = dexFindTypeIdx(pDexFile, typeDescriptor);
+    u4 lo = 0;
+    u4 hi = pDexFile->pHeader->fieldIdsSize;
+
+    if (classIdx == kDexNoIndex || nameIdx == kDexNoIndex ||
+        typeIdx == kDexNoIndex)
+    {
+        return kDexNoIndex;
+    }
+
+    /* sorted by defining class, then name, then type */
+    while (lo < hi) {
+        u4 mid = lo + (hi - lo) / 2;
+        const DexFieldId* pFieldId = dexGetFieldId(pDexFile, mid);
+        int cmp;
+
+        if (pFieldId->classIdx != classIdx)
+            cmp = (pFieldId->classIdx < classIdx) ? -1 : 1;
+        else if (pFieldId->nameIdx != nameIdx)
+            cmp = (pFieldId->nameIdx < nameIdx) ? -1 : 1;
+        else if (pFieldId->typeIdx != typeIdx)
+            cmp = (pFieldId->typeIdx < typeIdx) ? -1 : 1;
+        else
+            return mid;
+
+        if (cmp < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return kDexNoIndex;
+}
+
+/* (documented in header file) */
+u4 dexFindMethodIdx(const DexFile* pDexFile, const char* classDescriptor,
+    const char* name, const char* protoDescriptor)
+{
+    u4 classIdx = dexFindTypeIdx(pDexFile, classDescriptor);
+    u4 nameIdx = dexFindStringIdx(pDexFile, name);
+    u4 protoIdx = 0;
+    u4 lo = 0;
+    u4 hi = pDexFile->pHeader->methodIdsSize;
+
+    if (classIdx == kDexNoIndex || nameIdx == kDexNoIndex)
+        return kDexNoIndex;
+    if (protoDescriptor != NULL) {
+        protoIdx = dexFindProtoIdx(pDexFile, protoDescriptor);
+        if (protoIdx == kDexNoIndex)
+            return kDexNoIndex;
+    }
+
+    /*
+     * Sorted by defining class, then name, then proto.  Find the first
+     * entry not below (classIdx, nameIdx, protoIdx); with no proto given
+     * that's the first overload.
+     */
+    while (lo < hi) {
+        u4 mid = lo + (hi - lo) / 2;
+        const DexMethodId* pMethodId = dexGetMethodId(pDexFile, mid);
+        bool below;
+
+        if (pMethodId->classIdx != classIdx)
+            below = pMethodId->classIdx < classIdx;
+        else if (pMethodId->nameIdx != nameIdx)
+            below = pMethodId->nameIdx < nameIdx;
+        else
+            below = pMethodId->protoIdx < protoIdx;
+
+        if (below)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (lo < pDexFile->pHeader->methodIdsSize) {
+        const DexMethodId* pMethodId = dexGetMethodId(pDexFile, lo);
+        if (pMethodId->classIdx == classIdx && pMethodId->nameIdx == nameIdx &&
+            (protoDescriptor == NULL || pMethodId->protoIdx == protoIdx))
+        {
+            return lo;
+        }
+    }
+    return kDexNoIndex;
+}
@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Look up string, type, proto, field and method indices by content.
+ *
+ * The id tables are sorted (strings in dexUtf8Cmp() order, the others by
+ * the indices they hold), so every lookup is a binary search.  String
+ * searches can optionally use a DexStringIndex, which keeps an 8-byte
+ * prefix key per string_id so most probes compare one integer instead of
+ * reading string data.
+ */
+
+#ifndef LIBDEX_DEXINDEX_H_
+#define LIBDEX_DEXINDEX_H_
+
+#include "DexFile.h"
+
+/* buckets for the first two prefix bytes, each ASCII or "other" */
+#define kDexStringIndexBucketCount  (129 * 129)
+
+/*
+ * Prefix keys for the string_ids.  A key holds the first 8 bytes of a
+ * string when they're ASCII, big-endian, so comparing keys as integers
+ * agrees with dexUtf8Cmp() whenever the keys differ.  "buckets[b]" is the
+ * first string_id whose first two bytes fall in bucket "b".
+ */
+struct DexStringIndex {
+    u4          stringCount;
+    size_t      allocSize;      /* bytes, for DexFile::overhead */
+    const u8*   keys;
+    const u4*   buckets;        /* kDexStringIndexBucketCount + 1 entries */
+};
+
+/*
+ * Build the string index for "pDexFile", spreading the work over
+ * "numThreads" threads.  Returns NULL on allocation failure.
+ */
+DexStringIndex* dexStringIndexCreate(const DexFile* pDexFile, int numThreads);
+
+/*
+ * Free an index.  NULL is allowed.
+ */
+void dexStringIndexFree(DexStringIndex* pIndex);
+
+/*
+ * Serialize an index as the payload of a kDexChunkStringIndex opt data
+ * chunk (see dexOptAppendChunks()): u4 stringCount, u4 the DEX checksum,
+ * the DEX signature and a padding word, then the keys and buckets.
+ * Returns a malloc()ed buffer and sets "*pSize", or returns NULL on
+ * allocation failure.
+ */
+u1* dexStringIndexFlatten(const DexFile* pDexFile,
+    const DexStringIndex* pIndex, u4* pSize);
+
+/*
+ * Attach an index to "pDexFile", where it's used by dexFindStringIdx()
+ * and freed by dexFileFree().  Does nothing if one is already attached.
+ * An optimized DEX file's kDexChunkStringIndex chunk is used in place if
+ * it matches the file; otherwise the index is built.
+ *
+ * Returns false on allocation failure.
+ */
+bool dexFileAttachStringIndex(DexFile* pDexFile, int numThreads);
+
+/*
+ * Find the string_id whose contents are "str" (modified UTF-8).
+ *
+ * Each of these returns kDexNoIndex if there's no match.
+ */
+u4 dexFindStringIdx(const DexFile* pDexFile, const char* str);
+
+/*
+ * Find the type_id for a descriptor like "Ljava/lang/Object;".
+ */
+u4 dexFindTypeIdx(const DexFile* pDexFile, const char* descriptor);
+
+/*
+ * Find the proto_id for a method descriptor like "(ILjava/lang/String;)V".
+ */
+u4 dexFindProtoIdx(const DexFile* pDexFile, const char* descriptor);
+
+/*
+ * Find the field_id for a field of "classDescriptor" named "name" with
+ * type "typeDescriptor".
+ */
+u4 dexFindFieldIdx(const DexFile* pDexFile, const char* classDescriptor,
+    const char* name, const char* typeDescriptor);
+
+/*
+ * Find the method_id for a method of "classDescriptor" named "name" with
+ * method descriptor "protoDescriptor".  If "protoDescriptor" is NULL,
+ * finds the first of any overloads; the others follow it directly.
+ */
+u4 dexFindMethodIdx(const DexFile* pDexFile, const char* classDescriptor,
+    const char* name, const char* protoDescriptor);
+
+#endif  // LIBDEX_DEXINDEX_H_
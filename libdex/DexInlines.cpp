@@ -22,12 +22,20 @@
 
 #include "DexFile.h"
 
+#include "DexAnnotation.h"
+#include "DexAnnotationIndex.h"
+#include "DexArena.h"
 #include "DexCatch.h"
 #include "DexClass.h"
+#include "DexCsr.h"
 #include "DexDataMap.h"
+#include "DexHash.h"
 #include "DexUtf.h"
 #include "DexOpcodes.h"
+#include "DexParallel.h"
 #include "DexProto.h"
+#include "DexStaticValues.h"
+#include "DexXref.h"
 #include "InstrUtils.h"
 #include "Leb128.h"
 #include "ZipArchive.h"
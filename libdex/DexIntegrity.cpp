@@ -0,0 +1,227 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/*
+ * Single-pass checksum and signature computation.
+ */
+
+#include "DexIntegrity.h"
+#include "sha1.h"
+
+#include <zlib.h>
+#include <pthread.h>
+#include <stdlib.h>
+
+/*
+ * Single-threaded block size.  adler32 reads each block first and SHA-1
+ * finds it still in L1.
+ */
+#define kBlockSize      (16 * 1024)
+
+/*
+ * Multi-threaded window size.  The helpers and the SHA-1 thread work on
+ * the same window at the same time, so it's read from memory once and
+ * shared through the last-level cache; the window only has to be big
+ * enough to make the hand-off between windows cheap.
+ */
+#define kWindowSize     (1024 * 1024)
+
+/* adler32 keeps up with SHA-1 easily; past a few helpers it's all waiting */
+#define kMaxHelpers     4
+
+struct IntegrityJob {
+    const u1*   body;           /* everything after the signature */
+    size_t      bodyLen;
+    u4          numWindows;
+    int         numHelpers;
+    uLong*      partials;       /* [numWindows][numHelpers] adler32 sums */
+
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    int         window;         /* window being hashed; -1 before start */
+    int         done;           /* helpers finished with "window" */
+};
+
+struct IntegrityHelper {
+    IntegrityJob* pJob;
+    int         index;
+};
+
+/*
+ * Get the part of window "w" that helper "h" sums.  The last helper
+ * takes the remainder.
+ */
+static void getSlice(const IntegrityJob* pJob, u4 w, int h, size_t* pStart,
+    size_t* pLen)
+{
+    size_t windowStart = (size_t) w * kWindowSize;
+    size_t windowLen = pJob->bodyLen - windowStart;
+    if (windowLen > kWindowSize)
+        windowLen = kWindowSize;
+
+    size_t sliceLen = windowLen / pJob->numHelpers;
+    *pStart = windowStart + h * sliceLen;
+    *pLen = (h == pJob->numHelpers - 1) ?
+        windowLen - h * sliceLen : sliceLen;
+}
+
+static void* integrityHelperStart(void* arg)
+{
+    IntegrityHelper* pHelper = (IntegrityHelper*) arg;
+    IntegrityJob* pJob = pHelper->pJob;
+
+    for (u4 w = 0; w < pJob->numWindows; w++) {
+        pthread_mutex_lock(&pJob->lock);
+        while (pJob->window < (int) w)
+            pthread_cond_wait(&pJob->cond, &pJob->lock);
+        pthread_mutex_unlock(&pJob->lock);
+
+        size_t start, len;
+        getSlice(pJob, w, pHelper->index, &start, &len);
+        pJob->partials[w * pJob->numHelpers + pHelper->index] =
+            adler32(adler32(0L, Z_NULL, 0), pJob->body + start, len);
+
+        pthread_mutex_lock(&pJob->lock);
+        pJob->done++;
+        pthread_cond_broadcast(&pJob->cond);
+        pthread_mutex_unlock(&pJob->lock);
+    }
+    return NULL;
+}
+
+/*
+ * Hash "body" on this thread while the helpers sum it, one window at a
+ * time.  Returns false if no helper could be started, in which case
+ * nothing has been computed.
+ */
+static bool computeThreaded(IntegrityJob* pJob, SHA1_CTX* pContext,
+    uLong* pAdler)
+{
+    IntegrityHelper helpers[kMaxHelpers];
+    pthread_t threads[kMaxHelpers];
+    int wanted = pJob->numHelpers;
+    int started = 0;
+
+    pJob->window = -1;
+    pJob->done = 0;
+    pthread_mutex_init(&pJob->lock, NULL);
+    pthread_cond_init(&pJob->cond, NULL);
+
+    for (int h = 0; h < wanted; h++) {
+        helpers[h].pJob = pJob;
+        helpers[h].index = h;
+        if (pthread_create(&threads[h], NULL, integrityHelperStart,
+                &helpers[h]) != 0)
+            break;
+        started++;
+    }
+
+    /*
+     * The helpers wait for window 0 before reading numHelpers, so it can
+     * still be corrected if fewer of them started than asked for.
+     */
+    if (started != 0) {
+        pthread_mutex_lock(&pJob->lock);
+        pJob->numHelpers = started;
+        pJob->window = 0;
+        pthread_cond_broadcast(&pJob->cond);
+        pthread_mutex_unlock(&pJob->lock);
+
+        for (u4 w = 0; w < pJob->numWindows; w++) {
+            size_t windowStart = (size_t) w * kWindowSize;
+            size_t windowLen = pJob->bodyLen - windowStart;
+            if (windowLen > kWindowSize)
+                windowLen = kWindowSize;
+            SHA1Update(pContext, pJob->body + windowStart, windowLen);
+
+            pthread_mutex_lock(&pJob->lock);
+            while (pJob->done < started)
+                pthread_cond_wait(&pJob->cond, &pJob->lock);
+            if (w + 1 < pJob->numWindows) {
+                pJob->done = 0;
+                pJob->window = w + 1;
+                pthread_cond_broadcast(&pJob->cond);
+            }
+            pthread_mutex_unlock(&pJob->lock);
+        }
+    }
+
+    for (int h = 0; h < started; h++)
+        pthread_join(threads[h], NULL);
+    pthread_cond_destroy(&pJob->cond);
+    pthread_mutex_destroy(&pJob->lock);
+
+    if (started == 0)
+        return false;
+
+    uLong adler = *pAdler;
+    for (u4 w = 0; w < pJob->numWindows; w++) {
+        for (int h = 0; h < started; h++) {
+            size_t start, len;
+            getSlice(pJob, w, h, &start, &len);
+            adler = adler32_combine(adler,
+                pJob->partials[w * started + h], (z_off_t) len);
+        }
+    }
+    *pAdler = adler;
+    return true;
+}
+
+/* (documented in header file) */
+void dexComputeIntegrity(const u1* data, size_t length, int numThreads,
+    DexIntegrity* pIntegrity)
+{
+    const DexHeader* pHeader = (const DexHeader*) data;
+    const size_t nonSum = sizeof(pHeader->magic) + sizeof(pHeader->checksum);
+    const size_t nonSig = nonSum + kSHA1DigestLen;
+    SHA1_CTX context;
+
+    /* the checksum covers the signature, the signature doesn't */
+    uLong adler = adler32(adler32(0L, Z_NULL, 0), data + nonSum,
+        nonSig - nonSum);
+    SHA1Init(&context);
+
+    IntegrityJob job;
+    job.body = data + nonSig;
+    job.bodyLen = length - nonSig;
+    job.numWindows = (u4) ((job.bodyLen + kWindowSize - 1) / kWindowSize);
+    job.numHelpers = (numThreads - 1 > kMaxHelpers) ?
+        kMaxHelpers : numThreads - 1;
+    job.partials = NULL;
+
+    bool threaded = false;
+    if (job.numHelpers > 0 && job.numWindows >= 2) {
+        job.partials = (uLong*) malloc(
+            (size_t) job.numWindows * job.numHelpers * sizeof(uLong));
+        if (job.partials != NULL)
+            threaded = computeThreaded(&job, &context, &adler);
+        free(job.partials);
+    }
+
+    if (!threaded) {
+        for (size_t off = 0; off < job.bodyLen; off += kBlockSize) {
+            size_t len = job.bodyLen - off;
+            if (len > kBlockSize)
+                len = kBlockSize;
+            adler = adler32(adler, job.body + off, len);
+            SHA1Update(&context, job.body + off, len);
+        }
+    }
+
+    pIntegrity->checksum = (u4) adler;
+    SHA1Final(pIntegrity->signature, &context);
+}
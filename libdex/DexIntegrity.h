@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/*
+ * Single-pass integrity check of a DEX file: the adler32 checksum and
+ * the SHA-1 signature computed together.
+ */
+
+#ifndef LIBDEX_DEXINTEGRITY_H_
+#define LIBDEX_DEXINTEGRITY_H_
+
+#include "DexFile.h"
+
+/*
+ * The two header values, as they should be stored for "data".
+ */
+struct DexIntegrity {
+    u4  checksum;                       /* adler32 of everything after it */
+    u1  signature[kSHA1DigestLen];      /* SHA-1 of everything after it */
+};
+
+/*
+ * Compute the checksum and signature of the "length" bytes of an
+ * unoptimized DEX file at "data", which must be at least a DexHeader
+ * long.
+ *
+ * Doing both separately streams the file through the cache twice.  This
+ * walks it once, in blocks small enough to still be cached when the
+ * second algorithm reads them.  SHA-1 is inherently serial; with
+ * numThreads > 1 the adler32 half moves to helper threads that work on
+ * the same window of the file as the SHA-1 thread, and the partial sums
+ * are joined with adler32_combine().
+ */
+void dexComputeIntegrity(const u1* data, size_t length, int numThreads,
+    DexIntegrity* pIntegrity);
+
+#endif  // LIBDEX_DEXINTEGRITY_H_
@@ -0,0 +1,932 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Profile-driven data section layout.
+ *
+ * The data area is rebuilt section by section in map order.  Three
+ * sections are reordered item by item (code_item, string_data_item and
+ * class_data_item); every other section is copied as a block and just
+ * slides to its new start.  An old offset is translated either through
+ * the per-item table of a reordered section or by its section's delta.
+ *
+ * class_data_items hold code_item offsets as ULEB128, so their size
+ * depends on where the code ends up, which in turn depends on the size
+ * of the class_data section when it comes first.  We iterate the layout
+ * until it stops changing; each code offset is only ever allowed to get
+ * a wider encoding, so this terminates.
+ */
+
+#include "DexLayout.h"
+#include "DexClass.h"
+#include "InstrUtils.h"
+#include "Leb128.h"
+#include "sha1.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* upper bound on layout passes; in practice two or three suffice */
+#define kMaxLayoutPasses 16
+
+/*
+ * One item of a reordered section.
+ */
+struct LayoutItem {
+    u4          oldOffset;
+    u4          oldSize;
+    u4          newOffset;
+    u4          newSize;
+    bool        hot;
+    DexClassData* pClassData;   /* class_data_item only */
+    u1*         codeOffWidths;  /* class_data_item only; one per method */
+};
+
+/*
+ * One section from the map.  Sections at or after the start of the data
+ * area get moved; "pItems" is only set for the reordered ones.
+ */
+struct LayoutSection {
+    u2          type;
+    u4          count;
+    u4          oldStart;
+    u4          oldEnd;         /* start of the next section */
+    u4          newStart;
+    u4          newEnd;
+    bool        moved;
+    LayoutItem* pItems;         /* in old offset order */
+    u4*         pOrder;         /* emit order, as indices into pItems */
+};
+
+struct LayoutState {
+    const DexFile*  pDexFile;
+    const u1*       base;
+    u4              fileSize;
+    u4              sectionCount;
+    LayoutSection*  pSections;
+    LayoutSection*  pCode;
+    LayoutSection*  pStrings;
+    LayoutSection*  pClassData;
+};
+
+static bool isReorderedType(u2 type)
+{
+    return type == kDexTypeCodeItem || type == kDexTypeStringDataItem ||
+        type == kDexTypeClassDataItem;
+}
+
+/*
+ * Alignment of a section as a whole.  Byte-aligned sections may start
+ * anywhere.
+ */
+static u4 sectionAlignment(u2 type)
+{
+    switch (type) {
+    case kDexTypeClassDataItem:
+    case kDexTypeStringDataItem:
+    case kDexTypeDebugInfoItem:
+    case kDexTypeAnnotationItem:
+    case kDexTypeEncodedArrayItem:
+        return 1;
+    default:
+        return 4;
+    }
+}
+
+static u4 alignUp(u4 value, u4 alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+/*
+ * Write "value" as ULEB128 using exactly "width" bytes, padding with
+ * redundant continuation bytes if needed.
+ */
+static u1* writePaddedLeb128(u1* ptr, u4 value, int width)
+{
+    for (int i = 0; i < width - 1; i++) {
+        *ptr++ = (value & 0x7f) | 0x80;
+        value >>= 7;
+    }
+    *ptr++ = value & 0x7f;
+    return ptr;
+}
+
+/*
+ * Find the item of a reordered section that starts at "offset".
+ */
+static LayoutItem* findItem(const LayoutSection* pSection, u4 offset)
+{
+    u4 lo = 0;
+    u4 hi = pSection->count;
+
+    while (lo < hi) {
+        u4 mid = (lo + hi) / 2;
+        if (pSection->pItems[mid].oldOffset < offset)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (lo < pSection->count && pSection->pItems[lo].oldOffset == offset)
+        return &pSection->pItems[lo];
+    return NULL;
+}
+
+/*
+ * Translate an old file offset to its new value.  Returns false if the
+ * offset doesn't land on something we know how to move.
+ */
+static bool remapOffset(const LayoutState* pState, u4 oldOffset, u4* pNewOffset)
+{
+    if (oldOffset == 0) {
+        *pNewOffset = 0;
+        return true;
+    }
+
+    /* find the last section starting at or before oldOffset */
+    int lo = 0;
+    int hi = (int) pState->sectionCount - 1;
+    int found = -1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (pState->pSections[mid].oldStart <= oldOffset) {
+            found = mid;
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+
+    if (found < 0)
+        return false;
+
+    const LayoutSection* pSection = &pState->pSections[found];
+    if (!pSection->moved) {
+        *pNewOffset = oldOffset;
+    } else if (pSection->pItems != NULL) {
+        const LayoutItem* pItem = findItem(pSection, oldOffset);
+        if (pItem == NULL)
+            return false;
+        *pNewOffset = pItem->newOffset;
+    } else {
+        *pNewOffset = oldOffset - pSection->oldStart + pSection->newStart;
+    }
+
+    return true;
+}
+
+/*
+ * Encode a class_data_item with remapped code offsets.  Writes to "ptr"
+ * if it's non-NULL.  Widens pItem->codeOffWidths as needed and returns
+ * the encoded size, or 0 if a code offset couldn't be remapped.
+ */
+static u4 encodeClassData(const LayoutState* pState, LayoutItem* pItem, u1* ptr)
+{
+    const DexClassData* pClassData = pItem->pClassData;
+    const DexClassDataHeader* pHeader = &pClassData->header;
+    u1 buf[5];
+    u4 size = 0;
+    u4 methodNum = 0;
+
+#define EMIT_LEB(_value) do {                                               \
+        u1* _end = writeUnsignedLeb128((ptr != NULL) ? ptr + size : buf,    \
+            (_value));                                                      \
+        size += _end - ((ptr != NULL) ? ptr + size : buf);                  \
+    } while (false)
+
+    EMIT_LEB(pHeader->staticFieldsSize);
+    EMIT_LEB(pHeader->instanceFieldsSize);
+    EMIT_LEB(pHeader->directMethodsSize);
+    EMIT_LEB(pHeader->virtualMethodsSize);
+
+    for (int list = 0; list < 2; list++) {
+        const DexField* pFields = (list == 0) ?
+            pClassData->staticFields : pClassData->instanceFields;
+        u4 count = (list == 0) ?
+            pHeader->staticFieldsSize : pHeader->instanceFieldsSize;
+        u4 lastIdx = 0;
+
+        for (u4 i = 0; i < count; i++) {
+            EMIT_LEB(pFields[i].fieldIdx - lastIdx);
+            EMIT_LEB(pFields[i].accessFlags);
+            lastIdx = pFields[i].fieldIdx;
+        }
+    }
+
+    for (int list = 0; list < 2; list++) {
+        const DexMethod* pMethods = (list == 0) ?
+            pClassData->directMethods : pClassData->virtualMethods;
+        u4 count = (list == 0) ?
+            pHeader->directMethodsSize : pHeader->virtualMethodsSize;
+        u4 lastIdx = 0;
+
+        for (u4 i = 0; i < count; i++, methodNum++) {
+            u4 codeOff;
+
+            EMIT_LEB(pMethods[i].methodIdx - lastIdx);
+            EMIT_LEB(pMethods[i].accessFlags);
+            lastIdx = pMethods[i].methodIdx;
+
+            if (!remapOffset(pState, pMethods[i].codeOff, &codeOff)) {
+                ALOGE("Unable to remap code_off 0x%x", pMethods[i].codeOff);
+                return 0;
+            }
+
+            int width = unsignedLeb128Size(codeOff);
+            if (width < pItem->codeOffWidths[methodNum])
+                width = pItem->codeOffWidths[methodNum];
+            pItem->codeOffWidths[methodNum] = width;
+
+            if (ptr != NULL)
+                writePaddedLeb128(ptr + size, codeOff, width);
+            size += width;
+        }
+    }
+
+#undef EMIT_LEB
+
+    return size;
+}
+
+/*
+ * Enumerate the items of a reordered section.
+ */
+static bool loadSectionItems(LayoutState* pState, LayoutSection* pSection)
+{
+    const u1* limit = pState->base + pState->fileSize;
+    u4 offset = pSection->oldStart;
+
+    pSection->pItems =
+        (LayoutItem*) calloc(pSection->count + 1, sizeof(LayoutItem));
+    pSection->pOrder = (u4*) malloc((pSection->count + 1) * sizeof(u4));
+    if (pSection->pItems == NULL || pSection->pOrder == NULL)
+        return false;
+
+    for (u4 i = 0; i < pSection->count; i++) {
+        LayoutItem* pItem = &pSection->pItems[i];
+        const u1* ptr;
+
+        if (pSection->type == kDexTypeCodeItem)
+            offset = alignUp(offset, 4);
+        ptr = pState->base + offset;
+        pItem->oldOffset = offset;
+
+        switch (pSection->type) {
+        case kDexTypeCodeItem:
+            pItem->oldSize = dexGetCodeItemSize((const DexCode*) ptr);
+            break;
+        case kDexTypeStringDataItem: {
+            const u1* data = ptr;
+            skipLeb128(&data);
+            pItem->oldSize = (data - ptr) + strlen((const char*) data) + 1;
+            break;
+        }
+        case kDexTypeClassDataItem: {
+            const u1* data = ptr;
+            pItem->pClassData = dexReadAndVerifyClassData(&data, limit);
+            if (pItem->pClassData == NULL) {
+                ALOGE("Bad class_data_item at 0x%x", offset);
+                return false;
+            }
+            pItem->oldSize = data - ptr;
+
+            const DexClassDataHeader* pHeader = &pItem->pClassData->header;
+            pItem->codeOffWidths = (u1*) calloc(
+                pHeader->directMethodsSize + pHeader->virtualMethodsSize + 1, 1);
+            if (pItem->codeOffWidths == NULL)
+                return false;
+            break;
+        }
+        }
+
+        pItem->newSize = pItem->oldSize;
+        offset += pItem->oldSize;
+        if (offset > pSection->oldEnd) {
+            ALOGE("Item at 0x%x overruns its section", pItem->oldOffset);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Mark an item of a reordered section as hot, by its old offset.
+ */
+static void markHot(LayoutSection* pSection, u4 offset)
+{
+    if (pSection == NULL || offset == 0)
+        return;
+
+    LayoutItem* pItem = findItem(pSection, offset);
+    if (pItem != NULL)
+        pItem->hot = true;
+}
+
+static void markHotString(const LayoutState* pState, u4 stringIdx)
+{
+    if (stringIdx == kDexNoIndex)
+        return;
+    markHot(pState->pStrings,
+        dexGetStringId(pState->pDexFile, stringIdx)->stringDataOff);
+}
+
+static void markHotType(const LayoutState* pState, u4 typeIdx)
+{
+    if (typeIdx == kDexNoIndex)
+        return;
+    markHotString(pState, dexGetTypeId(pState->pDexFile, typeIdx)->descriptorIdx);
+}
+
+static void markHotMethodRef(const LayoutState* pState, u4 methodIdx)
+{
+    const DexFile* pDexFile = pState->pDexFile;
+    const DexMethodId* pMethodId = dexGetMethodId(pDexFile, methodIdx);
+
+    markHotType(pState, pMethodId->classIdx);
+    markHotString(pState, pMethodId->nameIdx);
+    markHotString(pState, dexGetProtoId(pDexFile, pMethodId->protoIdx)->shortyIdx);
+}
+
+static void markHotFieldRef(const LayoutState* pState, u4 fieldIdx)
+{
+    const DexFieldId* pFieldId = dexGetFieldId(pState->pDexFile, fieldIdx);
+
+    markHotType(pState, pFieldId->classIdx);
+    markHotString(pState, pFieldId->nameIdx);
+    markHotType(pState, pFieldId->typeIdx);
+}
+
+/*
+ * Mark the code_item and the strings a hot method's code refers to.
+ */
+static void markHotCode(const LayoutState* pState, const DexMethod* pMethod)
+{
+    const DexFile* pDexFile = pState->pDexFile;
+    const DexCode* pCode = dexGetCode(pDexFile, pMethod);
+
+    if (pCode == NULL)
+        return;
+    markHot(pState->pCode, pMethod->codeOff);
+
+    u4 insnIdx = 0;
+    while (insnIdx < pCode->insnsSize) {
+        const u2* insns = &pCode->insns[insnIdx];
+        size_t width = dexGetWidthFromInstruction(insns);
+        Opcode opcode = dexOpcodeFromCodeUnit(*insns);
+
+        if (width == 0)
+            break;
+        insnIdx += width;
+
+        /* skip switch and array payloads */
+        if (opcode == OP_NOP && *insns != 0)
+            continue;
+
+        DecodedInstruction decInsn;
+        switch (dexGetIndexTypeFromOpcode(opcode)) {
+        case kIndexStringRef:
+            dexDecodeInstruction(insns, &decInsn);
+            markHotString(pState, decInsn.vB);
+            break;
+        case kIndexTypeRef:
+            dexDecodeInstruction(insns, &decInsn);
+            markHotType(pState, (dexGetFormatFromOpcode(opcode) == kFmt22c) ?
+                decInsn.vC : decInsn.vB);
+            break;
+        case kIndexMethodRef:
+        case kIndexMethodAndProtoRef:
+            dexDecodeInstruction(insns, &decInsn);
+            markHotMethodRef(pState, decInsn.vB);
+            break;
+        case kIndexFieldRef:
+            dexDecodeInstruction(insns, &decInsn);
+            markHotFieldRef(pState, (dexGetFormatFromOpcode(opcode) == kFmt22c) ?
+                decInsn.vC : decInsn.vB);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+static int compareStrings(const void* a, const void* b)
+{
+    return strcmp(*(const char* const*) a, *(const char* const*) b);
+}
+
+static int compareU4(const void* a, const void* b)
+{
+    u4 valA = *(const u4*) a;
+    u4 valB = *(const u4*) b;
+    return (valA < valB) ? -1 : (valA > valB);
+}
+
+/*
+ * Decide which items are hot.  A class in the profile makes its
+ * class_data, all of its code, and the strings it and its code refer to
+ * hot; a method in the profile does the same for just that method.
+ */
+static bool markProfile(LayoutState* pState, const DexLayoutProfile* pProfile,
+    DexLayoutStats* pStats)
+{
+    const DexFile* pDexFile = pState->pDexFile;
+    const char** sortedClasses = NULL;
+    u4* sortedMethods = NULL;
+    bool result = false;
+    u4 matchedClasses = 0;
+
+    if (pProfile->classCount != 0) {
+        sortedClasses =
+            (const char**) malloc(pProfile->classCount * sizeof(const char*));
+        if (sortedClasses == NULL)
+            goto bail;
+        memcpy(sortedClasses, pProfile->classDescriptors,
+            pProfile->classCount * sizeof(const char*));
+        qsort(sortedClasses, pProfile->classCount, sizeof(const char*),
+            compareStrings);
+    }
+    if (pProfile->methodCount != 0) {
+        sortedMethods = (u4*) malloc(pProfile->methodCount * sizeof(u4));
+        if (sortedMethods == NULL)
+            goto bail;
+        memcpy(sortedMethods, pProfile->methodIdxs,
+            pProfile->methodCount * sizeof(u4));
+        qsort(sortedMethods, pProfile->methodCount, sizeof(u4), compareU4);
+    }
+
+    for (u4 i = 0; i < pDexFile->pHeader->classDefsSize; i++) {
+        const DexClassDef* pClassDef = dexGetClassDef(pDexFile, i);
+        const char* descriptor = dexGetClassDescriptor(pDexFile, pClassDef);
+        bool hotClass = (sortedClasses != NULL) &&
+            bsearch(&descriptor, sortedClasses, pProfile->classCount,
+                sizeof(const char*), compareStrings) != NULL;
+        LayoutItem* pClassDataItem = NULL;
+
+        if (hotClass) {
+            matchedClasses++;
+            markHotType(pState, pClassDef->classIdx);
+            markHotType(pState, pClassDef->superclassIdx);
+            markHotString(pState, pClassDef->sourceFileIdx);
+
+            const DexTypeList* pInterfaces =
+                dexGetInterfacesList(pDexFile, pClassDef);
+            for (u4 j = 0; pInterfaces != NULL && j < pInterfaces->size; j++)
+                markHotType(pState, dexTypeListGetIdx(pInterfaces, j));
+        }
+
+        if (pState->pClassData != NULL && pClassDef->classDataOff != 0)
+            pClassDataItem = findItem(pState->pClassData, pClassDef->classDataOff);
+        if (pClassDataItem == NULL)
+            continue;
+
+        const DexClassData* pClassData = pClassDataItem->pClassData;
+        if (hotClass) {
+            pClassDataItem->hot = true;
+
+            u4 fieldCount = pClassData->header.staticFieldsSize +
+                pClassData->header.instanceFieldsSize;
+            for (u4 j = 0; j < fieldCount; j++) {
+                const DexField* pField = (j < pClassData->header.staticFieldsSize) ?
+                    &pClassData->staticFields[j] :
+                    &pClassData->instanceFields[j - pClassData->header.staticFieldsSize];
+                markHotFieldRef(pState, pField->fieldIdx);
+            }
+        }
+
+        u4 methodCount = pClassData->header.directMethodsSize +
+            pClassData->header.virtualMethodsSize;
+        for (u4 j = 0; j < methodCount; j++) {
+            const DexMethod* pMethod = (j < pClassData->header.directMethodsSize) ?
+                &pClassData->directMethods[j] :
+                &pClassData->virtualMethods[j - pClassData->header.directMethodsSize];
+            bool hotMethod = hotClass || ((sortedMethods != NULL) &&
+                bsearch(&pMethod->methodIdx, sortedMethods,
+                    pProfile->methodCount, sizeof(u4), compareU4) != NULL);
+
+            if (hotMethod) {
+                pClassDataItem->hot = true;
+                markHotMethodRef(pState, pMethod->methodIdx);
+                markHotCode(pState, pMethod);
+            }
+        }
+    }
+
+    if (pStats != NULL)
+        pStats->unmatchedClasses = pProfile->classCount - matchedClasses;
+    result = true;
+
+bail:
+    free(sortedClasses);
+    free(sortedMethods);
+    return result;
+}
+
+/*
+ * Assign new offsets to every moved section and item.  Returns the new
+ * file size, or 0 on failure.  Sets "*pChanged" if any class_data_item
+ * changed size, meaning another pass is needed.
+ */
+static u4 computeLayout(LayoutState* pState, bool* pChanged)
+{
+    u4 offset = 0;
+
+    *pChanged = false;
+
+    for (u4 i = 0; i < pState->sectionCount; i++) {
+        LayoutSection* pSection = &pState->pSections[i];
+
+        if (!pSection->moved) {
+            offset = pSection->oldEnd;
+            continue;
+        }
+
+        offset = alignUp(offset, sectionAlignment(pSection->type));
+        pSection->newStart = offset;
+
+        if (pSection->pItems == NULL) {
+            offset += pSection->oldEnd - pSection->oldStart;
+        } else {
+            for (u4 j = 0; j < pSection->count; j++) {
+                LayoutItem* pItem = &pSection->pItems[pSection->pOrder[j]];
+
+                if (pSection->type == kDexTypeCodeItem)
+                    offset = alignUp(offset, 4);
+                if (j == 0)
+                    pSection->newStart = offset;
+                pItem->newOffset = offset;
+                offset += pItem->newSize;
+            }
+        }
+
+        pSection->newEnd = offset;
+    }
+
+    /* now see whether the class_data sizes still hold */
+    LayoutSection* pClassData = pState->pClassData;
+    for (u4 i = 0; pClassData != NULL && i < pClassData->count; i++) {
+        LayoutItem* pItem = &pClassData->pItems[i];
+        u4 size = encodeClassData(pState, pItem, NULL);
+
+        if (size == 0)
+            return 0;
+        if (size != pItem->newSize) {
+            pItem->newSize = size;
+            *pChanged = true;
+        }
+    }
+
+    return offset;
+}
+
+/*
+ * Fix the offsets stored in the moved annotation and call site
+ * sections of the new file.
+ */
+static bool patchSectionOffsets(const LayoutState* pState, u1* out)
+{
+#define REMAP(_field) do {                                                  \
+        if (!remapOffset(pState, (_field), &(_field))) {                    \
+            ALOGE("Unable to remap offset 0x%x", (_field));                 \
+            return false;                                                   \
+        }                                                                   \
+    } while (false)
+
+    for (u4 i = 0; i < pState->sectionCount; i++) {
+        const LayoutSection* pSection = &pState->pSections[i];
+        u4 offset = pSection->moved ? pSection->newStart : pSection->oldStart;
+
+        for (u4 j = 0; j < pSection->count; j++) {
+            switch (pSection->type) {
+            case kDexTypeAnnotationSetRefList: {
+                offset = alignUp(offset, 4);
+                DexAnnotationSetRefList* pList =
+                    (DexAnnotationSetRefList*) (out + offset);
+                for (u4 k = 0; k < pList->size; k++)
+                    REMAP(pList->list[k].annotationsOff);
+                offset += sizeof(u4) + pList->size * sizeof(DexAnnotationSetRefItem);
+                break;
+            }
+            case kDexTypeAnnotationSetItem: {
+                offset = alignUp(offset, 4);
+                DexAnnotationSetItem* pSet = (DexAnnotationSetItem*) (out + offset);
+                for (u4 k = 0; k < pSet->size; k++)
+                    REMAP(pSet->entries[k]);
+                offset += sizeof(u4) + pSet->size * sizeof(u4);
+                break;
+            }
+            case kDexTypeAnnotationsDirectoryItem: {
+                offset = alignUp(offset, 4);
+                DexAnnotationsDirectoryItem* pDir =
+                    (DexAnnotationsDirectoryItem*) (out + offset);
+                u4* entries = (u4*) (pDir + 1);
+                u4 entryCount =
+                    pDir->fieldsSize + pDir->methodsSize + pDir->parametersSize;
+
+                REMAP(pDir->classAnnotationsOff);
+                /* each entry is an (index, offset) pair */
+                for (u4 k = 0; k < entryCount; k++)
+                    REMAP(entries[k * 2 + 1]);
+                offset += sizeof(DexAnnotationsDirectoryItem) + entryCount * 8;
+                break;
+            }
+            case kDexTypeCallSiteIdItem: {
+                DexCallSiteId* pCallSite = (DexCallSiteId*) (out + offset);
+                REMAP(pCallSite->callSiteOff);
+                offset += sizeof(DexCallSiteId);
+                break;
+            }
+            default:
+                j = pSection->count;
+                break;
+            }
+        }
+    }
+
+    return true;
+
+#undef REMAP
+}
+
+/*
+ * Build the new file.  Returns NULL on failure.
+ */
+static u1* emitFile(const LayoutState* pState, u4 newFileSize)
+{
+    const DexHeader* pOldHeader = pState->pDexFile->pHeader;
+    u1* out = (u1*) calloc(newFileSize, 1);
+
+    if (out == NULL)
+        return NULL;
+
+    /* everything ahead of the data area stays where it is */
+    memcpy(out, pState->base, pOldHeader->dataOff);
+
+    for (u4 i = 0; i < pState->sectionCount; i++) {
+        const LayoutSection* pSection = &pState->pSections[i];
+
+        if (!pSection->moved)
+            continue;
+
+        if (pSection->pItems == NULL) {
+            memcpy(out + pSection->newStart, pState->base + pSection->oldStart,
+                pSection->oldEnd - pSection->oldStart);
+            continue;
+        }
+
+        for (u4 j = 0; j < pSection->count; j++) {
+            LayoutItem* pItem = &pSection->pItems[j];
+            u1* ptr = out + pItem->newOffset;
+
+            if (pSection->type == kDexTypeClassDataItem) {
+                if (encodeClassData(pState, pItem, ptr) != pItem->newSize) {
+                    ALOGE("class_data_item size changed during emit");
+                    goto fail;
+                }
+                continue;
+            }
+
+            memcpy(ptr, pState->base + pItem->oldOffset, pItem->oldSize);
+            if (pSection->type == kDexTypeCodeItem) {
+                DexCode* pCode = (DexCode*) ptr;
+                if (!remapOffset(pState, pCode->debugInfoOff, &pCode->debugInfoOff)) {
+                    ALOGE("Unable to remap debug_info_off 0x%x", pCode->debugInfoOff);
+                    goto fail;
+                }
+            }
+        }
+    }
+
+    return out;
+
+fail:
+    free(out);
+    return NULL;
+}
+
+/*
+ * Fix every offset outside the reordered items, then the header's
+ * size fields, checksum and signature.
+ */
+static bool patchFile(const LayoutState* pState, u1* out, u4 newFileSize)
+{
+    const DexFile* pDexFile = pState->pDexFile;
+    const DexHeader* pOldHeader = pDexFile->pHeader;
+    DexHeader* pHeader = (DexHeader*) out;
+
+    for (u4 i = 0; i < pOldHeader->stringIdsSize; i++) {
+        DexStringId* pStringId =
+            (DexStringId*) (out + pOldHeader->stringIdsOff) + i;
+        if (!remapOffset(pState, pStringId->stringDataOff, &pStringId->stringDataOff))
+            return false;
+    }
+
+    for (u4 i = 0; i < pOldHeader->protoIdsSize; i++) {
+        DexProtoId* pProtoId = (DexProtoId*) (out + pOldHeader->protoIdsOff) + i;
+        if (!remapOffset(pState, pProtoId->parametersOff, &pProtoId->parametersOff))
+            return false;
+    }
+
+    for (u4 i = 0; i < pOldHeader->classDefsSize; i++) {
+        DexClassDef* pClassDef = (DexClassDef*) (out + pOldHeader->classDefsOff) + i;
+        if (!remapOffset(pState, pClassDef->interfacesOff, &pClassDef->interfacesOff) ||
+            !remapOffset(pState, pClassDef->annotationsOff, &pClassDef->annotationsOff) ||
+            !remapOffset(pState, pClassDef->classDataOff, &pClassDef->classDataOff) ||
+            !remapOffset(pState, pClassDef->staticValuesOff, &pClassDef->staticValuesOff))
+            return false;
+    }
+
+    if (!patchSectionOffsets(pState, out))
+        return false;
+
+    if (!remapOffset(pState, pOldHeader->mapOff, &pHeader->mapOff))
+        return false;
+
+    DexMapList* pMap = (DexMapList*) (out + pHeader->mapOff);
+    for (u4 i = 0; i < pMap->size; i++) {
+        const LayoutSection* pSection = &pState->pSections[i];
+        pMap->list[i].offset =
+            pSection->moved ? pSection->newStart : pSection->oldStart;
+    }
+
+    pHeader->fileSize = newFileSize;
+    pHeader->dataSize = newFileSize - pHeader->dataOff;
+
+    /* the signature covers everything after itself; the checksum, that too */
+    SHA1_CTX context;
+    u4 nonSig = sizeof(pHeader->magic) + sizeof(pHeader->checksum) +
+        kSHA1DigestLen;
+    SHA1Init(&context);
+    SHA1Update(&context, out + nonSig, newFileSize - nonSig);
+    SHA1Final(pHeader->signature, &context);
+
+    pHeader->checksum = dexComputeChecksum(pHeader);
+    return true;
+}
+
+static void freeLayoutState(LayoutState* pState)
+{
+    if (pState->pSections == NULL)
+        return;
+
+    for (u4 i = 0; i < pState->sectionCount; i++) {
+        LayoutSection* pSection = &pState->pSections[i];
+        if (pSection->pItems != NULL) {
+            for (u4 j = 0; j < pSection->count; j++) {
+                free(pSection->pItems[j].pClassData);
+                free(pSection->pItems[j].codeOffWidths);
+            }
+        }
+        free(pSection->pItems);
+        free(pSection->pOrder);
+    }
+    free(pState->pSections);
+}
+
+/* (documented in header file) */
+int dexLayoutRewrite(const DexFile* pDexFile, const DexLayoutProfile* pProfile,
+    u1** pOutData, size_t* pOutLength, DexLayoutStats* pStats)
+{
+    const DexHeader* pHeader = pDexFile->pHeader;
+    const DexMapList* pMap = dexGetMap(pDexFile);
+    LayoutState state;
+    u1* out = NULL;
+    u4 newFileSize = 0;
+    int result = -1;
+
+    memset(&state, 0, sizeof(state));
+    if (pStats != NULL)
+        memset(pStats, 0, sizeof(*pStats));
+
+    if (pDexFile->pOptHeader != NULL) {
+        ALOGE("Can't lay out an optimized DEX file");
+        goto bail;
+    }
+    if (pMap == NULL || pHeader->linkSize != 0) {
+        ALOGE("Can't lay out a DEX file without a map or with link data");
+        goto bail;
+    }
+
+    state.pDexFile = pDexFile;
+    state.base = pDexFile->baseAddr;
+    state.fileSize = pHeader->fileSize;
+    state.sectionCount = pMap->size;
+    state.pSections =
+        (LayoutSection*) calloc(pMap->size, sizeof(LayoutSection));
+    if (state.pSections == NULL)
+        goto bail;
+
+    for (u4 i = 0; i < pMap->size; i++) {
+        LayoutSection* pSection = &state.pSections[i];
+
+        pSection->type = pMap->list[i].type;
+        pSection->count = pMap->list[i].size;
+        pSection->oldStart = pMap->list[i].offset;
+        pSection->oldEnd = (i + 1 < pMap->size) ?
+            pMap->list[i + 1].offset : pHeader->fileSize;
+        pSection->moved = (pSection->oldStart >= pHeader->dataOff);
+
+        if (pSection->moved && isReorderedType(pSection->type)) {
+            if (!loadSectionItems(&state, pSection))
+                goto bail;
+            if (pSection->type == kDexTypeCodeItem)
+                state.pCode = pSection;
+            else if (pSection->type == kDexTypeStringDataItem)
+                state.pStrings = pSection;
+            else
+                state.pClassData = pSection;
+        }
+    }
+
+    if (!markProfile(&state, pProfile, pStats))
+        goto bail;
+
+    /* hot items first, each group in original order */
+    for (u4 i = 0; i < state.sectionCount; i++) {
+        LayoutSection* pSection = &state.pSections[i];
+        u4 next = 0;
+
+        if (pSection->pItems == NULL)
+            continue;
+        for (int pass = 0; pass < 2; pass++) {
+            for (u4 j = 0; j < pSection->count; j++) {
+                if (pSection->pItems[j].hot == (pass == 0))
+                    pSection->pOrder[next++] = j;
+            }
+        }
+    }
+
+    for (int pass = 0; ; pass++) {
+        bool changed;
+
+        if (pass == kMaxLayoutPasses) {
+            ALOGE("Layout did not converge");
+            goto bail;
+        }
+        newFileSize = computeLayout(&state, &changed);
+        if (newFileSize == 0)
+            goto bail;
+        if (!changed)
+            break;
+    }
+
+    out = emitFile(&state, newFileSize);
+    if (out == NULL || !patchFile(&state, out, newFileSize))
+        goto bail;
+
+    if (pStats != NULL) {
+        for (u4 i = 0; i < state.sectionCount; i++) {
+            const LayoutSection* pSection = &state.pSections[i];
+            u4 *pHotItems, *pHotBytes, *pColdItems;
+
+            if (pSection == state.pCode) {
+                pHotItems = &pStats->hotCodeItems;
+                pHotBytes = &pStats->hotCodeBytes;
+                pColdItems = &pStats->coldCodeItems;
+            } else if (pSection == state.pStrings) {
+                pHotItems = &pStats->hotStringItems;
+                pHotBytes = &pStats->hotStringBytes;
+                pColdItems = &pStats->coldStringItems;
+            } else if (pSection == state.pClassData) {
+                pHotItems = &pStats->hotClassDataItems;
+                pHotBytes = &pStats->hotClassDataBytes;
+                pColdItems = &pStats->coldClassDataItems;
+            } else {
+                continue;
+            }
+
+            for (u4 j = 0; j < pSection->count; j++) {
+                if (pSection->pItems[j].hot) {
+                    (*pHotItems)++;
+                    *pHotBytes += pSection->pItems[j].newSize;
+                } else {
+                    (*pColdItems)++;
+                }
+            }
+        }
+    }
+
+    *pOutData = out;
+    *pOutLength = newFileSize;
+    out = NULL;
+    result = 0;
+
+bail:
+    free(out);
+    freeLayoutState(&state);
+    return result;
+}
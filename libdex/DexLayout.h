@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Profile-driven data section layout.
+ *
+ * Rewrites a .dex file so that the code_items, string_data_items and
+ * class_data_items used by a set of "hot" classes and methods sit
+ * together at the front of their sections, with everything else after
+ * them.  The other data sections are moved as-is.  All offsets are
+ * fixed up, and the checksum and signature are recomputed.
+ */
+
+#ifndef LIBDEX_DEXLAYOUT_H_
+#define LIBDEX_DEXLAYOUT_H_
+
+#include "DexFile.h"
+
+/*
+ * What's hot.  Class descriptors look like "Ljava/lang/Object;".
+ * Either list may be empty.
+ */
+struct DexLayoutProfile {
+    const char* const*  classDescriptors;
+    u4                  classCount;
+    const u4*           methodIdxs;
+    u4                  methodCount;
+};
+
+/*
+ * What the rewrite did, per reordered section.
+ */
+struct DexLayoutStats {
+    u4          hotCodeItems;
+    u4          hotCodeBytes;
+    u4          coldCodeItems;
+    u4          hotStringItems;
+    u4          hotStringBytes;
+    u4          coldStringItems;
+    u4          hotClassDataItems;
+    u4          hotClassDataBytes;
+    u4          coldClassDataItems;
+    u4          unmatchedClasses;   /* profile classes not in the file */
+};
+
+/*
+ * Rewrite the data section of "pDexFile" according to "pProfile".
+ *
+ * The input must be a verified, unoptimized .dex file in host byte
+ * order.  On success, returns 0 and sets "*pOutData" to a malloc'd
+ * buffer of "*pOutLength" bytes holding the new file.  "pStats" may be
+ * NULL.  Returns -1 on failure.
+ */
+int dexLayoutRewrite(const DexFile* pDexFile, const DexLayoutProfile* pProfile,
+    u1** pOutData, size_t* pOutLength, DexLayoutStats* pStats);
+
+#endif  // LIBDEX_DEXLAYOUT_H_
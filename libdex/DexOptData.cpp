@@ -23,6 +23,61 @@
 
 #include "DexOptData.h"
 
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+/*
+ * Opt data chunk types we recognize.  If "attach" is set it hooks the
+ * payload up to the DexFile while the chunk is parsed; the others are
+ * found on demand with dexGetOptChunk() by the code that uses them.
+ *
+ * To add a chunk type, give it a code in DexFile.h and an entry here.
+ */
+struct OptChunkType {
+    u4          type;
+    const char* name;
+    void        (*attach)(DexFile* pDexFile, const u1* data, u4 size);
+};
+
+static void attachClassLookup(DexFile* pDexFile, const u1* data, u4 size)
+{
+    (void) size;
+    pDexFile->pClassLookup = (const DexClassLookup*) data;
+}
+
+static void attachRegisterMaps(DexFile* pDexFile, const u1* data, u4 size)
+{
+    ALOGV("+++ found register maps, size=%u", size);
+    pDexFile->pRegisterMapPool = data;
+}
+
+static const OptChunkType gOptChunkTypes[] = {
+    { kDexChunkClassLookup,     "class lookup",         attachClassLookup },
+    { kDexChunkRegisterMaps,    "register maps",        attachRegisterMaps },
+    { kDexChunkStringIndex,     "string index",         NULL },
+    { kDexChunkXref,            "cross-reference index", NULL },
+    { kDexChunkAnnotationIndex, "annotation index",     NULL },
+};
+
+static const OptChunkType* findOptChunkType(u4 type)
+{
+    for (size_t i = 0; i < sizeof(gOptChunkTypes) / sizeof(gOptChunkTypes[0]);
+            i++) {
+        if (gOptChunkTypes[i].type == type)
+            return &gOptChunkTypes[i];
+    }
+    return NULL;
+}
+
+/* (documented in header file) */
+const char* dexGetOptChunkName(u4 type)
+{
+    const OptChunkType* pType = findOptChunkType(type);
+    return (pType != NULL) ? pType->name : NULL;
+}
+
 /*
  * Check to see if a given data pointer is a valid double-word-aligned
  * pointer into the given memory range (from start inclusive to end
@@ -104,21 +159,15 @@ bool dexParseOptData(const u1* data, size_t length, DexFile* pDexFile)
             return false;
         }
 
-        switch (*pOpt) {
-        case kDexChunkClassLookup:
-            pDexFile->pClassLookup = (const DexClassLookup*) pOptData;
-            break;
-        case kDexChunkRegisterMaps:
-            ALOGV("+++ found register maps, size=%u", size);
-            pDexFile->pRegisterMapPool = pOptData;
-            break;
-        default:
+        const OptChunkType* pType = findOptChunkType(*pOpt);
+        if (pType == NULL) {
             ALOGI("Unknown chunk 0x%08x (%c%c%c%c), size=%d in opt data area",
                 *pOpt,
                 (char) ((*pOpt) >> 24), (char) ((*pOpt) >> 16),
                 (char) ((*pOpt) >> 8),  (char)  (*pOpt),
                 size);
-            break;
+        } else if (pType->attach != NULL) {
+            (*pType->attach)(pDexFile, pOptData, size);
         }
 
         pOpt = pNextOpt;
@@ -126,3 +175,194 @@ bool dexParseOptData(const u1* data, size_t length, DexFile* pDexFile)
 
     return true;
 }
+
+/* (documented in header file) */
+void dexOptChunkIteratorInit(DexOptChunkIterator* pIterator,
+    const DexFile* pDexFile)
+{
+    const DexOptHeader* pOptHeader = pDexFile->pOptHeader;
+
+    if (pOptHeader == NULL) {
+        pIterator->pNext = NULL;
+        return;
+    }
+    pIterator->pNext =
+        (const u4*) ((const u1*) pOptHeader + pOptHeader->optOffset);
+}
+
+/* (documented in header file) */
+bool dexOptChunkIteratorNext(DexOptChunkIterator* pIterator, u4* pType,
+    const u1** pData, u4* pSize)
+{
+    const u4* pOpt = pIterator->pNext;
+
+    if (pOpt == NULL || *pOpt == kDexChunkEnd)
+        return false;
+
+    *pType = pOpt[0];
+    *pSize = pOpt[1];
+    *pData = (const u1*) (pOpt + 2);
+    pIterator->pNext = pOpt + ((pOpt[1] + 8 + 7) & ~7) / sizeof(u4);
+    return true;
+}
+
+/* (documented in header file) */
+const u1* dexGetOptChunk(const DexFile* pDexFile, u4 type, u4* pSize)
+{
+    DexOptChunkIterator iterator;
+    const u1* data;
+    u4 chunkType;
+
+    dexOptChunkIteratorInit(&iterator, pDexFile);
+    while (dexOptChunkIteratorNext(&iterator, &chunkType, &data, pSize)) {
+        if (chunkType == type)
+            return data;
+    }
+    return NULL;
+}
+
+/*
+ * Read "length" bytes at "offset" in "fd".  Returns false on failure or
+ * a short file.
+ */
+static bool readAt(int fd, off_t offset, void* buf, size_t length)
+{
+    u1* ptr = (u1*) buf;
+
+    /* no pread() on Windows */
+    if (lseek(fd, offset, SEEK_SET) != offset)
+        return false;
+
+    while (length != 0) {
+        ssize_t actual = read(fd, ptr, length);
+        if (actual <= 0) {
+            if (actual < 0 && errno == EINTR)
+                continue;
+            return false;
+        }
+        ptr += actual;
+        length -= actual;
+    }
+    return true;
+}
+
+/*
+ * Write "length" bytes at "offset" in "fd".  Returns 0 on success.
+ */
+static int writeAt(int fd, off_t offset, const void* buf, size_t length,
+    const char* logMsg)
+{
+    if (lseek(fd, offset, SEEK_SET) != offset) {
+        ALOGE("dexOptAppendChunks: seek failed: %s", strerror(errno));
+        return -1;
+    }
+    return sysWriteFully(fd, buf, length, logMsg);
+}
+
+/* (documented in header file) */
+int dexOptAppendChunks(int fd, const DexOptChunk* pChunks, int count)
+{
+    DexOptHeader optHeader;
+    u1* oldOpt = NULL;
+    u1* newOpt = NULL;
+    u1* deps = NULL;
+    size_t newLength = 0;
+    size_t maxLength;
+    size_t depsLength;
+    u4* pOpt;
+    uLong adler;
+    int result = -1;
+
+    if (!readAt(fd, 0, &optHeader, sizeof(optHeader)) ||
+        memcmp(optHeader.magic, DEX_OPT_MAGIC, 4) != 0 ||
+        memcmp(optHeader.magic + 4, DEX_OPT_MAGIC_VERS, 4) != 0)
+    {
+        ALOGE("dexOptAppendChunks: not an optimized DEX file");
+        return -1;
+    }
+    if (optHeader.depsOffset > optHeader.optOffset ||
+        (optHeader.optOffset & 7) != 0 || (optHeader.optLength & 3) != 0)
+    {
+        ALOGE("dexOptAppendChunks: bad opt header");
+        return -1;
+    }
+
+    /* room for the old chunks, the new ones, and the end marker */
+    maxLength = optHeader.optLength + 8;
+    for (int i = 0; i < count; i++)
+        maxLength += ((size_t) pChunks[i].size + 8 + 7) & ~7;
+
+    depsLength = optHeader.optOffset - optHeader.depsOffset;
+    oldOpt = (u1*) malloc(optHeader.optLength + 8);
+    newOpt = (u1*) calloc(1, maxLength);
+    deps = (u1*) malloc(depsLength + 1);
+    if (oldOpt == NULL || newOpt == NULL || deps == NULL)
+        goto bail;
+    if (!readAt(fd, optHeader.optOffset, oldOpt, optHeader.optLength) ||
+        !readAt(fd, optHeader.depsOffset, deps, depsLength))
+    {
+        ALOGE("dexOptAppendChunks: file truncated");
+        goto bail;
+    }
+
+    /* keep the old chunks, except the ones being replaced */
+    for (size_t offset = 0; offset + 8 <= optHeader.optLength; ) {
+        const u4* pOldOpt = (const u4*) (oldOpt + offset);
+        size_t roundedSize = ((size_t) pOldOpt[1] + 8 + 7) & ~7;
+        bool replaced = false;
+
+        if (pOldOpt[0] == kDexChunkEnd)
+            break;
+        if (offset + roundedSize > optHeader.optLength) {
+            ALOGE("dexOptAppendChunks: bad chunk at opt offset %zu", offset);
+            goto bail;
+        }
+        for (int i = 0; i < count; i++) {
+            if (pChunks[i].type == pOldOpt[0])
+                replaced = true;
+        }
+        if (!replaced) {
+            memcpy(newOpt + newLength, pOldOpt, roundedSize);
+            newLength += roundedSize;
+        }
+        offset += roundedSize;
+    }
+
+    for (int i = 0; i < count; i++) {
+        pOpt = (u4*) (newOpt + newLength);
+        pOpt[0] = pChunks[i].type;
+        pOpt[1] = pChunks[i].size;
+        memcpy(pOpt + 2, pChunks[i].data, pChunks[i].size);
+        newLength += ((size_t) pChunks[i].size + 8 + 7) & ~7;
+    }
+
+    pOpt = (u4*) (newOpt + newLength);
+    pOpt[0] = kDexChunkEnd;
+    pOpt[1] = 0;
+    newLength += 8;
+
+    /* same coverage as dexComputeOptChecksum() */
+    adler = adler32(0L, Z_NULL, 0);
+    adler = adler32(adler, deps, depsLength);
+    adler = adler32(adler, newOpt, newLength);
+
+    optHeader.optLength = newLength;
+    optHeader.checksum = (u4) adler;
+
+    if (writeAt(fd, optHeader.optOffset, newOpt, newLength, "opt data") != 0)
+        goto bail;
+    if (ftruncate(fd, optHeader.optOffset + newLength) != 0) {
+        ALOGE("dexOptAppendChunks: truncate failed: %s", strerror(errno));
+        goto bail;
+    }
+    if (writeAt(fd, 0, &optHeader, sizeof(optHeader), "opt header") != 0)
+        goto bail;
+
+    result = 0;
+
+bail:
+    free(oldOpt);
+    free(newOpt);
+    free(deps);
+    return result;
+}
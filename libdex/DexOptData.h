@@ -39,4 +39,54 @@ bool dexParseOptData(const u1* data, size_t length, DexFile* pDexFile);
  */
 u4 dexComputeOptChecksum(const DexOptHeader* pOptHeader);
 
+/*
+ * Return the human-readable name of a chunk type, or NULL if
+ * dexParseOptData() doesn't know it.
+ */
+const char* dexGetOptChunkName(u4 type);
+
+/*
+ * Iterator over the chunks in a DexFile's opt data, which
+ * dexParseOptData() has already checked.  This structure should be
+ * treated as opaque.
+ */
+struct DexOptChunkIterator {
+    const u4*   pNext;
+};
+
+/* Initialize an iterator; there are no chunks if the file isn't optimized. */
+void dexOptChunkIteratorInit(DexOptChunkIterator* pIterator,
+    const DexFile* pDexFile);
+
+/*
+ * Get the next chunk's type, payload and payload size.  Returns false
+ * after the last one.
+ */
+bool dexOptChunkIteratorNext(DexOptChunkIterator* pIterator, u4* pType,
+    const u1** pData, u4* pSize);
+
+/*
+ * Find the first chunk of the given type.  Returns a pointer to its
+ * payload, which is 8-byte aligned, and sets "*pSize"; or returns NULL
+ * if there is no such chunk.
+ */
+const u1* dexGetOptChunk(const DexFile* pDexFile, u4 type, u4* pSize);
+
+/*
+ * A chunk to be added with dexOptAppendChunks().
+ */
+struct DexOptChunk {
+    u4          type;
+    u4          size;           /* of the payload, in bytes */
+    const void* data;
+};
+
+/*
+ * Add "count" chunks to the opt data of the optimized DEX file open
+ * read/write on "fd".  Existing chunks of the same types are dropped, the
+ * new ones go just before the end marker, and the header's opt_length and
+ * checksum are updated to match.  Returns 0 on success.
+ */
+int dexOptAppendChunks(int fd, const DexOptChunk* pChunks, int count);
+
 #endif /* def _LIBDEX_DEXOPTDATA */
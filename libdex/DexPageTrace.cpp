@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Page-touch tracing for DexFile accessors.
+ */
+
+#include "DexPageTrace.h"
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* (documented in header file) */
+DexPageTrace* dexPageTraceCreate(const DexFile* pDexFile)
+{
+    const DexOptHeader* pOptHeader = pDexFile->pOptHeader;
+    DexPageTrace* pTrace;
+
+    pTrace = (DexPageTrace*) calloc(1, sizeof(DexPageTrace));
+    if (pTrace == NULL)
+        return NULL;
+
+    if (pOptHeader != NULL) {
+        pTrace->base = (const u1*) pOptHeader;
+        pTrace->length = pOptHeader->optOffset + pOptHeader->optLength;
+    } else {
+        pTrace->base = pDexFile->baseAddr;
+        pTrace->length = pDexFile->pHeader->fileSize;
+    }
+    pTrace->pageCount =
+        (pTrace->length + kDexPageTraceSize - 1) >> kDexPageTraceShift;
+
+    pTrace->pTouched = (u1*) calloc(pTrace->pageCount, 1);
+    pTrace->pTouches =
+        (DexPageTouch*) malloc(pTrace->pageCount * sizeof(DexPageTouch));
+    if (pTrace->pTouched == NULL || pTrace->pTouches == NULL) {
+        dexPageTraceFree(pTrace);
+        return NULL;
+    }
+
+    return pTrace;
+}
+
+/* (documented in header file) */
+void dexPageTraceFree(DexPageTrace* pTrace)
+{
+    if (pTrace == NULL)
+        return;
+
+    free(pTrace->pTouched);
+    free(pTrace->pTouches);
+    free(pTrace);
+}
+
+/* (documented in header file) */
+void dexPageTraceReset(DexPageTrace* pTrace)
+{
+    memset(pTrace->pTouched, 0, pTrace->pageCount);
+    pTrace->touchCount = 0;
+    pTrace->accessCount = 0;
+    pTrace->outOfRange = 0;
+}
+
+/* (documented in DexFile.h) */
+void dexPageTraceRecord(DexPageTrace* pTrace, const void* addr, size_t length)
+{
+    const u1* ptr = (const u1*) addr;
+
+    u8 accessNum = __atomic_add_fetch(&pTrace->accessCount, 1,
+        __ATOMIC_RELAXED);
+    if (ptr < pTrace->base || ptr >= pTrace->base + pTrace->length) {
+        __atomic_add_fetch(&pTrace->outOfRange, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    size_t offset = ptr - pTrace->base;
+    size_t last = offset + ((length != 0) ? length - 1 : 0);
+    if (last >= pTrace->length)
+        last = pTrace->length - 1;
+
+    for (size_t page = offset >> kDexPageTraceShift;
+            page <= (last >> kDexPageTraceShift); page++) {
+        if (__atomic_load_n(&pTrace->pTouched[page], __ATOMIC_RELAXED))
+            continue;
+
+        /*
+         * Claim the page before taking a slot, so each page gets at most
+         * one slot and touchCount can't run past pageCount.
+         */
+        if (__atomic_exchange_n(&pTrace->pTouched[page], 1, __ATOMIC_RELAXED))
+            continue;
+
+        u4 slot = __atomic_fetch_add(&pTrace->touchCount, 1, __ATOMIC_RELAXED);
+        DexPageTouch* pTouch = &pTrace->pTouches[slot];
+        size_t pageStart = page << kDexPageTraceShift;
+
+        pTouch->page = page;
+        pTouch->offset = (offset > pageStart) ? offset : pageStart;
+        pTouch->accessNum = accessNum;
+    }
+}
+
+/* (documented in header file) */
+void dexPageTraceDump(const DexPageTrace* pTrace, FILE* fp, bool summaryOnly)
+{
+    if (!summaryOnly) {
+        fprintf(fp, "Page trace (first touch order):\n");
+        fprintf(fp, "  %6s %8s %10s %12s\n", "seq", "page", "offset", "access");
+        for (u4 i = 0; i < pTrace->touchCount; i++) {
+            const DexPageTouch* pTouch = &pTrace->pTouches[i];
+            fprintf(fp, "  %6u %8u 0x%08x %12" PRIu64 "\n",
+                i, pTouch->page, pTouch->offset, pTouch->accessNum);
+        }
+        fprintf(fp, "\n");
+    }
+
+    fprintf(fp, "Page trace summary:\n");
+    fprintf(fp, "  file size     : %zu bytes, %u pages of %d bytes\n",
+        pTrace->length, pTrace->pageCount, kDexPageTraceSize);
+    fprintf(fp, "  pages touched : %u (%u%%), %zu bytes\n",
+        pTrace->touchCount,
+        (pTrace->pageCount != 0) ?
+            (u4) ((pTrace->touchCount * 100ULL) / pTrace->pageCount) : 0,
+        (size_t) pTrace->touchCount << kDexPageTraceShift);
+    fprintf(fp, "  accesses      : %" PRIu64 " (%" PRIu64 " outside the file)\n",
+        pTrace->accessCount, pTrace->outOfRange);
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Page-touch tracing for DexFile accessors.
+ *
+ * When libdex is built with DEX_PAGE_TRACE defined, the inline accessors
+ * in DexFile.h and DexClass.h report every structure they hand out to
+ * the DexPageTrace attached to the DexFile, if there is one.  Without
+ * the define the hooks compile to nothing.
+ *
+ * The trace remembers, for each 4 KiB page of the file, the first offset
+ * that touched it, in first-touch order.  Recording is thread-safe, so a
+ * trace may stay attached while the parallel index builders run; when
+ * several threads touch new pages at once, their order in the trace is
+ * the order they claimed them.  Reset, dump and free the trace only
+ * while nothing is recording into it.
+ */
+
+#ifndef LIBDEX_DEXPAGETRACE_H_
+#define LIBDEX_DEXPAGETRACE_H_
+
+#include "DexFile.h"
+
+#define kDexPageTraceShift  12
+#define kDexPageTraceSize   (1 << kDexPageTraceShift)
+
+/*
+ * First touch of one page.
+ */
+struct DexPageTouch {
+    u4          page;           /* page number within the file */
+    u4          offset;         /* file offset of the first touching access */
+    u8          accessNum;      /* value of accessCount at that moment */
+};
+
+struct DexPageTrace {
+    const u1*   base;           /* file offset 0 */
+    size_t      length;
+    u4          pageCount;
+
+    u1*         pTouched;       /* one byte per page */
+    DexPageTouch* pTouches;     /* first touches, in order */
+    u4          touchCount;
+
+    u8          accessCount;    /* accesses recorded */
+    u8          outOfRange;     /* accesses outside [base, base+length) */
+};
+
+/*
+ * Create a trace covering the whole file behind "pDexFile", including
+ * the optimized header and opt data if present.  Offsets in the trace
+ * are file offsets.  Returns NULL on allocation failure.
+ *
+ * The trace isn't active until it's stored in pDexFile->pPageTrace.
+ */
+DexPageTrace* dexPageTraceCreate(const DexFile* pDexFile);
+
+/*
+ * Free a trace.  Detach it from its DexFile first.
+ */
+void dexPageTraceFree(DexPageTrace* pTrace);
+
+/*
+ * Forget everything recorded so far.
+ */
+void dexPageTraceReset(DexPageTrace* pTrace);
+
+/*
+ * Print the trace to "fp": one line per page in first-touch order
+ * (unless "summaryOnly" is set), followed by a summary.
+ */
+void dexPageTraceDump(const DexPageTrace* pTrace, FILE* fp, bool summaryOnly);
+
+#endif  // LIBDEX_DEXPAGETRACE_H_
@@ -0,0 +1,224 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Fork/join helper.
+ */
+
+#include "DexParallel.h"
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+
+/* don't bother starting threads for fewer elements than this per thread */
+#define kMinPerThread   256
+
+/* hard cap, to keep the on-stack bookkeeping small */
+#define kMaxThreads     64
+
+struct ParallelRange {
+    DexParallelFunc func;
+    void*       arg;
+    u4          start;
+    u4          end;
+};
+
+static void* parallelThreadStart(void* arg)
+{
+    ParallelRange* pRange = (ParallelRange*) arg;
+    pRange->func(pRange->arg, pRange->start, pRange->end);
+    return NULL;
+}
+
+/* (documented in header file) */
+int dexGetDefaultThreadCount(void)
+{
+#ifdef _SC_NPROCESSORS_ONLN
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    if (count > 0)
+        return (count > kMaxThreads) ? kMaxThreads : (int) count;
+#endif
+    return 1;
+}
+
+/* (documented in header file) */
+void dexParallelFor(u4 count, int numThreads, DexParallelFunc func, void* arg)
+{
+    ParallelRange ranges[kMaxThreads];
+    pthread_t threads[kMaxThreads];
+    bool started[kMaxThreads];
+
+    if (numThreads > kMaxThreads)
+        numThreads = kMaxThreads;
+    if (numThreads > 1 && count / numThreads < kMinPerThread)
+        numThreads = count / kMinPerThread;
+    if (numThreads <= 1) {
+        if (count != 0)
+            func(arg, 0, count);
+        return;
+    }
+
+    u4 chunk = count / numThreads;
+    u4 extra = count % numThreads;
+    u4 start = 0;
+    for (int i = 0; i < numThreads; i++) {
+        ranges[i].func = func;
+        ranges[i].arg = arg;
+        ranges[i].start = start;
+        start += chunk + ((u4) i < extra ? 1 : 0);
+        ranges[i].end = start;
+    }
+
+    for (int i = 1; i < numThreads; i++) {
+        started[i] = (pthread_create(&threads[i], NULL, parallelThreadStart,
+            &ranges[i]) == 0);
+    }
+
+    func(arg, ranges[0].start, ranges[0].end);
+
+    for (int i = 1; i < numThreads; i++) {
+        if (started[i])
+            pthread_join(threads[i], NULL);
+        else
+            func(arg, ranges[i].start, ranges[i].end);
+    }
+}
+
+/* (documented in header file) */
+void dexParallelCollectorInit(DexParallelCollector* pCollector,
+    size_t recordSize)
+{
+    pCollector->recordSize = recordSize;
+    pthread_mutex_init(&pCollector->lock, NULL);
+    pCollector->pChunks = NULL;
+    pCollector->chunkCount = 0;
+    pCollector->failed = false;
+}
+
+/* (documented in header file) */
+void dexParallelCollectorFree(DexParallelCollector* pCollector)
+{
+    while (pCollector->pChunks != NULL) {
+        DexParallelChunk* pNext = pCollector->pChunks->pNext;
+        free(pCollector->pChunks->records);
+        free(pCollector->pChunks);
+        pCollector->pChunks = pNext;
+    }
+    pCollector->chunkCount = 0;
+    pthread_mutex_destroy(&pCollector->lock);
+}
+
+struct CollectJob {
+    DexParallelCollector* pCollector;
+    u8              keyBase;
+    DexCollectFunc  func;
+    void*           arg;
+};
+
+/*
+ * DexParallelFunc: run the collecting function on a new chunk, then
+ * hand the chunk to the collector.
+ */
+static void collectRange(void* arg, u4 start, u4 end)
+{
+    CollectJob* pJob = (CollectJob*) arg;
+    DexParallelCollector* pCollector = pJob->pCollector;
+    DexParallelChunk* pChunk =
+        (DexParallelChunk*) calloc(1, sizeof(DexParallelChunk));
+
+    if (pChunk == NULL) {
+        pthread_mutex_lock(&pCollector->lock);
+        pCollector->failed = true;
+        pthread_mutex_unlock(&pCollector->lock);
+        return;
+    }
+    pChunk->key = pJob->keyBase + start;
+    pChunk->recordSize = pCollector->recordSize;
+
+    pJob->func(pJob->arg, pChunk, start, end);
+
+    pthread_mutex_lock(&pCollector->lock);
+    pChunk->pNext = pCollector->pChunks;
+    pCollector->pChunks = pChunk;
+    pCollector->chunkCount++;
+    pthread_mutex_unlock(&pCollector->lock);
+}
+
+/* (documented in header file) */
+void dexParallelCollect(DexParallelCollector* pCollector, u4 count,
+    int numThreads, u8 keyBase, DexCollectFunc func, void* arg)
+{
+    CollectJob job;
+
+    job.pCollector = pCollector;
+    job.keyBase = keyBase;
+    job.func = func;
+    job.arg = arg;
+    dexParallelFor(count, numThreads, collectRange, &job);
+}
+
+static int compareChunks(const void* a, const void* b)
+{
+    u8 keyA = (*(const DexParallelChunk* const*) a)->key;
+    u8 keyB = (*(const DexParallelChunk* const*) b)->key;
+
+    return (keyA > keyB) - (keyA < keyB);
+}
+
+/* (documented in header file) */
+DexParallelChunk** dexParallelCollectorSort(DexParallelCollector* pCollector)
+{
+    DexParallelChunk** chunks;
+    u4 count = 0;
+
+    if (pCollector->failed)
+        return NULL;
+
+    chunks = (DexParallelChunk**)
+        malloc((pCollector->chunkCount + 1) * sizeof(DexParallelChunk*));
+    if (chunks == NULL)
+        return NULL;
+
+    for (DexParallelChunk* pChunk = pCollector->pChunks; pChunk != NULL;
+            pChunk = pChunk->pNext) {
+        if (pChunk->failed) {
+            free(chunks);
+            return NULL;
+        }
+        chunks[count++] = pChunk;
+    }
+    qsort(chunks, count, sizeof(DexParallelChunk*), compareChunks);
+    return chunks;
+}
+
+/* (documented in header file) */
+void* dexParallelChunkAppend(DexParallelChunk* pChunk)
+{
+    if (pChunk->count == pChunk->capacity) {
+        u4 newCapacity = (pChunk->capacity == 0) ? 64 : pChunk->capacity * 2;
+        u1* newRecords = (u1*) realloc(pChunk->records,
+            (size_t) newCapacity * pChunk->recordSize);
+        if (newRecords == NULL) {
+            pChunk->failed = true;
+            return NULL;
+        }
+        pChunk->records = newRecords;
+        pChunk->capacity = newCapacity;
+    }
+
+    return dexParallelChunkRecord(pChunk, pChunk->count++);
+}
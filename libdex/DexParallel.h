@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Minimal fork/join helper for building per-DexFile tables on the host.
+ */
+
+#ifndef LIBDEX_DEXPARALLEL_H_
+#define LIBDEX_DEXPARALLEL_H_
+
+#include "DexFile.h"
+
+#include <pthread.h>
+
+/*
+ * Work function.  Handles elements [start, end).
+ */
+typedef void (*DexParallelFunc)(void* arg, u4 start, u4 end);
+
+/*
+ * Return the number of online CPUs, or 1 if that can't be determined.
+ */
+int dexGetDefaultThreadCount(void);
+
+/*
+ * Split [0, count) into up to "numThreads" contiguous ranges and run
+ * "func" on each, returning once all are done.  The calling thread
+ * takes the first range.  Small jobs and numThreads <= 1 run inline.
+ *
+ * If a worker thread can't be started its range runs on the caller,
+ * so every element is always visited exactly once.
+ */
+void dexParallelFor(u4 count, int numThreads, DexParallelFunc func, void* arg);
+
+/*
+ * Fixed-size records produced for one range by dexParallelCollect().
+ */
+struct DexParallelChunk {
+    u8          key;            /* keyBase + start of the range */
+    size_t      recordSize;
+    u1*         records;
+    u4          count;
+    u4          capacity;
+    bool        failed;         /* set by the work function on error */
+    DexParallelChunk* pNext;
+};
+
+/*
+ * Collecting work function.  Handles elements [start, end), adding
+ * records to "pChunk".
+ */
+typedef void (*DexCollectFunc)(void* arg, DexParallelChunk* pChunk,
+    u4 start, u4 end);
+
+/*
+ * The chunks produced by one or more dexParallelCollect() calls.
+ */
+struct DexParallelCollector {
+    size_t              recordSize;
+    pthread_mutex_t     lock;
+    DexParallelChunk*   pChunks;
+    u4                  chunkCount;
+    bool                failed;     /* a chunk couldn't be allocated */
+};
+
+/*
+ * Prepare "pCollector" for records of "recordSize" bytes.
+ */
+void dexParallelCollectorInit(DexParallelCollector* pCollector,
+    size_t recordSize);
+
+/*
+ * Free every chunk, and the collector's lock.
+ */
+void dexParallelCollectorFree(DexParallelCollector* pCollector);
+
+/*
+ * Like dexParallelFor(), but each range gets a fresh chunk, keyed by
+ * "keyBase" plus the start of the range, to add records to.  Callers
+ * making several passes into one collector give each pass a keyBase
+ * that sorts its chunks where they belong.
+ */
+void dexParallelCollect(DexParallelCollector* pCollector, u4 count,
+    int numThreads, u8 keyBase, DexCollectFunc func, void* arg);
+
+/*
+ * Get the chunks in key order, so their records come out as if one
+ * thread had produced them all.  Returns a malloc()ed array of
+ * chunkCount pointers, or NULL if a chunk failed or on allocation
+ * failure.  The chunks still belong to the collector.
+ */
+DexParallelChunk** dexParallelCollectorSort(DexParallelCollector* pCollector);
+
+/*
+ * Add a record to "pChunk".  Returns a pointer to its uninitialized
+ * bytes, or NULL (and marks the chunk failed) on allocation failure.
+ */
+void* dexParallelChunkAppend(DexParallelChunk* pChunk);
+
+/*
+ * Get record "idx" of "pChunk".
+ */
+DEX_INLINE void* dexParallelChunkRecord(const DexParallelChunk* pChunk,
+    u4 idx)
+{
+    return pChunk->records + (size_t) idx * pChunk->recordSize;
+}
+
+#endif  // LIBDEX_DEXPARALLEL_H_
@@ -19,6 +19,7 @@
  */
 
 #include "DexProto.h"
+#include "DexParallel.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -133,6 +134,11 @@ const char* dexProtoGetShorty(const DexProto* pProto) {
 const char* dexProtoGetMethodDescriptor(const DexProto* pProto,
         DexStringCache* pCache) {
     const DexFile* dexFile = pProto->dexFile;
+
+    if (dexFile->pProtoTable != NULL) {
+        return dexProtoTableGet(dexFile->pProtoTable, pProto->protoIdx);
+    }
+
     const DexProtoId* protoId = getProtoId(pProto);
     const DexTypeList* typeList = dexGetProtoParameters(dexFile, protoId);
     size_t length = 3; // parens and terminating '\0'
@@ -275,6 +281,20 @@ static int protoCompare(const DexProto* pProto1, const DexProto* pProto2,
             return 0;
         }
 
+        // With both tables attached, equal protos are cheap to spot.
+
+        if (compareReturnType && dexFile1->pProtoTable != NULL &&
+                dexFile2->pProtoTable != NULL &&
+                dexProtoTableGetFingerprint(dexFile1->pProtoTable,
+                        pProto1->protoIdx) ==
+                dexProtoTableGetFingerprint(dexFile2->pProtoTable,
+                        pProto2->protoIdx) &&
+                strcmp(dexProtoTableGet(dexFile1->pProtoTable, pProto1->protoIdx),
+                        dexProtoTableGet(dexFile2->pProtoTable,
+                                pProto2->protoIdx)) == 0) {
+            return 0;
+        }
+
         // Compare return types.
 
         if (compareReturnType) {
@@ -324,6 +344,44 @@ int dexProtoCompareParameters(const DexProto* pProto1, const DexProto* pProto2){
     return protoCompare(pProto1, pProto2, false);
 }
 
+/* (documented in header file) */
+u8 dexProtoGetFingerprint(const DexProto* pProto) {
+    const DexProtoTable* pTable = pProto->dexFile->pProtoTable;
+
+    if (pTable != NULL) {
+        return dexProtoTableGetFingerprint(pTable, pProto->protoIdx);
+    }
+
+    DexStringCache cache;
+    dexStringCacheInit(&cache);
+    u8 fingerprint = dexComputeProtoFingerprint(
+            dexProtoGetMethodDescriptor(pProto, &cache));
+    dexStringCacheRelease(&cache);
+    return fingerprint;
+}
+
+/* (documented in header file) */
+bool dexProtoEquals(const DexProto* pProto1, const DexProto* pProto2) {
+    const DexProtoTable* pTable1 = pProto1->dexFile->pProtoTable;
+    const DexProtoTable* pTable2 = pProto2->dexFile->pProtoTable;
+
+    if (pProto1->dexFile == pProto2->dexFile &&
+            pProto1->protoIdx == pProto2->protoIdx) {
+        return true;
+    }
+
+    if (pTable1 != NULL && pTable2 != NULL) {
+        if (dexProtoTableGetFingerprint(pTable1, pProto1->protoIdx) !=
+                dexProtoTableGetFingerprint(pTable2, pProto2->protoIdx)) {
+            return false;
+        }
+        return strcmp(dexProtoTableGet(pTable1, pProto1->protoIdx),
+                dexProtoTableGet(pTable2, pProto2->protoIdx)) == 0;
+    }
+
+    return protoCompare(pProto1, pProto2, true) == 0;
+}
+
 
 /*
  * Helper for dexProtoCompareToDescriptor(), which gets the return type
@@ -468,6 +526,211 @@ int dexProtoCompareToParameterDescriptors(const DexProto* proto,
 
 
 
+/*
+ * ===========================================================================
+ *      Descriptor Table
+ * ===========================================================================
+ */
+
+/*
+ * Shared state for the two table-building passes.  "offsets" holds each
+ * descriptor's length (including the '\0') after the first pass and its
+ * offset into "chars" after the prefix sum.
+ */
+struct ProtoTableBuild {
+    const DexFile* dexFile;
+    u4* offsets;
+    char* chars;
+    const char** descriptors;
+    u8* fingerprints;
+    DexProtoIndexEntry* index;
+};
+
+static void protoTableMeasure(void* arg, u4 start, u4 end) {
+    ProtoTableBuild* pBuild = (ProtoTableBuild*) arg;
+    const DexFile* dexFile = pBuild->dexFile;
+
+    for (u4 i = start; i < end; i++) {
+        const DexProtoId* protoId = dexGetProtoId(dexFile, i);
+        const DexTypeList* typeList = dexGetProtoParameters(dexFile, protoId);
+        u4 paramCount = (typeList == NULL) ? 0 : typeList->size;
+        size_t length = 3; // parens and terminating '\0'
+
+        for (u4 j = 0; j < paramCount; j++) {
+            length += strlen(dexStringByTypeIdx(dexFile,
+                    dexTypeListGetIdx(typeList, j)));
+        }
+        length += strlen(dexStringByTypeIdx(dexFile, protoId->returnTypeIdx));
+
+        pBuild->offsets[i] = length;
+    }
+}
+
+static void protoTableFill(void* arg, u4 start, u4 end) {
+    ProtoTableBuild* pBuild = (ProtoTableBuild*) arg;
+    const DexFile* dexFile = pBuild->dexFile;
+
+    for (u4 i = start; i < end; i++) {
+        const DexProtoId* protoId = dexGetProtoId(dexFile, i);
+        const DexTypeList* typeList = dexGetProtoParameters(dexFile, protoId);
+        u4 paramCount = (typeList == NULL) ? 0 : typeList->size;
+        char* at = pBuild->chars + pBuild->offsets[i];
+
+        pBuild->descriptors[i] = at;
+        *(at++) = '(';
+        for (u4 j = 0; j < paramCount; j++) {
+            const char* desc = dexStringByTypeIdx(dexFile,
+                    dexTypeListGetIdx(typeList, j));
+            size_t len = strlen(desc);
+            memcpy(at, desc, len);
+            at += len;
+        }
+        *(at++) = ')';
+        strcpy(at, dexStringByTypeIdx(dexFile, protoId->returnTypeIdx));
+
+        u8 fingerprint = dexComputeProtoFingerprint(pBuild->descriptors[i]);
+        pBuild->fingerprints[i] = fingerprint;
+        pBuild->index[i].fingerprint = fingerprint;
+        pBuild->index[i].protoIdx = i;
+    }
+}
+
+static int compareIndexEntries(const void* a, const void* b) {
+    const DexProtoIndexEntry* pEntry1 = (const DexProtoIndexEntry*) a;
+    const DexProtoIndexEntry* pEntry2 = (const DexProtoIndexEntry*) b;
+
+    if (pEntry1->fingerprint != pEntry2->fingerprint) {
+        return (pEntry1->fingerprint < pEntry2->fingerprint) ? -1 : 1;
+    }
+    return (pEntry1->protoIdx < pEntry2->protoIdx) ? -1 :
+            (pEntry1->protoIdx > pEntry2->protoIdx);
+}
+
+/*
+ * Round "size" up to a multiple of 8.
+ */
+static size_t roundUp8(size_t size) {
+    return (size + 7) & ~(size_t) 7;
+}
+
+/* (documented in header file) */
+DexProtoTable* dexProtoTableCreate(const DexFile* pDexFile, int numThreads) {
+    u4 protoCount = pDexFile->pHeader->protoIdsSize;
+    ProtoTableBuild build;
+    DexProtoTable* pTable = NULL;
+    size_t charsSize = 0;
+
+    build.dexFile = pDexFile;
+    build.offsets = (u4*) malloc((protoCount + 1) * sizeof(u4));
+    if (build.offsets == NULL) {
+        return NULL;
+    }
+
+    dexParallelFor(protoCount, numThreads, protoTableMeasure, &build);
+
+    for (u4 i = 0; i < protoCount; i++) {
+        u4 length = build.offsets[i];
+        build.offsets[i] = charsSize;
+        charsSize += length;
+    }
+
+    /*
+     * The arrays holding u8s go first, each starting on an 8-byte
+     * boundary (the struct and the index entries are only 4-aligned on
+     * 32-bit hosts), then the pointers, then the chars.
+     */
+    size_t indexOffset = roundUp8(sizeof(DexProtoTable));
+    size_t fingerprintsOffset = indexOffset +
+            roundUp8(protoCount * sizeof(DexProtoIndexEntry));
+    size_t descriptorsOffset = fingerprintsOffset + protoCount * sizeof(u8);
+    size_t headerSize = descriptorsOffset + protoCount * sizeof(char*);
+    pTable = (DexProtoTable*) malloc(headerSize + charsSize);
+    if (pTable == NULL) {
+        free(build.offsets);
+        return NULL;
+    }
+
+    pTable->protoCount = protoCount;
+    pTable->allocSize = headerSize + charsSize;
+    build.index = (DexProtoIndexEntry*) ((char*) pTable + indexOffset);
+    build.fingerprints = (u8*) ((char*) pTable + fingerprintsOffset);
+    build.descriptors = (const char**) ((char*) pTable + descriptorsOffset);
+    build.chars = (char*) pTable + headerSize;
+    pTable->index = build.index;
+    pTable->fingerprints = build.fingerprints;
+    pTable->descriptors = build.descriptors;
+
+    dexParallelFor(protoCount, numThreads, protoTableFill, &build);
+    qsort(build.index, protoCount, sizeof(DexProtoIndexEntry),
+            compareIndexEntries);
+
+    free(build.offsets);
+    return pTable;
+}
+
+/* (documented in header file) */
+void dexProtoTableFree(DexProtoTable* pTable) {
+    free(pTable);
+}
+
+/* (documented in header file) */
+bool dexFileAttachProtoTable(DexFile* pDexFile, int numThreads) {
+    if (pDexFile->pProtoTable != NULL) {
+        return true;
+    }
+
+    DexProtoTable* pTable = dexProtoTableCreate(pDexFile, numThreads);
+    if (pTable == NULL) {
+        return false;
+    }
+
+    pDexFile->pProtoTable = pTable;
+    pDexFile->overhead += pTable->allocSize;
+    return true;
+}
+
+/* (documented in header file) */
+const DexProtoIndexEntry* dexProtoTableFind(const DexProtoTable* pTable,
+        u8 fingerprint, u4* pCount) {
+    u4 lo = 0;
+    u4 hi = pTable->protoCount;
+
+    while (lo < hi) {
+        u4 mid = lo + (hi - lo) / 2;
+        if (pTable->index[mid].fingerprint < fingerprint) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    u4 end = lo;
+    while (end < pTable->protoCount &&
+            pTable->index[end].fingerprint == fingerprint) {
+        end++;
+    }
+
+    *pCount = end - lo;
+    return (end == lo) ? NULL : &pTable->index[lo];
+}
+
+/* (documented in header file) */
+u4 dexProtoTableFindDescriptor(const DexProtoTable* pTable,
+        const char* descriptor) {
+    u4 count;
+    const DexProtoIndexEntry* pEntry = dexProtoTableFind(pTable,
+            dexComputeProtoFingerprint(descriptor), &count);
+
+    for (u4 i = 0; i < count; i++) {
+        if (strcmp(pTable->descriptors[pEntry[i].protoIdx], descriptor) == 0) {
+            return pEntry[i].protoIdx;
+        }
+    }
+
+    return kDexNoIndex;
+}
+
+
 /*
  * ===========================================================================
  *      Parameter Iterators
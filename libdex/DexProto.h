@@ -22,6 +22,7 @@
 #define LIBDEX_DEXPROTO_H_
 
 #include "DexFile.h"
+#include "DexHash.h"
 
 /*
  * Single-thread single-string cache. This structure holds a pointer to
@@ -98,7 +99,9 @@ DEX_INLINE void dexProtoSetFromMethodId(DexProto* pProto,
 const char* dexProtoGetShorty(const DexProto* pProto);
 
 /*
- * Get the full method descriptor for the given prototype.
+ * Get the full method descriptor for the given prototype.  If the
+ * DexFile has a proto table attached the result comes from there and
+ * "pCache" is left alone.
  */
 const char* dexProtoGetMethodDescriptor(const DexProto* pProto,
     DexStringCache* pCache);
@@ -117,6 +120,103 @@ char* dexProtoCopyMethodDescriptor(const DexProto* pProto);
 const char* dexProtoGetParameterDescriptors(const DexProto* pProto,
     DexStringCache* pCache);
 
+/*
+ * Compute the fingerprint of a full method descriptor, e.g.
+ * "(ILjava/lang/String;)V".  Equal descriptors give equal fingerprints
+ * in every DEX file; unequal ones almost always differ.
+ */
+DEX_INLINE u8 dexComputeProtoFingerprint(const char* descriptor)
+{
+    return dexHashString(kDexHashInit, descriptor);
+}
+
+/*
+ * Get the fingerprint of a prototype.  Uses the proto table when one is
+ * attached, otherwise builds the descriptor.
+ */
+u8 dexProtoGetFingerprint(const DexProto* pProto);
+
+/*
+ * Fingerprint index entry.
+ */
+struct DexProtoIndexEntry {
+    u8          fingerprint;
+    u4          protoIdx;
+};
+
+/*
+ * Precomputed full method descriptors and their fingerprints, indexed
+ * by protoIdx, plus the fingerprints again sorted for lookup.  Everything
+ * shares one allocation.
+ */
+struct DexProtoTable {
+    u4          protoCount;
+    size_t      allocSize;      /* bytes, for DexFile::overhead */
+    const char** descriptors;
+    const u8*   fingerprints;
+    const DexProtoIndexEntry* index;    /* sorted by fingerprint */
+};
+
+/*
+ * Build the descriptor table for "pDexFile", spreading the work over
+ * "numThreads" threads (1 builds it on the calling thread).
+ *
+ * Returns NULL on allocation failure.
+ */
+DexProtoTable* dexProtoTableCreate(const DexFile* pDexFile, int numThreads);
+
+/*
+ * Free a table.  NULL is allowed.
+ */
+void dexProtoTableFree(DexProtoTable* pTable);
+
+/*
+ * Build a table and attach it to "pDexFile", where it is used by
+ * dexProtoGetMethodDescriptor() and freed by dexFileFree().  Does
+ * nothing if one is already attached.
+ *
+ * Returns false on allocation failure.
+ */
+bool dexFileAttachProtoTable(DexFile* pDexFile, int numThreads);
+
+/*
+ * Get the descriptor for "protoIdx" from a table.
+ */
+DEX_INLINE const char* dexProtoTableGet(const DexProtoTable* pTable,
+    u4 protoIdx)
+{
+    assert(protoIdx < pTable->protoCount);
+    return pTable->descriptors[protoIdx];
+}
+
+/*
+ * Get the fingerprint for "protoIdx" from a table.
+ */
+DEX_INLINE u8 dexProtoTableGetFingerprint(const DexProtoTable* pTable,
+    u4 protoIdx)
+{
+    assert(protoIdx < pTable->protoCount);
+    return pTable->fingerprints[protoIdx];
+}
+
+/*
+ * Find the index entries with the given fingerprint.  Returns a pointer
+ * to the first one and sets "*pCount" to how many there are (normally 1,
+ * more only on a hash collision), or returns NULL.
+ *
+ * To match methods across DEX files, fingerprint one file's protos and
+ * probe the other's table; confirm hits with dexProtoTableGet().
+ */
+const DexProtoIndexEntry* dexProtoTableFind(const DexProtoTable* pTable,
+    u8 fingerprint, u4* pCount);
+
+/*
+ * Find the protoIdx whose full descriptor is "descriptor".  Returns
+ * kDexNoIndex if there is none.
+ */
+u4 dexProtoTableFindDescriptor(const DexProtoTable* pTable,
+    const char* descriptor);
+
 /*
  * Return the utf-8 encoded descriptor string from the proto of a MethodId.
  */
@@ -132,7 +232,8 @@ DEX_INLINE const char* dexGetDescriptorFromMethodId(const DexFile* pDexFile,
 /*
  * Get a copy of the utf-8 encoded method descriptor string from the
  * proto of a MethodId. The returned pointer must be free()ed by the
- * caller.
+ * caller.  Callers that only need to read the descriptor should attach
+ * a proto table and use dexGetDescriptorFromMethodId() instead.
  */
 DEX_INLINE char* dexCopyDescriptorFromMethodId(const DexFile* pDexFile,
     const DexMethodId* pMethodId)
@@ -170,6 +271,14 @@ int dexProtoComputeArgsSize(const DexProto* pProto);
  */
 int dexProtoCompare(const DexProto* pProto1, const DexProto* pProto2);
 
+/*
+ * Return whether two prototypes, possibly from different DEX files, are
+ * the same.  When both files have proto tables attached, unequal
+ * prototypes are almost always rejected by comparing fingerprints, and
+ * equal ones are confirmed with a single strcmp().
+ */
+bool dexProtoEquals(const DexProto* pProto1, const DexProto* pProto2);
+
 /*
  * Compare the two prototypes, ignoring return type. The two
  * prototypes are compared with the first argument as the major order,
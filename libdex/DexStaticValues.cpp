@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/*
+ * Bulk extraction of static field initial values.
+ */
+
+#include "DexStaticValues.h"
+#include "DexAnnotation.h"
+#include "DexClass.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* size of one element of each value column */
+static const size_t kValueSize[kDexStaticKindCount] = {
+    sizeof(s4), sizeof(s8), sizeof(float), sizeof(double), sizeof(u4),
+    sizeof(u4)
+};
+
+/*
+ * Make room for one more entry of "kind".  Returns a pointer to the
+ * value slot, or NULL on allocation failure.
+ */
+static void* appendValue(DexStaticValues* pValues, u4 kind, u4 fieldIdx)
+{
+    if (pValues->count[kind] == pValues->capacity[kind]) {
+        u4 newCapacity =
+            (pValues->capacity[kind] == 0) ? 64 : pValues->capacity[kind] * 2;
+        u4* newFieldIdx = (u4*) realloc(pValues->fieldIdx[kind],
+            newCapacity * sizeof(u4));
+        if (newFieldIdx == NULL)
+            return NULL;
+        pValues->fieldIdx[kind] = newFieldIdx;
+
+        void* newValues = realloc(pValues->values[kind],
+            newCapacity * kValueSize[kind]);
+        if (newValues == NULL)
+            return NULL;
+        pValues->values[kind] = newValues;
+        pValues->capacity[kind] = newCapacity;
+    }
+
+    u4 i = pValues->count[kind]++;
+    pValues->fieldIdx[kind][i] = fieldIdx;
+    return (u1*) pValues->values[kind] + i * kValueSize[kind];
+}
+
+/*
+ * Add one decoded value.  Returns false on allocation failure.
+ */
+static bool addValue(DexStaticValues* pValues, u4 fieldIdx,
+    const DexEncodedValue* pValue)
+{
+    void* pSlot;
+
+    switch (pValue->type) {
+    case kDexAnnotationByte:
+    case kDexAnnotationShort:
+    case kDexAnnotationChar:
+    case kDexAnnotationInt:
+        pSlot = appendValue(pValues, kDexStaticInt, fieldIdx);
+        if (pSlot != NULL)
+            *(s4*) pSlot = pValue->value.i;
+        break;
+    case kDexAnnotationBoolean:
+        pSlot = appendValue(pValues, kDexStaticInt, fieldIdx);
+        if (pSlot != NULL)
+            *(s4*) pSlot = pValue->value.z ? 1 : 0;
+        break;
+    case kDexAnnotationLong:
+        pSlot = appendValue(pValues, kDexStaticLong, fieldIdx);
+        if (pSlot != NULL)
+            *(s8*) pSlot = pValue->value.j;
+        break;
+    case kDexAnnotationFloat:
+        pSlot = appendValue(pValues, kDexStaticFloat, fieldIdx);
+        if (pSlot != NULL)
+            *(float*) pSlot = pValue->value.f;
+        break;
+    case kDexAnnotationDouble:
+        pSlot = appendValue(pValues, kDexStaticDouble, fieldIdx);
+        if (pSlot != NULL)
+            *(double*) pSlot = pValue->value.d;
+        break;
+    case kDexAnnotationString:
+        pSlot = appendValue(pValues, kDexStaticString, fieldIdx);
+        if (pSlot != NULL)
+            *(u4*) pSlot = pValue->value.idx;
+        break;
+    case kDexAnnotationType:
+        pSlot = appendValue(pValues, kDexStaticType, fieldIdx);
+        if (pSlot != NULL)
+            *(u4*) pSlot = pValue->value.idx;
+        break;
+    default:
+        return true;
+    }
+
+    return pSlot != NULL;
+}
+
+/*
+ * Pair up one class's static fields with its static_values.
+ */
+static bool extractClass(const DexFile* pDexFile, const DexClassDef* pClassDef,
+    DexStaticValues* pValues)
+{
+    const DexEncodedArray* pArray = dexGetStaticValuesList(pDexFile, pClassDef);
+    const u1* pClassData = dexGetClassData(pDexFile, pClassDef);
+    DexClassDataHeader header;
+    DexEncodedArrayIterator iterator;
+    DexEncodedValue value;
+    DexField field;
+    u4 lastIndex = 0;
+
+    if (pArray == NULL || pClassData == NULL)
+        return true;
+
+    dexReadClassDataHeader(&pClassData, &header);
+    dexEncodedArrayIteratorInit(&iterator, pArray->array);
+
+    for (u4 i = 0; i < header.staticFieldsSize; i++) {
+        if (!dexEncodedArrayIteratorNext(&iterator, &value))
+            break;
+        dexReadClassDataField(&pClassData, &field, &lastIndex);
+        if (!addValue(pValues, field.fieldIdx, &value))
+            return false;
+    }
+    return true;
+}
+
+/* (documented in header file) */
+DexStaticValues* dexExtractStaticValues(const DexFile* pDexFile)
+{
+    DexStaticValues* pValues =
+        (DexStaticValues*) calloc(1, sizeof(DexStaticValues));
+    if (pValues == NULL)
+        return NULL;
+
+    for (u4 i = 0; i < pDexFile->pHeader->classDefsSize; i++) {
+        if (!extractClass(pDexFile, dexGetClassDef(pDexFile, i), pValues)) {
+            dexStaticValuesFree(pValues);
+            return NULL;
+        }
+    }
+    return pValues;
+}
+
+/* (documented in header file) */
+void dexStaticValuesFree(DexStaticValues* pValues)
+{
+    if (pValues == NULL)
+        return;
+    for (int kind = 0; kind < kDexStaticKindCount; kind++) {
+        free(pValues->fieldIdx[kind]);
+        free(pValues->values[kind]);
+    }
+    free(pValues);
+}
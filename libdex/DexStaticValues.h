@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/*
+ * Bulk extraction of static field initial values (the static_values
+ * encoded_array of each class_def) into typed columns, for tools that
+ * pull constants such as version strings and feature flags out of many
+ * files.
+ */
+
+#ifndef LIBDEX_DEXSTATICVALUES_H_
+#define LIBDEX_DEXSTATICVALUES_H_
+
+#include "DexFile.h"
+
+/*
+ * Columns filled in by dexExtractStaticValues().  Boolean, byte, short,
+ * char and int values are all widened into the Int column; the field's
+ * type says which it was.
+ */
+enum DexStaticValueKind {
+    kDexStaticInt = 0,          /* s4 */
+    kDexStaticLong,             /* s8 */
+    kDexStaticFloat,            /* float */
+    kDexStaticDouble,           /* double */
+    kDexStaticString,           /* u4 string_id index */
+    kDexStaticType,             /* u4 type_id index */
+    kDexStaticKindCount
+};
+
+/*
+ * Static values of one file, by kind.  For each kind, fieldIdx[kind][i]
+ * is the field_id whose initial value is element i of values[kind].
+ * Entries appear in class_def order, then in field order.
+ *
+ * Only values present in static_values are collected.  Fields past the
+ * end of a class's static_values start out zero, false or null, and
+ * null, enum, array and annotation values are not collected.
+ */
+struct DexStaticValues {
+    u4      count[kDexStaticKindCount];
+    u4*     fieldIdx[kDexStaticKindCount];
+    void*   values[kDexStaticKindCount];
+    u4      capacity[kDexStaticKindCount];
+};
+
+/*
+ * Decode the static_values of every class_def in "pDexFile" in a single
+ * pass.  Returns NULL on allocation failure.
+ */
+DexStaticValues* dexExtractStaticValues(const DexFile* pDexFile);
+
+/*
+ * Free the result of dexExtractStaticValues().
+ */
+void dexStaticValuesFree(DexStaticValues* pValues);
+
+/* Typed views of the value columns. */
+DEX_INLINE const s4* dexStaticInts(const DexStaticValues* pValues) {
+    return (const s4*) pValues->values[kDexStaticInt];
+}
+DEX_INLINE const s8* dexStaticLongs(const DexStaticValues* pValues) {
+    return (const s8*) pValues->values[kDexStaticLong];
+}
+DEX_INLINE const float* dexStaticFloats(const DexStaticValues* pValues) {
+    return (const float*) pValues->values[kDexStaticFloat];
+}
+DEX_INLINE const double* dexStaticDoubles(const DexStaticValues* pValues) {
+    return (const double*) pValues->values[kDexStaticDouble];
+}
+DEX_INLINE const u4* dexStaticStringIdx(const DexStaticValues* pValues) {
+    return (const u4*) pValues->values[kDexStaticString];
+}
+DEX_INLINE const u4* dexStaticTypeIdx(const DexStaticValues* pValues) {
+    return (const u4*) pValues->values[kDexStaticType];
+}
+
+#endif  // LIBDEX_DEXSTATICVALUES_H_
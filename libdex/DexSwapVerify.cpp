@@ -19,6 +19,7 @@
  */
 
 #include "DexFile.h"
+#include "DexArena.h"
 #include "DexClass.h"
 #include "DexDataMap.h"
 #include "DexProto.h"
@@ -60,6 +61,9 @@ struct CheckState {
     u4*               pDefinedClassBits;
 
     const void*       previousItem; // set during section iteration
+
+    /* scratch space for decoded class_data_items */
+    DexArena*         pArena;
 };
 
 /*
@@ -919,10 +923,13 @@ static bool verifyClassDataIsForDef(const CheckState* state, u4 offset,
     }
 
     const u1* data = (const u1*) filePointer(state, offset);
-    DexClassData* classData = dexReadAndVerifyClassData(&data, NULL);
+    DexArenaMark mark = dexArenaMark(state->pArena);
+    DexClassData* classData =
+        dexReadAndVerifyClassDataInArena(&data, NULL, state->pArena);
 
     if (classData == NULL) {
         // Shouldn't happen, but bail here just in case.
+        dexArenaRelease(state->pArena, mark);
         return false;
     }
 
@@ -934,7 +941,7 @@ static bool verifyClassDataIsForDef(const CheckState* state, u4 offset,
     u4 dataDefiner = findFirstClassDataDefiner(state, classData);
     bool result = (dataDefiner == definerIdx) || (dataDefiner == kDexNoIndex);
 
-    free(classData);
+    dexArenaRelease(state->pArena, mark);
     return result;
 }
 
@@ -1622,16 +1629,19 @@ static bool verifyClassDataItem0(const CheckState* state,
 /* Perform intra-item verification on class_data_item. */
 static void* intraVerifyClassDataItem(const CheckState* state, void* ptr) {
     const u1* data = (const u1*) ptr;
-    DexClassData* classData = dexReadAndVerifyClassData(&data, state->fileEnd);
+    DexArenaMark mark = dexArenaMark(state->pArena);
+    DexClassData* classData =
+        dexReadAndVerifyClassDataInArena(&data, state->fileEnd, state->pArena);
 
     if (classData == NULL) {
         ALOGE("Unable to parse class_data_item");
+        dexArenaRelease(state->pArena, mark);
         return NULL;
     }
 
     bool okay = verifyClassDataItem0(state, classData);
 
-    free(classData);
+    dexArenaRelease(state->pArena, mark);
 
     if (!okay) {
         return NULL;
@@ -1675,7 +1685,9 @@ static u4 findFirstClassDataDefiner(const CheckState* state,
 /* Perform cross-item verification of class_data_item. */
 static void* crossVerifyClassDataItem(const CheckState* state, void* ptr) {
     const u1* data = (const u1*) ptr;
-    DexClassData* classData = dexReadAndVerifyClassData(&data, state->fileEnd);
+    DexArenaMark mark = dexArenaMark(state->pArena);
+    DexClassData* classData =
+        dexReadAndVerifyClassDataInArena(&data, state->fileEnd, state->pArena);
     u4 definingClass = findFirstClassDataDefiner(state, classData);
     bool okay = true;
     u4 i;
@@ -1708,7 +1720,7 @@ static void* crossVerifyClassDataItem(const CheckState* state, void* ptr) {
             && verifyMethodDefiner(state, definingClass, meth->methodIdx);
     }
 
-    free(classData);
+    dexArenaRelease(state->pArena, mark);
 
     if (!okay) {
         return NULL;
@@ -2932,9 +2944,12 @@ int dexSwapAndVerify(u1* addr, size_t len)
 {
     DexHeader* pHeader;
     CheckState state;
+    DexArena arena;
     bool okay = true;
 
     memset(&state, 0, sizeof(state));
+    dexArenaInit(&arena, 0);
+    state.pArena = &arena;
     ALOGV("+++ swapping and verifying");
 
     /*
@@ -3021,6 +3036,7 @@ int dexSwapAndVerify(u1* addr, size_t len)
             okay = okay && swapMap(&state, pDexMap);
             okay = okay && swapEverythingButHeaderAndMap(&state, pDexMap);
 
+            memset(&dexFile, 0, sizeof(dexFile));
             dexFileSetupBasicPointers(&dexFile, addr);
             state.pDexFile = &dexFile;
 
@@ -3038,6 +3054,7 @@ int dexSwapAndVerify(u1* addr, size_t len)
     if (state.pDataMap != NULL) {
         dexDataMapFree(state.pDataMap);
     }
+    dexArenaFree(&arena);
 
     return !okay;       // 0 == success
 }
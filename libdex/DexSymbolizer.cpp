@@ -0,0 +1,374 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Bulk address-to-line symbolization.
+ */
+
+#include "DexSymbolizer.h"
+#include "DexClass.h"
+#include "DexDebugInfo.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Shared table for methods that have no position entries, so that we
+ * don't try to decode them again.  Never freed.
+ */
+static DexSymbolizerLines gEmptyLines = { 0, { { 0, 0 } } };
+
+/* (documented in header file) */
+DexSymbolizer* dexSymbolizerCreate(const DexFile* pDexFile)
+{
+    const DexHeader* pHeader = pDexFile->pHeader;
+    const u1* pLimit = (const u1*) pHeader + pHeader->fileSize;
+    DexSymbolizer* pSymbolizer;
+    u4 i;
+
+    pSymbolizer = (DexSymbolizer*) malloc(sizeof(DexSymbolizer));
+    if (pSymbolizer == NULL)
+        return NULL;
+
+    pSymbolizer->pDexFile = pDexFile;
+    pSymbolizer->methodCount = pHeader->methodIdsSize;
+    pSymbolizer->pMethods = (DexSymbolizerMethod*)
+        calloc(pHeader->methodIdsSize + 1, sizeof(DexSymbolizerMethod));
+    if (pSymbolizer->pMethods == NULL)
+        goto bail;
+
+    for (i = 0; i < pHeader->methodIdsSize; i++)
+        pSymbolizer->pMethods[i].classDefIdx = kDexNoIndex;
+
+    for (i = 0; i < pHeader->classDefsSize; i++) {
+        const DexClassDef* pClassDef = dexGetClassDef(pDexFile, i);
+        const u1* pData = dexGetClassData(pDexFile, pClassDef);
+        DexClassDataHeader header;
+        DexField field;
+        DexMethod method;
+        u4 lastIndex;
+        u4 j;
+
+        if (pData == NULL)
+            continue;
+
+        /*
+         * Read the class data in place rather than going through
+         * dexReadAndVerifyClassData(), which would malloc a copy of
+         * every class.
+         */
+        if (!dexReadAndVerifyClassDataHeader(&pData, pLimit, &header))
+            goto bail;
+
+        lastIndex = 0;
+        for (j = 0; j < header.staticFieldsSize; j++) {
+            if (!dexReadAndVerifyClassDataField(&pData, pLimit, &field,
+                    &lastIndex))
+                goto bail;
+        }
+        lastIndex = 0;
+        for (j = 0; j < header.instanceFieldsSize; j++) {
+            if (!dexReadAndVerifyClassDataField(&pData, pLimit, &field,
+                    &lastIndex))
+                goto bail;
+        }
+
+        u4 methodsSize = header.directMethodsSize + header.virtualMethodsSize;
+        for (j = 0; j < methodsSize; j++) {
+            if (j == 0 || j == header.directMethodsSize)
+                lastIndex = 0;
+            if (!dexReadAndVerifyClassDataMethod(&pData, pLimit, &method,
+                    &lastIndex))
+                goto bail;
+            if (method.methodIdx >= pHeader->methodIdsSize) {
+                ALOGE("Bad method_idx %u in class_def %u", method.methodIdx, i);
+                goto bail;
+            }
+
+            DexSymbolizerMethod* pEntry = &pSymbolizer->pMethods[method.methodIdx];
+            pEntry->pCode = dexGetCode(pDexFile, &method);
+            pEntry->classDefIdx = i;
+            pEntry->accessFlags = method.accessFlags;
+        }
+    }
+
+    return pSymbolizer;
+
+bail:
+    dexSymbolizerFree(pSymbolizer);
+    return NULL;
+}
+
+/* (documented in header file) */
+void dexSymbolizerFree(DexSymbolizer* pSymbolizer)
+{
+    if (pSymbolizer == NULL)
+        return;
+
+    if (pSymbolizer->pMethods != NULL) {
+        for (u4 i = 0; i < pSymbolizer->methodCount; i++) {
+            DexSymbolizerLines* pLines = pSymbolizer->pMethods[i].pLines;
+            if (pLines != &gEmptyLines)
+                free(pLines);
+        }
+        free(pSymbolizer->pMethods);
+    }
+    free(pSymbolizer);
+}
+
+/*
+ * Accumulator for the position callback.
+ */
+struct LineCollector {
+    DexSymbolizerLines* pLines;
+    u4 capacity;
+    bool failed;
+};
+
+static int collectPositionCb(void* cnxt, u4 address, u4 lineNum)
+{
+    LineCollector* pCollector = (LineCollector*) cnxt;
+    DexSymbolizerLines* pLines = pCollector->pLines;
+
+    if (pLines == NULL || pLines->count == pCollector->capacity) {
+        u4 newCapacity = (pCollector->capacity == 0) ?
+            16 : pCollector->capacity * 2;
+        pLines = (DexSymbolizerLines*) realloc(pLines,
+            sizeof(DexSymbolizerLines) +
+            (newCapacity - 1) * sizeof(pLines->entries[0]));
+        if (pLines == NULL) {
+            pCollector->failed = true;
+            return 1;
+        }
+        if (pCollector->pLines == NULL)
+            pLines->count = 0;
+        pCollector->pLines = pLines;
+        pCollector->capacity = newCapacity;
+    }
+
+    pLines->entries[pLines->count].address = address;
+    pLines->entries[pLines->count].lineNum = lineNum;
+    pLines->count++;
+    return 0;
+}
+
+/*
+ * Return the line table for a method with code, decoding it if this is
+ * the first request.  Returns NULL on allocation failure.
+ *
+ * Concurrent callers may race to decode the same method; the loser
+ * frees its copy and uses the winner's.  The table is never modified
+ * once published.
+ */
+static const DexSymbolizerLines* getLines(DexSymbolizer* pSymbolizer,
+    u4 methodIdx)
+{
+    DexSymbolizerMethod* pEntry = &pSymbolizer->pMethods[methodIdx];
+    DexSymbolizerLines* pLines =
+        __atomic_load_n(&pEntry->pLines, __ATOMIC_ACQUIRE);
+
+    if (pLines != NULL)
+        return pLines;
+
+    const DexFile* pDexFile = pSymbolizer->pDexFile;
+    const DexMethodId* pMethodId = dexGetMethodId(pDexFile, methodIdx);
+    const DexClassDef* pClassDef =
+        dexGetClassDef(pDexFile, pEntry->classDefIdx);
+    LineCollector collector;
+
+    collector.pLines = NULL;
+    collector.capacity = 0;
+    collector.failed = false;
+
+    dexDecodeDebugInfo(pDexFile, pEntry->pCode,
+        dexStringByTypeIdx(pDexFile, pClassDef->classIdx),
+        pMethodId->protoIdx, pEntry->accessFlags,
+        collectPositionCb, NULL, &collector);
+
+    if (collector.failed) {
+        free(collector.pLines);
+        return NULL;
+    }
+
+    pLines = (collector.pLines != NULL) ? collector.pLines : &gEmptyLines;
+
+    DexSymbolizerLines* expected = NULL;
+    if (!__atomic_compare_exchange_n(&pEntry->pLines, &expected, pLines,
+            false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        if (pLines != &gEmptyLines)
+            free(pLines);
+        pLines = expected;
+    }
+
+    return pLines;
+}
+
+/*
+ * Fill in everything but the line number.  Returns the method entry, or
+ * NULL if the methodIdx is out of range.
+ */
+static const DexSymbolizerMethod* fillNames(DexSymbolizer* pSymbolizer,
+    DexSymbolizerQuery* pQuery)
+{
+    const DexFile* pDexFile = pSymbolizer->pDexFile;
+
+    pQuery->lineNum = kDexSymbolizerUnknownLine;
+    pQuery->sourceFile = NULL;
+    pQuery->classDescriptor = NULL;
+    pQuery->methodName = NULL;
+
+    if (pQuery->methodIdx >= pSymbolizer->methodCount)
+        return NULL;
+
+    const DexSymbolizerMethod* pEntry = &pSymbolizer->pMethods[pQuery->methodIdx];
+    const DexMethodId* pMethodId = dexGetMethodId(pDexFile, pQuery->methodIdx);
+
+    pQuery->classDescriptor = dexStringByTypeIdx(pDexFile, pMethodId->classIdx);
+    pQuery->methodName = dexStringById(pDexFile, pMethodId->nameIdx);
+
+    if (pEntry->classDefIdx != kDexNoIndex) {
+        const DexClassDef* pClassDef =
+            dexGetClassDef(pDexFile, pEntry->classDefIdx);
+        if (pClassDef->sourceFileIdx != kDexNoIndex)
+            pQuery->sourceFile = dexStringById(pDexFile, pClassDef->sourceFileIdx);
+        if (pEntry->pCode == NULL && (pEntry->accessFlags & ACC_NATIVE) != 0)
+            pQuery->lineNum = kDexSymbolizerNativeLine;
+    }
+
+    return pEntry;
+}
+
+/*
+ * Return the line for "dexPc": that of the last position entry whose
+ * address is <= dexPc.
+ */
+static int findLine(const DexSymbolizerLines* pLines, u4 dexPc)
+{
+    int lo = 0;
+    int hi = (int) pLines->count - 1;
+    int lineNum = kDexSymbolizerUnknownLine;
+
+    while (lo <= hi) {
+        int mid = (lo + hi) >> 1;
+        if (pLines->entries[mid].address <= dexPc) {
+            lineNum = pLines->entries[mid].lineNum;
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+
+    return lineNum;
+}
+
+/* (documented in header file) */
+bool dexSymbolizerLookup(DexSymbolizer* pSymbolizer,
+    DexSymbolizerQuery* pQuery)
+{
+    const DexSymbolizerMethod* pEntry = fillNames(pSymbolizer, pQuery);
+
+    if (pEntry == NULL)
+        return false;
+
+    if (pEntry->pCode != NULL) {
+        const DexSymbolizerLines* pLines =
+            getLines(pSymbolizer, pQuery->methodIdx);
+        if (pLines != NULL)
+            pQuery->lineNum = findLine(pLines, pQuery->dexPc);
+    }
+
+    return true;
+}
+
+/*
+ * Sort key for batched queries.
+ */
+struct QueryOrder {
+    u4 methodIdx;
+    u4 dexPc;
+    u4 queryIdx;
+};
+
+static int compareQueryOrder(const void* a, const void* b)
+{
+    const QueryOrder* pA = (const QueryOrder*) a;
+    const QueryOrder* pB = (const QueryOrder*) b;
+
+    if (pA->methodIdx != pB->methodIdx)
+        return (pA->methodIdx < pB->methodIdx) ? -1 : 1;
+    if (pA->dexPc != pB->dexPc)
+        return (pA->dexPc < pB->dexPc) ? -1 : 1;
+    return (pA->queryIdx < pB->queryIdx) ? -1 : (pA->queryIdx > pB->queryIdx);
+}
+
+/* (documented in header file) */
+int dexSymbolizeBatch(DexSymbolizer* pSymbolizer,
+    DexSymbolizerQuery* pQueries, size_t count)
+{
+    QueryOrder* pOrder;
+    size_t i;
+    int resolved = 0;
+
+    pOrder = (QueryOrder*) malloc(count * sizeof(QueryOrder));
+    if (pOrder == NULL && count != 0)
+        return -1;
+
+    for (i = 0; i < count; i++) {
+        pOrder[i].methodIdx = pQueries[i].methodIdx;
+        pOrder[i].dexPc = pQueries[i].dexPc;
+        pOrder[i].queryIdx = i;
+    }
+    qsort(pOrder, count, sizeof(QueryOrder), compareQueryOrder);
+
+    i = 0;
+    while (i < count) {
+        u4 methodIdx = pOrder[i].methodIdx;
+        DexSymbolizerQuery* pFirst = &pQueries[pOrder[i].queryIdx];
+        const DexSymbolizerMethod* pEntry = fillNames(pSymbolizer, pFirst);
+        const DexSymbolizerLines* pLines = NULL;
+        u4 pos = 0;
+        int lineNum = pFirst->lineNum;
+
+        if (pEntry != NULL && pEntry->pCode != NULL)
+            pLines = getLines(pSymbolizer, methodIdx);
+
+        /*
+         * The pcs in this run are ascending, so walk the position table
+         * forward once instead of searching it per query.
+         */
+        for ( ; i < count && pOrder[i].methodIdx == methodIdx; i++) {
+            DexSymbolizerQuery* pQuery = &pQueries[pOrder[i].queryIdx];
+
+            if (pLines != NULL) {
+                while (pos < pLines->count &&
+                        pLines->entries[pos].address <= pOrder[i].dexPc) {
+                    lineNum = pLines->entries[pos].lineNum;
+                    pos++;
+                }
+            }
+
+            pQuery->lineNum = lineNum;
+            pQuery->sourceFile = pFirst->sourceFile;
+            pQuery->classDescriptor = pFirst->classDescriptor;
+            pQuery->methodName = pFirst->methodName;
+            if (lineNum >= 0)
+                resolved++;
+        }
+    }
+
+    free(pOrder);
+    return resolved;
+}
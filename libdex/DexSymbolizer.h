@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Bulk (methodIdx, dexPc) -> source line symbolization.
+ *
+ * The symbolizer walks the class definitions once to map every defined
+ * method to its DexCode, and decodes each method's line table the first
+ * time it is asked about.  After dexSymbolizerCreate() returns, lookups
+ * may be issued from any number of threads concurrently.
+ */
+
+#ifndef LIBDEX_DEXSYMBOLIZER_H_
+#define LIBDEX_DEXSYMBOLIZER_H_
+
+#include "DexFile.h"
+
+/* line number reported for native methods, as the VM does */
+#define kDexSymbolizerNativeLine (-2)
+/* line number reported when nothing is known */
+#define kDexSymbolizerUnknownLine (-1)
+
+/*
+ * Decoded position table for one method, in ascending address order.
+ */
+struct DexSymbolizerLines {
+    u4      count;
+    struct {
+        u4  address;
+        u4  lineNum;
+    } entries[1];           /* actually "count" entries */
+};
+
+/*
+ * Per-method entry, indexed by methodIdx.
+ */
+struct DexSymbolizerMethod {
+    const DexCode*  pCode;          /* NULL if abstract/native/undefined */
+    u4              classDefIdx;    /* kDexNoIndex if not defined here */
+    u4              accessFlags;
+    DexSymbolizerLines* pLines;     /* decoded lazily; see .cpp */
+};
+
+struct DexSymbolizer {
+    const DexFile*  pDexFile;
+    u4              methodCount;
+    DexSymbolizerMethod* pMethods;
+};
+
+/*
+ * One query.  "methodIdx" and "dexPc" (in 16-bit code units) are filled
+ * in by the caller; the rest is filled in by the symbolizer.  The string
+ * pointers point into the DexFile and are NULL when unavailable.
+ */
+struct DexSymbolizerQuery {
+    u4          methodIdx;
+    u4          dexPc;
+
+    int         lineNum;
+    const char* sourceFile;
+    const char* classDescriptor;
+    const char* methodName;
+};
+
+/*
+ * Build the methodIdx -> DexCode index for "pDexFile".  Line tables are
+ * not decoded here.
+ *
+ * Returns NULL on failure (e.g. malformed class_data).
+ */
+DexSymbolizer* dexSymbolizerCreate(const DexFile* pDexFile);
+
+/*
+ * Free a symbolizer and every line table it decoded.
+ */
+void dexSymbolizerFree(DexSymbolizer* pSymbolizer);
+
+/*
+ * Resolve a single query in place.  Returns false if the query's
+ * methodIdx is out of range, in which case only lineNum is set.
+ */
+bool dexSymbolizerLookup(DexSymbolizer* pSymbolizer,
+    DexSymbolizerQuery* pQuery);
+
+/*
+ * Resolve "count" queries in place.  Queries are visited in
+ * (methodIdx, dexPc) order so each line table is fetched once and
+ * walked forward; results land in the caller's original order.
+ *
+ * Returns the number of queries that resolved to a line number, or -1
+ * on allocation failure.
+ */
+int dexSymbolizeBatch(DexSymbolizer* pSymbolizer,
+    DexSymbolizerQuery* pQueries, size_t count);
+
+#endif  // LIBDEX_DEXSYMBOLIZER_H_
@@ -0,0 +1,252 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Cross-reference index.
+ */
+
+#include "DexXref.h"
+#include "DexClass.h"
+#include "InstrUtils.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static const DexCsrFormat kXrefFormat = {
+    kDexXrefMagic, kDexXrefVersion, kDexXrefKindCount, sizeof(DexXrefSite),
+    kDexChunkXref, "cross-reference index"
+};
+
+struct XrefBuild {
+    const DexFile*  pDexFile;
+    u4              idCount[kDexXrefKindCount];
+};
+
+static bool addEdge(DexParallelChunk* pChunk, u4 kind, u4 targetIdx,
+    u4 methodIdx, u4 dexPc)
+{
+    DexXrefSite* pSite = (DexXrefSite*) dexCsrAddEdge(pChunk, kind, targetIdx);
+
+    if (pSite == NULL)
+        return false;
+    pSite->methodIdx = methodIdx;
+    pSite->dexPc = dexPc;
+    return true;
+}
+
+/*
+ * Work out which relation, if any, an instruction belongs to.  Returns
+ * kDexXrefKindCount for none.
+ */
+static u4 xrefKindFromOpcode(Opcode opcode)
+{
+    switch (dexGetIndexTypeFromOpcode(opcode)) {
+    case kIndexMethodRef:
+    case kIndexMethodAndProtoRef:
+        return kDexXrefCallers;
+    case kIndexFieldRef:
+        if ((opcode >= OP_IPUT && opcode <= OP_IPUT_SHORT) ||
+            (opcode >= OP_SPUT && opcode <= OP_SPUT_SHORT))
+        {
+            return kDexXrefFieldWrites;
+        }
+        switch (opcode) {
+        case OP_IPUT_VOLATILE:
+        case OP_SPUT_VOLATILE:
+        case OP_IPUT_WIDE_VOLATILE:
+        case OP_SPUT_WIDE_VOLATILE:
+            return kDexXrefFieldWrites;
+        default:
+            return kDexXrefFieldReads;
+        }
+    case kIndexTypeRef:
+        switch (opcode) {
+        case OP_NEW_INSTANCE:
+        case OP_NEW_ARRAY:
+        case OP_FILLED_NEW_ARRAY:
+        case OP_FILLED_NEW_ARRAY_RANGE:
+            return kDexXrefInstantiations;
+        default:
+            return kDexXrefKindCount;
+        }
+    default:
+        return kDexXrefKindCount;
+    }
+}
+
+/*
+ * Record the references made by one method's code.
+ */
+static bool scanCode(const XrefBuild* pBuild, DexParallelChunk* pChunk,
+    const DexMethod* pMethod)
+{
+    const DexCode* pCode = dexGetCode(pBuild->pDexFile, pMethod);
+    const u2* insns = pCode->insns;
+    u4 insnIdx = 0;
+
+    while (insnIdx < pCode->insnsSize) {
+        Opcode opcode = dexOpcodeFromCodeUnit(insns[insnIdx]);
+        size_t width = dexGetWidthFromInstruction(&insns[insnIdx]);
+        u4 kind;
+
+        if (width == 0)
+            break;
+
+        kind = xrefKindFromOpcode(opcode);
+        if (kind != kDexXrefKindCount) {
+            DecodedInstruction decInsn;
+            u4 targetIdx;
+
+            dexDecodeInstruction(&insns[insnIdx], &decInsn);
+            if (dexGetFormatFromOpcode(opcode) == kFmt22c)
+                targetIdx = decInsn.vC;
+            else
+                targetIdx = decInsn.vB;
+
+            /* ignore anything the verifier would have rejected */
+            if (targetIdx < pBuild->idCount[kind] &&
+                !addEdge(pChunk, kind, targetIdx, pMethod->methodIdx, insnIdx))
+            {
+                return false;
+            }
+        }
+        insnIdx += width;
+    }
+    return true;
+}
+
+static bool scanMethods(const XrefBuild* pBuild, DexParallelChunk* pChunk,
+    const DexMethod* pMethods, u4 count)
+{
+    for (u4 i = 0; i < count; i++) {
+        if (pMethods[i].codeOff != 0 && !scanCode(pBuild, pChunk, &pMethods[i]))
+            return false;
+    }
+    return true;
+}
+
+/*
+ * DexCollectFunc: scan class_defs [start, end) into "pChunk".
+ */
+static void scanClasses(void* arg, DexParallelChunk* pChunk, u4 start,
+    u4 end)
+{
+    const XrefBuild* pBuild = (const XrefBuild*) arg;
+
+    for (u4 i = start; i < end && !pChunk->failed; i++) {
+        const DexClassDef* pClassDef = dexGetClassDef(pBuild->pDexFile, i);
+        const u1* pEncodedData = dexGetClassData(pBuild->pDexFile, pClassDef);
+        DexClassData* pClassData;
+
+        if (pEncodedData == NULL)
+            continue;
+
+        pClassData = dexReadAndVerifyClassData(&pEncodedData, NULL);
+        if (pClassData == NULL) {
+            ALOGE("Trouble reading class data for class_def %u", i);
+            pChunk->failed = true;
+            break;
+        }
+        pChunk->failed =
+            !scanMethods(pBuild, pChunk, pClassData->directMethods,
+                pClassData->header.directMethodsSize) ||
+            !scanMethods(pBuild, pChunk, pClassData->virtualMethods,
+                pClassData->header.virtualMethodsSize);
+        free(pClassData);
+    }
+}
+
+/* (documented in header file) */
+DexXref* dexXrefBuild(const DexFile* pDexFile, int numThreads)
+{
+    const DexHeader* pHeader = pDexFile->pHeader;
+    DexParallelCollector collector;
+    DexParallelChunk** chunks = NULL;
+    DexXref* pXref = NULL;
+    XrefBuild build;
+
+    build.pDexFile = pDexFile;
+    build.idCount[kDexXrefCallers] = pHeader->methodIdsSize;
+    build.idCount[kDexXrefFieldReads] = pHeader->fieldIdsSize;
+    build.idCount[kDexXrefFieldWrites] = pHeader->fieldIdsSize;
+    build.idCount[kDexXrefInstantiations] = pHeader->typeIdsSize;
+    dexParallelCollectorInit(&collector,
+        sizeof(DexCsrEdge) + sizeof(DexXrefSite));
+
+    dexParallelCollect(&collector, pHeader->classDefsSize, numThreads, 0,
+        scanClasses, &build);
+
+    chunks = dexParallelCollectorSort(&collector);
+    if (chunks == NULL)
+        goto bail;
+
+    pXref = (DexXref*) malloc(sizeof(DexXref));
+    if (pXref == NULL)
+        goto bail;
+    if (!dexCsrBuild(&pXref->csr, &kXrefFormat, pDexFile, build.idCount,
+            chunks, collector.chunkCount)) {
+        free(pXref);
+        pXref = NULL;
+    }
+
+bail:
+    free(chunks);
+    dexParallelCollectorFree(&collector);
+    return pXref;
+}
+
+/* (documented in header file) */
+void dexXrefFree(DexXref* pXref)
+{
+    if (pXref == NULL)
+        return;
+    dexCsrRelease(&pXref->csr);
+    free(pXref);
+}
+
+/* (documented in header file) */
+int dexXrefWrite(const DexXref* pXref, int fd)
+{
+    return dexCsrWrite(&pXref->csr, fd);
+}
+
+/* (documented in header file) */
+DexXref* dexXrefOpen(const char* fileName, const DexFile* pDexFile)
+{
+    DexXref* pXref = (DexXref*) malloc(sizeof(DexXref));
+
+    if (pXref != NULL &&
+        !dexCsrOpen(&pXref->csr, &kXrefFormat, fileName, pDexFile))
+    {
+        free(pXref);
+        pXref = NULL;
+    }
+    return pXref;
+}
+
+/* (documented in header file) */
+DexXref* dexXrefFromOptData(const DexFile* pDexFile)
+{
+    DexXref* pXref = (DexXref*) malloc(sizeof(DexXref));
+
+    if (pXref != NULL &&
+        !dexCsrFromOptData(&pXref->csr, &kXrefFormat, pDexFile))
+    {
+        free(pXref);
+        pXref = NULL;
+    }
+    return pXref;
+}
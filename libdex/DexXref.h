@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Cross-reference index: who calls a method, who reads or writes a
+ * field, and where a type is instantiated.
+ *
+ * Each relation is stored in compressed sparse row form: an array of
+ * (idCount + 1) offsets and an array of sites, so the sites for id "i"
+ * are sites[offsets[i]] through sites[offsets[i+1] - 1].  Sites for an
+ * id appear in class_def order, then in code order.
+ *
+ * The index is a serialized DexCsr (see DexCsr.h) with one table per
+ * relation, so it can be written to disk as-is and later mapped and
+ * used in place.
+ */
+
+#ifndef LIBDEX_DEXXREF_H_
+#define LIBDEX_DEXXREF_H_
+
+#include "DexFile.h"
+#include "DexCsr.h"
+
+#define kDexXrefMagic       "dexxref"       /* 8 bytes with the '\0' */
+#define kDexXrefVersion     1
+
+/*
+ * One referencing instruction: the method_id of the method whose code
+ * holds it, and its offset in 16-bit code units.
+ */
+struct DexXrefSite {
+    u4  methodIdx;
+    u4  dexPc;
+};
+
+/*
+ * Relations, in the order of their tables.
+ */
+enum DexXrefKind {
+    kDexXrefCallers = 0,        /* by method_id: invoke-* */
+    kDexXrefFieldReads,         /* by field_id: iget-*, sget-* */
+    kDexXrefFieldWrites,        /* by field_id: iput-*, sput-* */
+    kDexXrefInstantiations,     /* by type_id: new-instance, new-array,
+                                   filled-new-array */
+    kDexXrefKindCount
+};
+
+/*
+ * An index, either built in memory or mapped from a file.  The tables
+ * hold DexXrefSite records and are in DexXrefKind order.
+ */
+struct DexXref {
+    DexCsr      csr;
+};
+
+/*
+ * Scan every code_item in "pDexFile" and build the index.  Classes are
+ * split across up to "numThreads" threads; the result doesn't depend
+ * on the thread count.  Returns NULL on failure.
+ */
+DexXref* dexXrefBuild(const DexFile* pDexFile, int numThreads);
+
+/*
+ * Free an index from dexXrefBuild() or dexXrefOpen().
+ */
+void dexXrefFree(DexXref* pXref);
+
+/*
+ * Write the serialized index to "fd".  Returns 0 on success.
+ */
+int dexXrefWrite(const DexXref* pXref, int fd);
+
+/*
+ * Map an index written by dexXrefWrite().  The file's layout is checked
+ * before it's used.  If "pDexFile" is non-NULL the index must have been
+ * built from a file with the same checksum and signature.  Returns NULL
+ * on failure.
+ */
+DexXref* dexXrefOpen(const char* fileName, const DexFile* pDexFile);
+
+/*
+ * Use the index stored in the kDexChunkXref chunk of an optimized DEX
+ * file's opt data (see dexOptAppendChunks()), in place.  The chunk is
+ * checked as dexXrefOpen() checks a file.  Returns NULL if there is no
+ * usable chunk.  Free the result with dexXrefFree(); the data stays with
+ * "pDexFile".
+ */
+DexXref* dexXrefFromOptData(const DexFile* pDexFile);
+
+/*
+ * Get the sites for "idx" in relation "kind".  Sets "*pCount" to the
+ * number of sites.
+ */
+DEX_INLINE const DexXrefSite* dexXrefGetSites(const DexXref* pXref,
+    DexXrefKind kind, u4 idx, u4* pCount)
+{
+    return (const DexXrefSite*) dexCsrGetRecords(&pXref->csr, kind, idx,
+        pCount);
+}
+
+DEX_INLINE const DexXrefSite* dexXrefGetCallers(const DexXref* pXref,
+    u4 methodIdx, u4* pCount)
+{
+    return dexXrefGetSites(pXref, kDexXrefCallers, methodIdx, pCount);
+}
+
+DEX_INLINE const DexXrefSite* dexXrefGetFieldReads(const DexXref* pXref,
+    u4 fieldIdx, u4* pCount)
+{
+    return dexXrefGetSites(pXref, kDexXrefFieldReads, fieldIdx, pCount);
+}
+
+DEX_INLINE const DexXrefSite* dexXrefGetFieldWrites(const DexXref* pXref,
+    u4 fieldIdx, u4* pCount)
+{
+    return dexXrefGetSites(pXref, kDexXrefFieldWrites, fieldIdx, pCount);
+}
+
+DEX_INLINE const DexXrefSite* dexXrefGetInstantiations(const DexXref* pXref,
+    u4 typeIdx, u4* pCount)
+{
+    return dexXrefGetSites(pXref, kDexXrefInstantiations, typeIdx, pCount);
+}
+
+#endif  // LIBDEX_DEXXREF_H_
@@ -101,6 +101,22 @@ DEX_INLINE int readSignedLeb128(const u1** pStream) {
     return result;
 }
 
+/*
+ * Skips over an unsigned or signed LEB128 value, updating the given
+ * pointer to point just past its end. Like the readers above, this
+ * never consumes more than five bytes.
+ */
+DEX_INLINE void skipLeb128(const u1** pStream) {
+    const u1* ptr = *pStream;
+    const u1* limit = ptr + 5;
+
+    while (ptr < limit && *(ptr++) > 0x7f) {
+        /* keep going */
+    }
+
+    *pStream = ptr;
+}
+
 /*
  * Reads an unsigned LEB128 value, updating the given pointer to point
  * just past the end of the read value and also indicating whether the
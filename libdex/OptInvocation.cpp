@@ -26,9 +26,11 @@
 #include <sys/stat.h>
 #include <sys/file.h>
 #include <errno.h>
+#include <zlib.h>
 
 #include "OptInvocation.h"
 #include "DexFile.h"
+#include "SysUtil.h"
 
 static const char* kCacheDirectoryName = "dalvik-cache";
 
@@ -175,3 +177,153 @@ int dexOptCreateEmptyHeader(int fd)
 
     return 0;
 }
+
+/*
+ * Write "length" bytes to "fd", folding them into "*pAdler" if it's
+ * non-NULL.  Returns 0 on success.
+ */
+static int writeChecksummed(int fd, const void* data, size_t length,
+    uLong* pAdler, const char* logMsg)
+{
+    if (pAdler != NULL)
+        *pAdler = adler32(*pAdler, (const Bytef*) data, length);
+    return sysWriteFully(fd, data, length, logMsg);
+}
+
+/*
+ * Pad the file out to the next 64-bit boundary after "offset".  Returns
+ * the new offset, or 0 on failure.
+ */
+static u4 writePadding(int fd, u4 offset, uLong* pAdler)
+{
+    static const u1 kZeroes[8] = { 0 };
+    u4 padding = ((offset + 7) & ~7) - offset;
+
+    if (writeChecksummed(fd, kZeroes, padding, pAdler, "opt padding") != 0)
+        return 0;
+    return offset + padding;
+}
+
+/*
+ * Write the dependency table.  The format is:
+ *
+ *  4b  source file modification time, in seconds since 1970 UTC
+ *  4b  CRC-32 from the source zip entry, or the source DEX checksum
+ *  4b  Dalvik VM build number
+ *  4b  number of dependency entries that follow
+ *  dependency entries:
+ *    4b  name length, including the terminating null
+ *    var full path of the dependency, null-terminated
+ *    20b SHA-1 signature of the dependency
+ *
+ * Returns the number of bytes written, or 0 on failure.
+ */
+static u4 writeDependencies(int fd, const DexOptWriteOptions* pOptions,
+    uLong* pAdler)
+{
+    u4 header[4];
+    u4 length = sizeof(header);
+
+    header[0] = pOptions->modWhen;
+    header[1] = pOptions->crc;
+    header[2] = pOptions->vmBuild;
+    header[3] = pOptions->depCount;
+    if (writeChecksummed(fd, header, sizeof(header), pAdler, "opt deps") != 0)
+        return 0;
+
+    for (int i = 0; i < pOptions->depCount; i++) {
+        const DexOptDependency* pDep = &pOptions->pDeps[i];
+        u4 nameLength = strlen(pDep->fileName) + 1;
+
+        if (writeChecksummed(fd, &nameLength, sizeof(nameLength), pAdler,
+                "opt deps") != 0 ||
+            writeChecksummed(fd, pDep->fileName, nameLength, pAdler,
+                "opt deps") != 0 ||
+            writeChecksummed(fd, pDep->signature, kSHA1DigestLen, pAdler,
+                "opt deps") != 0)
+        {
+            return 0;
+        }
+        length += sizeof(nameLength) + nameLength + kSHA1DigestLen;
+    }
+
+    return length;
+}
+
+/* (documented in header file) */
+int dexOptWriteFile(int fd, DexFile* pDexFile,
+    const DexOptWriteOptions* pOptions)
+{
+    DexOptHeader optHdr;
+    DexClassLookup* pLookup = NULL;
+    uLong adler = adler32(0L, Z_NULL, 0);
+    u4 dexLength = pDexFile->pHeader->fileSize;
+    u4 offset, chunk[2];
+    int result = -1;
+
+    if (pDexFile->pOptHeader != NULL) {
+        ALOGE("dexOptWriteFile: DEX file is already optimized");
+        return -1;
+    }
+
+    pLookup = dexCreateClassLookup(pDexFile);
+    if (pLookup == NULL)
+        return -1;
+
+    memset(&optHdr, 0, sizeof(optHdr));
+    if (dexOptCreateEmptyHeader(fd) != 0)
+        goto bail;
+
+    optHdr.dexOffset = sizeof(optHdr);
+    optHdr.dexLength = dexLength;
+    if (sysWriteFully(fd, pDexFile->baseAddr, dexLength, "opt dex") != 0)
+        goto bail;
+    offset = writePadding(fd, optHdr.dexOffset + dexLength, NULL);
+    if (offset == 0)
+        goto bail;
+
+    /* the checksum covers everything from here on */
+    optHdr.depsOffset = offset;
+    optHdr.depsLength = writeDependencies(fd, pOptions, &adler);
+    if (optHdr.depsLength == 0)
+        goto bail;
+    offset = writePadding(fd, offset + optHdr.depsLength, &adler);
+    if (offset == 0)
+        goto bail;
+
+    optHdr.optOffset = offset;
+    chunk[0] = kDexChunkClassLookup;
+    chunk[1] = pLookup->size;
+    if (writeChecksummed(fd, chunk, sizeof(chunk), &adler, "opt chunk") != 0 ||
+        writeChecksummed(fd, pLookup, pLookup->size, &adler, "opt chunk") != 0)
+    {
+        goto bail;
+    }
+    offset = writePadding(fd, offset + sizeof(chunk) + pLookup->size, &adler);
+    if (offset == 0)
+        goto bail;
+    chunk[0] = kDexChunkEnd;
+    chunk[1] = 0;
+    if (writeChecksummed(fd, chunk, sizeof(chunk), &adler, "opt chunk") != 0)
+        goto bail;
+    offset += sizeof(chunk);
+    optHdr.optLength = offset - optHdr.optOffset;
+
+    optHdr.checksum = (u4) adler;
+
+    /* now that the rest is on disk, make the file recognizable */
+    memcpy(optHdr.magic, DEX_OPT_MAGIC, 4);
+    memcpy(optHdr.magic + 4, DEX_OPT_MAGIC_VERS, 4);
+    if (lseek(fd, 0, SEEK_SET) != 0) {
+        ALOGE("dexOptWriteFile: seek failed: %s", strerror(errno));
+        goto bail;
+    }
+    if (sysWriteFully(fd, &optHdr, sizeof(optHdr), "opt header") != 0)
+        goto bail;
+
+    result = 0;
+
+bail:
+    free(pLookup);
+    return result;
+}
@@ -20,6 +20,8 @@
 #ifndef LIBDEX_OPTINVOCATION_H_
 #define LIBDEX_OPTINVOCATION_H_
 
+#include "libdex/DexFile.h"
+
 /*
  * Utility routines, used by the VM.
  */
@@ -27,4 +29,44 @@ char* dexOptGenerateCacheFileName(const char* fileName,
     const char* subFileName);
 int dexOptCreateEmptyHeader(int fd);
 
+/*
+ * One entry in an optimized DEX file's dependency table: a DEX file the
+ * optimized code was prepared against, and that file's SHA-1 signature.
+ * The VM writes one entry per bootclasspath entry, in bootclasspath
+ * order, naming that entry's optimized (cache) file rather than its
+ * source jar, and rejects a table that doesn't match.
+ */
+struct DexOptDependency {
+    const char* fileName;       /* bootclasspath entry's odex/cache path */
+    u1          signature[kSHA1DigestLen];
+};
+
+/*
+ * What goes in the dependency table, besides the dependencies.  The VM
+ * rejects an optimized file whose values don't match the source file
+ * and the VM itself.
+ */
+struct DexOptWriteOptions {
+    u4          modWhen;        /* source modification time, in seconds */
+    u4          crc;            /* source zip entry CRC-32, or DEX checksum */
+    u4          vmBuild;        /* DALVIK_VM_BUILD of the loading VM */
+    const DexOptDependency* pDeps;
+    int         depCount;
+};
+
+/*
+ * Write a complete optimized DEX file to "fd", which must be positioned
+ * at the start of an empty file: an opt header, the DEX data of
+ * "pDexFile" as-is, the dependency table, and opt data holding a class
+ * lookup table from dexCreateClassLookup(), with the opt checksum set.
+ *
+ * The DEX is neither verified nor optimized, so the header has none of
+ * those flags.  The header is written last, so a file that wasn't
+ * finished doesn't look like an optimized DEX file.
+ *
+ * Returns 0 on success.
+ */
+int dexOptWriteFile(int fd, DexFile* pDexFile,
+    const DexOptWriteOptions* pOptions);
+
 #endif  // LIBDEX_OPTINVOCATION_H_
@@ -27,6 +27,8 @@
 #if !defined(__MINGW32__)
 # include <sys/mman.h>
 #endif
+#include <fcntl.h>
+#include <sys/stat.h>
 #include <limits.h>
 #include <errno.h>
 
@@ -137,6 +139,245 @@ int sysFakeMapFile(int fd, MemMapping* pMap)
 }
 #endif
 
+#if !defined(__MINGW32__)
+/*
+ * Pass the kSysMap* hints for a range of a file on to the page cache, so
+ * readahead suits them even before the mapping exists.  Populating is
+ * much faster if the whole range is already being read in big chunks.
+ */
+static void sysAdviseFile(int fd, off_t start, size_t length, int flags)
+{
+#if defined(POSIX_FADV_SEQUENTIAL)
+    if (flags & kSysMapSequential)
+        (void) posix_fadvise(fd, start, length, POSIX_FADV_SEQUENTIAL);
+    else if (flags & kSysMapRandom)
+        (void) posix_fadvise(fd, start, length, POSIX_FADV_RANDOM);
+    if (flags & (kSysMapWillNeed | kSysMapPopulate))
+        (void) posix_fadvise(fd, start, length, POSIX_FADV_WILLNEED);
+#endif
+}
+
+/*
+ * Extra mmap() flags for the kSysMap* hints.  Only for read-only
+ * mappings: MAP_POPULATE write-faults writable private ones, which would
+ * copy every page.
+ */
+static int sysMapFlags(int flags)
+{
+#if defined(MAP_POPULATE)
+    if (flags & kSysMapPopulate)
+        return MAP_POPULATE;
+#endif
+    return 0;
+}
+
+/*
+ * Fault in a page-aligned range for reading, without breaking COW on
+ * private mappings.
+ */
+static void sysPopulateRange(void* addr, size_t length)
+{
+#if defined(MADV_POPULATE_READ)
+    if (madvise(addr, length, MADV_POPULATE_READ) == 0)
+        return;
+#endif
+    /* no kernel help (or too old a kernel); fault the pages in by hand */
+    for (size_t off = 0; off < length; off += SYSTEM_PAGE_SIZE)
+        (void) *(volatile const u1*) ((const u1*) addr + off);
+}
+
+/*
+ * Apply the kSysMap* hints to a page-aligned range of a mapping.
+ */
+static int sysAdviseRange(void* addr, size_t length, int flags)
+{
+    int advice = MADV_NORMAL;
+    int result = 0;
+
+    if (flags & kSysMapSequential)
+        advice = MADV_SEQUENTIAL;
+    else if (flags & kSysMapRandom)
+        advice = MADV_RANDOM;
+    if (madvise(addr, length, advice) != 0) {
+        ALOGV("madvise(%p, %zd, %d) failed: %s",
+            addr, length, advice, strerror(errno));
+        result = errno;
+    }
+
+    if ((flags & kSysMapWillNeed) &&
+        madvise(addr, length, MADV_WILLNEED) != 0)
+    {
+        ALOGV("madvise(%p, %zd, WILLNEED) failed: %s",
+            addr, length, strerror(errno));
+        result = errno;
+    }
+    return result;
+}
+#endif
+
+#if !defined(__MINGW32__)
+/*
+ * Fault in a page-aligned range for writing.  Anonymous memory reads as
+ * zero anyway, so storing zeroes is harmless.
+ */
+static void sysPrefaultWrite(void* addr, size_t length)
+{
+#if defined(MADV_POPULATE_WRITE)
+    if (madvise(addr, length, MADV_POPULATE_WRITE) == 0)
+        return;
+#endif
+    for (size_t off = 0; off < length; off += SYSTEM_PAGE_SIZE)
+        ((volatile u1*) addr)[off] = 0;
+}
+
+/*
+ * Create private anonymous memory of "length" bytes (a multiple of
+ * "align") starting on an "align" boundary, by over-allocating and
+ * trimming the ends.
+ */
+static void* sysCreateAlignedAnon(size_t length, size_t align)
+{
+    size_t mapLength = length + align;
+    u1* rawPtr;
+    u1* alignPtr;
+
+    rawPtr = (u1*) mmap(NULL, mapLength, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANON, -1, 0);
+    if (rawPtr == (u1*) MAP_FAILED) {
+        ALOGW("mmap(%zd, RW, PRIVATE|ANON) failed: %s", mapLength,
+            strerror(errno));
+        return NULL;
+    }
+
+    alignPtr = (u1*) (((uintptr_t) rawPtr + align - 1) & ~(align - 1));
+    if (alignPtr != rawPtr)
+        munmap(rawPtr, alignPtr - rawPtr);
+    if (alignPtr + length != rawPtr + mapLength)
+        munmap(alignPtr + length, (rawPtr + mapLength) - (alignPtr + length));
+    return alignPtr;
+}
+#endif
+
+/* (documented in header file) */
+int sysCreatePrivateMapWithFlags(size_t length, int flags, MemMapping* pMap)
+{
+#if !defined(__MINGW32__)
+    if (!(flags & kSysMapHugePages)) {
+        if (sysCreatePrivateMap(length, pMap) != 0)
+            return -1;
+        if (flags & kSysMapPopulate)
+            sysPrefaultWrite(pMap->baseAddr, pMap->baseLength);
+        return 0;
+    }
+
+    size_t baseLength = (length + SYSTEM_HUGE_PAGE_SIZE - 1) &
+        ~((size_t) SYSTEM_HUGE_PAGE_SIZE - 1);
+    void* memPtr = sysCreateAlignedAnon(baseLength, SYSTEM_HUGE_PAGE_SIZE);
+    if (memPtr == NULL)
+        return -1;
+
+#if defined(MADV_HUGEPAGE)
+    /* THP may be disabled, or set to "never"; carry on with small pages */
+    if (madvise(memPtr, baseLength, MADV_HUGEPAGE) != 0) {
+        ALOGV("madvise(%p, %zd, HUGEPAGE) failed: %s",
+            memPtr, baseLength, strerror(errno));
+    }
+#endif
+    if (flags & kSysMapPopulate)
+        sysPrefaultWrite(memPtr, baseLength);
+
+    pMap->addr = pMap->baseAddr = memPtr;
+    pMap->length = length;
+    pMap->baseLength = baseLength;
+    return 0;
+#else
+    return sysCreatePrivateMap(length, pMap);
+#endif
+}
+
+/* (documented in header file) */
+int sysLoadFileInPrivateMap(int fd, int flags, MemMapping* pMap)
+{
+#if !defined(__MINGW32__)
+    off_t start;
+    size_t length;
+    MemMapping map;
+
+    assert(pMap != NULL);
+
+    if (getFileStartAndLength(fd, &start, &length) < 0)
+        return -1;
+
+    /* the read below writes every page, so there's nothing to prefault */
+    if (sysCreatePrivateMapWithFlags(length, flags & ~kSysMapPopulate,
+            &map) != 0)
+        return -1;
+
+    u1* dst = (u1*) map.addr;
+    size_t remaining = length;
+    while (remaining != 0) {
+        ssize_t actual = TEMP_FAILURE_RETRY(read(fd, dst, remaining));
+        if (actual <= 0) {
+            ALOGW("read(fd=%d, %zd) failed: %s", fd, remaining,
+                (actual == 0) ? "unexpected EOF" : strerror(errno));
+            sysReleaseShmem(&map);
+            return -1;
+        }
+        dst += actual;
+        remaining -= actual;
+    }
+
+    sysCopyMap(pMap, &map);
+    return 0;
+#else
+    return sysFakeMapFile(fd, pMap);
+#endif
+}
+
+/* (documented in header file) */
+int sysGetHugePageBytes(const MemMapping* pMap, size_t* pBytes)
+{
+#if defined(__linux__)
+    uintptr_t mapStart = (uintptr_t) pMap->baseAddr;
+    uintptr_t mapEnd = mapStart + pMap->baseLength;
+    bool inMap = false;
+    size_t total = 0;
+    char* line = NULL;
+    size_t lineSize = 0;
+    FILE* fp;
+
+    fp = fopen("/proc/self/smaps", "r");
+    if (fp == NULL)
+        return -1;
+
+    /*
+     * Read whole lines: a mapping's path can be arbitrarily long, and a
+     * piece of it must not be mistaken for the next mapping's header.
+     */
+    while (getline(&line, &lineSize, fp) != -1) {
+        unsigned long vmaStart, vmaEnd, kb;
+
+        /* each mapping starts with a "start-end perms ..." line */
+        if (sscanf(line, "%lx-%lx ", &vmaStart, &vmaEnd) == 2) {
+            inMap = (vmaStart < mapEnd && vmaEnd > mapStart);
+        } else if (inMap &&
+            (sscanf(line, "AnonHugePages: %lu kB", &kb) == 1 ||
+             sscanf(line, "ShmemPmdMapped: %lu kB", &kb) == 1 ||
+             sscanf(line, "FilePmdMapped: %lu kB", &kb) == 1))
+        {
+            total += (size_t) kb * 1024;
+        }
+    }
+    free(line);
+    fclose(fp);
+
+    *pBytes = (total > pMap->baseLength) ? pMap->baseLength : total;
+    return 0;
+#else
+    return -1;
+#endif
+}
+
 /*
  * Map a file (from fd's current offset) into a private, read-write memory
  * segment that will be marked read-only (a/k/a "writable read-only").  The
@@ -149,6 +390,14 @@ int sysFakeMapFile(int fd, MemMapping* pMap)
  * value and does not disturb "pMap".
  */
 int sysMapFileInShmemWritableReadOnly(int fd, MemMapping* pMap)
+{
+    return sysMapFileInShmemWritableReadOnlyWithFlags(fd, kSysMapDefault,
+        pMap);
+}
+
+/* (documented in header file) */
+int sysMapFileInShmemWritableReadOnlyWithFlags(int fd, int flags,
+    MemMapping* pMap)
 {
 #if !defined(__MINGW32__)
     off_t start;
@@ -160,6 +409,9 @@ int sysMapFileInShmemWritableReadOnly(int fd, MemMapping* pMap)
     if (getFileStartAndLength(fd, &start, &length) < 0)
         return -1;
 
+    if (flags != kSysMapDefault)
+        sysAdviseFile(fd, start, length, flags);
+
     memPtr = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_FILE | MAP_PRIVATE,
             fd, start);
     if (memPtr == MAP_FAILED) {
@@ -174,6 +426,10 @@ int sysMapFileInShmemWritableReadOnly(int fd, MemMapping* pMap)
             memPtr, length, strerror(err));
         ALOGD("mprotect(RO) failed (%d), file will remain read-write", err);
     }
+    if (flags != kSysMapDefault)
+        (void) sysAdviseRange(memPtr, length, flags);
+    if (flags & kSysMapPopulate)
+        sysPopulateRange(memPtr, length);
 
     pMap->baseAddr = pMap->addr = memPtr;
     pMap->baseLength = pMap->length = length;
@@ -193,6 +449,14 @@ int sysMapFileInShmemWritableReadOnly(int fd, MemMapping* pMap)
  */
 int sysMapFileSegmentInShmem(int fd, off_t start, size_t length,
     MemMapping* pMap)
+{
+    return sysMapFileSegmentInShmemWithFlags(fd, start, length,
+        kSysMapDefault, pMap);
+}
+
+/* (documented in header file) */
+int sysMapFileSegmentInShmemWithFlags(int fd, off_t start, size_t length,
+    int flags, MemMapping* pMap)
 {
 #if !defined(__MINGW32__)
     size_t actualLength;
@@ -207,13 +471,18 @@ int sysMapFileSegmentInShmem(int fd, off_t start, size_t length,
     actualStart = start - adjust;
     actualLength = length + adjust;
 
-    memPtr = mmap(NULL, actualLength, PROT_READ, MAP_FILE | MAP_SHARED,
-                fd, actualStart);
+    if (flags != kSysMapDefault)
+        sysAdviseFile(fd, actualStart, actualLength, flags);
+
+    memPtr = mmap(NULL, actualLength, PROT_READ,
+                MAP_FILE | MAP_SHARED | sysMapFlags(flags), fd, actualStart);
     if (memPtr == MAP_FAILED) {
         ALOGW("mmap(%d, R, FILE|SHARED, %d, %d) failed: %s",
             (int) actualLength, fd, (int) actualStart, strerror(errno));
         return -1;
     }
+    if (flags != kSysMapDefault)
+        (void) sysAdviseRange(memPtr, actualLength, flags);
 
     pMap->baseAddr = memPtr;
     pMap->baseLength = actualLength;
@@ -232,6 +501,63 @@ int sysMapFileSegmentInShmem(int fd, off_t start, size_t length,
 #endif
 }
 
+#if defined(__linux__) && defined(MFD_ALLOW_SEALING) && defined(F_ADD_SEALS)
+#define HAVE_SEALED_MEMFD
+static const int kMemfdSeals =
+    F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL;
+#endif
+
+/* (documented in header file) */
+int sysCreateSealedMemfd(const void* data, size_t length, const char* name)
+{
+#if defined(HAVE_SEALED_MEMFD)
+    int fd = memfd_create(name, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) {
+        ALOGW("memfd_create(%s) failed: %s", name, strerror(errno));
+        return -1;
+    }
+
+    if (sysWriteFully(fd, data, length, "sysCreateSealedMemfd") != 0)
+        goto fail;
+    /* F_SEAL_WRITE is refused while any writable mapping exists; none do */
+    if (fcntl(fd, F_ADD_SEALS, kMemfdSeals) != 0) {
+        ALOGW("sealing memfd %s failed: %s", name, strerror(errno));
+        goto fail;
+    }
+    return fd;
+
+fail:
+    close(fd);
+    return -1;
+#else
+    ALOGE("sysCreateSealedMemfd not implemented.");
+    return -1;
+#endif
+}
+
+/* (documented in header file) */
+int sysMapSealedMemfd(int fd, MemMapping* pMap)
+{
+#if defined(HAVE_SEALED_MEMFD)
+    struct stat st;
+    int seals = fcntl(fd, F_GET_SEALS);
+    int needed = F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE;
+
+    if (seals < 0 || (seals & needed) != needed) {
+        ALOGE("memfd %d isn't sealed (seals=0x%x)", fd, seals);
+        return -1;
+    }
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ALOGE("memfd %d is empty", fd);
+        return -1;
+    }
+    return sysMapFileSegmentInShmem(fd, 0, st.st_size, pMap);
+#else
+    ALOGE("sysMapSealedMemfd not implemented.");
+    return -1;
+#endif
+}
+
 /*
  * Change the access rights on one or more pages to read-only or read-write.
  *
@@ -273,6 +599,31 @@ int sysChangeMapAccess(void* addr, size_t length, int wantReadWrite,
     return 0;
 }
 
+/* (documented in header file) */
+int sysAdviseMap(void* addr, size_t length, int flags, MemMapping* pMap)
+{
+#if !defined(__MINGW32__)
+    if (addr < pMap->baseAddr ||
+        (u1*)addr + length > (u1*)pMap->baseAddr + pMap->baseLength)
+    {
+        ALOGE("Attempted to advise %p+%zd; map is %p - %p", addr, length,
+            pMap->baseAddr, (u1*)pMap->baseAddr + pMap->baseLength);
+        return -1;
+    }
+
+    u1* alignAddr = (u1*) ((uintptr_t) addr & ~(SYSTEM_PAGE_SIZE-1));
+    size_t alignLength = length + ((u1*) addr - alignAddr);
+
+    int result = sysAdviseRange(alignAddr, alignLength, flags);
+    if (flags & kSysMapPopulate)
+        sysPopulateRange(alignAddr, alignLength);
+    return result;
+#else
+    /* "fake" mappings are plain heap memory, already resident */
+    return 0;
+#endif
+}
+
 /*
  * Release a memory mapping.
  */
@@ -37,6 +37,12 @@
 #define SYSTEM_PAGE_SIZE        4096
 #endif
 
+/*
+ * PMD-sized transparent huge page, on the 4K-page configurations we run
+ * on (x86-64, arm64).  kSysMapHugePages aligns to this.
+ */
+#define SYSTEM_HUGE_PAGE_SIZE   (2 * 1024 * 1024)
+
 /*
  * Use this to keep track of mapped segments.
  */
@@ -48,6 +54,20 @@ struct MemMapping {
     size_t  baseLength;     /* length of mapping */
 };
 
+/*
+ * Access hints for the "WithFlags" mapping calls and sysAdviseMap().
+ * They only tell the kernel how the pages are going to be read; any the
+ * platform doesn't support are ignored.
+ */
+enum {
+    kSysMapDefault      = 0,
+    kSysMapSequential   = (1 << 0),     /* one pass, front to back */
+    kSysMapRandom       = (1 << 1),     /* scattered lookups, no readahead */
+    kSysMapPopulate     = (1 << 2),     /* read it all in before returning */
+    kSysMapWillNeed     = (1 << 3),     /* start reading it all in */
+    kSysMapHugePages    = (1 << 4),     /* anonymous maps only, see below */
+};
+
 /*
  * Copy a map.
  */
@@ -62,6 +82,13 @@ void sysCopyMap(MemMapping* dst, const MemMapping* src);
  */
 int sysMapFileInShmemWritableReadOnly(int fd, MemMapping* pMap);
 
+/*
+ * Like sysMapFileInShmemWritableReadOnly(), with kSysMap* access hints
+ * applied to the file and the mapping.
+ */
+int sysMapFileInShmemWritableReadOnlyWithFlags(int fd, int flags,
+    MemMapping* pMap);
+
 /*
  * Map part of a file into a shared, read-only memory segment.
  *
@@ -70,6 +97,23 @@ int sysMapFileInShmemWritableReadOnly(int fd, MemMapping* pMap);
 int sysMapFileSegmentInShmem(int fd, off_t start, size_t length,
     MemMapping* pMap);
 
+/*
+ * Like sysMapFileSegmentInShmem(), with kSysMap* access hints applied to
+ * the file and the mapping.
+ */
+int sysMapFileSegmentInShmemWithFlags(int fd, off_t start, size_t length,
+    int flags, MemMapping* pMap);
+
+/*
+ * Change the access hints on part of a mapping, e.g. from sequential to
+ * random once a file has been verified.  kSysMapDefault restores normal
+ * readahead; kSysMapPopulate faults the range in where supported.
+ * "addr" need not be page-aligned.
+ *
+ * Returns 0 on success.
+ */
+int sysAdviseMap(void* addr, size_t length, int flags, MemMapping* pMap);
+
 /*
  * Create a private anonymous mapping, useful for large allocations.
  *
@@ -77,6 +121,57 @@ int sysMapFileSegmentInShmem(int fd, off_t start, size_t length,
  */
 int sysCreatePrivateMap(size_t length, MemMapping* pMap);
 
+/*
+ * Like sysCreatePrivateMap(), with kSysMap* flags.
+ *
+ * kSysMapHugePages makes the area private (not shared) memory rounded up
+ * to and aligned on SYSTEM_HUGE_PAGE_SIZE, and asks for transparent huge
+ * pages with MADV_HUGEPAGE, for long-lived data where TLB misses matter.
+ * kSysMapPopulate prefaults every page (with a write, so real pages are
+ * allocated rather than the shared zero page).  Other flags are ignored.
+ *
+ * pMap->length is "length"; pMap->baseLength may be larger.
+ */
+int sysCreatePrivateMapWithFlags(size_t length, int flags, MemMapping* pMap);
+
+/*
+ * Read a file (from fd's current offset) into a new private map created
+ * with sysCreatePrivateMapWithFlags().  Unlike mapping the file, the
+ * copy can be backed by huge pages; the cost is that it isn't shared
+ * with the page cache.
+ *
+ * On success, "pMap" is filled in, and zero is returned.
+ */
+int sysLoadFileInPrivateMap(int fd, int flags, MemMapping* pMap);
+
+/*
+ * Find out how many bytes of a mapping are backed by huge pages, from
+ * /proc/self/smaps.  If the kernel merged the mapping with a neighbour
+ * the neighbour's huge pages are counted too, up to the mapping's size.
+ *
+ * Returns 0 on success, or -1 where that information isn't available.
+ */
+int sysGetHugePageBytes(const MemMapping* pMap, size_t* pBytes);
+
+/*
+ * Copy "length" bytes into a new memfd named "name", sealed so nobody
+ * can write, grow or shrink it any more, for handing to other processes
+ * (e.g. over a Unix socket).  A broker can verify a DEX file once and
+ * publish it this way; its workers then share one copy.
+ *
+ * Returns the fd, or -1 on failure or where memfds aren't supported.
+ */
+int sysCreateSealedMemfd(const void* data, size_t length, const char* name);
+
+/*
+ * Map a memfd from sysCreateSealedMemfd() shared and read-only.  Refuses
+ * fds that aren't sealed against writing and resizing, since then the
+ * contents could change after whoever created it checked them.
+ *
+ * On success, "pMap" is filled in, and zero is returned.
+ */
+int sysMapSealedMemfd(int fd, MemMapping* pMap);
+
 /*
  * Change the access rights on one or more pages.  If "wantReadWrite" is
  * zero, the pages will be made read-only; otherwise they will be read-write.
@@ -83,4 +83,15 @@ DEX_INLINE int dexZipExtractEntryToFile(ZipArchiveHandle handle,
     return ExtractEntryToFile(handle, entry, fd);
 }
 
+/*
+ * Uncompress an entry into "buf", which must hold the entry's
+ * uncompressed_length bytes.
+ *
+ * Returns 0 on success.
+ */
+DEX_INLINE int dexZipExtractEntryToMemory(ZipArchiveHandle handle,
+    ZipEntry* entry, u1* buf, size_t length) {
+    return ExtractToMemory(handle, entry, buf, length);
+}
+
 #endif  // LIBDEX_ZIPARCHIVE_H_
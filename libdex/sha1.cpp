@@ -6,6 +6,8 @@
  *    trashing the input.
  *  - Include <endian.h> to get endian info.
  *  - Split a small piece into a header file.
+ *  - Hand runs of whole blocks to SHA-NI or ARMv8 SHA1 instructions
+ *    when the CPU has them.
  */
 
 /*
@@ -101,7 +103,7 @@ A million repetitions of "a"
 
 #define LINESIZE 2048
 
-static void SHA1Transform(unsigned long state[5],
+static void SHA1Transform(uint32_t state[5],
     const unsigned char buffer[64]);
 
 #define rol(value,bits) \
@@ -129,18 +131,18 @@ static void SHA1Transform(unsigned long state[5],
 
 /* Hash a single 512-bit block. This is the core of the algorithm. */
 
-static void SHA1Transform(unsigned long state[5],
+static void SHA1Transform(uint32_t state[5],
     const unsigned char buffer[64])
 {
-unsigned long a, b, c, d, e;
+uint32_t a, b, c, d, e;
 union CHAR64LONG16 {
     unsigned char c[64];
-    unsigned long l[16];
+    uint32_t l[16];
 };
 CHAR64LONG16* block;
 #ifdef SHA1HANDSOFF
-static unsigned char workspace[64];
-    block = (CHAR64LONG16*)workspace;
+CHAR64LONG16 workspace;
+    block = &workspace;
     memcpy(block, buffer, 64);
 #else
     block = (CHAR64LONG16*)buffer;
@@ -193,6 +195,217 @@ warning. */
 }
 
 
+/*
+ * Block functions.  SHA1Update hands every run of whole 64-byte blocks to
+ * one of these; the generic one is SHA1Transform in a loop, the others
+ * use the SHA extensions on x86 (SHA-NI) and the ARMv8 crypto extensions.
+ * The choice is made once, from what the CPU reports at run time, so a
+ * single binary works everywhere.
+ */
+typedef void (*SHA1BlockFunc)(uint32_t state[5], const unsigned char* data,
+    size_t blocks);
+
+static void SHA1BlocksGeneric(uint32_t state[5], const unsigned char* data,
+    size_t blocks)
+{
+    for ( ; blocks != 0; blocks--, data += 64)
+        SHA1Transform(state, data);
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SHA1_HAVE_SHANI
+#include <cpuid.h>
+#include <immintrin.h>
+
+/*
+ * One group of four rounds.  "w" holds the message words for the last
+ * four groups, indexed by group number mod 4; from group 4 on the next
+ * entry is expanded in place from the other three.  "e" carries the
+ * ABCD value from before the previous group, which sha1nexte turns into
+ * the E input for this one.
+ */
+#define SHANI_GROUP(g, func) \
+    do { \
+        if ((g) >= 4) { \
+            w[(g) & 3] = _mm_sha1msg2_epu32(_mm_xor_si128( \
+                _mm_sha1msg1_epu32(w[(g) & 3], w[((g) + 1) & 3]), \
+                w[((g) + 2) & 3]), w[((g) + 3) & 3]); \
+        } \
+        __m128i e1 = ((g) == 0) ? _mm_add_epi32(e, w[0]) \
+                                : _mm_sha1nexte_epu32(e, w[(g) & 3]); \
+        e = abcd; \
+        abcd = _mm_sha1rnds4_epu32(abcd, e1, func); \
+    } while (0)
+
+__attribute__((target("sha,sse4.1,ssse3")))
+static void SHA1BlocksShaNi(uint32_t state[5], const unsigned char* data,
+    size_t blocks)
+{
+    /* reverses the bytes of the whole vector: big-endian words, and
+     * word 0 in the top lane where the SHA instructions want it */
+    const __m128i byteSwap = _mm_set_epi64x(0x0001020304050607ULL,
+        0x08090a0b0c0d0e0fULL);
+    __m128i abcd = _mm_shuffle_epi32(
+        _mm_loadu_si128((const __m128i*) state), 0x1b);
+    __m128i e0 = _mm_set_epi32((int) state[4], 0, 0, 0);
+
+    for ( ; blocks != 0; blocks--, data += 64) {
+        __m128i abcdSave = abcd;
+        __m128i e0Save = e0;
+        __m128i w[4];
+        __m128i e = e0;
+        int g;
+
+        for (g = 0; g < 4; g++) {
+            w[g] = _mm_shuffle_epi8(
+                _mm_loadu_si128((const __m128i*) (data + g * 16)), byteSwap);
+        }
+        for (g = 0; g < 5; g++)
+            SHANI_GROUP(g, 0);
+        for ( ; g < 10; g++)
+            SHANI_GROUP(g, 1);
+        for ( ; g < 15; g++)
+            SHANI_GROUP(g, 2);
+        for ( ; g < 20; g++)
+            SHANI_GROUP(g, 3);
+
+        e0 = _mm_sha1nexte_epu32(e, e0Save);
+        abcd = _mm_add_epi32(abcd, abcdSave);
+    }
+
+    _mm_storeu_si128((__m128i*) state, _mm_shuffle_epi32(abcd, 0x1b));
+    state[4] = (uint32_t) _mm_extract_epi32(e0, 3);
+}
+
+#undef SHANI_GROUP
+
+static bool SHA1CpuHasShaNi(void)
+{
+    unsigned int eax, ebx, ecx, edx;
+
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        return false;
+    if (!(ecx & bit_SSSE3) || !(ecx & bit_SSE4_1))
+        return false;
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+        return false;
+    return (ebx & bit_SHA) != 0;
+}
+#endif
+
+#if defined(__GNUC__) && defined(__aarch64__) && \
+    (defined(__linux__) || defined(__APPLE__))
+#define SHA1_HAVE_ARMV8
+#include <arm_neon.h>
+#if defined(__linux__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+#if defined(__clang__)
+# define SHA1_ARMV8_TARGET __attribute__((target("crypto")))
+#else
+# define SHA1_ARMV8_TARGET __attribute__((target("+crypto")))
+#endif
+
+/*
+ * One group of four rounds; "w" is indexed as in SHANI_GROUP.  "e" is
+ * the E input for this group, and the next one's is derived from the
+ * A lane before the group runs.
+ */
+#define ARMV8_GROUP(g, op, k) \
+    do { \
+        if ((g) >= 4) { \
+            w[(g) & 3] = vsha1su1q_u32(vsha1su0q_u32(w[(g) & 3], \
+                w[((g) + 1) & 3], w[((g) + 2) & 3]), w[((g) + 3) & 3]); \
+        } \
+        uint32_t eNext = vsha1h_u32(vgetq_lane_u32(abcd, 0)); \
+        abcd = op(abcd, e, vaddq_u32(w[(g) & 3], vdupq_n_u32(k))); \
+        e = eNext; \
+    } while (0)
+
+SHA1_ARMV8_TARGET
+static void SHA1BlocksArmV8(uint32_t state[5], const unsigned char* data,
+    size_t blocks)
+{
+    uint32x4_t abcd = vld1q_u32(state);
+    uint32_t e0 = state[4];
+
+    for ( ; blocks != 0; blocks--, data += 64) {
+        uint32x4_t abcdSave = abcd;
+        uint32x4_t w[4];
+        uint32_t e = e0;
+        int g;
+
+        for (g = 0; g < 4; g++) {
+            w[g] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + g * 16)));
+        }
+        for (g = 0; g < 5; g++)
+            ARMV8_GROUP(g, vsha1cq_u32, 0x5A827999);
+        for ( ; g < 10; g++)
+            ARMV8_GROUP(g, vsha1pq_u32, 0x6ED9EBA1);
+        for ( ; g < 15; g++)
+            ARMV8_GROUP(g, vsha1mq_u32, 0x8F1BBCDC);
+        for ( ; g < 20; g++)
+            ARMV8_GROUP(g, vsha1pq_u32, 0xCA62C1D6);
+
+        e0 += e;
+        abcd = vaddq_u32(abcd, abcdSave);
+    }
+
+    vst1q_u32(state, abcd);
+    state[4] = e0;
+}
+
+#undef ARMV8_GROUP
+
+static bool SHA1CpuHasArmV8(void)
+{
+#if defined(__APPLE__)
+    return true;        /* every Apple arm64 core has them */
+#else
+    return (getauxval(AT_HWCAP) & HWCAP_SHA1) != 0;
+#endif
+}
+#endif
+
+struct SHA1Backend {
+    SHA1BlockFunc func;
+    const char* name;
+};
+
+static SHA1Backend SHA1ChooseBackend(void)
+{
+    SHA1Backend backend = { SHA1BlocksGeneric, "generic" };
+
+#ifdef SHA1_HAVE_SHANI
+    if (SHA1CpuHasShaNi()) {
+        backend.func = SHA1BlocksShaNi;
+        backend.name = "sha-ni";
+    }
+#endif
+#ifdef SHA1_HAVE_ARMV8
+    if (SHA1CpuHasArmV8()) {
+        backend.func = SHA1BlocksArmV8;
+        backend.name = "armv8";
+    }
+#endif
+    return backend;
+}
+
+/* chosen on first use; function-local statics are initialized once */
+static const SHA1Backend& SHA1GetBackend(void)
+{
+    static const SHA1Backend backend = SHA1ChooseBackend();
+    return backend;
+}
+
+const char* SHA1ImplementationName(void)
+{
+    return SHA1GetBackend().name;
+}
+
+
 /* SHA1Init - Initialize new context */
 
 void SHA1Init(SHA1_CTX* context)
@@ -215,15 +428,17 @@ void SHA1Update(SHA1_CTX* context, const unsigned char* data,
     unsigned long i, j; /* JHB */
 
     j = (context->count[0] >> 3) & 63;
-    if ((context->count[0] += len << 3) < (len << 3))
+    if ((context->count[0] += (uint32_t) (len << 3)) < (uint32_t) (len << 3))
         context->count[1]++;
-    context->count[1] += (len >> 29);
+    context->count[1] += (uint32_t) (len >> 29);
     if ((j + len) > 63)
     {
+        SHA1BlockFunc blockFunc = SHA1GetBackend().func;
         memcpy(&context->buffer[j], data, (i = 64-j));
-        SHA1Transform(context->state, context->buffer);
-        for ( ; i + 63 < len; i += 64) {
-            SHA1Transform(context->state, &data[i]);
+        blockFunc(context->state, context->buffer, 1);
+        if (i + 63 < len) {
+            blockFunc(context->state, &data[i], (len - i) / 64);
+            i += (len - i) & ~63UL;
         }
         j = 0;
     }
@@ -262,10 +477,6 @@ unsigned char finalcount[8];
     memset(context->state, 0, HASHSIZE);
     memset(context->count, 0, 8);
     memset(&finalcount, 0, 8);
-#ifdef SHA1HANDSOFF
-    /* make SHA1Transform overwrite it's own static vars */
-    SHA1Transform(context->state, context->buffer);
-#endif
 }
 
 
@@ -4,9 +4,11 @@
 #ifndef LIBDEX_SHA1_H_
 #define LIBDEX_SHA1_H_
 
+#include <stdint.h>
+
 struct SHA1_CTX {
-    unsigned long state[5];
-    unsigned long count[2];
+    uint32_t state[5];
+    uint32_t count[2];
     unsigned char buffer[64];
 };
 
@@ -17,4 +19,10 @@ void SHA1Update(SHA1_CTX* context, const unsigned char* data,
     unsigned long len);
 void SHA1Final(unsigned char digest[HASHSIZE], SHA1_CTX* context);
 
+/*
+ * Name of the block function SHA1Update uses on this CPU: "sha-ni",
+ * "armv8" or "generic".
+ */
+const char* SHA1ImplementationName(void);
+
 #endif  // LIBDEX_SHA1_H_
@@ -0,0 +1,721 @@
+/*
+ * Copyright (C) 2009 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Native dexdeps: list the classes, fields and methods a DEX file refers
+ * to but doesn't define.  The output matches the Java tool in ../src.
+ *
+ * Input files are scanned concurrently, one per worker thread; output
+ * is buffered per file and written in command-line order.
+ */
+
+#include "libdex/DexFile.h"
+
+#include "libdex/DexParallel.h"
+#include "libdex/DexProto.h"
+#include "libdex/SysUtil.h"
+#include "libdex/ZipArchive.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+static const char* gProgName = "dexdeps";
+
+enum OutputFormat {
+    OUTPUT_BRIEF,
+    OUTPUT_XML,
+};
+
+/* command-line options */
+struct Options {
+    OutputFormat outputFormat;
+    bool justClasses;
+    int numThreads;
+};
+
+static Options gOptions;
+
+/*
+ * Growable text buffer.  Each input file's output is built in one of
+ * these so that files can be scanned out of order.
+ */
+struct OutBuf {
+    char*       data;
+    size_t      length;
+    size_t      capacity;
+};
+
+/*
+ * Make room for "count" more bytes (plus a '\0') and return a pointer to
+ * the end of the buffer.  The caller advances "length".
+ */
+static char* outReserve(OutBuf* pBuf, size_t count)
+{
+    if (pBuf->capacity - pBuf->length <= count) {
+        size_t newCapacity = (pBuf->capacity == 0) ? 4096 : pBuf->capacity * 2;
+        while (newCapacity - pBuf->length <= count)
+            newCapacity *= 2;
+        char* newData = (char*) realloc(pBuf->data, newCapacity);
+        if (newData == NULL) {
+            fprintf(stderr, "%s: out of memory\n", gProgName);
+            exit(1);
+        }
+        pBuf->data = newData;
+        pBuf->capacity = newCapacity;
+    }
+    return pBuf->data + pBuf->length;
+}
+
+static void outPrintf(OutBuf* pBuf, const char* fmt, ...)
+    __attribute__ ((format (printf, 2, 3)));
+
+static void outPrintf(OutBuf* pBuf, const char* fmt, ...)
+{
+    va_list args;
+    int len;
+
+    va_start(args, fmt);
+    len = vsnprintf(pBuf->data + pBuf->length, pBuf->capacity - pBuf->length,
+        fmt, args);
+    va_end(args);
+    if (len < 0)
+        return;
+
+    if ((size_t) len >= pBuf->capacity - pBuf->length) {
+        outReserve(pBuf, len);
+        va_start(args, fmt);
+        vsnprintf(pBuf->data + pBuf->length, pBuf->capacity - pBuf->length,
+            fmt, args);
+        va_end(args);
+    }
+    pBuf->length += len;
+}
+
+/*
+ * Append "count" characters of "str", turning '/' into '.'.
+ */
+static void outDotted(OutBuf* pBuf, const char* str, size_t count)
+{
+    char* cp = outReserve(pBuf, count);
+
+    for (size_t i = 0; i < count; i++)
+        cp[i] = (str[i] == '/') ? '.' : str[i];
+    pBuf->length += count;
+}
+
+/*
+ * Per-file work item.
+ */
+struct FileJob {
+    const char* fileName;
+    OutBuf      out;
+    bool        failed;
+    bool        done;
+};
+
+struct JobQueue {
+    FileJob*        jobs;
+    int             jobCount;
+    int             nextJob;
+    pthread_mutex_t lock;
+    pthread_cond_t  jobDone;
+};
+
+/*
+ * ===========================================================================
+ *      Name formatting (same rules as Output.java)
+ * ===========================================================================
+ */
+
+static const char* primitiveTypeLabel(char typeChar)
+{
+    switch (typeChar) {
+    case 'B':   return "byte";
+    case 'C':   return "char";
+    case 'D':   return "double";
+    case 'F':   return "float";
+    case 'I':   return "int";
+    case 'J':   return "long";
+    case 'S':   return "short";
+    case 'V':   return "void";
+    case 'Z':   return "boolean";
+    default:    return "UNKNOWN";
+    }
+}
+
+/*
+ * Append the "dotted" form of a type descriptor: "Ljava/lang/String;"
+ * becomes "java.lang.String" and "[I" becomes "int[]".
+ */
+static void outDescriptorToDot(OutBuf* pBuf, const char* descriptor)
+{
+    size_t targetLen = strlen(descriptor);
+    int arrayDepth = 0;
+
+    while (targetLen > 1 && *descriptor == '[') {
+        descriptor++;
+        targetLen--;
+        arrayDepth++;
+    }
+
+    if (targetLen == 1) {
+        const char* label = primitiveTypeLabel(*descriptor);
+        outDotted(pBuf, label, strlen(label));
+    } else {
+        if (targetLen >= 2 && descriptor[0] == 'L' &&
+            descriptor[targetLen - 1] == ';')
+        {
+            descriptor++;
+            targetLen -= 2;
+        }
+        outDotted(pBuf, descriptor, targetLen);
+    }
+
+    while (arrayDepth-- > 0)
+        outDotted(pBuf, "[]", 2);
+}
+
+/*
+ * Find the package/class split in a class descriptor.  Returns the
+ * length of the package part ("Ljava/lang" in "Ljava/lang/String;"),
+ * or 1 for the default package.
+ */
+static size_t packageLength(const char* descriptor)
+{
+    const char* lastSlash = strrchr(descriptor, '/');
+    return (lastSlash == NULL) ? 1 : (size_t) (lastSlash - descriptor);
+}
+
+/* append the dotted package name */
+static void outPackageName(OutBuf* pBuf, const char* descriptor, size_t len)
+{
+    if (len > 1)
+        outDotted(pBuf, descriptor + 1, len - 1);
+}
+
+/* append the class name without its package */
+static void outClassName(OutBuf* pBuf, const char* descriptor)
+{
+    const char* start = strrchr(descriptor, '/');
+    size_t len;
+
+    start = (start == NULL) ? descriptor + 1 : start + 1;
+    len = strlen(start);
+    if (len > 0 && start[len - 1] == ';')
+        len--;
+    outDotted(pBuf, start, len);
+}
+
+/*
+ * ===========================================================================
+ *      Scanning
+ * ===========================================================================
+ */
+
+/*
+ * Build a bitset of the type_ids the file provides itself: classes it
+ * defines, primitives and arrays.  Everything else is external.
+ */
+static u4* createInternalTypeBits(const DexFile* pDexFile)
+{
+    u4 typeCount = pDexFile->pHeader->typeIdsSize;
+    u4* bits = (u4*) calloc((typeCount + 31) / 32 + 1, sizeof(u4));
+
+    if (bits == NULL)
+        return NULL;
+
+    for (u4 i = 0; i < pDexFile->pHeader->classDefsSize; i++) {
+        u4 typeIdx = dexGetClassDef(pDexFile, i)->classIdx;
+        bits[typeIdx >> 5] |= 1 << (typeIdx & 0x1f);
+    }
+    for (u4 i = 0; i < typeCount; i++) {
+        const char* descriptor = dexStringByTypeIdx(pDexFile, i);
+        if (descriptor[0] == '[' || descriptor[1] == '\0')
+            bits[i >> 5] |= 1 << (i & 0x1f);
+    }
+    return bits;
+}
+
+static inline bool isInternal(const u4* bits, u4 typeIdx)
+{
+    return (bits[typeIdx >> 5] & (1 << (typeIdx & 0x1f))) != 0;
+}
+
+static void outXmlField(OutBuf* pBuf, const DexFile* pDexFile,
+    const DexFieldId* pFieldId)
+{
+    outPrintf(pBuf, "      <field name=\"%s\" type=\"",
+        dexStringById(pDexFile, pFieldId->nameIdx));
+    outDescriptorToDot(pBuf, dexStringByTypeIdx(pDexFile, pFieldId->typeIdx));
+    outPrintf(pBuf, "\"/>\n");
+}
+
+static void outXmlMethod(OutBuf* pBuf, const DexFile* pDexFile,
+    const DexMethodId* pMethodId)
+{
+    const char* name = dexStringById(pDexFile, pMethodId->nameIdx);
+    bool constructor = (strcmp(name, "<init>") == 0);
+    DexProto proto;
+    DexParameterIterator iterator;
+    const char* descriptor;
+
+    proto.dexFile = pDexFile;
+    proto.protoIdx = pMethodId->protoIdx;
+
+    if (constructor) {
+        outPrintf(pBuf, "      <constructor name=\"");
+        outClassName(pBuf, dexStringByTypeIdx(pDexFile, pMethodId->classIdx));
+        outPrintf(pBuf, "\">\n");
+    } else {
+        outPrintf(pBuf, "      <method name=\"%s\" return=\"", name);
+        outDescriptorToDot(pBuf, dexProtoGetReturnType(&proto));
+        outPrintf(pBuf, "\">\n");
+    }
+
+    dexParameterIteratorInit(&iterator, &proto);
+    while ((descriptor = dexParameterIteratorNextDescriptor(&iterator)) != NULL) {
+        outPrintf(pBuf, "        <parameter type=\"");
+        outDescriptorToDot(pBuf, descriptor);
+        outPrintf(pBuf, "\"/>\n");
+    }
+
+    outPrintf(pBuf, constructor ? "      </constructor>\n" : "      </method>\n");
+}
+
+/*
+ * Print the external references of one DEX file.
+ *
+ * The verifier guarantees field_ids and method_ids are sorted by
+ * defining class, so each class's members are a contiguous run and the
+ * runs come in type_id order.
+ */
+static void generate(OutBuf* pBuf, const DexFile* pDexFile, const u4* bits)
+{
+    const DexHeader* pHeader = pDexFile->pHeader;
+
+    if (gOptions.outputFormat == OUTPUT_BRIEF) {
+        if (!gOptions.justClasses)
+            outPrintf(pBuf, "Classes:\n");
+        for (u4 i = 0; i < pHeader->typeIdsSize; i++) {
+            if (!isInternal(bits, i)) {
+                outDescriptorToDot(pBuf, dexStringByTypeIdx(pDexFile, i));
+                outPrintf(pBuf, "\n");
+            }
+        }
+        if (gOptions.justClasses)
+            return;
+
+        outPrintf(pBuf, "\nFields:\n");
+        for (u4 i = 0; i < pHeader->fieldIdsSize; i++) {
+            const DexFieldId* pFieldId = dexGetFieldId(pDexFile, i);
+            if (isInternal(bits, pFieldId->classIdx))
+                continue;
+            outDescriptorToDot(pBuf,
+                dexStringByTypeIdx(pDexFile, pFieldId->classIdx));
+            outPrintf(pBuf, ".%s : %s\n",
+                dexStringById(pDexFile, pFieldId->nameIdx),
+                dexStringByTypeIdx(pDexFile, pFieldId->typeIdx));
+        }
+
+        outPrintf(pBuf, "\nMethods:\n");
+        for (u4 i = 0; i < pHeader->methodIdsSize; i++) {
+            const DexMethodId* pMethodId = dexGetMethodId(pDexFile, i);
+            if (isInternal(bits, pMethodId->classIdx))
+                continue;
+            outDescriptorToDot(pBuf,
+                dexStringByTypeIdx(pDexFile, pMethodId->classIdx));
+            outPrintf(pBuf, ".%s : %s\n",
+                dexStringById(pDexFile, pMethodId->nameIdx),
+                dexProtoTableGet(pDexFile->pProtoTable, pMethodId->protoIdx));
+        }
+        return;
+    }
+
+    const char* prevPackage = NULL;
+    size_t prevPackageLen = 0;
+    u4 fieldIdx = 0;
+    u4 methodIdx = 0;
+
+    for (u4 i = 0; i < pHeader->typeIdsSize; i++) {
+        if (isInternal(bits, i))
+            continue;
+
+        const char* descriptor = dexStringByTypeIdx(pDexFile, i);
+        size_t packageLen = packageLength(descriptor);
+
+        if (prevPackage == NULL || packageLen != prevPackageLen ||
+            strncmp(descriptor, prevPackage, packageLen) != 0)
+        {
+            if (prevPackage != NULL)
+                outPrintf(pBuf, "  </package>\n");
+            outPrintf(pBuf, "  <package name=\"");
+            outPackageName(pBuf, descriptor, packageLen);
+            outPrintf(pBuf, "\">\n");
+            prevPackage = descriptor;
+            prevPackageLen = packageLen;
+        }
+
+        outPrintf(pBuf, "    <class name=\"");
+        outClassName(pBuf, descriptor);
+        outPrintf(pBuf, "\">\n");
+        if (!gOptions.justClasses) {
+            while (fieldIdx < pHeader->fieldIdsSize &&
+                dexGetFieldId(pDexFile, fieldIdx)->classIdx < i)
+                fieldIdx++;
+            for (; fieldIdx < pHeader->fieldIdsSize; fieldIdx++) {
+                const DexFieldId* pFieldId = dexGetFieldId(pDexFile, fieldIdx);
+                if (pFieldId->classIdx != i)
+                    break;
+                outXmlField(pBuf, pDexFile, pFieldId);
+            }
+
+            while (methodIdx < pHeader->methodIdsSize &&
+                dexGetMethodId(pDexFile, methodIdx)->classIdx < i)
+                methodIdx++;
+            for (; methodIdx < pHeader->methodIdsSize; methodIdx++) {
+                const DexMethodId* pMethodId =
+                    dexGetMethodId(pDexFile, methodIdx);
+                if (pMethodId->classIdx != i)
+                    break;
+                outXmlMethod(pBuf, pDexFile, pMethodId);
+            }
+        }
+        outPrintf(pBuf, "    </class>\n");
+    }
+
+    if (prevPackage != NULL)
+        outPrintf(pBuf, "  </package>\n");
+}
+
+/*
+ * Verify and scan one DEX file held in writable memory.
+ */
+static bool processDex(FileJob* pJob, u1* data, size_t length,
+    const char* dexName)
+{
+    DexFile* pDexFile = NULL;
+    u4* bits = NULL;
+    bool result = false;
+
+    if (dexSwapAndVerifyIfNecessary(data, length) != 0) {
+        fprintf(stderr, "%s: failed structural verification of '%s'\n",
+            gProgName, dexName);
+        return false;
+    }
+
+    pDexFile = dexFileParse(data, length, 0);
+    if (pDexFile == NULL) {
+        fprintf(stderr, "%s: DEX parse of '%s' failed\n", gProgName, dexName);
+        goto bail;
+    }
+    if (!dexFileAttachProtoTable(pDexFile, 1))
+        goto bail;
+    bits = createInternalTypeBits(pDexFile);
+    if (bits == NULL)
+        goto bail;
+
+    generate(&pJob->out, pDexFile, bits);
+    result = true;
+
+bail:
+    free(bits);
+    if (pDexFile != NULL)
+        dexFileFree(pDexFile);
+    return result;
+}
+
+/*
+ * Scan classes.dex, classes2.dex, ... from an archive.  Each entry is
+ * uncompressed into memory; no temp files are involved, so any number
+ * of archives can be open at once.
+ */
+static bool processZip(FileJob* pJob, ZipArchiveHandle archive)
+{
+    for (int dexNum = 1; ; dexNum++) {
+        char entryName[32];
+        ZipEntry entry;
+        u1* data;
+        bool ok;
+
+        if (dexNum == 1)
+            strcpy(entryName, "classes.dex");
+        else
+            sprintf(entryName, "classes%d.dex", dexNum);
+
+        if (dexZipFindEntry(archive, entryName, &entry) != 0) {
+            if (dexNum == 1) {
+                fprintf(stderr, "%s: unable to find '%s' in '%s'\n",
+                    gProgName, entryName, pJob->fileName);
+                return false;
+            }
+            return true;
+        }
+
+        data = (u1*) malloc(entry.uncompressed_length);
+        if (data == NULL) {
+            fprintf(stderr, "%s: out of memory\n", gProgName);
+            return false;
+        }
+        if (dexZipExtractEntryToMemory(archive, &entry, data,
+                entry.uncompressed_length) != 0) {
+            fprintf(stderr, "%s: extract of '%s' from '%s' failed\n",
+                gProgName, entryName, pJob->fileName);
+            free(data);
+            return false;
+        }
+        ok = processDex(pJob, data, entry.uncompressed_length, pJob->fileName);
+        free(data);
+        if (!ok)
+            return false;
+    }
+}
+
+/*
+ * Map and scan a bare DEX file.  The map is private and writable in
+ * case the file needs byte-swapping.
+ */
+static bool processRawDex(FileJob* pJob)
+{
+    MemMapping map;
+    bool result;
+    int fd;
+
+    fd = open(pJob->fileName, O_RDONLY | O_BINARY);
+    if (fd < 0) {
+        fprintf(stderr, "%s: unable to open '%s': %s\n", gProgName,
+            pJob->fileName, strerror(errno));
+        return false;
+    }
+    if (sysMapFileInShmemWritableReadOnly(fd, &map) != 0) {
+        fprintf(stderr, "%s: unable to map '%s'\n", gProgName, pJob->fileName);
+        close(fd);
+        return false;
+    }
+    close(fd);
+    sysChangeMapAccess(map.addr, map.length, true, &map);
+
+    result = processDex(pJob, (u1*) map.addr, map.length, pJob->fileName);
+    sysReleaseShmem(&map);
+    return result;
+}
+
+/*
+ * Process one input file, which may be a .dex or a Zip archive.
+ */
+static void processFile(FileJob* pJob)
+{
+    ZipArchiveHandle archive;
+
+    if (dexZipOpenArchive(pJob->fileName, &archive) == 0) {
+        pJob->failed = !processZip(pJob, archive);
+    } else {
+        pJob->failed = !processRawDex(pJob);
+    }
+    dexZipCloseArchive(archive);
+}
+
+static void* workerThreadStart(void* arg)
+{
+    JobQueue* pQueue = (JobQueue*) arg;
+
+    while (true) {
+        int jobIdx;
+
+        pthread_mutex_lock(&pQueue->lock);
+        jobIdx = pQueue->nextJob;
+        if (jobIdx < pQueue->jobCount)
+            pQueue->nextJob++;
+        pthread_mutex_unlock(&pQueue->lock);
+        if (jobIdx >= pQueue->jobCount)
+            break;
+
+        processFile(&pQueue->jobs[jobIdx]);
+
+        pthread_mutex_lock(&pQueue->lock);
+        pQueue->jobs[jobIdx].done = true;
+        pthread_cond_broadcast(&pQueue->jobDone);
+        pthread_mutex_unlock(&pQueue->lock);
+    }
+    return NULL;
+}
+
+/*
+ * Write one file's output, with the header and footer the Java tool
+ * puts around it.
+ */
+static void printJob(const FileJob* pJob, bool first)
+{
+    if (!first)
+        printf("\n");
+    if (gOptions.outputFormat == OUTPUT_BRIEF)
+        printf("File: %s\n", pJob->fileName);
+    else
+        printf("<external file=\"%s\">\n", pJob->fileName);
+
+    fwrite(pJob->out.data, 1, pJob->out.length, stdout);
+
+    if (gOptions.outputFormat == OUTPUT_XML)
+        printf("</external>\n");
+}
+
+/*
+ * Scan all files, printing results in command-line order as soon as
+ * each one and all of its predecessors are done.
+ */
+static int processAll(char* const fileNames[], int fileCount)
+{
+    JobQueue queue;
+    pthread_t* threads;
+    bool* started;
+    int numThreads = gOptions.numThreads;
+    bool first = true;
+    int result = 0;
+
+    if (numThreads > fileCount)
+        numThreads = fileCount;
+
+    memset(&queue, 0, sizeof(queue));
+    queue.jobs = (FileJob*) calloc(fileCount, sizeof(FileJob));
+    threads = (pthread_t*) calloc(numThreads, sizeof(pthread_t));
+    started = (bool*) calloc(numThreads, sizeof(bool));
+    if (queue.jobs == NULL || threads == NULL || started == NULL) {
+        fprintf(stderr, "%s: out of memory\n", gProgName);
+        exit(1);
+    }
+    queue.jobCount = fileCount;
+    for (int i = 0; i < fileCount; i++)
+        queue.jobs[i].fileName = fileNames[i];
+    pthread_mutex_init(&queue.lock, NULL);
+    pthread_cond_init(&queue.jobDone, NULL);
+
+    bool anyStarted = false;
+    for (int i = 0; i < numThreads; i++) {
+        started[i] = (pthread_create(&threads[i], NULL, workerThreadStart,
+            &queue) == 0);
+        anyStarted |= started[i];
+    }
+    if (!anyStarted)
+        workerThreadStart(&queue);
+
+    for (int i = 0; i < fileCount; i++) {
+        FileJob* pJob = &queue.jobs[i];
+
+        pthread_mutex_lock(&queue.lock);
+        while (!pJob->done)
+            pthread_cond_wait(&queue.jobDone, &queue.lock);
+        pthread_mutex_unlock(&queue.lock);
+
+        if (pJob->failed) {
+            result = 1;
+        } else {
+            printJob(pJob, first);
+            first = false;
+        }
+        free(pJob->out.data);
+        pJob->out.data = NULL;
+    }
+
+    for (int i = 0; i < numThreads; i++) {
+        if (started[i])
+            pthread_join(threads[i], NULL);
+    }
+
+    pthread_cond_destroy(&queue.jobDone);
+    pthread_mutex_destroy(&queue.lock);
+    free(started);
+    free(threads);
+    free(queue.jobs);
+
+    if (fflush(stdout) != 0 || ferror(stdout)) {
+        fprintf(stderr, "%s: error writing output\n", gProgName);
+        result = 1;
+    }
+    return result;
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+        "DEX dependency scanner v1.2 (native)\n"
+        "Copyright (C) 2009 The Android Open Source Project\n\n"
+        "Usage: dexdeps [options] <file.{dex,apk,jar}> ...\n"
+        "Options:\n"
+        "  --format={xml,brief}\n"
+        "  --just-classes\n"
+        "  --threads=N     scan up to N files at once (default: #cpus)\n");
+}
+
+int main(int argc, char* const argv[])
+{
+    int idx;
+
+    gOptions.outputFormat = OUTPUT_XML;
+    gOptions.justClasses = false;
+    gOptions.numThreads = dexGetDefaultThreadCount();
+
+    for (idx = 1; idx < argc; idx++) {
+        const char* arg = argv[idx];
+
+        if (strcmp(arg, "--") == 0) {
+            idx++;
+            break;
+        } else if (strncmp(arg, "--", 2) != 0) {
+            break;
+        } else if (strncmp(arg, "--format=", 9) == 0) {
+            if (strcmp(arg + 9, "brief") == 0) {
+                gOptions.outputFormat = OUTPUT_BRIEF;
+            } else if (strcmp(arg + 9, "xml") == 0) {
+                gOptions.outputFormat = OUTPUT_XML;
+            } else {
+                fprintf(stderr, "Unknown format '%s'\n", arg + 9);
+                usage();
+                return 2;
+            }
+        } else if (strcmp(arg, "--just-classes") == 0) {
+            gOptions.justClasses = true;
+        } else if (strncmp(arg, "--threads=", 10) == 0) {
+            char* end;
+            long value = strtol(arg + 10, &end, 10);
+            if (*end != '\0' || value < 1 || value > 1024) {
+                fprintf(stderr, "Bad thread count '%s'\n", arg + 10);
+                usage();
+                return 2;
+            }
+            gOptions.numThreads = (int) value;
+        } else {
+            fprintf(stderr, "Unknown option '%s'\n", arg);
+            usage();
+            return 2;
+        }
+    }
+
+    if (idx == argc) {
+        usage();
+        return 2;
+    }
+
+    return processAll(&argv[idx], argc - idx);
+}
@@ -0,0 +1,231 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/*
+ * Time checksum + signature verification of .dex files three ways: as
+ * two separate passes (what dexFileParse used to do), as a single
+ * blocked pass, and as a single pass with the adler32 work on helper
+ * threads.
+ *
+ * The single pass only saves memory bandwidth once the file doesn't fit
+ * in the last-level cache; for smaller files use -e to flush the cache
+ * between iterations.
+ */
+
+#include "libdex/DexFile.h"
+
+#include "libdex/DexIntegrity.h"
+#include "libdex/DexParallel.h"
+#include "libdex/SysUtil.h"
+#include "libdex/sha1.h"
+
+#include <zlib.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+static const char* gProgName = "dexintegritybench";
+
+/* bigger than any last-level cache we're likely to run on */
+#define kEvictSize      (256 * 1024 * 1024)
+
+struct Options {
+    int         iterations;
+    int         numThreads;
+    bool        evict;
+};
+
+static Options gOptions;
+static u1* gEvictBuffer;
+
+static u8 nowNsec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u8) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Push the file out of the cache by writing a buffer bigger than it.
+ */
+static void evictCache(void)
+{
+    if (gEvictBuffer == NULL)
+        return;
+    for (size_t i = 0; i < kEvictSize; i += 64)
+        gEvictBuffer[i]++;
+}
+
+static void computeTwoPass(const u1* data, size_t length,
+    DexIntegrity* pIntegrity)
+{
+    const DexHeader* pHeader = (const DexHeader*) data;
+    const size_t nonSig = sizeof(pHeader->magic) +
+        sizeof(pHeader->checksum) + kSHA1DigestLen;
+    SHA1_CTX context;
+
+    pIntegrity->checksum = dexComputeChecksum(pHeader);
+    SHA1Init(&context);
+    SHA1Update(&context, data + nonSig, length - nonSig);
+    SHA1Final(pIntegrity->signature, &context);
+}
+
+/*
+ * Run one method "iterations" times, print the best time, and check the
+ * result against the header.  Returns false on a mismatch.
+ */
+static bool runOne(const char* label, const u1* data, size_t length,
+    int numThreads)
+{
+    const DexHeader* pHeader = (const DexHeader*) data;
+    DexIntegrity integrity;
+    u8 best = ~0ULL;
+
+    memset(&integrity, 0, sizeof(integrity));
+
+    for (int i = 0; i < gOptions.iterations; i++) {
+        if (gOptions.evict)
+            evictCache();
+        u8 start = nowNsec();
+        if (numThreads == 0)
+            computeTwoPass(data, length, &integrity);
+        else
+            dexComputeIntegrity(data, length, numThreads, &integrity);
+        u8 elapsed = nowNsec() - start;
+        if (elapsed < best)
+            best = elapsed;
+    }
+
+    bool match = integrity.checksum == pHeader->checksum &&
+        memcmp(integrity.signature, pHeader->signature, kSHA1DigestLen) == 0;
+    printf("  %-20s %9.3f ms %8.1f MB/s%s\n", label, best / 1e6,
+        (best == 0) ? 0.0 : length * 1e3 / best,
+        match ? "" : "  MISMATCH");
+    return match;
+}
+
+static int process(const char* fileName)
+{
+    MemMapping map;
+    const u1* data;
+    int result = 1;
+
+    /* map it directly; dexOpenAndMap would verify, and so pre-load, it */
+    int fd = open(fileName, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "%s: unable to open '%s': %s\n", gProgName,
+            fileName, strerror(errno));
+        return 1;
+    }
+    int mapResult = sysMapFileInShmemWritableReadOnly(fd, &map);
+    close(fd);
+    if (mapResult != 0) {
+        fprintf(stderr, "%s: unable to map '%s'\n", gProgName, fileName);
+        return 1;
+    }
+
+    data = (const u1*) map.addr;
+    if (map.length < sizeof(DexHeader) ||
+        !dexHasValidMagic((const DexHeader*) data) ||
+        ((const DexHeader*) data)->fileSize != map.length) {
+        fprintf(stderr, "%s: '%s' is not an unoptimized DEX file\n",
+            gProgName, fileName);
+        goto bail;
+    }
+
+    printf("%s: %zu bytes, sha1 %s\n", fileName, map.length,
+        SHA1ImplementationName());
+
+    {
+        char label[32];
+        bool ok = runOne("two-pass", data, map.length, 0);
+        ok &= runOne("single-pass", data, map.length, 1);
+        if (gOptions.numThreads > 1) {
+            snprintf(label, sizeof(label), "single-pass -j%d",
+                gOptions.numThreads);
+            ok &= runOne(label, data, map.length, gOptions.numThreads);
+        }
+        if (ok)
+            result = 0;
+    }
+
+bail:
+    sysReleaseShmem(&map);
+    return result;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Copyright (C) 2008 The Android Open Source Project\n\n");
+    fprintf(stderr, "%s: [-n iterations] [-j threads] [-e] file.dex...\n",
+        gProgName);
+    fprintf(stderr, "\n");
+    fprintf(stderr, " -n : runs per method, best one reported (default 10)\n");
+    fprintf(stderr, " -j : threads for the threaded single pass (default: CPUs)\n");
+    fprintf(stderr, " -e : evict the file from the cache before every run\n");
+}
+
+int main(int argc, char* const argv[])
+{
+    int ic;
+    int result = 0;
+
+    gOptions.iterations = 10;
+    gOptions.numThreads = dexGetDefaultThreadCount();
+    gOptions.evict = false;
+
+    while ((ic = getopt(argc, argv, "n:j:e")) >= 0) {
+        switch (ic) {
+        case 'n':
+            gOptions.iterations = atoi(optarg);
+            break;
+        case 'j':
+            gOptions.numThreads = atoi(optarg);
+            break;
+        case 'e':
+            gOptions.evict = true;
+            break;
+        default:
+            usage();
+            return 2;
+        }
+    }
+
+    if (optind == argc || gOptions.iterations <= 0) {
+        usage();
+        return 2;
+    }
+
+    if (gOptions.evict) {
+        gEvictBuffer = (u1*) calloc(kEvictSize, 1);
+        if (gEvictBuffer == NULL) {
+            fprintf(stderr, "%s: can't allocate eviction buffer\n", gProgName);
+            return 1;
+        }
+    }
+
+    while (optind < argc)
+        result |= process(argv[optind++]);
+
+    free(gEvictBuffer);
+    return result;
+}
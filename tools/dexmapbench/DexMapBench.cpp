@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/*
+ * Time opening, mapping and fully verifying .dex files from a cold page
+ * cache, once for each dexOpenAndMapWithOptions() strategy.
+ *
+ * The file is dropped from the page cache with POSIX_FADV_DONTNEED
+ * before every run, which works without privileges as long as nothing
+ * else has the file mapped.  The huge-pages strategy also reports how
+ * much of its private copy the kernel backed with huge pages.  The
+ * shared strategy leaves a stamp in /tmp/dex-verified-<uid> and skips
+ * structural verification (but not the checksum) from the second run
+ * on.
+ */
+
+#include "libdex/DexFile.h"
+
+#include "libdex/CmdUtils.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+static const char* gProgName = "dexmapbench";
+
+struct Strategy {
+    const char* name;
+    int         flags;
+};
+
+static const Strategy kStrategies[] = {
+    { "default",        kDexMapDefault },
+    { "verify-once",    kDexMapVerifyOnce },
+    { "long-lived",     kDexMapLongLived },
+    { "huge-pages",     kDexMapLongLived | kDexMapHugePages },
+    { "shared",         kDexMapLongLived | kDexMapShared },
+};
+
+static u8 nowNsec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u8) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Ask the kernel to drop the file's clean pages.  Returns false if it
+ * can't be opened.
+ */
+static bool dropFromCache(const char* fileName)
+{
+    int fd = open(fileName, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "%s: unable to open '%s': %s\n", gProgName,
+            fileName, strerror(errno));
+        return false;
+    }
+#if defined(POSIX_FADV_DONTNEED)
+    (void) posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+#endif
+    close(fd);
+    return true;
+}
+
+/*
+ * One cold open + map + structural verification + checksum and
+ * signature check.  Returns the elapsed time, or 0 on failure.  Also
+ * reports how much of the mapping ended up on huge pages, or -1 if
+ * that's unknown.
+ */
+static u8 openAndVerify(const char* fileName, int flags, long* pHugeBytes)
+{
+    MemMapping map;
+    DexFile* pDexFile;
+
+    if (!dropFromCache(fileName))
+        return 0;
+
+    u8 start = nowNsec();
+    if (dexOpenAndMapWithOptions(fileName, NULL, flags, &map, false) != 0)
+        return 0;
+    pDexFile = dexFileParse((u1*) map.addr, map.length, kDexParseVerifyAll);
+    u8 elapsed = nowNsec() - start;
+
+    if (pDexFile == NULL) {
+        fprintf(stderr, "%s: '%s' failed verification\n", gProgName,
+            fileName);
+        elapsed = 0;
+    } else {
+        dexFileFree(pDexFile);
+    }
+
+    size_t hugeBytes;
+    *pHugeBytes = (sysGetHugePageBytes(&map, &hugeBytes) == 0) ?
+        (long) hugeBytes : -1;
+    sysReleaseShmem(&map);
+    return elapsed;
+}
+
+static int compareU8(const void* a, const void* b)
+{
+    u8 left = *(const u8*) a;
+    u8 right = *(const u8*) b;
+    return (left < right) ? -1 : (left > right);
+}
+
+static int process(const char* fileName, int iterations)
+{
+    u8* times = (u8*) malloc(iterations * sizeof(u8));
+    int result = 0;
+
+    if (times == NULL)
+        return 1;
+
+    printf("%s:\n", fileName);
+    for (size_t s = 0; s < sizeof(kStrategies) / sizeof(kStrategies[0]); s++) {
+        const Strategy* pStrategy = &kStrategies[s];
+        long hugeBytes = -1;
+        int i;
+
+        for (i = 0; i < iterations; i++) {
+            times[i] = openAndVerify(fileName, pStrategy->flags, &hugeBytes);
+            if (times[i] == 0)
+                break;
+        }
+        if (i != iterations) {
+            result = 1;
+            break;
+        }
+
+        qsort(times, iterations, sizeof(u8), compareU8);
+        printf("  %-12s best %9.3f ms  median %9.3f ms", pStrategy->name,
+            times[0] / 1e6, times[iterations / 2] / 1e6);
+        if (hugeBytes >= 0)
+            printf("  huge pages %ld KiB", hugeBytes / 1024);
+        printf("\n");
+    }
+
+    free(times);
+    return result;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Copyright (C) 2008 The Android Open Source Project\n\n");
+    fprintf(stderr, "%s: [-n iterations] file.dex...\n", gProgName);
+    fprintf(stderr, "\n");
+    fprintf(stderr, " -n : runs per strategy (default 5)\n");
+}
+
+int main(int argc, char* const argv[])
+{
+    int iterations = 5;
+    int ic;
+    int result = 0;
+
+    while ((ic = getopt(argc, argv, "n:")) >= 0) {
+        switch (ic) {
+        case 'n':
+            iterations = atoi(optarg);
+            break;
+        default:
+            usage();
+            return 2;
+        }
+    }
+
+    if (optind == argc || iterations <= 0) {
+        usage();
+        return 2;
+    }
+
+    while (optind < argc)
+        result |= process(argv[optind++], iterations);
+
+    return result;
+}
@@ -0,0 +1,377 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/*
+ * Write an optimized DEX file ("odex") on the host: the input DEX with an
+ * opt header, a dependency table and a prebuilt class lookup table, so
+ * host-side tools get dexFindClass() without building the table on every
+ * open.  Optionally the string, cross-reference and annotation indexes
+ * are stored too.
+ */
+
+#include "libdex/DexFile.h"
+
+#include "libdex/CmdUtils.h"
+#include "libdex/DexAnnotationIndex.h"
+#include "libdex/DexIndex.h"
+#include "libdex/DexOptData.h"
+#include "libdex/DexParallel.h"
+#include "libdex/DexXref.h"
+#include "libdex/OptInvocation.h"
+#include "libdex/SysUtil.h"
+#include "libdex/ZipArchive.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+static const char* gProgName = "dexoptwrite";
+
+/* DALVIK_VM_BUILD of the last Dalvik release */
+#define kDefaultVmBuild     27
+
+/*
+ * Look up the full path and signature of each dependency.  The paths are
+ * malloc()ed.  Returns false if one can't be opened.
+ */
+static bool readDependencies(char* const* fileNames, int count,
+    DexOptDependency* pDeps)
+{
+    for (int i = 0; i < count; i++) {
+        MemMapping map;
+        DexFile* pDexFile;
+
+        /* record absolute paths, as the VM's cache file names are */
+        pDeps[i].fileName = realpath(fileNames[i], NULL);
+        if (pDeps[i].fileName == NULL) {
+            fprintf(stderr, "%s: unable to resolve dependency '%s': %s\n",
+                gProgName, fileNames[i], strerror(errno));
+            return false;
+        }
+
+        if (dexOpenAndMap(fileNames[i], NULL, &map, true) != 0) {
+            fprintf(stderr, "%s: unable to open dependency '%s'\n",
+                gProgName, fileNames[i]);
+            return false;
+        }
+        pDexFile = dexFileParse((u1*) map.addr, map.length, kDexParseDefault);
+        if (pDexFile == NULL) {
+            fprintf(stderr, "%s: dependency '%s' isn't a DEX file\n",
+                gProgName, fileNames[i]);
+            sysReleaseShmem(&map);
+            return false;
+        }
+
+        memcpy(pDeps[i].signature, pDexFile->pHeader->signature,
+            kSHA1DigestLen);
+        dexFileFree(pDexFile);
+        sysReleaseShmem(&map);
+    }
+    return true;
+}
+
+/*
+ * Append the string, cross-reference and annotation index chunks.
+ */
+static bool appendIndexes(int fd, DexFile* pDexFile)
+{
+    int numThreads = dexGetDefaultThreadCount();
+    DexStringIndex* pStringIndex = dexStringIndexCreate(pDexFile, numThreads);
+    DexXref* pXref = dexXrefBuild(pDexFile, numThreads);
+    DexAnnotationIndex* pAnnoIndex =
+        dexAnnotationIndexBuild(pDexFile, numThreads);
+    u1* stringData = NULL;
+    u4 stringSize = 0;
+    bool result = false;
+
+    if (pStringIndex != NULL)
+        stringData = dexStringIndexFlatten(pDexFile, pStringIndex, &stringSize);
+    if (stringData == NULL || pXref == NULL || pAnnoIndex == NULL) {
+        fprintf(stderr, "%s: unable to build indexes\n", gProgName);
+        goto bail;
+    }
+
+    {
+        DexOptChunk chunks[3];
+        chunks[0].type = kDexChunkStringIndex;
+        chunks[0].size = stringSize;
+        chunks[0].data = stringData;
+        chunks[1].type = kDexChunkXref;
+        chunks[1].size = pXref->csr.length;
+        chunks[1].data = pXref->csr.pHeader;
+        chunks[2].type = kDexChunkAnnotationIndex;
+        chunks[2].size = pAnnoIndex->csr.length;
+        chunks[2].data = pAnnoIndex->csr.pHeader;
+
+        if (dexOptAppendChunks(fd, chunks, 3) != 0) {
+            fprintf(stderr, "%s: unable to append indexes\n", gProgName);
+            goto bail;
+        }
+    }
+
+    result = true;
+
+bail:
+    free(stringData);
+    dexStringIndexFree(pStringIndex);
+    dexXrefFree(pXref);
+    dexAnnotationIndexFree(pAnnoIndex);
+    return result;
+}
+
+/*
+ * Map the new file back in and make sure every class can be found
+ * through its class lookup table.
+ */
+static bool checkOutput(const char* outputName, u4 classCount,
+    bool verbose)
+{
+    MemMapping map;
+    DexFile* pDexFile;
+    bool result = true;
+    int fd;
+
+    fd = open(outputName, O_RDONLY);
+    if (fd < 0 || sysMapFileInShmemWritableReadOnly(fd, &map) != 0) {
+        fprintf(stderr, "%s: unable to map '%s'\n", gProgName, outputName);
+        if (fd >= 0)
+            close(fd);
+        return false;
+    }
+    close(fd);
+
+    pDexFile = dexFileParse((u1*) map.addr, map.length,
+        kDexParseVerifyChecksum);
+    if (pDexFile == NULL || pDexFile->pClassLookup == NULL ||
+        pDexFile->pHeader->classDefsSize != classCount)
+    {
+        fprintf(stderr, "%s: '%s' doesn't read back\n", gProgName, outputName);
+        result = false;
+        goto bail;
+    }
+
+    for (u4 i = 0; i < classCount; i++) {
+        const DexClassDef* pClassDef = dexGetClassDef(pDexFile, i);
+        const char* descriptor = dexGetClassDescriptor(pDexFile, pClassDef);
+        if (dexFindClass(pDexFile, descriptor) != pClassDef) {
+            fprintf(stderr, "%s: class lookup fails for '%s'\n", gProgName,
+                descriptor);
+            result = false;
+            goto bail;
+        }
+    }
+
+    if (verbose) {
+        const DexOptHeader* pOptHeader = pDexFile->pOptHeader;
+        printf("classes:     %u (%d lookup slots)\n", classCount,
+            pDexFile->pClassLookup->numEntries);
+        printf("deps:        %u bytes\n", pOptHeader->depsLength);
+        printf("opt data:    %u bytes\n", pOptHeader->optLength);
+        printf("file size:   %zu\n", map.length);
+    }
+
+bail:
+    dexFileFree(pDexFile);
+    sysReleaseShmem(&map);
+    return result;
+}
+
+/*
+ * Check whether "fileName" is a Zip archive.
+ *
+ * The opt header's crc is compared against the DEX checksum for a plain
+ * DEX file, but against the CRC-32 of classes.dex for an archive, so
+ * archives (which dexOpenAndMap() would quietly extract) are refused.
+ */
+static bool isArchive(const char* fileName)
+{
+    ZipArchiveHandle archive;
+
+    if (dexZipOpenArchive(fileName, &archive) != 0)
+        return false;
+    dexZipCloseArchive(archive);
+    return true;
+}
+
+static int process(const char* inputName, const char* outputName,
+    const DexOptWriteOptions* pBaseOptions, bool withIndexes, bool verbose)
+{
+    DexFile* pDexFile = NULL;
+    DexOptWriteOptions options = *pBaseOptions;
+    MemMapping map;
+    bool mapped = false;
+    struct stat st;
+    int fd = -1;
+    int result = 1;
+
+    if (stat(inputName, &st) != 0) {
+        fprintf(stderr, "%s: unable to stat '%s': %s\n", gProgName,
+            inputName, strerror(errno));
+        goto bail;
+    }
+    if (isArchive(inputName)) {
+        fprintf(stderr, "%s: '%s' is an archive; extract classes.dex"
+            " from it first\n", gProgName, inputName);
+        goto bail;
+    }
+    if (dexOpenAndMap(inputName, NULL, &map, true) != 0)
+        goto bail;
+    mapped = true;
+
+    pDexFile = dexFileParse((u1*) map.addr, map.length,
+        kDexParseVerifyChecksum);
+    if (pDexFile == NULL) {
+        fprintf(stderr, "%s: DEX parse failed\n", gProgName);
+        goto bail;
+    }
+    if (pDexFile->pOptHeader != NULL) {
+        fprintf(stderr, "%s: '%s' is already optimized\n", gProgName,
+            inputName);
+        goto bail;
+    }
+
+    options.modWhen = (u4) st.st_mtime;
+    options.crc = pDexFile->pHeader->checksum;
+
+    fd = open(outputName, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "%s: unable to create '%s': %s\n", gProgName,
+            outputName, strerror(errno));
+        goto bail;
+    }
+    if (dexOptWriteFile(fd, pDexFile, &options) != 0) {
+        fprintf(stderr, "%s: unable to write '%s'\n", gProgName, outputName);
+        goto bail;
+    }
+    if (withIndexes && !appendIndexes(fd, pDexFile))
+        goto bail;
+    if (close(fd) != 0) {
+        fd = -1;
+        fprintf(stderr, "%s: error closing '%s': %s\n", gProgName,
+            outputName, strerror(errno));
+        goto bail;
+    }
+    fd = -1;
+
+    if (!checkOutput(outputName, pDexFile->pHeader->classDefsSize, verbose))
+        goto bail;
+
+    result = 0;
+
+bail:
+    if (fd >= 0)
+        close(fd);
+    if (result != 0)
+        unlink(outputName);
+    if (pDexFile != NULL)
+        dexFileFree(pDexFile);
+    if (mapped)
+        sysReleaseShmem(&map);
+    return result;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Copyright (C) 2008 The Android Open Source Project\n\n");
+    fprintf(stderr,
+        "%s: [-q] [-x] [-b vmbuild] [-d dependency]... input output.odex\n",
+        gProgName);
+    fprintf(stderr, "\n");
+    fprintf(stderr, " -q : don't print a summary\n");
+    fprintf(stderr, " -x : also store string, cross-reference and annotation"
+        " indexes\n");
+    fprintf(stderr, " -b : VM build number for the dependency table"
+        " (default %d)\n", kDefaultVmBuild);
+    fprintf(stderr, " -d : record the optimized (cache) file of a bootclasspath"
+        " entry;\n      repeat for each entry, in bootclasspath order\n");
+}
+
+int main(int argc, char* const argv[])
+{
+    DexOptWriteOptions options;
+    char** depNames = NULL;
+    DexOptDependency* pDeps = NULL;
+    int depCount = 0;
+    bool withIndexes = false;
+    bool verbose = true;
+    int ic;
+    int result = 2;
+
+    memset(&options, 0, sizeof(options));
+    options.vmBuild = kDefaultVmBuild;
+
+    depNames = (char**) calloc(argc, sizeof(char*));
+    if (depNames == NULL)
+        return 1;
+
+    while ((ic = getopt(argc, argv, "qxb:d:")) >= 0) {
+        switch (ic) {
+        case 'q':
+            verbose = false;
+            break;
+        case 'x':
+            withIndexes = true;
+            break;
+        case 'b': {
+            char* end;
+            options.vmBuild = strtoul(optarg, &end, 10);
+            if (*optarg == '\0' || *end != '\0') {
+                usage();
+                goto bail;
+            }
+            break;
+        }
+        case 'd':
+            depNames[depCount++] = optarg;
+            break;
+        default:
+            usage();
+            goto bail;
+        }
+    }
+
+    if (argc - optind != 2) {
+        usage();
+        goto bail;
+    }
+
+    pDeps = (DexOptDependency*) calloc(depCount + 1, sizeof(DexOptDependency));
+    if (pDeps == NULL) {
+        result = 1;
+        goto bail;
+    }
+    if (!readDependencies(depNames, depCount, pDeps)) {
+        result = 1;
+        goto bail;
+    }
+    options.pDeps = pDeps;
+    options.depCount = depCount;
+
+    result = process(argv[optind], argv[optind + 1], &options, withIndexes,
+        verbose);
+
+bail:
+    for (int i = 0; pDeps != NULL && i < depCount; i++)
+        free((void*) pDeps[i].fileName);
+    free(pDeps);
+    free(depNames);
+    return result;
+}
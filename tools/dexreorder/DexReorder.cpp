@@ -0,0 +1,292 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Rewrite a .dex file so the data used by a profile's hot classes and
+ * methods is packed together at the front of its sections.
+ *
+ * The profile is a text file with one entry per line: a class
+ * descriptor ("Lfoo/Bar;") or a decimal method index.  Blank lines and
+ * lines starting with '#' are ignored.
+ */
+
+#include "libdex/DexFile.h"
+
+#include "libdex/CmdUtils.h"
+#include "libdex/DexLayout.h"
+#include "libdex/SysUtil.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <ctype.h>
+
+static const char* gProgName = "dexreorder";
+
+/*
+ * Profile as read from disk.  The descriptor strings are owned here.
+ */
+struct Profile {
+    char**      classDescriptors;
+    u4          classCount;
+    u4          classCapacity;
+    u4*         methodIdxs;
+    u4          methodCount;
+    u4          methodCapacity;
+};
+
+static bool addClass(Profile* pProfile, const char* descriptor)
+{
+    if (pProfile->classCount == pProfile->classCapacity) {
+        u4 newCapacity = (pProfile->classCapacity == 0) ?
+            64 : pProfile->classCapacity * 2;
+        char** newList = (char**) realloc(pProfile->classDescriptors,
+            newCapacity * sizeof(char*));
+        if (newList == NULL)
+            return false;
+        pProfile->classDescriptors = newList;
+        pProfile->classCapacity = newCapacity;
+    }
+
+    char* copy = strdup(descriptor);
+    if (copy == NULL)
+        return false;
+    pProfile->classDescriptors[pProfile->classCount++] = copy;
+    return true;
+}
+
+static bool addMethod(Profile* pProfile, u4 methodIdx)
+{
+    if (pProfile->methodCount == pProfile->methodCapacity) {
+        u4 newCapacity = (pProfile->methodCapacity == 0) ?
+            64 : pProfile->methodCapacity * 2;
+        u4* newList = (u4*) realloc(pProfile->methodIdxs,
+            newCapacity * sizeof(u4));
+        if (newList == NULL)
+            return false;
+        pProfile->methodIdxs = newList;
+        pProfile->methodCapacity = newCapacity;
+    }
+
+    pProfile->methodIdxs[pProfile->methodCount++] = methodIdx;
+    return true;
+}
+
+static void freeProfile(Profile* pProfile)
+{
+    for (u4 i = 0; i < pProfile->classCount; i++)
+        free(pProfile->classDescriptors[i]);
+    free(pProfile->classDescriptors);
+    free(pProfile->methodIdxs);
+}
+
+/*
+ * Read the profile file.  Returns false on I/O or syntax errors.
+ */
+static bool readProfile(const char* fileName, Profile* pProfile)
+{
+    FILE* fp = fopen(fileName, "r");
+    char line[1024];
+    int lineNum = 0;
+    bool result = false;
+
+    if (fp == NULL) {
+        fprintf(stderr, "%s: unable to open '%s': %s\n", gProgName, fileName,
+            strerror(errno));
+        return false;
+    }
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        char* start = line;
+        char* end;
+
+        lineNum++;
+        while (isspace((unsigned char) *start))
+            start++;
+        end = start + strlen(start);
+        while (end > start && isspace((unsigned char) end[-1]))
+            *--end = '\0';
+
+        if (*start == '\0' || *start == '#')
+            continue;
+
+        if (*start == 'L' || *start == '[') {
+            if (!addClass(pProfile, start))
+                goto bail;
+        } else if (isdigit((unsigned char) *start)) {
+            unsigned long methodIdx = strtoul(start, &end, 10);
+            if (*end != '\0' || methodIdx > 0xffffffffUL) {
+                fprintf(stderr, "%s:%d: bad method index '%s'\n",
+                    fileName, lineNum, start);
+                goto bail;
+            }
+            if (!addMethod(pProfile, (u4) methodIdx))
+                goto bail;
+        } else {
+            fprintf(stderr, "%s:%d: unrecognized entry '%s'\n",
+                fileName, lineNum, start);
+            goto bail;
+        }
+    }
+
+    result = true;
+
+bail:
+    fclose(fp);
+    return result;
+}
+
+/*
+ * Run the full structural verifier over a copy of the new file.
+ */
+static bool verifyOutput(const u1* data, size_t length)
+{
+    u1* copy = (u1*) malloc(length);
+    bool result;
+
+    if (copy == NULL)
+        return false;
+    memcpy(copy, data, length);
+    result = (dexSwapAndVerifyIfNecessary(copy, length) == 0);
+    free(copy);
+    return result;
+}
+
+static int process(const char* inputName, const char* outputName,
+    const Profile* pProfile, bool verbose)
+{
+    DexFile* pDexFile = NULL;
+    MemMapping map;
+    bool mapped = false;
+    u1* outData = NULL;
+    size_t outLength = 0;
+    DexLayoutProfile layoutProfile;
+    DexLayoutStats stats;
+    int fd = -1;
+    int result = 1;
+
+    if (dexOpenAndMap(inputName, NULL, &map, true) != 0)
+        goto bail;
+    mapped = true;
+
+    pDexFile = dexFileParse((u1*) map.addr, map.length, kDexParseVerifyChecksum);
+    if (pDexFile == NULL) {
+        fprintf(stderr, "%s: DEX parse failed\n", gProgName);
+        goto bail;
+    }
+
+    layoutProfile.classDescriptors = pProfile->classDescriptors;
+    layoutProfile.classCount = pProfile->classCount;
+    layoutProfile.methodIdxs = pProfile->methodIdxs;
+    layoutProfile.methodCount = pProfile->methodCount;
+
+    if (dexLayoutRewrite(pDexFile, &layoutProfile, &outData, &outLength,
+            &stats) != 0) {
+        fprintf(stderr, "%s: layout failed\n", gProgName);
+        goto bail;
+    }
+
+    if (!verifyOutput(outData, outLength)) {
+        fprintf(stderr, "%s: rewritten file failed verification\n", gProgName);
+        goto bail;
+    }
+
+    fd = open(outputName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "%s: unable to create '%s': %s\n", gProgName,
+            outputName, strerror(errno));
+        goto bail;
+    }
+    if (sysWriteFully(fd, outData, outLength, "dexreorder") != 0)
+        goto bail;
+
+    if (verbose) {
+        printf("code_item:       %u hot (%u bytes), %u cold\n",
+            stats.hotCodeItems, stats.hotCodeBytes, stats.coldCodeItems);
+        printf("string_data:     %u hot (%u bytes), %u cold\n",
+            stats.hotStringItems, stats.hotStringBytes, stats.coldStringItems);
+        printf("class_data_item: %u hot (%u bytes), %u cold\n",
+            stats.hotClassDataItems, stats.hotClassDataBytes,
+            stats.coldClassDataItems);
+        if (stats.unmatchedClasses != 0)
+            printf("%u profile classes not found\n", stats.unmatchedClasses);
+        printf("file size:       %zu -> %zu\n", map.length, outLength);
+    }
+
+    result = 0;
+
+bail:
+    if (fd >= 0 && close(fd) != 0 && result == 0) {
+        fprintf(stderr, "%s: error closing '%s': %s\n", gProgName,
+            outputName, strerror(errno));
+        result = 1;
+    }
+    free(outData);
+    if (pDexFile != NULL)
+        dexFileFree(pDexFile);
+    if (mapped)
+        sysReleaseShmem(&map);
+    return result;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Copyright (C) 2008 The Android Open Source Project\n\n");
+    fprintf(stderr, "%s: [-q] profile input.dex output.dex\n", gProgName);
+    fprintf(stderr, "\n");
+    fprintf(stderr, " -q : don't print layout statistics\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr,
+        "The profile lists one class descriptor (Lfoo/Bar;) or decimal\n"
+        "method index per line.  Lines starting with '#' are ignored.\n");
+}
+
+int main(int argc, char* const argv[])
+{
+    Profile profile;
+    bool verbose = true;
+    int ic;
+    int result;
+
+    while ((ic = getopt(argc, argv, "q")) >= 0) {
+        switch (ic) {
+        case 'q':
+            verbose = false;
+            break;
+        default:
+            usage();
+            return 2;
+        }
+    }
+
+    if (argc - optind != 3) {
+        usage();
+        return 2;
+    }
+
+    memset(&profile, 0, sizeof(profile));
+    if (!readProfile(argv[optind], &profile)) {
+        freeProfile(&profile);
+        return 1;
+    }
+
+    result = process(argv[optind + 1], argv[optind + 2], &profile, verbose);
+    freeProfile(&profile);
+    return result;
+}
@@ -0,0 +1,299 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/*
+ * Time (methodIdx, dexPc) -> line symbolization of a .dex file: building
+ * the symbolizer, the first batch (which decodes line tables), warm
+ * batches, one-at-a-time lookups, and warm batches split across threads.
+ *
+ * Queries are drawn at random, with a fixed seed, from the methods that
+ * have code, so every run of a given file asks the same questions.
+ */
+
+#include "libdex/DexFile.h"
+
+#include "libdex/CmdUtils.h"
+#include "libdex/DexParallel.h"
+#include "libdex/DexSymbolizer.h"
+#include "libdex/SysUtil.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static const char* gProgName = "dexsymbench";
+
+struct Options {
+    int         iterations;
+    int         numThreads;
+    u4          queryCount;
+    u4          seed;
+};
+
+static Options gOptions;
+
+/* per-thread share of a threaded batch */
+struct BatchWork {
+    DexSymbolizer*      pSymbolizer;
+    DexSymbolizerQuery* pQueries;
+};
+
+static u8 nowNsec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u8) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Simple LCG, so the query set doesn't depend on the C library.
+ */
+static u4 nextRandom(u4* pState)
+{
+    *pState = *pState * 1103515245 + 12345;
+    return *pState >> 8;
+}
+
+/*
+ * Fill in "count" queries against methods that have code.  Returns false
+ * if the file has none.
+ */
+static bool makeQueries(const DexSymbolizer* pSymbolizer,
+    DexSymbolizerQuery* pQueries, u4 count)
+{
+    u4* candidates = (u4*) malloc(pSymbolizer->methodCount * sizeof(u4));
+    u4 candidateCount = 0;
+    u4 state = gOptions.seed;
+
+    if (candidates == NULL)
+        return false;
+    for (u4 i = 0; i < pSymbolizer->methodCount; i++) {
+        if (pSymbolizer->pMethods[i].pCode != NULL)
+            candidates[candidateCount++] = i;
+    }
+    if (candidateCount == 0) {
+        free(candidates);
+        return false;
+    }
+
+    memset(pQueries, 0, count * sizeof(DexSymbolizerQuery));
+    for (u4 i = 0; i < count; i++) {
+        u4 methodIdx = candidates[nextRandom(&state) % candidateCount];
+        u4 insnsSize = pSymbolizer->pMethods[methodIdx].pCode->insnsSize;
+
+        pQueries[i].methodIdx = methodIdx;
+        pQueries[i].dexPc = (insnsSize == 0) ? 0 : nextRandom(&state) % insnsSize;
+    }
+
+    free(candidates);
+    return true;
+}
+
+static void batchRange(void* arg, u4 start, u4 end)
+{
+    BatchWork* pWork = (BatchWork*) arg;
+    dexSymbolizeBatch(pWork->pSymbolizer, pWork->pQueries + start, end - start);
+}
+
+static void printRow(const char* label, u8 elapsed, u4 count)
+{
+    printf("  %-20s %9.3f ms %10.0f queries/s\n", label, elapsed / 1e6,
+        (elapsed == 0) ? 0.0 : count * 1e9 / elapsed);
+}
+
+static int process(const char* fileName)
+{
+    DexFile* pDexFile = NULL;
+    DexSymbolizer* pSymbolizer = NULL;
+    DexSymbolizerQuery* pQueries = NULL;
+    int* expectedLines = NULL;
+    u4 count = gOptions.queryCount;
+    MemMapping map;
+    bool mapped = false;
+    bool ok = true;
+    int result = 1;
+
+    if (dexOpenAndMap(fileName, NULL, &map, true) != 0)
+        goto bail;
+    mapped = true;
+
+    pDexFile = dexFileParse((u1*) map.addr, map.length, kDexParseDefault);
+    if (pDexFile == NULL) {
+        fprintf(stderr, "%s: DEX parse failed for '%s'\n", gProgName,
+            fileName);
+        goto bail;
+    }
+
+    pQueries = (DexSymbolizerQuery*) malloc(count * sizeof(DexSymbolizerQuery));
+    expectedLines = (int*) malloc(count * sizeof(int));
+    if (pQueries == NULL || expectedLines == NULL) {
+        fprintf(stderr, "%s: out of memory\n", gProgName);
+        goto bail;
+    }
+
+    printf("%s: %u methods, %u queries\n", fileName,
+        pDexFile->pHeader->methodIdsSize, count);
+
+    {
+        u8 start = nowNsec();
+        pSymbolizer = dexSymbolizerCreate(pDexFile);
+        u8 elapsed = nowNsec() - start;
+        if (pSymbolizer == NULL) {
+            fprintf(stderr, "%s: unable to build symbolizer\n", gProgName);
+            goto bail;
+        }
+        printf("  %-20s %9.3f ms\n", "create", elapsed / 1e6);
+    }
+
+    if (!makeQueries(pSymbolizer, pQueries, count)) {
+        fprintf(stderr, "%s: '%s' has no methods with code\n", gProgName,
+            fileName);
+        goto bail;
+    }
+
+    /* the first batch decodes every line table it touches */
+    {
+        u8 start = nowNsec();
+        if (dexSymbolizeBatch(pSymbolizer, pQueries, count) < 0) {
+            fprintf(stderr, "%s: batch failed\n", gProgName);
+            goto bail;
+        }
+        printRow("batch (cold)", nowNsec() - start, count);
+        for (u4 i = 0; i < count; i++)
+            expectedLines[i] = pQueries[i].lineNum;
+    }
+
+    {
+        u8 best = ~0ULL;
+        for (int i = 0; i < gOptions.iterations; i++) {
+            u8 start = nowNsec();
+            dexSymbolizeBatch(pSymbolizer, pQueries, count);
+            u8 elapsed = nowNsec() - start;
+            if (elapsed < best)
+                best = elapsed;
+        }
+        printRow("batch", best, count);
+    }
+
+    {
+        u8 best = ~0ULL;
+        for (int i = 0; i < gOptions.iterations; i++) {
+            u8 start = nowNsec();
+            for (u4 j = 0; j < count; j++)
+                dexSymbolizerLookup(pSymbolizer, &pQueries[j]);
+            u8 elapsed = nowNsec() - start;
+            if (elapsed < best)
+                best = elapsed;
+        }
+        printRow("single lookups", best, count);
+        for (u4 i = 0; i < count; i++)
+            ok &= (pQueries[i].lineNum == expectedLines[i]);
+    }
+
+    if (gOptions.numThreads > 1) {
+        BatchWork work;
+        char label[32];
+        u8 best = ~0ULL;
+
+        work.pSymbolizer = pSymbolizer;
+        work.pQueries = pQueries;
+        for (int i = 0; i < gOptions.iterations; i++) {
+            u8 start = nowNsec();
+            dexParallelFor(count, gOptions.numThreads, batchRange, &work);
+            u8 elapsed = nowNsec() - start;
+            if (elapsed < best)
+                best = elapsed;
+        }
+        snprintf(label, sizeof(label), "batch -j%d", gOptions.numThreads);
+        printRow(label, best, count);
+        for (u4 i = 0; i < count; i++)
+            ok &= (pQueries[i].lineNum == expectedLines[i]);
+    }
+
+    if (!ok) {
+        printf("  MISMATCH between batched and single lookups\n");
+        goto bail;
+    }
+
+    result = 0;
+
+bail:
+    dexSymbolizerFree(pSymbolizer);
+    free(pQueries);
+    free(expectedLines);
+    if (pDexFile != NULL)
+        dexFileFree(pDexFile);
+    if (mapped)
+        sysReleaseShmem(&map);
+    return result;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Copyright (C) 2008 The Android Open Source Project\n\n");
+    fprintf(stderr,
+        "%s: [-n iterations] [-q queries] [-s seed] [-j threads] file.dex...\n",
+        gProgName);
+    fprintf(stderr, "\n");
+    fprintf(stderr, " -n : runs per method, best one reported (default 10)\n");
+    fprintf(stderr, " -q : queries per batch (default 1000000)\n");
+    fprintf(stderr, " -s : random seed for the queries (default 1)\n");
+    fprintf(stderr, " -j : threads for the threaded batch (default: CPUs)\n");
+}
+
+int main(int argc, char* const argv[])
+{
+    int ic;
+    int result = 0;
+
+    gOptions.iterations = 10;
+    gOptions.numThreads = dexGetDefaultThreadCount();
+    gOptions.queryCount = 1000000;
+    gOptions.seed = 1;
+
+    while ((ic = getopt(argc, argv, "n:q:s:j:")) >= 0) {
+        switch (ic) {
+        case 'n':
+            gOptions.iterations = atoi(optarg);
+            break;
+        case 'q':
+            gOptions.queryCount = strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            gOptions.seed = strtoul(optarg, NULL, 10);
+            break;
+        case 'j':
+            gOptions.numThreads = atoi(optarg);
+            break;
+        default:
+            usage();
+            return 2;
+        }
+    }
+
+    if (optind == argc || gOptions.iterations <= 0 || gOptions.queryCount == 0) {
+        usage();
+        return 2;
+    }
+
+    while (optind < argc)
+        result |= process(argv[optind++]);
+
+    return result;
+}